@@ -3,8 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <chainparams.h>
 #include <consensus/validation.h>
 #include <crypto/sha256.h>
+#include <miner.h>
+#include <random.h>
 #include <test/util/mining.h>
 #include <test/util/script.h>
 #include <test/util/setup_common.h>
@@ -47,4 +50,79 @@ static void AssembleBlock(benchmark::Bench& bench)
     });
 }
 
+//! Outputs of the funding transaction spent by the parent and child pairs in the mempool
+static constexpr size_t NUM_PAIRS{1900};
+//! Transactions that arrive while templates are requested
+static constexpr size_t NUM_NEW_TXS{100};
+
+static CTransactionRef SpendOpTrue(const COutPoint& prevout, std::vector<CTxOut> outputs)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(prevout);
+    tx.vin.back().scriptWitness.stack.push_back(WITNESS_STACK_ELEM_OP_TRUE);
+    tx.vout = std::move(outputs);
+    return MakeTransactionRef(tx);
+}
+
+// Templates are requested against a mempool holding about twice what fits in
+// a block, with a new transaction arriving before each request. The
+// transactions are selected either from the selection kept by the mempool, or
+// from scratch.
+static void AssembleBlockFullMempool(benchmark::Bench& bench, bool incremental)
+{
+    const auto test_setup = MakeNoLogFileContext<const TestingSetup>();
+    CChainState& chainstate = test_setup->m_node.chainman->ActiveChainstate();
+    CTxMemPool& pool = *test_setup->m_node.mempool;
+
+    const CTxIn coin = MineBlock(test_setup->m_node, P2WSH_OP_TRUE);
+    for (int i = 0; i < COINBASE_MATURITY; ++i) {
+        MineBlock(test_setup->m_node, P2WSH_OP_TRUE);
+    }
+    const CAmount value = 49 * COIN / (NUM_PAIRS + NUM_NEW_TXS);
+    const CTransactionRef funding = SpendOpTrue(coin.prevout, std::vector<CTxOut>(NUM_PAIRS + NUM_NEW_TXS, CTxOut(value, P2WSH_OP_TRUE)));
+    {
+        LOCK(::cs_main);
+        const MempoolAcceptResult res = ::AcceptToMemoryPool(chainstate, pool, funding, /* bypass_limits */ false);
+        assert(res.m_result_type == MempoolAcceptResult::ResultType::VALID);
+    }
+    MineBlock(test_setup->m_node, P2WSH_OP_TRUE);
+
+    std::vector<CTransactionRef> new_txs;
+    {
+        LOCK(::cs_main);
+        FastRandomContext rng(/* deterministic */ true);
+        for (size_t i = 0; i < NUM_PAIRS; ++i) {
+            const CTransactionRef parent = SpendOpTrue(COutPoint(funding->GetHash(), i), {CTxOut(value - 200 - rng.randrange(5000), P2WSH_OP_TRUE)});
+            const CTransactionRef child = SpendOpTrue(COutPoint(parent->GetHash(), 0), {CTxOut(parent->vout[0].nValue - 200 - rng.randrange(5000), P2WSH_OP_TRUE)});
+            for (const CTransactionRef& tx : {parent, child}) {
+                const MempoolAcceptResult res = ::AcceptToMemoryPool(chainstate, pool, tx, /* bypass_limits */ false);
+                assert(res.m_result_type == MempoolAcceptResult::ResultType::VALID);
+            }
+        }
+        for (size_t i = 0; i < NUM_NEW_TXS; ++i) {
+            new_txs.push_back(SpendOpTrue(COutPoint(funding->GetHash(), NUM_PAIRS + i), {CTxOut(value - 200 - rng.randrange(10000), P2WSH_OP_TRUE)}));
+        }
+    }
+
+    // About half of the mempool fits in a block
+    BlockAssembler::Options options;
+    options.nBlockMaxWeight = 4000 + NUM_PAIRS * GetTransactionWeight(*new_txs[0]);
+    size_t next{0};
+    bench.epochs(10).epochIterations(NUM_NEW_TXS / 10).run([&] {
+        assert(next < new_txs.size());
+        {
+            LOCK(::cs_main);
+            const MempoolAcceptResult res = ::AcceptToMemoryPool(chainstate, pool, new_txs[next++], /* bypass_limits */ false);
+            assert(res.m_result_type == MempoolAcceptResult::ResultType::VALID);
+        }
+        if (!incremental) WITH_LOCK(pool.cs, pool.m_template_selection = {});
+        BlockAssembler(chainstate, pool, Params(), options).CreateNewBlock(P2WSH_OP_TRUE);
+    });
+}
+
+static void AssembleBlockFullMempoolIncremental(benchmark::Bench& bench) { AssembleBlockFullMempool(bench, /* incremental */ true); }
+static void AssembleBlockFullMempoolFromScratch(benchmark::Bench& bench) { AssembleBlockFullMempool(bench, /* incremental */ false); }
+
 BENCHMARK(AssembleBlock);
+BENCHMARK(AssembleBlockFullMempoolIncremental);
+BENCHMARK(AssembleBlockFullMempoolFromScratch);
@@ -0,0 +1,88 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <bench/bench.h>
+#include <bench/data.h>
+
+#include <chainparams.h>
+#include <clientversion.h>
+#include <node/blockcompression.h>
+#include <node/blockstorage.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <tinyformat.h>
+#include <validation.h>
+
+#include <iostream>
+
+static CBlock LoadBlock()
+{
+    CDataStream stream(benchmark::data::block413567, SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+    return block;
+}
+
+// Writing a block as it is received during IBD: serialization, compression
+// if enabled, and the write to the block file (which is not synced).
+static void SaveBlockToDisk(benchmark::Bench& bench, BlockCompression compression)
+{
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::MAIN);
+    const CBlock block = LoadBlock();
+    g_block_compression = compression;
+
+    CChain& active_chain = testing_setup->m_node.chainman->ActiveChain();
+    // Every iteration appends a block, keep the amount of data written down.
+    bench.unit("block").epochs(5).epochIterations(20).run([&] {
+        FlatFilePos pos = SaveBlockToDisk(block, 1, active_chain, Params(), nullptr);
+        assert(!pos.IsNull());
+    });
+    g_block_compression = BlockCompression::NONE;
+}
+
+// Random access to a block in the (cached) block file, as done to serve
+// blocks to peers and by the indexes and RPCs.
+static void ReadBlockFromDisk(benchmark::Bench& bench, BlockCompression compression)
+{
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::MAIN);
+    const CBlock block = LoadBlock();
+    g_block_compression = compression;
+
+    CChain& active_chain = testing_setup->m_node.chainman->ActiveChain();
+    const FlatFilePos pos = SaveBlockToDisk(block, 1, active_chain, Params(), nullptr);
+    assert(!pos.IsNull());
+    uint32_t size_field;
+    CAutoFile(OpenBlockFile(FlatFilePos(pos.nFile, pos.nPos - 4), true), SER_DISK, CLIENT_VERSION) >> size_field;
+
+    bench.unit("block").run([&] {
+        CBlock read;
+        bool ok = ::ReadBlockFromDisk(read, pos, Params().GetConsensus());
+        assert(ok);
+    });
+    std::cout << tfm::format("Block of %u bytes stored in %u bytes (%s)\n", benchmark::data::block413567.size(), size_field & BLOCK_RECORD_SIZE_MASK, BlockCompressionName(compression));
+    g_block_compression = BlockCompression::NONE;
+}
+
+static void SaveBlockToDiskNone(benchmark::Bench& bench) { SaveBlockToDisk(bench, BlockCompression::NONE); }
+static void SaveBlockToDiskZlib(benchmark::Bench& bench) { SaveBlockToDisk(bench, BlockCompression::ZLIB); }
+static void ReadBlockFromDiskNone(benchmark::Bench& bench) { ReadBlockFromDisk(bench, BlockCompression::NONE); }
+static void ReadBlockFromDiskZlib(benchmark::Bench& bench) { ReadBlockFromDisk(bench, BlockCompression::ZLIB); }
+
+BENCHMARK(SaveBlockToDiskNone);
+BENCHMARK(SaveBlockToDiskZlib);
+BENCHMARK(ReadBlockFromDiskNone);
+BENCHMARK(ReadBlockFromDiskZlib);
+
+#ifdef USE_ZSTD
+static void SaveBlockToDiskZstd(benchmark::Bench& bench) { SaveBlockToDisk(bench, BlockCompression::ZSTD); }
+static void ReadBlockFromDiskZstd(benchmark::Bench& bench) { ReadBlockFromDisk(bench, BlockCompression::ZSTD); }
+
+BENCHMARK(SaveBlockToDiskZstd);
+BENCHMARK(ReadBlockFromDiskZstd);
+#endif // USE_ZSTD
@@ -0,0 +1,84 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <coins.h>
+#include <random.h>
+#include <script/script.h>
+#include <test/util/setup_common.h>
+#include <tinyformat.h>
+#include <txdb.h>
+
+#include <iostream>
+#include <vector>
+
+//! Coins in the chainstate before the replay starts
+static constexpr size_t INITIAL_COINS{500000};
+//! Outputs spent and created per block
+static constexpr size_t COINS_PER_BLOCK{2000};
+static constexpr int BLOCKS_PER_RUN{50};
+//! Memory of the coins cache on top of the backend, far less than the UTXO set
+static constexpr size_t COINS_CACHE_SIZE{4 << 20};
+
+static Coin MakeCoin(FastRandomContext& rng)
+{
+    Coin coin;
+    coin.out.nValue = rng.randrange(50 * COIN);
+    coin.out.scriptPubKey = CScript() << OP_0 << rng.randbytes(20);
+    coin.nHeight = 1;
+    return coin;
+}
+
+// Replay of IBD once the UTXO set outgrows -dbcache: every block spends
+// random older outputs, which mostly miss the coins cache and are read from
+// the backend, and creates as many new ones, which are flushed to the backend
+// whenever the cache is full.
+static void CoinsBackendReplay(benchmark::Bench& bench, CoinsBackend backend)
+{
+    const auto testing_setup = MakeNoLogFileContext<const BasicTestingSetup>(CBaseChainParams::REGTEST);
+    const auto base = MakeCoinsView(backend, GetCoinsDBPath(gArgs.GetDataDirNet(), "bench", backend),
+                                    /* cache_size */ 8 << 20, /* in_memory */ false, /* wipe */ true);
+    FastRandomContext rng(/* fDeterministic */ true);
+
+    std::vector<COutPoint> unspent;
+    uint256 best_block = rng.rand256();
+    {
+        CCoinsMap coins;
+        for (size_t i = 0; i < INITIAL_COINS; ++i) {
+            CCoinsCacheEntry entry{MakeCoin(rng)};
+            entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+            unspent.emplace_back(rng.rand256(), 0);
+            coins.emplace(unspent.back(), std::move(entry));
+        }
+        base->BatchWrite(coins, best_block);
+    }
+
+    bench.batch(BLOCKS_PER_RUN * COINS_PER_BLOCK).unit("spend").epochs(3).epochIterations(1).run([&] {
+        CCoinsViewCache cache(base.get());
+        for (int block = 0; block < BLOCKS_PER_RUN; ++block) {
+            for (size_t i = 0; i < COINS_PER_BLOCK; ++i) {
+                const size_t spent = rng.randrange(unspent.size());
+                bool ok = cache.SpendCoin(unspent[spent]);
+                assert(ok);
+                unspent[spent] = COutPoint(rng.rand256(), 0);
+                cache.AddCoin(unspent[spent], MakeCoin(rng), /* possible_overwrite */ false);
+            }
+            best_block = rng.rand256();
+            cache.SetBestBlock(best_block);
+            if (cache.DynamicMemoryUsage() > COINS_CACHE_SIZE) {
+                bool ok = cache.Flush();
+                assert(ok);
+            }
+        }
+        bool ok = cache.Flush();
+        assert(ok);
+    });
+    std::cout << tfm::format("%s chainstate of %u coins takes %.1f MiB on disk\n", CoinsBackendName(backend), unspent.size(), base->EstimateSize() * (1.0 / (1 << 20)));
+}
+
+static void CoinsBackendReplayLevelDB(benchmark::Bench& bench) { CoinsBackendReplay(bench, CoinsBackend::LEVELDB); }
+static void CoinsBackendReplayFlatFile(benchmark::Bench& bench) { CoinsBackendReplay(bench, CoinsBackend::FLATFILE); }
+
+BENCHMARK(CoinsBackendReplayLevelDB);
+BENCHMARK(CoinsBackendReplayFlatFile);
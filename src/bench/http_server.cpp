@@ -0,0 +1,214 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <compat.h>
+#include <httprpc.h>
+#include <httpserver.h>
+#include <rpc/server.h>
+#include <test/util/setup_common.h>
+#include <tinyformat.h>
+#include <util/strencodings.h>
+#include <util/sock.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef WIN32
+#include <netinet/tcp.h>
+#endif
+
+namespace {
+
+/** A loopback HTTP/1.1 client keeping its connection alive across requests */
+class HTTPClient
+{
+    SOCKET m_socket;
+    std::string m_received;
+
+public:
+    explicit HTTPClient(uint16_t port)
+    {
+        m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        assert(m_socket != INVALID_SOCKET);
+        int one = 1;
+        setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, (sockopt_arg_type)&one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        int ret = connect(m_socket, (sockaddr*)&addr, sizeof(addr));
+        assert(ret == 0);
+    }
+    ~HTTPClient() { CloseSocket(m_socket); }
+
+    void Send(const std::string& data)
+    {
+        for (size_t sent = 0; sent < data.size();) {
+            const auto n = send(m_socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            assert(n > 0);
+            sent += n;
+        }
+    }
+
+    //! Read one response, returning the size of its body
+    size_t ReadResponse()
+    {
+        size_t header_end;
+        while ((header_end = m_received.find("\r\n\r\n")) == std::string::npos) Receive();
+        const size_t length_pos = m_received.find("Content-Length: ");
+        assert(length_pos < header_end);
+        const size_t body_size = std::stoul(m_received.substr(length_pos + 16, header_end - length_pos - 16));
+        while (m_received.size() < header_end + 4 + body_size) Receive();
+        assert(m_received.compare(0, 12, "HTTP/1.1 200") == 0);
+        m_received.erase(0, header_end + 4 + body_size);
+        return body_size;
+    }
+
+private:
+    void Receive()
+    {
+        char buf[64 * 1024];
+        const auto n = recv(m_socket, buf, sizeof(buf), 0);
+        assert(n > 0);
+        m_received.append(buf, n);
+    }
+};
+
+//! A free loopback port, to start the server on
+uint16_t FreePort()
+{
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int ret = bind(s, (sockaddr*)&addr, sizeof(addr));
+    assert(ret == 0);
+    socklen_t len = sizeof(addr);
+    getsockname(s, (sockaddr*)&addr, &len);
+    CloseSocket(s);
+    return ntohs(addr.sin_port);
+}
+
+/** The HTTP server with its JSON-RPC handler, on a regtest chain */
+class HTTPRPCServer
+{
+    const std::unique_ptr<TestingSetup> m_testing_setup{MakeNoLogFileContext<TestingSetup>(CBaseChainParams::REGTEST)};
+
+public:
+    const uint16_t m_port{FreePort()};
+
+    HTTPRPCServer()
+    {
+        gArgs.ForceSetArg("-rpcport", ToString(m_port));
+        gArgs.ForceSetArg("-rpcbind", "127.0.0.1");
+        gArgs.ForceSetArg("-rpcallowip", "127.0.0.1");
+        gArgs.ForceSetArg("-rpcuser", "bench");
+        gArgs.ForceSetArg("-rpcpassword", "bench");
+        bool ok = InitHTTPServer() && StartHTTPRPC(&m_testing_setup->m_node);
+        assert(ok);
+        StartHTTPServer();
+        if (RPCIsInWarmup(nullptr)) SetRPCWarmupFinished();
+    }
+    ~HTTPRPCServer()
+    {
+        InterruptHTTPRPC();
+        InterruptHTTPServer();
+        StopHTTPRPC();
+        StopHTTPServer();
+    }
+
+    static std::string Request(const std::string& body)
+    {
+        return strprintf("POST / HTTP/1.1\r\nHost: 127.0.0.1\r\nAuthorization: Basic %s\r\n"
+                         "Content-Type: application/json\r\nContent-Length: %u\r\n\r\n%s",
+                         EncodeBase64("bench:bench"), body.size(), body);
+    }
+
+    //! A batch of count getblockheader calls for the genesis block
+    static std::string HeaderBatch(size_t count)
+    {
+        const std::string call = strprintf(R"({"method":"getblockheader","params":["%s"],"id":1})", Params().GenesisBlock().GetHash().GetHex());
+        std::string batch = "[" + call;
+        for (size_t i = 1; i < count; ++i) batch += "," + call;
+        return Request(batch + "]");
+    }
+};
+
+//! Print the 99th percentile of the request latencies, which nanobench does not report
+void PrintLatency(const std::string& name, std::vector<std::chrono::nanoseconds>& latencies)
+{
+    if (latencies.empty()) return;
+    std::sort(latencies.begin(), latencies.end());
+    const auto p99 = latencies[latencies.size() * 99 / 100];
+    std::cout << strprintf("%s: p99 latency %.1f us over %u requests\n", name, p99.count() / 1000.0, latencies.size());
+}
+
+} // namespace
+
+// One request at a time over a persistent connection: the reply to each
+// request must arrive before the next one is sent. Requests are a single
+// trivial call, or a batch of batch_size calls.
+static void HTTPRPCRoundTrip(benchmark::Bench& bench, const std::string& name, size_t batch_size)
+{
+    HTTPRPCServer server;
+    const std::string request = batch_size ? HTTPRPCServer::HeaderBatch(batch_size) : HTTPRPCServer::Request(R"({"method":"getblockcount","id":1})");
+    std::vector<std::chrono::nanoseconds> latencies;
+    {
+        HTTPClient client(server.m_port);
+        bench.unit("req").run([&] {
+            const auto start = std::chrono::steady_clock::now();
+            client.Send(request);
+            client.ReadResponse();
+            latencies.push_back(std::chrono::steady_clock::now() - start);
+        });
+    }
+    PrintLatency(name, latencies);
+}
+
+static void HTTPRPCTrivial(benchmark::Bench& bench)
+{
+    HTTPRPCRoundTrip(bench, __func__, /* batch_size */ 0);
+}
+
+static void HTTPRPCMedium(benchmark::Bench& bench)
+{
+    // A reply of about 16 KB
+    HTTPRPCRoundTrip(bench, __func__, /* batch_size */ 25);
+}
+
+static void HTTPRPCLarge(benchmark::Bench& bench)
+{
+    // A reply of about 1 MB
+    HTTPRPCRoundTrip(bench, __func__, /* batch_size */ 1500);
+}
+
+// Requests pipelined over a persistent connection: they are all sent before
+// the replies are read.
+static void HTTPRPCPipelined(benchmark::Bench& bench)
+{
+    static constexpr size_t PIPELINE_DEPTH{16};
+    HTTPRPCServer server;
+    std::string requests;
+    for (size_t i = 0; i < PIPELINE_DEPTH; ++i) {
+        requests += HTTPRPCServer::Request(R"({"method":"getblockcount","id":1})");
+    }
+    HTTPClient client(server.m_port);
+    bench.unit("req").batch(PIPELINE_DEPTH).run([&] {
+        client.Send(requests);
+        for (size_t i = 0; i < PIPELINE_DEPTH; ++i) client.ReadResponse();
+    });
+}
+
+BENCHMARK(HTTPRPCTrivial);
+BENCHMARK(HTTPRPCMedium);
+BENCHMARK(HTTPRPCLarge);
+BENCHMARK(HTTPRPCPipelined);
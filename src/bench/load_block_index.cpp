@@ -0,0 +1,82 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <test/util/setup_common.h>
+#include <tinyformat.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <iostream>
+#include <set>
+#include <vector>
+
+//! Roughly the number of headers on mainnet.
+static constexpr int CHAIN_LENGTH{800000};
+static constexpr int WRITE_BATCH_SIZE{10000};
+
+// Time loading a synthetic header chain from the block tree database into
+// the in-memory block index, as done at startup, and report the memory the
+// block index ends up using.
+static void LoadBlockIndex(benchmark::Bench& bench)
+{
+    const auto testing_setup = MakeNoLogFileContext<const BasicTestingSetup>(CBaseChainParams::REGTEST);
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+
+    CBlockTreeDB block_tree(/* nCacheSize = */ 1 << 20, /* fMemory = */ true);
+    {
+        std::vector<uint256> hashes(CHAIN_LENGTH);
+        std::vector<CBlockIndex> chain(CHAIN_LENGTH);
+        CBlockHeader header;
+        header.nVersion = 4;
+        header.nTime = 1600000000;
+        header.nBits = UintToArith256(consensus_params.powLimit).GetCompact();
+        for (int height = 0; height < CHAIN_LENGTH; ++height) {
+            header.hashPrevBlock = height > 0 ? hashes[height - 1] : uint256();
+            ++header.nTime;
+            header.nNonce = 0;
+            while (!CheckProofOfWork(header.GetHash(), header.nBits, consensus_params)) {
+                ++header.nNonce;
+            }
+            hashes[height] = header.GetHash();
+
+            CBlockIndex& index = chain[height];
+            index = CBlockIndex(header);
+            index.phashBlock = &hashes[height];
+            index.pprev = height > 0 ? &chain[height - 1] : nullptr;
+            index.nHeight = height;
+            index.RaiseValidity(BLOCK_VALID_TREE);
+        }
+
+        std::vector<const CBlockIndex*> batch;
+        for (const CBlockIndex& index : chain) {
+            batch.push_back(&index);
+            if (batch.size() == WRITE_BATCH_SIZE) {
+                block_tree.WriteBatchSync({}, 0, batch);
+                batch.clear();
+            }
+        }
+        block_tree.WriteBatchSync({}, 0, batch);
+    }
+
+    size_t memory_usage{0};
+    bench.batch(CHAIN_LENGTH).unit("header").epochs(3).epochIterations(1).run([&] {
+        LOCK(cs_main);
+        BlockManager blockman;
+        std::set<CBlockIndex*, CBlockIndexWorkComparator> candidates;
+        bool loaded = blockman.LoadBlockIndex(consensus_params, block_tree, candidates);
+        assert(loaded);
+        assert(blockman.m_block_index.size() == CHAIN_LENGTH);
+        memory_usage = blockman.DynamicMemoryUsage();
+        // Don't leave a dangling pointer into blockman behind.
+        pindexBestHeader = nullptr;
+    });
+    std::cout << tfm::format("Block index of %d headers uses %.1f MiB\n", CHAIN_LENGTH, memory_usage * (1.0 / (1 << 20)));
+}
+
+BENCHMARK(LoadBlockIndex);
@@ -0,0 +1,81 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <consensus/validation.h>
+#include <script/sign.h>
+#include <script/signingprovider.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <vector>
+
+//! Transactions received in one go, as from a peer during a fee spike
+static constexpr size_t NUM_TXS{200};
+//! Every run accepts different transactions, so that they miss the signature and script caches
+static constexpr int NUM_RUNS{10};
+
+static CMutableTransaction SignedSpend(const FillableSigningProvider& keystore, const CTransactionRef& prev, uint32_t n, std::vector<CTxOut> outputs, uint32_t lock_time = 0)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(COutPoint(prev->GetHash(), n));
+    tx.vout = std::move(outputs);
+    tx.nLockTime = lock_time;
+    std::map<COutPoint, Coin> coins{{tx.vin[0].prevout, Coin(prev->vout[n], /* nHeight */ 1, /* fCoinBase */ prev->IsCoinBase())}};
+    std::map<int, std::string> input_errors;
+    bool ok = SignTransaction(tx, &keystore, coins, SIGHASH_ALL, input_errors);
+    assert(ok);
+    return tx;
+}
+
+// Independent transactions, each spending a P2WPKH output, are accepted to the
+// mempool with cold signature and script caches, either one at a time under
+// cs_main, or after their scripts were verified in parallel.
+static void MempoolAccept(benchmark::Bench& bench, bool preverify)
+{
+    const auto testing_setup = std::make_unique<TestChain100Setup>();
+    CTxMemPool& pool = *testing_setup->m_node.mempool;
+    CChainState& chainstate = testing_setup->m_node.chainman->ActiveChainstate();
+
+    FillableSigningProvider keystore;
+    keystore.AddKey(testing_setup->coinbaseKey);
+    const CScript script_pub_key = GetScriptForDestination(WitnessV0KeyHash(testing_setup->coinbaseKey.GetPubKey()));
+
+    const CMutableTransaction funding = SignedSpend(keystore, testing_setup->m_coinbase_txns[0], 0,
+                                                    std::vector<CTxOut>(NUM_TXS, CTxOut(49 * COIN / NUM_TXS, script_pub_key)));
+    testing_setup->CreateAndProcessBlock({funding}, script_pub_key);
+    const CTransactionRef funding_tx = MakeTransactionRef(funding);
+
+    std::vector<std::vector<CTransactionRef>> runs(NUM_RUNS);
+    for (int run = 0; run < NUM_RUNS; ++run) {
+        for (size_t i = 0; i < NUM_TXS; ++i) {
+            runs[run].push_back(MakeTransactionRef(SignedSpend(keystore, funding_tx, i, {CTxOut(funding.vout[i].nValue - 1000, script_pub_key)}, run)));
+        }
+    }
+
+    int run = 0;
+    bench.batch(NUM_TXS).unit("tx").epochs(NUM_RUNS).epochIterations(1).run([&] {
+        assert(run < NUM_RUNS);
+        const std::vector<CTransactionRef>& txs = runs[run++];
+        WITH_LOCK(pool.cs, pool.clear());
+
+        if (preverify) {
+            const auto rejects = PreverifyTransactionScripts(chainstate, pool, txs);
+            assert(rejects.empty());
+        }
+        LOCK(cs_main);
+        for (const CTransactionRef& tx : txs) {
+            const MempoolAcceptResult result = AcceptToMemoryPool(chainstate, pool, tx, /* bypass_limits */ false);
+            assert(result.m_result_type == MempoolAcceptResult::ResultType::VALID);
+        }
+    });
+}
+
+static void MempoolAcceptSerial(benchmark::Bench& bench) { MempoolAccept(bench, /* preverify */ false); }
+static void MempoolAcceptPreverified(benchmark::Bench& bench) { MempoolAccept(bench, /* preverify */ true); }
+
+BENCHMARK(MempoolAcceptSerial);
+BENCHMARK(MempoolAcceptPreverified);
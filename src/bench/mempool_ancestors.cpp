@@ -0,0 +1,96 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/policy.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <vector>
+
+static void AddTx(const CTransactionRef& tx, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    LockPoints lp;
+    pool.addUnchecked(CTxMemPoolEntry(tx, 1000, /* time */ 0, /* height */ 1, /* spendsCoinbase */ false, /* sigOpCost */ 4, lp));
+}
+
+static CTransactionRef MakeTx(const std::vector<COutPoint>& prevouts, size_t outputs)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+        tx.vin.back().scriptSig = CScript() << OP_1;
+    }
+    if (prevouts.empty()) {
+        tx.vin.emplace_back();
+        tx.vin.back().scriptSig = CScript() << OP_2;
+    }
+    tx.vout.resize(outputs);
+    for (auto& out : tx.vout) {
+        out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        out.nValue = 1 * COIN;
+    }
+    return MakeTransactionRef(tx);
+}
+
+// A transaction spending the tip of a chain far longer than the ancestor limit
+// is checked against the default package limits, as when it is submitted.
+static void MempoolAncestorsLongChain(benchmark::Bench& bench)
+{
+    static constexpr int CHAIN_LENGTH{1000};
+
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>();
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    CTransactionRef tx = MakeTx({}, 1);
+    AddTx(tx, pool);
+    for (int i = 1; i < CHAIN_LENGTH; ++i) {
+        tx = MakeTx({COutPoint(tx->GetHash(), 0)}, 1);
+        AddTx(tx, pool);
+    }
+    const CTxMemPoolEntry child(MakeTx({COutPoint(tx->GetHash(), 0)}, 1), 1000, 0, 1, false, 4, LockPoints());
+
+    bench.run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        CTxMemPool::setEntries ancestors;
+        std::string err;
+        const bool ok = pool.CalculateMemPoolAncestors(child, ancestors, DEFAULT_ANCESTOR_LIMIT, DEFAULT_ANCESTOR_SIZE_LIMIT * 1000,
+                                                       DEFAULT_DESCENDANT_LIMIT, DEFAULT_DESCENDANT_SIZE_LIMIT * 1000, err);
+        assert(!ok);
+    });
+}
+
+// A transaction of a disconnected block that has a wide fan-out of in-mempool
+// descendants is added back to the mempool, which then has to account for
+// all of them in its descendant state.
+static void MempoolUpdateFromBlockFanOut(benchmark::Bench& bench)
+{
+    static constexpr size_t FAN_OUT{500};
+    static constexpr int CHAIN_LENGTH{5};
+
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>();
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    const CTransactionRef root = MakeTx({}, FAN_OUT);
+    AddTx(root, pool);
+    for (size_t n = 0; n < FAN_OUT; ++n) {
+        CTransactionRef tx = MakeTx({COutPoint(root->GetHash(), n)}, 1);
+        AddTx(tx, pool);
+        for (int i = 0; i < CHAIN_LENGTH; ++i) {
+            tx = MakeTx({COutPoint(tx->GetHash(), 0)}, 1);
+            AddTx(tx, pool);
+        }
+    }
+    const size_t pool_size = pool.size();
+
+    bench.run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        pool.removeForBlock({root}, 1);
+        AddTx(root, pool);
+        pool.UpdateTransactionsFromBlock({root->GetHash()}, DEFAULT_ANCESTOR_SIZE_LIMIT * 1000, DEFAULT_ANCESTOR_LIMIT);
+        assert(pool.size() == pool_size);
+    });
+}
+
+BENCHMARK(MempoolAncestorsLongChain);
+BENCHMARK(MempoolUpdateFromBlockFanOut);
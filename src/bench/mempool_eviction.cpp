@@ -7,6 +7,8 @@
 #include <test/util/setup_common.h>
 #include <txmempool.h>
 
+#include <utility>
+#include <vector>
 
 static void AddTx(const CTransactionRef& tx, const CAmount& nFee, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
 {
@@ -132,4 +134,48 @@ static void MempoolEviction(benchmark::Bench& bench)
     });
 }
 
+// A large mempool of small packages with random feerates, trimmed to half its
+// size and then emptied, which evicts the package with the lowest descendant
+// score over and over.
+static void MempoolEvictionLarge(benchmark::Bench& bench)
+{
+    static constexpr int PACKAGES{10000};
+
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>();
+    FastRandomContext det_rand{true};
+    std::vector<std::pair<CTransactionRef, CAmount>> txs;
+    for (int i = 0; i < PACKAGES; ++i) {
+        CMutableTransaction parent;
+        parent.vin.resize(1);
+        parent.vin[0].scriptSig = CScript() << i;
+        parent.vout.resize(2);
+        for (auto& out : parent.vout) {
+            out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            out.nValue = 10 * COIN;
+        }
+        txs.emplace_back(MakeTransactionRef(parent), det_rand.randrange(100000));
+        for (uint32_t n = 0; n < parent.vout.size(); ++n) {
+            CMutableTransaction child;
+            child.vin.resize(1);
+            child.vin[0].prevout = COutPoint(parent.GetHash(), n);
+            child.vout.resize(1);
+            child.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+            child.vout[0].nValue = 10 * COIN;
+            txs.emplace_back(MakeTransactionRef(child), det_rand.randrange(100000));
+        }
+    }
+
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    bench.batch(txs.size()).unit("tx").run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        for (const auto& [tx, fee] : txs) {
+            AddTx(tx, fee, pool);
+        }
+        pool.TrimToSize(pool.DynamicMemoryUsage() / 2);
+        pool.TrimToSize(0);
+        assert(pool.size() == 0);
+    });
+}
+
 BENCHMARK(MempoolEviction);
+BENCHMARK(MempoolEvictionLarge);
@@ -7,6 +7,7 @@
 #include <test/util/setup_common.h>
 #include <txmempool.h>
 
+#include <algorithm>
 #include <vector>
 
 static void AddTx(const CTransactionRef& tx, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
@@ -26,19 +27,13 @@ struct Available {
     Available(CTransactionRef& ref, size_t tx_count) : ref(ref), tx_count(tx_count){}
 };
 
-static void ComplexMemPool(benchmark::Bench& bench)
+//! Transactions spending base_txs unconfirmed ones and each other, with all parents before their children
+static std::vector<CTransactionRef> CreateOrderedCoins(FastRandomContext& det_rand, int childTxs, int base_txs, size_t& tx_counter)
 {
-    int childTxs = 800;
-    if (bench.complexityN() > 1) {
-        childTxs = static_cast<int>(bench.complexityN());
-    }
-
-    FastRandomContext det_rand{true};
     std::vector<Available> available_coins;
     std::vector<CTransactionRef> ordered_coins;
     // Create some base transactions
-    size_t tx_counter = 1;
-    for (auto x = 0; x < 100; ++x) {
+    for (auto x = 0; x < base_txs; ++x) {
         CMutableTransaction tx = CMutableTransaction();
         tx.vin.resize(1);
         tx.vin[0].scriptSig = CScript() << CScriptNum(tx_counter);
@@ -79,6 +74,19 @@ static void ComplexMemPool(benchmark::Bench& bench)
         ordered_coins.emplace_back(MakeTransactionRef(tx));
         available_coins.emplace_back(ordered_coins.back(), tx_counter++);
     }
+    return ordered_coins;
+}
+
+static void ComplexMemPool(benchmark::Bench& bench)
+{
+    int childTxs = 800;
+    if (bench.complexityN() > 1) {
+        childTxs = static_cast<int>(bench.complexityN());
+    }
+
+    FastRandomContext det_rand{true};
+    size_t tx_counter = 1;
+    const std::vector<CTransactionRef> ordered_coins = CreateOrderedCoins(det_rand, childTxs, /* base_txs */ 100, tx_counter);
     const auto testing_setup = MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::MAIN);
     CTxMemPool pool;
     LOCK2(cs_main, pool.cs);
@@ -91,4 +99,44 @@ static void ComplexMemPool(benchmark::Bench& bench)
     });
 }
 
+// A large mempool of many small clusters being filled and then mined in
+// blocks. Blocks take the oldest transactions of every cluster, so removing
+// them updates the ancestor state of what is left of each cluster.
+static void MempoolRemoveForBlock(benchmark::Bench& bench)
+{
+    static constexpr int CLUSTERS{2000};
+    static constexpr size_t TXS_PER_BLOCK{2000};
+
+    FastRandomContext det_rand{true};
+    size_t tx_counter = 1;
+    std::vector<std::vector<CTransactionRef>> clusters;
+    size_t max_cluster_size = 0;
+    for (int i = 0; i < CLUSTERS; ++i) {
+        clusters.push_back(CreateOrderedCoins(det_rand, /* childTxs */ 15, /* base_txs */ 5, tx_counter));
+        max_cluster_size = std::max(max_cluster_size, clusters.back().size());
+    }
+    // Interleave the clusters, which keeps parents before their children
+    std::vector<CTransactionRef> ordered_coins;
+    for (size_t depth = 0; depth < max_cluster_size; ++depth) {
+        for (const auto& cluster : clusters) {
+            if (depth < cluster.size()) ordered_coins.push_back(cluster[depth]);
+        }
+    }
+
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::MAIN);
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    bench.batch(ordered_coins.size()).unit("tx").run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        for (auto& tx : ordered_coins) {
+            AddTx(tx, pool);
+        }
+        for (size_t start = 0; start < ordered_coins.size(); start += TXS_PER_BLOCK) {
+            const size_t end = std::min(start + TXS_PER_BLOCK, ordered_coins.size());
+            pool.removeForBlock({ordered_coins.begin() + start, ordered_coins.begin() + end}, 1);
+        }
+        assert(pool.size() == 0);
+    });
+}
+
 BENCHMARK(ComplexMemPool);
+BENCHMARK(MempoolRemoveForBlock);
@@ -0,0 +1,143 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/data.h>
+
+#include <core_io.h>
+#include <primitives/block.h>
+#include <rpc/json.h>
+#include <rpc/request.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <version.h>
+
+#include <univalue.h>
+
+namespace {
+
+//! JSON-RPC payloads built from the transactions of a mainnet block, as heavy
+//! clients exchange them in batches
+struct RPCPayloads {
+    const std::unique_ptr<const BasicTestingSetup> testing_setup{MakeNoLogFileContext<const BasicTestingSetup>(CBaseChainParams::MAIN)};
+    CBlock block;
+    //! A batch of sendrawtransaction and getrawtransaction calls
+    std::string batch_request;
+    //! The replies to a batch of verbose getrawtransaction calls
+    UniValue batch_reply{UniValue::VARR};
+
+    RPCPayloads()
+    {
+        CDataStream stream(benchmark::data::block413567, SER_NETWORK, PROTOCOL_VERSION);
+        stream >> block;
+
+        UniValue batch(UniValue::VARR);
+        int id = 0;
+        for (const CTransactionRef& tx : block.vtx) {
+            UniValue send_params(UniValue::VARR);
+            send_params.push_back(EncodeHexTx(*tx));
+            batch.push_back(JSONRPCRequestObj("sendrawtransaction", send_params, id++));
+
+            UniValue get_params(UniValue::VARR);
+            get_params.push_back(tx->GetHash().GetHex());
+            get_params.push_back(true);
+            batch.push_back(JSONRPCRequestObj("getrawtransaction", get_params, id++));
+
+            UniValue result(UniValue::VOBJ);
+            TxToUniv(*tx, block.GetHash(), /* include_addresses */ false, result);
+            batch_reply.push_back(JSONRPCReplyObj(result, NullUniValue, id++));
+        }
+        batch_request = batch.write();
+    }
+};
+
+} // namespace
+
+static void JsonParseBatchRequest(benchmark::Bench& bench)
+{
+    const RPCPayloads payloads;
+    bench.unit("byte").batch(payloads.batch_request.size()).run([&] {
+        UniValue request;
+        bool ok = ParseJSON(payloads.batch_request, request);
+        assert(ok);
+        ankerl::nanobench::doNotOptimizeAway(request);
+    });
+}
+
+static void JsonParseBatchRequestUniValue(benchmark::Bench& bench)
+{
+    const RPCPayloads payloads;
+    bench.unit("byte").batch(payloads.batch_request.size()).run([&] {
+        UniValue request;
+        bool ok = request.read(payloads.batch_request);
+        assert(ok);
+        ankerl::nanobench::doNotOptimizeAway(request);
+    });
+}
+
+static void JsonParseBatchReply(benchmark::Bench& bench)
+{
+    const RPCPayloads payloads;
+    const std::string reply = payloads.batch_reply.write();
+    bench.unit("byte").batch(reply.size()).run([&] {
+        UniValue parsed;
+        bool ok = ParseJSON(reply, parsed);
+        assert(ok);
+        ankerl::nanobench::doNotOptimizeAway(parsed);
+    });
+}
+
+static void JsonParseBatchReplyUniValue(benchmark::Bench& bench)
+{
+    const RPCPayloads payloads;
+    const std::string reply = payloads.batch_reply.write();
+    bench.unit("byte").batch(reply.size()).run([&] {
+        UniValue parsed;
+        bool ok = parsed.read(reply);
+        assert(ok);
+        ankerl::nanobench::doNotOptimizeAway(parsed);
+    });
+}
+
+static void JsonWriteBatchReply(benchmark::Bench& bench)
+{
+    const RPCPayloads payloads;
+    bench.unit("byte").batch(payloads.batch_reply.write().size()).run([&] {
+        std::string str;
+        WriteJSON(payloads.batch_reply, str);
+        ankerl::nanobench::doNotOptimizeAway(str);
+    });
+}
+
+static void JsonWriteBatchReplyUniValue(benchmark::Bench& bench)
+{
+    const RPCPayloads payloads;
+    bench.unit("byte").batch(payloads.batch_reply.write().size()).run([&] {
+        std::string str = payloads.batch_reply.write();
+        ankerl::nanobench::doNotOptimizeAway(str);
+    });
+}
+
+static void JsonBuildBatchReply(benchmark::Bench& bench)
+{
+    const RPCPayloads payloads;
+    bench.unit("tx").batch(payloads.block.vtx.size()).run([&] {
+        UniValue reply(UniValue::VARR);
+        int id = 0;
+        for (const CTransactionRef& tx : payloads.block.vtx) {
+            UniValue result(UniValue::VOBJ);
+            TxToUniv(*tx, payloads.block.GetHash(), /* include_addresses */ false, result);
+            reply.push_back(JSONRPCReplyObj(result, NullUniValue, id++));
+        }
+        ankerl::nanobench::doNotOptimizeAway(reply);
+    });
+}
+
+BENCHMARK(JsonParseBatchRequest);
+BENCHMARK(JsonParseBatchRequestUniValue);
+BENCHMARK(JsonParseBatchReply);
+BENCHMARK(JsonParseBatchReplyUniValue);
+BENCHMARK(JsonWriteBatchReply);
+BENCHMARK(JsonWriteBatchReplyUniValue);
+BENCHMARK(JsonBuildBatchReply);
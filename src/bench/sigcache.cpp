@@ -0,0 +1,120 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <cuckoocache.h>
+#include <key.h>
+#include <primitives/transaction.h>
+#include <pubkey.h>
+#include <random.h>
+#include <script/interpreter.h>
+#include <script/sigcache.h>
+#include <util/hasher.h>
+#include <util/system.h>
+
+#include <thread>
+#include <vector>
+
+static const uint32_t LOOKUPS_PER_THREAD = 1 << 14;
+static const size_t CACHE_BYTES = 32 << 20;
+
+// Every script-check thread (-par defaults to the number of cores) hammering
+// the cache with lookups of entries that are present, as happens when a block
+// arrives whose transactions were already validated in the mempool. With a
+// single shard this is the old shared_mutex-guarded cache.
+template <uint32_t SHARDS>
+static void CuckooCacheConcurrentLookup(benchmark::Bench& bench)
+{
+    const int n_threads = std::max(1, GetNumCores());
+
+    FastRandomContext rng(true);
+    CuckooCache::sharded_cache<uint256, SignatureCacheHasher, SHARDS> cache;
+    cache.setup_bytes(CACHE_BYTES);
+    std::vector<uint256> entries(LOOKUPS_PER_THREAD);
+    for (uint256& entry : entries) {
+        entry = rng.rand256();
+        cache.insert(entry);
+    }
+
+    bench.minEpochIterations(10).batch(LOOKUPS_PER_THREAD * n_threads).unit("lookup").run([&] {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < n_threads; ++t) {
+            threads.emplace_back([&, t] {
+                // Start each thread at a different offset so they do not walk
+                // the shards in lockstep.
+                for (uint32_t i = 0; i < LOOKUPS_PER_THREAD; ++i) {
+                    bool found = cache.contains(entries[(i + t * 997) % LOOKUPS_PER_THREAD], false);
+                    assert(found);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    });
+}
+
+static void CuckooCacheConcurrentLookupOneShard(benchmark::Bench& bench)
+{
+    CuckooCacheConcurrentLookup<1>(bench);
+}
+
+static void CuckooCacheConcurrentLookupSharded(benchmark::Bench& bench)
+{
+    CuckooCacheConcurrentLookup<16>(bench);
+}
+
+// End to end: all threads verify signatures which are already in the global
+// signature cache through CachingTransactionSignatureChecker, including the
+// salted entry hashing.
+static void SigCacheConcurrentLookup(benchmark::Bench& bench)
+{
+    const int n_threads = std::max(1, GetNumCores());
+    const ECCVerifyHandle verify_handle;
+    ECC_Start();
+    InitSignatureCache();
+
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+
+    FastRandomContext rng(true);
+    std::vector<uint256> sighashes(256);
+    std::vector<std::vector<unsigned char>> sigs(sighashes.size());
+    for (size_t i = 0; i < sighashes.size(); ++i) {
+        sighashes[i] = rng.rand256();
+        key.Sign(sighashes[i], sigs[i]);
+    }
+
+    const CTransaction tx{CMutableTransaction{}};
+    PrecomputedTransactionData txdata;
+    const CachingTransactionSignatureChecker checker(&tx, 0, 0, /* storeIn = */ true, txdata);
+    // Warm the cache.
+    for (size_t i = 0; i < sighashes.size(); ++i) {
+        bool valid = checker.VerifyECDSASignature(sigs[i], pubkey, sighashes[i]);
+        assert(valid);
+    }
+
+    const uint32_t lookups_per_thread = 1024;
+    bench.batch(lookups_per_thread * n_threads).unit("lookup").run([&] {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < n_threads; ++t) {
+            threads.emplace_back([&] {
+                for (uint32_t i = 0; i < lookups_per_thread; ++i) {
+                    const size_t n = i % sighashes.size();
+                    bool valid = checker.VerifyECDSASignature(sigs[n], pubkey, sighashes[n]);
+                    assert(valid);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    });
+    ECC_Stop();
+}
+
+BENCHMARK(CuckooCacheConcurrentLookupOneShard);
+BENCHMARK(CuckooCacheConcurrentLookupSharded);
+BENCHMARK(SigCacheConcurrentLookup);
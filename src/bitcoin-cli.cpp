@@ -10,6 +10,7 @@
 #include <chainparamsbase.h>
 #include <clientversion.h>
 #include <rpc/client.h>
+#include <rpc/json.h>
 #include <rpc/mining.h>
 #include <rpc/protocol.h>
 #include <rpc/request.h>
@@ -773,7 +774,7 @@ static UniValue CallRPC(BaseRequestHandler* rh, const std::string& strMethod, co
 
     // Parse reply
     UniValue valReply(UniValue::VSTR);
-    if (!valReply.read(response.body))
+    if (!ParseJSON(response.body, valReply))
         throw std::runtime_error("couldn't parse reply from server");
     const UniValue reply = rh->ProcessReply(valReply);
     if (reply.empty())
@@ -0,0 +1,157 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKMAP_H
+#define BITCOIN_BLOCKMAP_H
+
+#include <crypto/common.h>
+#include <memusage.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+
+/** Map from block hash to block index entry, holding the whole block tree.
+ *
+ * Entries are appended to a std::deque and are never moved nor erased (other
+ * than by clear()), so references to keys and values stay valid for the
+ * lifetime of the map: CBlockIndex::phashBlock points at the key. Iteration
+ * walks the entries in insertion order.
+ *
+ * Lookups go through a flat, open addressing table of 8 byte slots, probed
+ * linearly. A slot holds the position of its entry plus 32 bits of the key's
+ * hash, so an entry is only touched on a likely match. Growing the table
+ * only rehashes the slots, the entries stay where they are.
+ *
+ * Compared to a std::unordered_map this saves a heap allocation per block and
+ * the bucket array, and keeps the table small enough to stay in cache for
+ * longer.
+ *
+ * Like BlockHasher, slots are picked from the low 64 bits of the block hash.
+ * These are not salted, but proof of work has to be provided for every
+ * header before it is added.
+ */
+class BlockMap
+{
+public:
+    typedef uint256 key_type;
+    typedef CBlockIndex* mapped_type;
+    typedef std::pair<const uint256, CBlockIndex*> value_type;
+    typedef std::deque<value_type>::iterator iterator;
+    typedef std::deque<value_type>::const_iterator const_iterator;
+    typedef std::deque<value_type>::size_type size_type;
+
+private:
+    struct Slot {
+        //! Position in m_entries plus one, 0 for an empty slot
+        uint32_t entry{0};
+        //! High 32 bits of the key's hash
+        uint32_t tag{0};
+    };
+
+    std::deque<value_type> m_entries;
+    std::vector<Slot> m_slots;
+
+    static constexpr size_type NOT_FOUND = ~size_type{0};
+    static constexpr size_type MIN_SLOTS = 16;
+
+    static uint64_t Hash(const uint256& key) { return ReadLE64(key.begin()); }
+
+    size_type Mask() const { return m_slots.size() - 1; }
+
+    size_type Lookup(const uint256& key) const
+    {
+        if (m_slots.empty()) return NOT_FOUND;
+        const uint64_t hash = Hash(key);
+        const uint32_t tag = hash >> 32;
+        for (size_type pos = hash & Mask();; pos = (pos + 1) & Mask()) {
+            const Slot& slot = m_slots[pos];
+            if (slot.entry == 0) return NOT_FOUND;
+            if (slot.tag == tag && m_entries[slot.entry - 1].first == key) return slot.entry - 1;
+        }
+    }
+
+    void Place(size_type index)
+    {
+        const uint64_t hash = Hash(m_entries[index].first);
+        size_type pos = hash & Mask();
+        while (m_slots[pos].entry != 0) {
+            pos = (pos + 1) & Mask();
+        }
+        m_slots[pos].entry = index + 1;
+        m_slots[pos].tag = hash >> 32;
+    }
+
+    void Rehash(size_type slots)
+    {
+        m_slots.assign(slots, Slot{});
+        for (size_type i = 0; i < m_entries.size(); ++i) {
+            Place(i);
+        }
+    }
+
+public:
+    //! Make room for n entries without growing the table, keeping the load factor at most 3/4
+    void reserve(size_type n)
+    {
+        size_type slots = MIN_SLOTS;
+        while (slots * 3 < n * 4) slots *= 2;
+        if (slots > m_slots.size()) Rehash(slots);
+    }
+
+    std::pair<iterator, bool> emplace(const uint256& key, CBlockIndex* value)
+    {
+        const size_type found = Lookup(key);
+        if (found != NOT_FOUND) return {m_entries.begin() + found, false};
+        reserve(m_entries.size() + 1);
+        m_entries.emplace_back(key, value);
+        Place(m_entries.size() - 1);
+        return {m_entries.end() - 1, true};
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value) { return emplace(value.first, value.second); }
+
+    //! Inserts a nullptr entry if key is not present, like std::unordered_map
+    CBlockIndex*& operator[](const uint256& key) { return emplace(key, nullptr).first->second; }
+
+    iterator find(const uint256& key)
+    {
+        const size_type found = Lookup(key);
+        return found == NOT_FOUND ? m_entries.end() : m_entries.begin() + found;
+    }
+
+    const_iterator find(const uint256& key) const
+    {
+        const size_type found = Lookup(key);
+        return found == NOT_FOUND ? m_entries.end() : m_entries.begin() + found;
+    }
+
+    size_type count(const uint256& key) const { return Lookup(key) == NOT_FOUND ? 0 : 1; }
+
+    void clear()
+    {
+        m_entries.clear();
+        m_slots.clear();
+        m_slots.shrink_to_fit();
+    }
+
+    bool empty() const { return m_entries.empty(); }
+    size_type size() const { return m_entries.size(); }
+    iterator begin() { return m_entries.begin(); }
+    iterator end() { return m_entries.end(); }
+    const_iterator begin() const { return m_entries.begin(); }
+    const_iterator end() const { return m_entries.end(); }
+
+    //! Approximate heap usage of the map, not counting the CBlockIndex entries themselves
+    size_t DynamicMemoryUsage() const
+    {
+        return memusage::DynamicUsage(m_slots) + m_entries.size() * sizeof(value_type);
+    }
+};
+
+#endif // BITCOIN_BLOCKMAP_H
@@ -11,6 +11,8 @@
 #include <cmath>
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <utility>
 #include <vector>
 
@@ -23,6 +25,9 @@
  *
  * 2. @ref cache is a cache which is performant in memory usage and lookup speed. It
  * is lockfree for erase operations. Elements are lazily erased on the next insert.
+ *
+ * 3. @ref sharded_cache splits a @ref cache into independently locked shards so
+ * that concurrent readers and writers rarely touch the same lock.
  */
 namespace CuckooCache
 {
@@ -477,6 +482,136 @@ public:
             }
         return false;
     }
+
+    /** for_each calls fn on every element which has neither been garbage
+     * collected nor been marked for erasure. Requires no concurrent Write.
+     *
+     * @param fn a callable taking a const Element&
+     */
+    template <typename Fn>
+    void for_each(Fn&& fn) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                fn(table[i]);
+    }
+};
+
+/** @ref sharded_cache partitions elements over `SHARDS` independent @ref cache
+ * instances, each guarded by its own std::shared_mutex.
+ *
+ * A single shared_mutex in front of one cache is a point of contention even
+ * for readers: every shared lock acquisition writes to the same cache line,
+ * which bounces between cores when many script-check threads look up entries
+ * at once, and every insert excludes all readers. With shards, readers and
+ * writers only contend when they hit the same shard, and each shard's lock
+ * lives on its own cache line.
+ *
+ * Each shard runs its own epoch based garbage collection, so erasure stays
+ * lazy and lock-free (contains() with `erase=true` only needs a shared lock),
+ * and an insert only ever scans the epoch flags of the shard it lands in.
+ *
+ * The shard is picked from the low bits of the first hash of the element.
+ * @ref cache maps a hash onto a table slot through its most significant bits
+ * (see compute_hashes), so the shard choice is independent of the slots an
+ * element may occupy within its shard.
+ *
+ * Unlike @ref cache, all operations except setup/setup_bytes are threadsafe.
+ *
+ * @tparam Element should be a movable and copyable type
+ * @tparam Hash should be a function/callable which takes a template parameter
+ * hash_select and an Element and extracts a hash from it.
+ * @tparam SHARDS the number of shards, must be a power of two
+ */
+template <typename Element, typename Hash, uint32_t SHARDS = 16>
+class sharded_cache
+{
+    static_assert(SHARDS > 0 && (SHARDS & (SHARDS - 1)) == 0, "sharded_cache requires a power of two number of shards");
+
+private:
+    /** Aligned so that the locks of neighbouring shards never share a cache line. */
+    struct alignas(64) shard {
+        mutable std::shared_mutex mutex;
+        cache<Element, Hash> map;
+    };
+
+    std::array<shard, SHARDS> shards;
+
+    const Hash hash_function;
+
+    inline shard& shard_for(const Element& e)
+    {
+        return shards[hash_function.template operator()<0>(e) & (SHARDS - 1)];
+    }
+
+public:
+    sharded_cache() : shards(), hash_function() {}
+
+    /** setup initializes every shard to store an equal part of new_size
+     * elements. Not threadsafe.
+     *
+     * @param new_size the desired number of elements to store
+     * @returns the maximum number of elements storable over all shards
+     */
+    uint32_t setup(uint32_t new_size)
+    {
+        uint32_t total = 0;
+        for (shard& s : shards) {
+            total += s.map.setup(new_size / SHARDS);
+        }
+        return total;
+    }
+
+    /** setup_bytes splits the byte budget evenly over all shards. Not
+     * threadsafe. See cache::setup_bytes.
+     *
+     * @param bytes the approximate number of bytes to use for this data
+     * structure
+     * @returns the maximum number of elements storable over all shards
+     */
+    uint32_t setup_bytes(size_t bytes)
+    {
+        uint32_t total = 0;
+        for (shard& s : shards) {
+            total += s.map.setup_bytes(bytes / SHARDS);
+        }
+        return total;
+    }
+
+    /** insert takes the exclusive lock of the element's shard only. See
+     * cache::insert.
+     */
+    inline void insert(Element e)
+    {
+        shard& s = shard_for(e);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        s.map.insert(std::move(e));
+    }
+
+    /** contains takes the shared lock of the element's shard only. See
+     * cache::contains.
+     */
+    inline bool contains(const Element& e, const bool erase)
+    {
+        shard& s = shard_for(e);
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        return s.map.contains(e, erase);
+    }
+
+    /** for_each calls fn on every live element of every shard, holding the
+     * shared lock of one shard at a time. See cache::for_each.
+     */
+    template <typename Fn>
+    void for_each(Fn&& fn) const
+    {
+        for (const shard& s : shards) {
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            s.map.for_each(fn);
+        }
+    }
+
+    /** @returns the number of shards */
+    static constexpr uint32_t shard_count() { return SHARDS; }
 };
 } // namespace CuckooCache
 
@@ -5,7 +5,9 @@
 #include <dbwrapper.h>
 
 #include <memory>
+#include <metrics/metrics.h>
 #include <random.h>
+#include <sync.h>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -13,6 +15,111 @@
 #include <memenv.h>
 #include <stdint.h>
 #include <algorithm>
+#include <set>
+#include <sstream>
+
+const std::vector<std::string> DB_OPTION_NAMES{"chainstate", "blockindex", "txindex", "blockfilterindex", "coinstatsindex"};
+
+//! Databases that are open, for ReportMetrics
+static Mutex g_open_dbs_mutex;
+static std::set<const CDBWrapper*> g_open_dbs GUARDED_BY(g_open_dbs_mutex);
+
+/** Split a -dbopt=<name>:<option>=<value> setting. */
+static bool SplitDBOption(const std::string& setting, std::string& name, std::string& option, std::string& value)
+{
+    const size_t colon = setting.find(':');
+    const size_t equals = setting.find('=', colon == std::string::npos ? 0 : colon);
+    if (colon == std::string::npos || equals == std::string::npos) return false;
+    name = setting.substr(0, colon);
+    option = setting.substr(colon + 1, equals - colon - 1);
+    value = setting.substr(equals + 1);
+    return true;
+}
+
+static bool ApplyDBOption(const std::string& option, const std::string& value, DBOptions& db_options)
+{
+    int64_t n;
+    if (!ParseInt64(value, &n) || n < 0) return false;
+    if (option == "blocksize") {
+        if (n < 1024 || n > 4 * 1024 * 1024) return false;
+        db_options.block_size = n;
+    } else if (option == "bloombits") {
+        if (n > 64) return false;
+        db_options.bloom_bits = n;
+    } else if (option == "writebuffer") {
+        if (n != 0 && (n < 64 * 1024 || n > 1024 * 1024 * 1024)) return false;
+        db_options.write_buffer_size = n;
+    } else if (option == "maxfilesize") {
+        if (n < 1024 * 1024 || n > 1024 * 1024 * 1024) return false;
+        db_options.max_file_size = n;
+    } else if (option == "compression") {
+        if (n > 1) return false;
+        db_options.compression = n;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool CheckDBOptions(const ArgsManager& args, std::string& error)
+{
+    for (const std::string& setting : args.GetArgs("-dbopt")) {
+        std::string name, option, value;
+        DBOptions db_options;
+        if (!SplitDBOption(setting, name, option, value)) {
+            error = strprintf("Invalid -dbopt '%s', expected <db>:<option>=<value>", setting);
+            return false;
+        }
+        if (std::find(DB_OPTION_NAMES.begin(), DB_OPTION_NAMES.end(), name) == DB_OPTION_NAMES.end()) {
+            error = strprintf("Unknown database '%s' in -dbopt '%s'", name, setting);
+            return false;
+        }
+        if (!ApplyDBOption(option, value, db_options)) {
+            error = strprintf("Unknown option or invalid value in -dbopt '%s'", setting);
+            return false;
+        }
+    }
+    return true;
+}
+
+DBOptions GetDBOptions(const ArgsManager& args, const std::string& name)
+{
+    DBOptions db_options;
+    db_options.name = name;
+    for (const std::string& setting : args.GetArgs("-dbopt")) {
+        std::string db, option, value;
+        if (SplitDBOption(setting, db, option, value) && db == name) {
+            // Invalid settings were rejected by CheckDBOptions at startup
+            ApplyDBOption(option, value, db_options);
+        }
+    }
+    return db_options;
+}
+
+std::vector<DBLevelStats> ParseDBLevelStats(const std::string& stats)
+{
+    // The table looks like
+    //                                Compactions
+    // Level  Files Size(MB) Time(sec) Read(MB) Write(MB)
+    // --------------------------------------------------
+    //   0        2        1         0        0         0
+    std::vector<DBLevelStats> levels;
+    std::istringstream lines(stats);
+    std::string line;
+    bool in_table = false;
+    while (std::getline(lines, line)) {
+        if (!in_table) {
+            in_table = line.rfind("---", 0) == 0;
+            continue;
+        }
+        std::istringstream row(line);
+        DBLevelStats level;
+        if (row >> level.level >> level.files >> level.size_mb >> level.compaction_sec >> level.compaction_read_mb >> level.compaction_write_mb) {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
 
 class CBitcoinLevelDBLogger : public leveldb::Logger {
 public:
@@ -97,13 +204,16 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+static leveldb::Options GetOptions(size_t nCacheSize, const DBOptions& db_options)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
+    // up to two write buffers may be held in memory simultaneously
+    options.write_buffer_size = db_options.write_buffer_size ? db_options.write_buffer_size : nCacheSize / 4;
+    options.block_size = db_options.block_size;
+    options.max_file_size = db_options.max_file_size;
+    options.filter_policy = db_options.bloom_bits > 0 ? leveldb::NewBloomFilterPolicy(db_options.bloom_bits) : nullptr;
+    options.compression = db_options.compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -114,16 +224,18 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
-    : m_name{path.stem().string()}
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const DBOptions& db_options)
+    : m_name{db_options.name.empty() ? path.stem().string() : db_options.name}
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, db_options);
     options.create_if_missing = true;
+    LogPrint(BCLog::LEVELDB, "LevelDB options for %s: block_size=%u, bloom_bits=%d, write_buffer_size=%u, max_file_size=%u, compression=%d\n",
+             m_name, options.block_size, db_options.bloom_bits, options.write_buffer_size, options.max_file_size, db_options.compression);
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
         options.env = penv;
@@ -164,10 +276,17 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), HexStr(obfuscate_key));
+
+    LOCK(g_open_dbs_mutex);
+    g_open_dbs.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        LOCK(g_open_dbs_mutex);
+        g_open_dbs.erase(this);
+    }
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -206,6 +325,28 @@ size_t CDBWrapper::DynamicMemoryUsage() const {
     return stoul(memory);
 }
 
+std::vector<DBLevelStats> CDBWrapper::GetLevelStats() const
+{
+    std::string stats;
+    if (!pdb->GetProperty("leveldb.stats", &stats)) {
+        LogPrint(BCLog::LEVELDB, "Failed to get stats property\n");
+        return {};
+    }
+    return ParseDBLevelStats(stats);
+}
+
+void CDBWrapper::ReportMetrics()
+{
+    auto& db_metrics = metrics::Instance()->DB();
+    LOCK(g_open_dbs_mutex);
+    for (const CDBWrapper* db : g_open_dbs) {
+        db_metrics.MemoryUsage(db->m_name, db->DynamicMemoryUsage());
+        for (const DBLevelStats& level : db->GetLevelStats()) {
+            db_metrics.Level(db->m_name, level.level, level.files, level.size_mb, level.compaction_sec, level.compaction_read_mb, level.compaction_write_mb);
+        }
+    }
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
@@ -225,6 +366,12 @@ std::vector<unsigned char> CDBWrapper::CreateObfuscateKey() const
     return ret;
 }
 
+std::shared_ptr<const leveldb::Snapshot> CDBWrapper::GetSnapshot() const
+{
+    leveldb::DB* db = pdb;
+    return {db->GetSnapshot(), [db](const leveldb::Snapshot* snapshot) { db->ReleaseSnapshot(snapshot); }};
+}
+
 bool CDBWrapper::IsEmpty()
 {
     std::unique_ptr<CDBIterator> it(NewIterator());
@@ -16,9 +16,51 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <memory>
+
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
+/**
+ * LevelDB settings of one database. The defaults are what every database used
+ * before they could be tuned; -dbopt=<name>:<option>=<value> overrides them.
+ */
+struct DBOptions {
+    //! Name of the database in -dbopt, logs and metrics, e.g. "chainstate"
+    std::string name;
+    //! Approximate size of the (uncompressed) data in a table block
+    size_t block_size{4 * 1024};
+    //! Bits per key of the bloom filters, 0 for no filters
+    int bloom_bits{10};
+    //! Size of the memtable, 0 for a quarter of the cache size
+    size_t write_buffer_size{0};
+    //! Target size of table files
+    size_t max_file_size{2 * 1024 * 1024};
+    //! Compress table blocks with snappy, if LevelDB was built with it
+    bool compression{false};
+};
+
+/** Databases that can be tuned with -dbopt */
+extern const std::vector<std::string> DB_OPTION_NAMES;
+
+/** Check that every -dbopt setting names a known database, option and valid value. */
+bool CheckDBOptions(const ArgsManager& args, std::string& error);
+/** The options of the database called name, with its -dbopt settings applied */
+DBOptions GetDBOptions(const ArgsManager& args, const std::string& name);
+
+/** One row of the compaction table of the leveldb.stats property */
+struct DBLevelStats {
+    int level{0};
+    int files{0};
+    double size_mb{0};
+    double compaction_sec{0};
+    double compaction_read_mb{0};
+    double compaction_write_mb{0};
+};
+
+/** Parse the leveldb.stats property. Levels that never had a file are omitted by LevelDB. */
+std::vector<DBLevelStats> ParseDBLevelStats(const std::string& stats);
+
 class dbwrapper_error : public std::runtime_error
 {
 public:
@@ -220,23 +262,26 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] db_options  LevelDB tuning, see GetDBOptions.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const DBOptions& db_options = {});
     ~CDBWrapper();
 
     CDBWrapper(const CDBWrapper&) = delete;
     CDBWrapper& operator=(const CDBWrapper&) = delete;
 
     template <typename K, typename V>
-    bool Read(const K& key, V& value) const
+    bool Read(const K& key, V& value, const leveldb::Snapshot* snapshot = nullptr) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey((const char*)ssKey.data(), ssKey.size());
 
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot;
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -293,9 +338,22 @@ public:
     // Get an estimate of LevelDB memory usage (in bytes).
     size_t DynamicMemoryUsage() const;
 
-    CDBIterator *NewIterator()
+    //! Per level file counts, sizes and compaction work of LevelDB
+    std::vector<DBLevelStats> GetLevelStats() const;
+
+    const std::string& GetName() const { return m_name; }
+
+    /** Report memory usage and level stats of all open databases to the metrics. */
+    static void ReportMetrics();
+
+    /** A consistent state of the database for NewIterator(), released with its last reference. */
+    std::shared_ptr<const leveldb::Snapshot> GetSnapshot() const;
+
+    CDBIterator *NewIterator(const leveldb::Snapshot* snapshot = nullptr)
     {
-        return new CDBIterator(*this, pdb->NewIterator(iteroptions));
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
     }
 
     /**
@@ -0,0 +1,676 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <flatcoins.h>
+
+#include <clientversion.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <logging.h>
+#include <memusage.h>
+#include <span.h>
+#include <streams.h>
+#include <tinyformat.h>
+#include <util/system.h>
+#include <util/time.h>
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+static_assert(256 % FLAT_COINS_PARTITIONS == 0, "partitions must split the first txid byte evenly");
+
+namespace {
+//! Length field in front of every record
+constexpr size_t RECORD_HEADER_SIZE{4};
+//! txid, output index and unspent flag at the start of every record
+constexpr size_t RECORD_KEY_SIZE{32 + 4 + 1};
+//! Limits of the fields of CCoinsViewFlatFile::Location
+constexpr uint64_t MAX_RECORD_POS{(uint64_t{1} << 40) - 1};
+constexpr uint64_t MAX_RECORD_SIZE{(uint64_t{1} << 24) - 1};
+//! Partitions are read sequentially in chunks of this size
+constexpr size_t SCAN_CHUNK_SIZE{4 << 20};
+//! Partitions are only compacted once they are this large and mostly dead
+constexpr uint64_t COMPACT_MIN_SIZE{16 << 20};
+
+constexpr uint32_t MANIFEST_VERSION{1};
+const char* const MANIFEST_NAME{"coins.manifest"};
+} // namespace
+
+[[noreturn]] static void FlatCoinsError(const std::string& message)
+{
+    const std::string errmsg = "Fatal flat file chainstate error: " + message;
+    LogPrintf("%s\n", errmsg);
+    throw std::runtime_error(errmsg);
+}
+
+static fs::path PartitionPath(const fs::path& dir, size_t partition, uint32_t generation)
+{
+    return dir / strprintf("coins%02u_%u.dat", partition, generation);
+}
+
+class CCoinsViewFlatFile::PartitionFile
+{
+private:
+    Mutex m_mutex;
+    FILE* m_file GUARDED_BY(m_mutex);
+    //! Length of the data appended so far
+    uint64_t m_size GUARDED_BY(m_mutex);
+    //! Whether a newer generation replaced this file, which is then removed once unused
+    std::atomic<bool> m_obsolete{false};
+
+public:
+    const fs::path m_path;
+    const uint32_t m_generation;
+
+    PartitionFile(fs::path path, uint32_t generation, uint64_t size) : m_size{size}, m_path{std::move(path)}, m_generation{generation}
+    {
+        m_file = fsbridge::fopen(m_path, "rb+");
+        if (!m_file) m_file = fsbridge::fopen(m_path, "wb+");
+        if (!m_file) FlatCoinsError(strprintf("Unable to open %s", m_path.string()));
+    }
+
+    ~PartitionFile()
+    {
+        fclose(m_file);
+        if (m_obsolete) {
+            try {
+                fs::remove(m_path);
+            } catch (const fs::filesystem_error& e) {
+                LogPrintf("Unable to remove %s: %s\n", m_path.string(), fsbridge::get_filesystem_error_message(e));
+            }
+        }
+    }
+
+    PartitionFile(const PartitionFile&) = delete;
+    PartitionFile& operator=(const PartitionFile&) = delete;
+
+    uint64_t Size()
+    {
+        LOCK(m_mutex);
+        return m_size;
+    }
+
+    void Read(uint64_t pos, size_t size, std::vector<uint8_t>& out)
+    {
+        out.resize(size);
+        LOCK(m_mutex);
+        if (pos + size > m_size || !FileSeek(m_file, pos) || fread(out.data(), 1, size, m_file) != size) {
+            FlatCoinsError(strprintf("Unable to read %u bytes at %u from %s", size, pos, m_path.string()));
+        }
+    }
+
+    //! Append data and return its position
+    uint64_t Append(Span<const uint8_t> data)
+    {
+        LOCK(m_mutex);
+        if (!FileSeek(m_file, m_size) || fwrite(data.data(), 1, data.size(), m_file) != data.size()) {
+            FlatCoinsError(strprintf("Unable to append %u bytes to %s", data.size(), m_path.string()));
+        }
+        const uint64_t pos = m_size;
+        m_size += data.size();
+        return pos;
+    }
+
+    void Commit()
+    {
+        LOCK(m_mutex);
+        if (!FileCommit(m_file)) FlatCoinsError(strprintf("Unable to sync %s", m_path.string()));
+    }
+
+    void MarkObsolete() { m_obsolete = true; }
+};
+
+/** Append the record of outpoint, a tombstone if coin is nullptr, to buf. */
+static void AppendRecord(std::vector<uint8_t>& buf, const COutPoint& outpoint, const Coin* coin)
+{
+    const size_t start = buf.size();
+    buf.resize(start + RECORD_HEADER_SIZE + RECORD_KEY_SIZE);
+    uint8_t* key = buf.data() + start + RECORD_HEADER_SIZE;
+    std::copy(outpoint.hash.begin(), outpoint.hash.end(), key);
+    WriteLE32(key + 32, outpoint.n);
+    key[36] = coin != nullptr;
+    if (coin) {
+        CVectorWriter writer(SER_DISK, CLIENT_VERSION, buf, buf.size());
+        writer << *coin;
+    }
+    if (buf.size() - start > MAX_RECORD_SIZE) {
+        FlatCoinsError(strprintf("Coin %s is too large", outpoint.ToString()));
+    }
+    WriteLE32(buf.data() + start, buf.size() - start - RECORD_HEADER_SIZE);
+}
+
+static bool ParseRecordKey(Span<const uint8_t> body, COutPoint& outpoint, bool& unspent)
+{
+    if (body.size() < RECORD_KEY_SIZE || body[36] > 1) return false;
+    std::copy(body.begin(), body.begin() + 32, outpoint.hash.begin());
+    outpoint.n = ReadLE32(body.data() + 32);
+    unspent = body[36];
+    return unspent || body.size() == RECORD_KEY_SIZE;
+}
+
+static CCoinsViewFlatFile::Location MakeLocation(uint64_t pos, uint64_t size)
+{
+    if (pos > MAX_RECORD_POS) FlatCoinsError("Partition file too large");
+    CCoinsViewFlatFile::Location location;
+    location.pos = pos;
+    location.size = size;
+    return location;
+}
+
+/**
+ * Call fn(outpoint, unspent, pos, record) for every record of file before
+ * end, in order. Records are read in large chunks, not one at a time.
+ */
+template <typename F>
+static void ScanRecords(CCoinsViewFlatFile::PartitionFile& file, uint64_t end, F fn)
+{
+    std::vector<uint8_t> chunk;
+    uint64_t pos{0};
+    size_t want{SCAN_CHUNK_SIZE};
+    while (pos < end) {
+        file.Read(pos, std::min<uint64_t>(want, end - pos), chunk);
+        size_t offset{0};
+        while (offset + RECORD_HEADER_SIZE <= chunk.size()) {
+            const size_t size = RECORD_HEADER_SIZE + ReadLE32(chunk.data() + offset);
+            if (offset + size > chunk.size()) break;
+            const Span<const uint8_t> record{chunk.data() + offset, size};
+            COutPoint outpoint;
+            bool unspent;
+            if (!ParseRecordKey(record.subspan(RECORD_HEADER_SIZE), outpoint, unspent)) {
+                FlatCoinsError(strprintf("Corrupt record at %u in %s", pos + offset, file.m_path.string()));
+            }
+            fn(outpoint, unspent, pos + offset, record);
+            offset += size;
+        }
+        if (offset == 0) {
+            // The next record does not fit in the chunk: read it whole, unless it is cut off.
+            const uint64_t size = chunk.size() < RECORD_HEADER_SIZE ? end : RECORD_HEADER_SIZE + ReadLE32(chunk.data());
+            if (pos + size > end || size <= want) {
+                FlatCoinsError(strprintf("Truncated record at %u in %s", pos, file.m_path.string()));
+            }
+            want = size;
+            continue;
+        }
+        pos += offset;
+        want = SCAN_CHUNK_SIZE;
+    }
+}
+
+/** Read the coin of outpoint from the record at location. */
+static void ReadCoin(CCoinsViewFlatFile::PartitionFile& file, const COutPoint& outpoint, CCoinsViewFlatFile::Location location, Coin& coin)
+{
+    std::vector<uint8_t> record;
+    file.Read(location.pos, location.size, record);
+    COutPoint key;
+    bool unspent;
+    if (ReadLE32(record.data()) + RECORD_HEADER_SIZE != record.size() ||
+        !ParseRecordKey(Span<const uint8_t>{record}.subspan(RECORD_HEADER_SIZE), key, unspent) || !unspent || key != outpoint) {
+        FlatCoinsError(strprintf("Corrupt record of %s at %u in %s", outpoint.ToString(), location.pos, file.m_path.string()));
+    }
+    CDataStream stream(Span<const uint8_t>{record}.subspan(RECORD_HEADER_SIZE + RECORD_KEY_SIZE), SER_DISK, CLIENT_VERSION);
+    stream >> coin;
+}
+
+/**
+ * The coins of a snapshot, sorted one partition at a time, shared by the
+ * cursors over its key ranges. A partition is only read once when several
+ * ranges lie in it, and forgotten once all of them are done with it.
+ */
+class FlatCoinsSortedPartitions
+{
+public:
+    using Snapshot = CCoinsViewFlatFile::Snapshot;
+    using Coins = std::vector<std::pair<COutPoint, CCoinsViewFlatFile::Location>>;
+
+    //! users: the number of cursors that will Release() each partition
+    FlatCoinsSortedPartitions(Snapshot snapshot, const std::vector<size_t>& users)
+        : m_snapshot(std::move(snapshot)), m_entries(m_snapshot.size())
+    {
+        for (size_t i = 0; i < m_entries.size(); ++i) {
+            WITH_LOCK(m_entries[i].cs, m_entries[i].users = users[i]);
+        }
+    }
+
+    CCoinsViewFlatFile::PartitionFile& GetFile(size_t partition) const { return *m_snapshot[partition].first; }
+
+    //! The coins of a partition, in LevelDB key order
+    std::shared_ptr<const Coins> Get(size_t partition)
+    {
+        Entry& entry = m_entries[partition];
+        LOCK(entry.cs);
+        if (!entry.coins) entry.coins = Load(partition);
+        return entry.coins;
+    }
+
+    void Release(size_t partition)
+    {
+        Entry& entry = m_entries[partition];
+        LOCK(entry.cs);
+        if (--entry.users == 0) entry.coins.reset();
+    }
+
+private:
+    struct Entry {
+        Mutex cs;
+        size_t users GUARDED_BY(cs);
+        std::shared_ptr<const Coins> coins GUARDED_BY(cs);
+    };
+
+    const Snapshot m_snapshot;
+    std::vector<Entry> m_entries;
+
+    std::shared_ptr<const Coins> Load(size_t partition) const
+    {
+        std::unordered_map<COutPoint, CCoinsViewFlatFile::Location, SaltedOutpointHasher> index;
+        ScanRecords(*m_snapshot[partition].first, m_snapshot[partition].second,
+                    [&](const COutPoint& outpoint, bool unspent, uint64_t pos, Span<const uint8_t> record) {
+            if (unspent) {
+                index[outpoint] = MakeLocation(pos, record.size());
+            } else {
+                index.erase(outpoint);
+            }
+        });
+        auto coins = std::make_shared<Coins>(index.begin(), index.end());
+        std::sort(coins->begin(), coins->end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        return coins;
+    }
+};
+
+/** A key range of a snapshot of the coins as of the last commit, read one partition at a time. */
+class CCoinsViewFlatFileCursor : public CCoinsViewCursor
+{
+public:
+    //! Cursor over the coins whose txid starts with a byte in [begin, end)
+    CCoinsViewFlatFileCursor(const uint256& best_block, std::shared_ptr<FlatCoinsSortedPartitions> partitions, unsigned int begin, unsigned int end)
+        : CCoinsViewCursor(best_block), m_partitions(std::move(partitions)), m_begin(begin), m_end(end),
+          m_partition(FirstPartition(begin)), m_last_partition(FirstPartition(end - 1)) {}
+
+    ~CCoinsViewFlatFileCursor()
+    {
+        for (; m_partition <= m_last_partition; ++m_partition) {
+            m_partitions->Release(m_partition);
+        }
+    }
+
+    static size_t FirstPartition(unsigned int byte) { return byte * FLAT_COINS_PARTITIONS / 256; }
+
+    bool GetKey(COutPoint& key) const override
+    {
+        if (!Valid()) return false;
+        key = (*m_coins)[m_pos].first;
+        return true;
+    }
+
+    bool GetValue(Coin& coin) const override
+    {
+        if (!Valid()) return false;
+        ReadCoin(m_partitions->GetFile(m_partition), (*m_coins)[m_pos].first, (*m_coins)[m_pos].second, coin);
+        return true;
+    }
+
+    unsigned int GetValueSize() const override
+    {
+        return Valid() ? (*m_coins)[m_pos].second.size : 0;
+    }
+
+    bool Valid() const override
+    {
+        if (!m_loaded) {
+            LoadNextPartition();
+            m_loaded = true;
+        }
+        return m_pos < m_end_pos;
+    }
+
+    void Next() override
+    {
+        if (!Valid()) return;
+        if (++m_pos == m_end_pos) {
+            m_coins.reset();
+            m_partitions->Release(m_partition++);
+            LoadNextPartition();
+        }
+    }
+
+private:
+    const std::shared_ptr<FlatCoinsSortedPartitions> m_partitions;
+    const unsigned int m_begin;
+    const unsigned int m_end;
+    // Partitions are only read once the cursor is used, so that creating one is cheap.
+    mutable bool m_loaded{false};
+    //! Partition m_coins belongs to. The cursor is done with the ones before it.
+    mutable size_t m_partition;
+    const size_t m_last_partition;
+    mutable std::shared_ptr<const FlatCoinsSortedPartitions::Coins> m_coins;
+    //! Position in m_coins, and end of the cursor's range in it
+    mutable size_t m_pos{0};
+    mutable size_t m_end_pos{0};
+
+    static size_t LowerBound(const FlatCoinsSortedPartitions::Coins& coins, unsigned int byte)
+    {
+        if (byte == 256) return coins.size();
+        COutPoint start(uint256(), 0);
+        *start.hash.begin() = byte;
+        return std::lower_bound(coins.begin(), coins.end(), start, [](const auto& a, const COutPoint& b) { return a.first < b; }) - coins.begin();
+    }
+
+    void LoadNextPartition() const
+    {
+        m_pos = m_end_pos = 0;
+        for (; m_partition <= m_last_partition; ++m_partition) {
+            m_coins = m_partitions->Get(m_partition);
+            m_pos = LowerBound(*m_coins, m_begin);
+            m_end_pos = LowerBound(*m_coins, m_end);
+            if (m_pos < m_end_pos) return;
+            m_coins.reset();
+            m_partitions->Release(m_partition);
+        }
+        m_pos = m_end_pos = 0;
+    }
+};
+
+CCoinsViewFlatFile::CCoinsViewFlatFile(fs::path dir, bool wipe) : m_dir(std::move(dir))
+{
+    if (wipe) {
+        LogPrintf("Wiping flat file chainstate in %s\n", m_dir.string());
+        fs::remove_all(m_dir);
+    }
+    TryCreateDirectories(m_dir);
+    LogPrintf("Opening flat file chainstate in %s\n", m_dir.string());
+
+    // Read the manifest, if the directory is not new
+    std::array<std::pair<uint32_t, uint64_t>, FLAT_COINS_PARTITIONS> committed{};
+    uint256 best_block;
+    if (fs::exists(m_dir / MANIFEST_NAME)) {
+        CAutoFile file(fsbridge::fopen(m_dir / MANIFEST_NAME, "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) FlatCoinsError("Unable to open manifest");
+        try {
+            std::vector<uint8_t> data;
+            uint256 checksum;
+            file >> data >> checksum;
+            if (Hash(data) != checksum) FlatCoinsError("Manifest checksum mismatch");
+            CDataStream manifest(data, SER_DISK, CLIENT_VERSION);
+            uint32_t version;
+            manifest >> version;
+            if (version != MANIFEST_VERSION) FlatCoinsError(strprintf("Unknown manifest version %u", version));
+            manifest >> best_block;
+            for (auto& [generation, size] : committed) manifest >> generation >> size;
+        } catch (const std::ios_base::failure& e) {
+            FlatCoinsError(strprintf("Unable to read manifest: %s", e.what()));
+        }
+    }
+
+    // Remove the files of interrupted compactions, and the data of an interrupted BatchWrite.
+    for (fs::directory_iterator it(m_dir); it != fs::directory_iterator(); ++it) {
+        const std::string name = it->path().filename().string();
+        if (name.rfind("coins", 0) != 0 || it->path().extension() != ".dat") continue;
+        bool current = false;
+        for (size_t i = 0; i < FLAT_COINS_PARTITIONS; ++i) {
+            current |= it->path() == PartitionPath(m_dir, i, committed[i].first);
+        }
+        if (!current) {
+            LogPrintf("Removing stale chainstate file %s\n", name);
+            fs::remove(it->path());
+        }
+    }
+    for (size_t i = 0; i < FLAT_COINS_PARTITIONS; ++i) {
+        const auto [generation, size] = committed[i];
+        const fs::path path = PartitionPath(m_dir, i, generation);
+        const uint64_t file_size = fs::exists(path) ? fs::file_size(path) : 0;
+        if (file_size < size) {
+            FlatCoinsError(strprintf("%s is shorter than its committed size %u", path.string(), size));
+        }
+        if (file_size > size) {
+            LogPrintf("Discarding %u uncommitted bytes of %s\n", file_size - size, path.filename().string());
+            fs::resize_file(path, size);
+        }
+        LOCK(m_partitions[i].cs);
+        m_partitions[i].file = std::make_shared<PartitionFile>(path, generation, size);
+    }
+
+    // Replay the partitions into the index. They are independent, so do them in parallel.
+    const int64_t start = GetTimeMillis();
+    std::vector<std::exception_ptr> errors(FLAT_COINS_PARTITIONS);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < FLAT_COINS_PARTITIONS; ++i) {
+        threads.emplace_back([this, i, &errors] {
+            try {
+                LoadPartition(m_partitions[i]);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    for (const std::exception_ptr& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    size_t coins{0};
+    for (Partition& partition : m_partitions) coins += WITH_LOCK(partition.cs, return partition.index.size());
+    LogPrintf("Loaded %u coins from %.1f MiB of chainstate files in %dms, index uses %.1f MiB\n",
+              coins, GetFileSize() * (1.0 / 1024 / 1024), GetTimeMillis() - start, DynamicMemoryUsage() * (1.0 / 1024 / 1024));
+
+    WriteManifest(best_block);
+}
+
+CCoinsViewFlatFile::~CCoinsViewFlatFile() = default;
+
+CCoinsViewFlatFile::Partition& CCoinsViewFlatFile::GetPartition(const COutPoint& outpoint) const
+{
+    return m_partitions[*outpoint.hash.begin() * FLAT_COINS_PARTITIONS / 256];
+}
+
+void CCoinsViewFlatFile::LoadPartition(Partition& partition) const
+{
+    LOCK(partition.cs);
+    ScanRecords(*partition.file, partition.file->Size(),
+                [&](const COutPoint& outpoint, bool unspent, uint64_t pos, Span<const uint8_t> record) {
+        const auto [it, inserted] = partition.index.try_emplace(outpoint);
+        if (!inserted) partition.live_bytes -= it->second.size;
+        if (unspent) {
+            it->second = MakeLocation(pos, record.size());
+            partition.live_bytes += record.size();
+        } else {
+            partition.index.erase(it);
+        }
+    });
+}
+
+void CCoinsViewFlatFile::WriteManifest(const uint256& best_block)
+{
+    Snapshot snapshot;
+    CDataStream manifest(SER_DISK, CLIENT_VERSION);
+    manifest << MANIFEST_VERSION << best_block;
+    for (Partition& partition : m_partitions) {
+        LOCK(partition.cs);
+        snapshot.emplace_back(partition.file, partition.file->Size());
+        manifest << partition.file->m_generation << snapshot.back().second;
+    }
+    const std::vector<uint8_t> data(manifest.begin(), manifest.end());
+
+    const fs::path tmp_path = m_dir / (std::string{MANIFEST_NAME} + ".new");
+    {
+        CAutoFile file(fsbridge::fopen(tmp_path, "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) FlatCoinsError("Unable to create manifest");
+        file << data << Hash(data);
+        if (!FileCommit(file.Get())) FlatCoinsError("Unable to sync manifest");
+    }
+    if (!RenameOver(tmp_path, m_dir / MANIFEST_NAME)) FlatCoinsError("Unable to replace manifest");
+    DirectoryCommit(m_dir);
+
+    LOCK(m_manifest_mutex);
+    m_best_block = best_block;
+    m_committed = std::move(snapshot);
+}
+
+bool CCoinsViewFlatFile::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    Partition& partition = GetPartition(outpoint);
+    LOCK(partition.cs);
+    const auto it = partition.index.find(outpoint);
+    if (it == partition.index.end()) return false;
+    ReadCoin(*partition.file, outpoint, it->second, coin);
+    return true;
+}
+
+bool CCoinsViewFlatFile::HaveCoin(const COutPoint& outpoint) const
+{
+    Partition& partition = GetPartition(outpoint);
+    LOCK(partition.cs);
+    return partition.index.count(outpoint);
+}
+
+uint256 CCoinsViewFlatFile::GetBestBlock() const
+{
+    LOCK(m_manifest_mutex);
+    return m_best_block;
+}
+
+bool CCoinsViewFlatFile::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    assert(!hashBlock.IsNull());
+    std::array<std::vector<CCoinsMap::const_iterator>, FLAT_COINS_PARTITIONS> dirty;
+    for (auto it = mapCoins.cbegin(); it != mapCoins.cend(); ++it) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            dirty[*it->first.hash.begin() * FLAT_COINS_PARTITIONS / 256].push_back(it);
+        }
+    }
+
+    size_t changed{0};
+    std::vector<uint8_t> buf;
+    for (size_t i = 0; i < FLAT_COINS_PARTITIONS; ++i) {
+        if (dirty[i].empty()) continue;
+        Partition& partition = m_partitions[i];
+        LOCK(partition.cs);
+        const uint64_t start = partition.file->Size();
+        buf.clear();
+        for (const CCoinsMap::const_iterator& it : dirty[i]) {
+            const Coin& coin = it->second.coin;
+            const auto entry = partition.index.find(it->first);
+            // Coins that were created and spent since the last flush never reached the files.
+            if (coin.IsSpent() && entry == partition.index.end()) continue;
+            const size_t offset = buf.size();
+            AppendRecord(buf, it->first, coin.IsSpent() ? nullptr : &coin);
+            ++changed;
+            if (entry != partition.index.end()) partition.live_bytes -= entry->second.size;
+            if (coin.IsSpent()) {
+                partition.index.erase(entry);
+                continue;
+            }
+            const Location location = MakeLocation(start + offset, buf.size() - offset);
+            if (entry != partition.index.end()) {
+                entry->second = location;
+            } else {
+                partition.index.emplace(it->first, location);
+            }
+            partition.live_bytes += location.size;
+        }
+        partition.file->Append(buf);
+        partition.file->Commit();
+    }
+    WriteManifest(hashBlock);
+
+    // Compact after the commit, so that the rewritten files only contain committed data.
+    std::vector<std::shared_ptr<PartitionFile>> replaced;
+    for (Partition& partition : m_partitions) {
+        if (auto old_file = MaybeCompact(partition)) replaced.push_back(std::move(old_file));
+    }
+    if (!replaced.empty()) {
+        WriteManifest(hashBlock);
+        // Cursors may still hold on to the replaced files, which are removed when the last one is done.
+        for (const auto& file : replaced) file->MarkObsolete();
+    }
+
+    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to chainstate files...\n", changed, mapCoins.size());
+    mapCoins.clear();
+    return true;
+}
+
+std::shared_ptr<CCoinsViewFlatFile::PartitionFile> CCoinsViewFlatFile::MaybeCompact(Partition& partition)
+{
+    LOCK(partition.cs);
+    const std::shared_ptr<PartitionFile> old_file = partition.file;
+    const uint64_t size = old_file->Size();
+    if (size < COMPACT_MIN_SIZE || partition.live_bytes * 2 > size) return nullptr;
+
+    const size_t i = &partition - m_partitions.data();
+    const uint32_t generation = old_file->m_generation + 1;
+    LogPrint(BCLog::COINDB, "Compacting chainstate partition %u: %.1f of %.1f MiB in use\n",
+             i, partition.live_bytes * (1.0 / 1024 / 1024), size * (1.0 / 1024 / 1024));
+    const fs::path path = PartitionPath(m_dir, i, generation);
+    fs::remove(path);
+    auto new_file = std::make_shared<PartitionFile>(path, generation, 0);
+
+    // Copy the live records in file order, which keeps the coins of a transaction together.
+    std::vector<uint8_t> buf;
+    ScanRecords(*old_file, size, [&](const COutPoint& outpoint, bool unspent, uint64_t pos, Span<const uint8_t> record) {
+        const auto it = partition.index.find(outpoint);
+        if (it == partition.index.end() || it->second.pos != pos) return;
+        it->second.pos = new_file->Size() + buf.size();
+        buf.insert(buf.end(), record.begin(), record.end());
+        if (buf.size() >= SCAN_CHUNK_SIZE) {
+            new_file->Append(buf);
+            buf.clear();
+        }
+    });
+    new_file->Append(buf);
+    new_file->Commit();
+    assert(new_file->Size() == partition.live_bytes);
+    partition.file = std::move(new_file);
+    return old_file;
+}
+
+std::unique_ptr<CCoinsViewCursor> CCoinsViewFlatFile::Cursor() const
+{
+    return std::move(RangeCursors(1).front());
+}
+
+std::vector<std::unique_ptr<CCoinsViewCursor>> CCoinsViewFlatFile::RangeCursors(size_t n) const
+{
+    assert(n >= 1 && n <= 256);
+    uint256 best_block;
+    Snapshot snapshot;
+    {
+        LOCK(m_manifest_mutex);
+        best_block = m_best_block;
+        snapshot = m_committed;
+    }
+    std::vector<size_t> users(snapshot.size(), 0);
+    for (size_t range = 0; range < n; ++range) {
+        const size_t last_partition{CCoinsViewFlatFileCursor::FirstPartition((range + 1) * 256 / n - 1)};
+        for (size_t i = CCoinsViewFlatFileCursor::FirstPartition(range * 256 / n); i <= last_partition; ++i) {
+            ++users[i];
+        }
+    }
+    const auto partitions = std::make_shared<FlatCoinsSortedPartitions>(std::move(snapshot), users);
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    for (size_t range = 0; range < n; ++range) {
+        cursors.push_back(std::make_unique<CCoinsViewFlatFileCursor>(best_block, partitions, range * 256 / n, (range + 1) * 256 / n));
+    }
+    return cursors;
+}
+
+size_t CCoinsViewFlatFile::EstimateSize() const
+{
+    size_t size{0};
+    for (Partition& partition : m_partitions) size += WITH_LOCK(partition.cs, return partition.live_bytes);
+    return size;
+}
+
+size_t CCoinsViewFlatFile::DynamicMemoryUsage() const
+{
+    size_t usage{0};
+    for (Partition& partition : m_partitions) usage += WITH_LOCK(partition.cs, return memusage::DynamicUsage(partition.index));
+    return usage;
+}
+
+uint64_t CCoinsViewFlatFile::GetFileSize() const
+{
+    uint64_t size{0};
+    for (Partition& partition : m_partitions) size += WITH_LOCK(partition.cs, return partition.file->Size());
+    return size;
+}
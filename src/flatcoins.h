@@ -0,0 +1,109 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATCOINS_H
+#define BITCOIN_FLATCOINS_H
+
+#include <coins.h>
+#include <fs.h>
+#include <sync.h>
+#include <txdb.h>
+#include <uint256.h>
+#include <util/hasher.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+//! Number of files the coins are split over, by the top bits of the first txid byte
+static constexpr size_t FLAT_COINS_PARTITIONS{16};
+
+/**
+ * CCoinsView backed by append-only flat files (chainstate_flat/).
+ *
+ * Coins are split over FLAT_COINS_PARTITIONS files by the leading bits of
+ * their txid, so every partition holds a contiguous range of the LevelDB key
+ * order. Each file is a log of records
+ *
+ *     uint32 length | txid | uint32 n | uint8 unspent | Coin (if unspent)
+ *
+ * and an in-memory index maps every unspent outpoint to the position of its
+ * latest record, so a lookup costs at most one read. A BatchWrite appends to
+ * the partitions, syncs them and then atomically replaces the manifest, which
+ * records the best block and the committed length of every partition. Data
+ * past the committed length is discarded on open, so a BatchWrite is never
+ * seen half done and GetHeadBlocks() is always empty.
+ *
+ * Partitions in which most bytes belong to overwritten or spent coins are
+ * rewritten to a new generation of their file. Cursors only remember the
+ * files and their committed lengths, which makes them cheap, consistent
+ * snapshots: the records they need are never modified, and a replaced file
+ * is only deleted once no cursor uses it anymore.
+ */
+class CCoinsViewFlatFile final : public CCoinsViewDisk
+{
+public:
+    /** A file of a partition. Shared between the view and its cursors. */
+    class PartitionFile;
+
+    //! Position and total size of the latest record of an unspent coin
+    struct Location {
+        uint64_t pos : 40;
+        uint64_t size : 24;
+    };
+
+    //! Files and committed lengths of all partitions
+    using Snapshot = std::vector<std::pair<std::shared_ptr<PartitionFile>, uint64_t>>;
+
+private:
+    struct Partition {
+        mutable Mutex cs;
+        std::unordered_map<COutPoint, Location, SaltedOutpointHasher> index GUARDED_BY(cs);
+        std::shared_ptr<PartitionFile> file GUARDED_BY(cs);
+        //! Total size of the records index points to
+        uint64_t live_bytes GUARDED_BY(cs){0};
+    };
+
+    const fs::path m_dir;
+    mutable std::array<Partition, FLAT_COINS_PARTITIONS> m_partitions;
+
+    mutable Mutex m_manifest_mutex;
+    uint256 m_best_block GUARDED_BY(m_manifest_mutex);
+    //! The state the manifest describes, which is what cursors see
+    Snapshot m_committed GUARDED_BY(m_manifest_mutex);
+
+    Partition& GetPartition(const COutPoint& outpoint) const;
+    //! Replay a partition's records into its index
+    void LoadPartition(Partition& partition) const;
+    //! Write the best block and the generation and length of all partitions
+    void WriteManifest(const uint256& best_block);
+    //! Rewrite a partition without its dead records if it is mostly dead. Returns the replaced file.
+    std::shared_ptr<PartitionFile> MaybeCompact(Partition& partition);
+
+public:
+    /**
+     * @param[in] dir   Directory of the partition files and manifest
+     * @param[in] wipe  If true, remove all existing data.
+     */
+    CCoinsViewFlatFile(fs::path dir, bool wipe);
+    ~CCoinsViewFlatFile();
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
+    bool HaveCoin(const COutPoint& outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override;
+    std::unique_ptr<CCoinsViewCursor> Cursor() const override;
+    std::vector<std::unique_ptr<CCoinsViewCursor>> RangeCursors(size_t n) const override;
+    //! Total size of the records of unspent coins
+    size_t EstimateSize() const override;
+
+    //! Memory used by the outpoint index
+    size_t DynamicMemoryUsage() const;
+    //! Size of all partition files, including dead records
+    uint64_t GetFileSize() const;
+};
+
+#endif // BITCOIN_FLATCOINS_H
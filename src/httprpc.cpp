@@ -7,6 +7,7 @@
 #include <chainparams.h>
 #include <crypto/hmac_sha256.h>
 #include <httpserver.h>
+#include <rpc/json.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
 #include <util/strencodings.h>
@@ -144,6 +145,51 @@ static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUserna
     return multiUserAuthorized(strUserPass);
 }
 
+//! Methods that can keep a worker busy for seconds or more. They are queued
+//! in the expensive lane, so that they do not hold up other calls.
+static const std::set<std::string> EXPENSIVE_RPC_METHODS{
+    "dumptxoutset",
+    "dumpwallet",
+    "gettxoutsetinfo",
+    "importaddress",
+    "importdescriptors",
+    "importmulti",
+    "importprivkey",
+    "importpubkey",
+    "importwallet",
+    "rescanblockchain",
+    "savemempool",
+    "scantxoutset",
+    "verifychain",
+    "waitforblock",
+    "waitforblockheight",
+    "waitfornewblock",
+};
+
+//! Requests are classified before they are parsed, looking only this far into the body
+static constexpr size_t MAX_CLASSIFIED_BODY_SIZE{64 * 1024};
+
+/** Queue a request in the expensive lane if it calls an expensive method.
+ * The body is scanned for "method" members rather than parsed, as this runs
+ * on the HTTP event loop thread.
+ */
+static HTTPWorkLane ClassifyJSONRPC(HTTPRequest* req)
+{
+    const std::string body = req->PeekBody(MAX_CLASSIFIED_BODY_SIZE);
+    static constexpr const char* SPACE = " \t\r\n";
+    for (size_t pos = body.find("\"method\""); pos != std::string::npos; pos = body.find("\"method\"", pos)) {
+        pos = body.find_first_not_of(SPACE, pos + 8);
+        if (pos == std::string::npos || body[pos] != ':') continue;
+        pos = body.find_first_not_of(SPACE, pos + 1);
+        if (pos == std::string::npos || body[pos] != '"') continue;
+        const size_t end = body.find('"', pos + 1);
+        if (end == std::string::npos) break;
+        if (EXPENSIVE_RPC_METHODS.count(body.substr(pos + 1, end - pos - 1))) return HTTPWorkLane::EXPENSIVE;
+        pos = end;
+    }
+    return HTTPWorkLane::CHEAP;
+}
+
 static bool HTTPReq_JSONRPC(const std::any& context, HTTPRequest* req)
 {
     // JSONRPC handles only POST
@@ -178,7 +224,7 @@ static bool HTTPReq_JSONRPC(const std::any& context, HTTPRequest* req)
     try {
         // Parse request
         UniValue valRequest;
-        if (!valRequest.read(req->ReadBody()))
+        if (!ParseJSON(req->ReadBody(), valRequest))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
         // Set the URI
@@ -199,10 +245,41 @@ static bool HTTPReq_JSONRPC(const std::any& context, HTTPRequest* req)
                 req->WriteReply(HTTP_FORBIDDEN);
                 return false;
             }
-            UniValue result = tableRPC.execute(jreq);
+            // A method may stream a large result, which is then sent in
+            // chunks while it is written
+            bool reply_started{false};
+            JSONStreamWriter result_stream([&](std::string&& chunk) {
+                if (!reply_started) {
+                    req->WriteHeader("Content-Type", "application/json");
+                    req->StartReply(HTTP_OK);
+                    reply_started = true;
+                    chunk.insert(0, "{\"result\":");
+                }
+                if (!req->WriteReplyChunk(std::move(chunk))) {
+                    throw std::runtime_error("Client stopped receiving the reply");
+                }
+            });
+            jreq.result_stream = &result_stream;
+            try {
+                UniValue result = tableRPC.execute(jreq);
+                if (!result_stream.empty()) {
+                    result_stream.Flush();
+                    req->WriteReplyChunk(",\"error\":null,\"id\":" + jreq.id.write() + "}\n");
+                    req->EndReply();
+                    return true;
+                }
 
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+                // Send reply
+                strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            } catch (...) {
+                // Errors cannot be replied anymore once a result is being sent
+                if (reply_started) {
+                    LogPrintf("RPC %s stopped while its result was sent\n", SanitizeString(jreq.strMethod));
+                    req->EndReply();
+                    return false;
+                }
+                throw;
+            }
 
         // array of requests
         } else if (valRequest.isArray()) {
@@ -222,13 +299,16 @@ static bool HTTPReq_JSONRPC(const std::any& context, HTTPRequest* req)
                     }
                 }
             }
-            strReply = JSONRPCExecBatch(jreq, valRequest.get_array());
+            // Other HTTP workers help with the read-only calls of the batch
+            const size_t helpers = std::max(HTTPWorkerCount() - 1, 0);
+            const auto enqueue_task = [req](std::function<void()> task) { return HTTPEnqueueTask(req, std::move(task)); };
+            strReply = JSONRPCExecBatch(jreq, valRequest.get_array(), enqueue_task, helpers);
         }
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strReply);
+        req->WriteReply(HTTP_OK, std::move(strReply));
     } catch (const UniValue& objError) {
         JSONErrorReply(req, objError, jreq.id);
         return false;
@@ -296,9 +376,9 @@ bool StartHTTPRPC(const std::any& context)
         return false;
 
     auto handle_rpc = [context](HTTPRequest* req, const std::string&) { return HTTPReq_JSONRPC(context, req); };
-    RegisterHTTPHandler("/", true, handle_rpc);
+    RegisterHTTPHandler("/", true, handle_rpc, ClassifyJSONRPC);
     if (g_wallet_init_interface.HasWalletSupport()) {
-        RegisterHTTPHandler("/wallet/", false, handle_rpc);
+        RegisterHTTPHandler("/wallet/", false, handle_rpc, ClassifyJSONRPC);
     }
     struct event_base* eventBase = EventBase();
     assert(eventBase);
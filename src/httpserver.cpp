@@ -6,6 +6,7 @@
 
 #include <chainparamsbase.h>
 #include <compat.h>
+#include <metrics/metrics.h>
 #include <netbase.h>
 #include <node/ui_interface.h>
 #include <rpc/protocol.h> // For HTTP status codes
@@ -16,8 +17,13 @@
 #include <util/threadnames.h>
 #include <util/translation.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <map>
 #include <memory>
+#include <optional>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
@@ -30,22 +36,54 @@
 #include <event2/bufferevent.h>
 #include <event2/util.h>
 #include <event2/keyvalq_struct.h>
+#include <event2/http.h>
 
 #include <support/events.h>
 
 /** Maximum size of http request (request line + headers) */
 static const size_t MAX_HEADERS_SIZE = 8192;
 
+/** Replies from this size on are sent without copying them into an evbuffer */
+static constexpr size_t MIN_REFERENCED_REPLY_SIZE{4096};
+
+static const char* LaneName(HTTPWorkLane lane)
+{
+    return lane == HTTPWorkLane::EXPENSIVE ? "expensive" : "cheap";
+}
+
+/** Append data to an evbuffer, without copying it if it is large */
+static void AddToBuffer(evbuffer* evb, std::string&& data)
+{
+    if (data.size() < MIN_REFERENCED_REPLY_SIZE) {
+        evbuffer_add(evb, data.data(), data.size());
+    } else {
+        // Let libevent send the data from the string, rather than from a copy
+        auto body = new std::string(std::move(data));
+        evbuffer_add_reference(evb, body->data(), body->size(), [](const void*, size_t, void* arg) {
+            delete static_cast<std::string*>(arg);
+        }, body);
+    }
+}
+
 /** HTTP request work item */
 class HTTPWorkItem final : public HTTPClosure
 {
 public:
-    HTTPWorkItem(std::unique_ptr<HTTPRequest> _req, const std::string &_path, const HTTPRequestHandler& _func):
-        req(std::move(_req)), path(_path), func(_func)
+    HTTPWorkItem(std::unique_ptr<HTTPRequest> _req, const std::string &_path, const HTTPRequestHandler& _func, std::shared_ptr<const std::atomic<bool>> closed):
+        req(std::move(_req)), path(_path), func(_func), m_closed(std::move(closed))
     {
     }
     void operator()() override
     {
+        // Requests wait in the queue for as long as it takes to serve those
+        // before them, so their client may have given up by now
+        if (*m_closed) {
+            LogPrint(BCLog::HTTP, "Dropping request for %s from %s: client disconnected\n",
+                     SanitizeString(req->GetURI(), SAFE_CHARS_URI).substr(0, 100), req->GetPeer().ToString());
+            metrics::Instance()->HTTP().Dropped(LaneName(req->GetLane()), "disconnected");
+            req->WriteReply(HTTP_SERVICE_UNAVAILABLE, "Client disconnected");
+            return;
+        }
         func(req.get(), path);
     }
 
@@ -54,57 +92,148 @@ public:
 private:
     std::string path;
     HTTPRequestHandler func;
+    //! Set once libevent closed the connection of the request
+    const std::shared_ptr<const std::atomic<bool>> m_closed;
 };
 
-/** Simple work queue for distributing work over multiple threads.
- * Work items are simply callable objects.
+/** Task queued by a request being handled by another worker */
+class HTTPTaskItem final : public HTTPClosure
+{
+public:
+    explicit HTTPTaskItem(std::function<void()> task) : m_task(std::move(task)) {}
+    void operator()() override
+    {
+        m_task();
+    }
+
+private:
+    std::function<void()> m_task;
+};
+
+/** Work queue for distributing work over multiple threads.
+ * Work items are simply callable objects. Items are queued in a lane and
+ * for a client: workers take items from the cheap lane first, and take
+ * turns between the clients of a lane so that one client queueing many
+ * requests does not hold up the others.
  */
 template <typename WorkItem>
 class WorkQueue
 {
 private:
+    struct QueuedItem {
+        std::unique_ptr<WorkItem> item;
+        std::chrono::steady_clock::time_point queued_time;
+        //! Whether the item is a task helping with another item
+        bool helper;
+    };
+    struct Lane {
+        //! Queued items of each client
+        std::map<std::string, std::deque<QueuedItem>> pending;
+        //! Clients with queued items, in the order they are served
+        std::deque<std::string> clients;
+        //! Items being run
+        size_t running{0};
+        //! Limit on the items run at once
+        size_t max_running;
+    };
+
     Mutex cs;
     std::condition_variable cond GUARDED_BY(cs);
-    std::deque<std::unique_ptr<WorkItem>> queue GUARDED_BY(cs);
+    std::map<HTTPWorkLane, Lane> lanes GUARDED_BY(cs);
+    size_t depth GUARDED_BY(cs){0};
+    //! Queued helper tasks, which are not counted in depth
+    size_t helper_depth GUARDED_BY(cs){0};
     bool running GUARDED_BY(cs);
     const size_t maxDepth;
+    //! Limit on the queued helper tasks
+    const size_t maxHelpers;
+
+    //! Lane to take the next item from, if any
+    std::optional<HTTPWorkLane> NextLane() EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        for (auto& [lane_id, lane] : lanes) {
+            if (!lane.clients.empty() && lane.running < lane.max_running) return lane_id;
+        }
+        return std::nullopt;
+    }
 
 public:
-    explicit WorkQueue(size_t _maxDepth) : running(true),
-                                 maxDepth(_maxDepth)
+    WorkQueue(size_t _maxDepth, size_t threads) : running(true),
+                                 maxDepth(_maxDepth),
+                                 maxHelpers(threads)
     {
+        lanes[HTTPWorkLane::CHEAP].max_running = threads;
+        lanes[HTTPWorkLane::EXPENSIVE].max_running = std::max<size_t>(threads - 1, 1);
     }
     /** Precondition: worker threads have all stopped (they have been joined).
      */
     ~WorkQueue()
     {
     }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    /** Enqueue a work item. Helper items, queued by items being run, are
+     * limited separately so that they never take the place of new requests.
+     */
+    bool Enqueue(WorkItem* item, HTTPWorkLane lane_id = HTTPWorkLane::CHEAP, const std::string& client = {}, bool helper = false)
     {
         LOCK(cs);
-        if (!running || queue.size() >= maxDepth) {
+        if (!running || (helper ? helper_depth >= maxHelpers : depth >= maxDepth)) {
             return false;
         }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
+        Lane& lane = lanes.at(lane_id);
+        std::deque<QueuedItem>& client_items = lane.pending[client];
+        if (client_items.empty()) lane.clients.push_back(client);
+        client_items.push_back({std::unique_ptr<WorkItem>(item), std::chrono::steady_clock::now(), helper});
+        if (helper) {
+            ++helper_depth;
+        } else {
+            ++depth;
+        }
         cond.notify_one();
         return true;
     }
     /** Thread function */
     void Run()
     {
+        auto& metrics = metrics::Instance()->HTTP();
         while (true) {
-            std::unique_ptr<WorkItem> i;
+            QueuedItem queued;
+            HTTPWorkLane lane_id;
             {
                 WAIT_LOCK(cs, lock);
-                while (running && queue.empty())
+                // Once interrupted, keep running until the queue is empty
+                std::optional<HTTPWorkLane> next;
+                while (!(next = NextLane()) && (running || depth + helper_depth > 0))
                     cond.wait(lock);
-                if (!running && queue.empty())
+                if (!next)
                     break;
-                i = std::move(queue.front());
-                queue.pop_front();
+                lane_id = *next;
+                Lane& lane = lanes.at(lane_id);
+                std::string client = std::move(lane.clients.front());
+                lane.clients.pop_front();
+                auto it = lane.pending.find(client);
+                queued = std::move(it->second.front());
+                it->second.pop_front();
+                if (it->second.empty()) {
+                    lane.pending.erase(it);
+                } else {
+                    lane.clients.push_back(std::move(client));
+                }
+                if (queued.helper) {
+                    --helper_depth;
+                } else {
+                    --depth;
+                }
+                ++lane.running;
+            }
+            metrics.QueueWait(LaneName(lane_id), std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - queued.queued_time).count());
+            (*queued.item)();
+            queued.item.reset();
+            {
+                LOCK(cs);
+                --lanes.at(lane_id).running;
+                // A worker waiting for this lane may take an item now
+                cond.notify_all();
             }
-            (*i)();
         }
     }
     /** Interrupt and exit loops */
@@ -118,17 +247,58 @@ public:
 
 struct HTTPPathHandler
 {
-    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler):
-        prefix(_prefix), exactMatch(_exactMatch), handler(_handler)
+    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler, HTTPRequestClassifier _classifier):
+        prefix(_prefix), exactMatch(_exactMatch), handler(_handler), classifier(_classifier)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPRequestClassifier classifier;
 };
 
 /** HTTP module state */
 
+//! Functions posted by the workers to run on the main http thread, in order
+static Mutex g_http_thread_tasks_mutex;
+static std::vector<std::function<void()>> g_http_thread_tasks GUARDED_BY(g_http_thread_tasks_mutex);
+//! Event running the posted functions, which is reused rather than allocated for each
+static std::unique_ptr<HTTPEvent> g_http_thread_tasks_event;
+
+static void RunHTTPThreadTasks()
+{
+    std::vector<std::function<void()>> tasks;
+    WITH_LOCK(g_http_thread_tasks_mutex, tasks.swap(g_http_thread_tasks));
+    for (auto& task : tasks) {
+        task();
+    }
+}
+
+/** Run fn on the main http thread, after the functions posted before it */
+static void PostToHTTPThread(std::function<void()> fn)
+{
+    bool triggered;
+    {
+        LOCK(g_http_thread_tasks_mutex);
+        // The event is pending until it took the queued functions
+        triggered = !g_http_thread_tasks.empty();
+        g_http_thread_tasks.push_back(std::move(fn));
+    }
+    if (!triggered) g_http_thread_tasks_event->trigger(nullptr);
+}
+
+//! Flags of the connections with a request being handled, set when libevent
+//! closes them. Only accessed on the main http thread.
+static std::map<evhttp_connection*, std::shared_ptr<std::atomic<bool>>> g_connections_closed;
+
+static void http_connection_close_cb(struct evhttp_connection* conn, void*)
+{
+    auto it = g_connections_closed.find(conn);
+    if (it == g_connections_closed.end()) return;
+    *it->second = true;
+    g_connections_closed.erase(it);
+}
+
 //! libevent event loop
 static struct event_base* eventBase = nullptr;
 //! HTTP server
@@ -141,6 +311,8 @@ static std::unique_ptr<WorkQueue<HTTPClosure>> g_work_queue{nullptr};
 static std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
 static std::vector<evhttp_bound_socket *> boundSockets;
+//! Seconds after which a client that does not receive a reply is given up on
+static int g_server_timeout{DEFAULT_HTTP_SERVER_TIMEOUT};
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
@@ -205,16 +377,18 @@ std::string RequestMethodString(HTTPRequest::RequestMethod m)
 /** HTTP request callback */
 static void http_request_cb(struct evhttp_request* req, void* arg)
 {
+    evhttp_connection* conn = evhttp_request_get_connection(req);
+    bufferevent* bev = conn ? evhttp_connection_get_bufferevent(conn) : nullptr;
     // Disable reading to work around a libevent bug, fixed in 2.2.0.
     if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-        evhttp_connection* conn = evhttp_request_get_connection(req);
-        if (conn) {
-            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-            if (bev) {
-                bufferevent_disable(bev, EV_READ);
-            }
+        if (bev) {
+            bufferevent_disable(bev, EV_READ);
         }
     }
+    const evutil_socket_t socket = bev ? bufferevent_getfd(bev) : -1;
+    // Replies to pipelined requests are written one after the other, so do
+    // not let Nagle hold each of them back until the previous one is acked.
+    if (socket != -1) SetSocketNoDelay(socket);
     std::unique_ptr<HTTPRequest> hreq(new HTTPRequest(req));
 
     // Early address-based allow check
@@ -255,12 +429,23 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
-        std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler));
+        const HTTPWorkLane lane = i->classifier ? i->classifier(hreq.get()) : HTTPWorkLane::CHEAP;
+        const std::string client = hreq->GetPeer().ToStringIP();
+        hreq->SetLane(lane);
+        // libevent handles the requests of a connection one at a time, so
+        // the flag is that of this request until the connection closes
+        auto closed = std::make_shared<std::atomic<bool>>(false);
+        if (conn) {
+            g_connections_closed[conn] = closed;
+            evhttp_connection_set_closecb(conn, http_connection_close_cb, nullptr);
+        }
+        std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler, std::move(closed)));
         assert(g_work_queue);
-        if (g_work_queue->Enqueue(item.get())) {
+        if (g_work_queue->Enqueue(item.get(), lane, client)) {
             item.release(); /* if true, queue took ownership */
         } else {
             LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
+            metrics::Instance()->HTTP().Dropped(LaneName(lane), "queue-full");
             item->req->WriteReply(HTTP_SERVICE_UNAVAILABLE, "Work queue depth exceeded");
         }
     } else {
@@ -378,7 +563,8 @@ bool InitHTTPServer()
         return false;
     }
 
-    evhttp_set_timeout(http, gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+    g_server_timeout = gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+    evhttp_set_timeout(http, g_server_timeout);
     evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
     evhttp_set_max_body_size(http, MAX_SIZE);
     evhttp_set_gencb(http, http_request_cb, nullptr);
@@ -392,7 +578,9 @@ bool InitHTTPServer()
     int workQueueDepth = std::max((long)gArgs.GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
 
-    g_work_queue = std::make_unique<WorkQueue<HTTPClosure>>(workQueueDepth);
+    const int rpcThreads = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
+    g_work_queue = std::make_unique<WorkQueue<HTTPClosure>>(workQueueDepth, rpcThreads);
+    g_http_thread_tasks_event = std::make_unique<HTTPEvent>(base_ctr.get(), false, RunHTTPThreadTasks);
     // transfer ownership to eventBase/HTTP via .release()
     eventBase = base_ctr.release();
     eventHTTP = http_ctr.release();
@@ -415,6 +603,8 @@ bool UpdateHTTPServerLogging(bool enable) {
 
 static std::thread g_thread_http;
 static std::vector<std::thread> g_thread_http_workers;
+//! Number of HTTP worker threads, set before they are started
+static int g_http_worker_count{0};
 
 void StartHTTPServer()
 {
@@ -423,6 +613,7 @@ void StartHTTPServer()
     LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
     g_thread_http = std::thread(ThreadHTTP, eventBase);
 
+    g_http_worker_count = rpcThreads;
     for (int i = 0; i < rpcThreads; i++) {
         g_thread_http_workers.emplace_back(HTTPWorkQueueRun, g_work_queue.get(), i);
     }
@@ -449,6 +640,7 @@ void StopHTTPServer()
             thread.join();
         }
         g_thread_http_workers.clear();
+        g_http_worker_count = 0;
     }
     // Unlisten sockets, these are what make the event loop running, which means
     // that after this and all connections are closed the event loop will quit.
@@ -464,6 +656,8 @@ void StopHTTPServer()
         evhttp_free(eventHTTP);
         eventHTTP = nullptr;
     }
+    g_http_thread_tasks_event.reset();
+    WITH_LOCK(g_http_thread_tasks_mutex, g_http_thread_tasks.clear());
     if (eventBase) {
         event_base_free(eventBase);
         eventBase = nullptr;
@@ -509,7 +703,11 @@ HTTPRequest::HTTPRequest(struct evhttp_request* _req, bool _replySent) : req(_re
 
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (!replySent && m_chunked_reply) {
+        // The body of the reply may be incomplete, but it cannot be replaced anymore
+        LogPrintf("%s: Unfinished reply\n", __func__);
+        EndReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL_SERVER_ERROR, "Unhandled request");
@@ -548,6 +746,17 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+std::string HTTPRequest::PeekBody(size_t max_size)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    std::string rv(std::min(evbuffer_get_length(buf), max_size), '\0');
+    const ev_ssize_t copied = evbuffer_copyout(buf, rv.data(), rv.size());
+    rv.resize(std::max<ev_ssize_t>(copied, 0));
+    return rv;
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -560,7 +769,7 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  * Replies must be sent in the main loop in the main http thread,
  * this cannot be done from worker threads.
  */
-void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
+void HTTPRequest::WriteReply(int nStatus, std::string strReply)
 {
     assert(!replySent && req);
     if (ShutdownRequested()) {
@@ -569,9 +778,9 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
-    evbuffer_add(evb, strReply.data(), strReply.size());
+    AddToBuffer(evb, std::move(strReply));
     auto req_copy = req;
-    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+    PostToHTTPThread([req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
         // Re-enable reading from the socket. This is the second part of the libevent
         // workaround above.
@@ -585,7 +794,122 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
             }
         }
     });
-    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+/** Progress of a reply sent in chunks */
+struct HTTPChunkedReply {
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    //! Chunks passed to the main http thread
+    uint64_t m_chunks_written GUARDED_BY(m_mutex){0};
+    //! Chunks given to libevent on the main http thread
+    uint64_t m_chunks_queued GUARDED_BY(m_mutex){0};
+    //! Chunks known to be written to the socket
+    uint64_t m_chunks_sent GUARDED_BY(m_mutex){0};
+    //! Whether the client does not receive the reply anymore
+    bool m_failed GUARDED_BY(m_mutex){false};
+    //! When the client last made progress receiving the reply
+    std::chrono::steady_clock::time_point m_last_progress GUARDED_BY(m_mutex){std::chrono::steady_clock::now()};
+    //! Connection the reply is sent on, only accessed on the main http thread
+    evhttp_connection* m_conn{nullptr};
+};
+
+//! Chunked replies in progress by connection, only accessed on the main http thread
+static std::map<evhttp_connection*, std::shared_ptr<HTTPChunkedReply>> g_chunked_replies;
+
+/** Called by libevent when its output to a connection was written to the
+ * socket, which then includes every chunk queued so far. */
+static void http_reply_chunks_sent_cb(struct evhttp_connection* conn, void*)
+{
+    auto it = g_chunked_replies.find(conn);
+    if (it == g_chunked_replies.end()) return;
+    {
+        LOCK(it->second->m_mutex);
+        if (it->second->m_chunks_sent < it->second->m_chunks_queued) {
+            it->second->m_chunks_sent = it->second->m_chunks_queued;
+            it->second->m_last_progress = std::chrono::steady_clock::now();
+        }
+    }
+    it->second->m_cv.notify_all();
+}
+
+void HTTPRequest::StartReply(int nStatus)
+{
+    assert(!replySent && req && !m_chunked_reply);
+    if (ShutdownRequested()) {
+        WriteHeader("Connection", "close");
+    }
+    m_chunked_reply = std::make_shared<HTTPChunkedReply>();
+    auto req_copy = req;
+    PostToHTTPThread([req_copy, nStatus, chunked_reply = m_chunked_reply]{
+        chunked_reply->m_conn = evhttp_request_get_connection(req_copy);
+        if (chunked_reply->m_conn) g_chunked_replies[chunked_reply->m_conn] = chunked_reply;
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+    });
+}
+
+bool HTTPRequest::WriteReplyChunk(std::string&& chunk)
+{
+    assert(!replySent && req && m_chunked_reply);
+    {
+        // Keep at most one chunk waiting besides the one being sent. A client
+        // that receives nothing for -rpcservertimeout is given up on, so that
+        // it cannot hold the worker thread, however long the reply.
+        WAIT_LOCK(m_chunked_reply->m_mutex, lock);
+        while (!m_chunked_reply->m_failed && m_chunked_reply->m_chunks_written > m_chunked_reply->m_chunks_sent + 1) {
+            const auto deadline = m_chunked_reply->m_last_progress + std::chrono::seconds{g_server_timeout};
+            if (ShutdownRequested() || m_chunked_reply->m_cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+                m_chunked_reply->m_failed = true;
+            }
+        }
+        if (m_chunked_reply->m_failed) return false;
+        ++m_chunked_reply->m_chunks_written;
+    }
+    auto req_copy = req;
+    PostToHTTPThread([req_copy, chunked_reply = m_chunked_reply, chunk = std::move(chunk)]() mutable {
+        {
+            LOCK(chunked_reply->m_mutex);
+            // The request is detached from its connection once that failed
+            if (!evhttp_request_get_connection(req_copy)) chunked_reply->m_failed = true;
+            ++chunked_reply->m_chunks_queued;
+        }
+        chunked_reply->m_cv.notify_all();
+        struct evbuffer* evb = evbuffer_new();
+        AddToBuffer(evb, std::move(chunk));
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+        evhttp_send_reply_chunk_with_cb(req_copy, evb, http_reply_chunks_sent_cb, nullptr);
+#else
+        // Without a callback for written chunks, the output is not limited
+        evhttp_send_reply_chunk(req_copy, evb);
+        WITH_LOCK(chunked_reply->m_mutex, chunked_reply->m_chunks_sent = chunked_reply->m_chunks_queued);
+#endif
+        evbuffer_free(evb);
+    });
+    return true;
+}
+
+void HTTPRequest::EndReply()
+{
+    assert(!replySent && req && m_chunked_reply);
+    auto req_copy = req;
+    PostToHTTPThread([req_copy, chunked_reply = m_chunked_reply]{
+        auto it = g_chunked_replies.find(chunked_reply->m_conn);
+        if (it != g_chunked_replies.end() && it->second == chunked_reply) g_chunked_replies.erase(it);
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (conn) {
+            // Re-enable reading from the socket, see WriteReply. This is done
+            // first, as the request and connection may be freed on completion.
+            if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+                if (bev) {
+                    bufferevent_enable(bev, EV_READ | EV_WRITE);
+                }
+            }
+        }
+        evhttp_send_reply_end(req_copy);
+    });
     replySent = true;
     req = nullptr; // transferred back to main thread
 }
@@ -630,10 +954,10 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod() const
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestClassifier& classifier)
 {
     LogPrint(BCLog::HTTP, "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, classifier));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
@@ -649,3 +973,17 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
         pathHandlers.erase(i);
     }
 }
+
+bool HTTPEnqueueTask(const HTTPRequest* req, std::function<void()> task)
+{
+    if (!g_work_queue) return false;
+    auto item = std::make_unique<HTTPTaskItem>(std::move(task));
+    if (!g_work_queue->Enqueue(item.get(), req->GetLane(), req->GetPeer().ToStringIP(), /*helper=*/true)) return false;
+    item.release(); // queue took ownership
+    return true;
+}
+
+int HTTPWorkerCount()
+{
+    return g_http_worker_count;
+}
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <functional>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
@@ -35,21 +36,43 @@ void StopHTTPServer();
  * libevent doesn't support debug logging.*/
 bool UpdateHTTPServerLogging(bool enable);
 
+/** Lanes of the HTTP work queue. Workers serve the cheap lane first, and
+ * expensive requests never take the last worker when there are several.
+ */
+enum class HTTPWorkLane {
+    CHEAP,
+    EXPENSIVE,
+};
+
 /** Handler for requests to a certain HTTP path */
 typedef std::function<bool(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Picks the work queue lane of a request, on the HTTP event loop thread */
+typedef std::function<HTTPWorkLane(HTTPRequest* req)> HTTPRequestClassifier;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Requests go to the cheap lane unless classifier says otherwise.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestClassifier& classifier = {});
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Queue a task for the HTTP worker threads, so that req can spread its work
+ * over idle workers. The task is queued in the lane of req and for its client.
+ * Tasks do not count towards the -rpcworkqueue depth, but at most one per
+ * worker may be queued at once. Returns false if no more tasks can be queued
+ * or the work queue is stopping.
+ */
+bool HTTPEnqueueTask(const HTTPRequest* req, std::function<void()> task);
+/** Number of HTTP worker threads */
+int HTTPWorkerCount();
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
 struct event_base* EventBase();
 
+struct HTTPChunkedReply;
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -59,6 +82,12 @@ private:
     struct evhttp_request* req;
     bool replySent;
 
+    /** State of a chunked reply, shared with the main http thread */
+    std::shared_ptr<HTTPChunkedReply> m_chunked_reply;
+
+    /** Work queue lane the request was queued in */
+    HTTPWorkLane m_lane{HTTPWorkLane::CHEAP};
+
 public:
     explicit HTTPRequest(struct evhttp_request* req, bool replySent = false);
     ~HTTPRequest();
@@ -75,6 +104,10 @@ public:
      */
     std::string GetURI() const;
 
+    /** Work queue lane of the request, and of the tasks it queues */
+    HTTPWorkLane GetLane() const { return m_lane; }
+    void SetLane(HTTPWorkLane lane) { m_lane = lane; }
+
     /** Get CService (address:ip) for the origin of the http request.
      */
     CService GetPeer() const;
@@ -97,6 +130,11 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Return up to max_size bytes of the request body without consuming it.
+     */
+    std::string PeekBody(size_t max_size);
+
     /**
      * Write output header.
      *
@@ -108,11 +146,39 @@ public:
      * Write HTTP reply.
      * nStatus is the HTTP status code to send.
      * strReply is the body of the reply. Keep it empty to send a standard message.
+     * Large replies are sent without being copied, so pass them as rvalues.
      *
      * @note Can be called only once. As this will give the request back to the
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
-    void WriteReply(int nStatus, const std::string& strReply = "");
+    void WriteReply(int nStatus, std::string strReply = "");
+
+    /**
+     * Start a HTTP reply whose body is sent in chunks, with WriteReplyChunk,
+     * while it is produced. The reply is completed with EndReply.
+     * nStatus is the HTTP status code to send.
+     *
+     * @note Use instead of WriteReply, output headers are sent by this.
+     */
+    void StartReply(int nStatus);
+
+    /**
+     * Send a chunk of the body of a reply started with StartReply. Waits while
+     * more than a chunk is waiting to be sent to the client, so that a large
+     * reply is never buffered as a whole. Waits at most -rpcservertimeout
+     * for the client to receive a chunk.
+     *
+     * @returns false if the client does not receive the reply anymore, or
+     *          received nothing within that time.
+     */
+    bool WriteReplyChunk(std::string&& chunk);
+
+    /**
+     * Complete a reply started with StartReply. As this will give the request
+     * back to the main thread, do not call any other HTTPRequest methods
+     * after calling this.
+     */
+    void EndReply();
 };
 
 /** Event handler closure.
@@ -4,6 +4,7 @@
 
 #include <chainparams.h>
 #include <index/base.h>
+#include <index/blockreader.h>
 #include <node/blockstorage.h>
 #include <node/ui_interface.h>
 #include <shutdown.h>
@@ -18,6 +19,9 @@ constexpr uint8_t DB_BEST_BLOCK{'B'};
 constexpr int64_t SYNC_LOG_INTERVAL = 30; // seconds
 constexpr int64_t SYNC_LOCATOR_WRITE_INTERVAL = 30; // seconds
 
+//! Shares the blocks read by the indexes syncing at the same time
+static IndexBlockReader g_index_block_reader;
+
 template <typename... Args>
 static void FatalError(const char* fmt, const Args&... args)
 {
@@ -28,8 +32,9 @@ static void FatalError(const char* fmt, const Args&... args)
     StartShutdown();
 }
 
-BaseIndex::DB::DB(const fs::path& path, size_t n_cache_size, bool f_memory, bool f_wipe, bool f_obfuscate) :
-    CDBWrapper(path, n_cache_size, f_memory, f_wipe, f_obfuscate)
+BaseIndex::DB::DB(const fs::path& path, size_t n_cache_size, bool f_memory, bool f_wipe, bool f_obfuscate,
+                  const DBOptions& db_options) :
+    CDBWrapper(path, n_cache_size, f_memory, f_wipe, f_obfuscate, db_options)
 {}
 
 bool BaseIndex::DB::ReadBestBlock(CBlockLocator& locator) const
@@ -125,7 +130,11 @@ void BaseIndex::ThreadSync()
 {
     const CBlockIndex* pindex = m_best_block_index.load();
     if (!m_synced) {
-        auto& consensus_params = Params().GetConsensus();
+        g_index_block_reader.Register(*this, *m_chainstate, pindex, NeedsUndoData());
+        struct ReaderRegistration {
+            BaseIndex& index;
+            ~ReaderRegistration() { g_index_block_reader.Unregister(index); }
+        } reader_registration{*this};
 
         int64_t last_log_time = 0;
         int64_t last_locator_write_time = 0;
@@ -172,13 +181,13 @@ void BaseIndex::ThreadSync()
                 Commit();
             }
 
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            IndexBlock block;
+            if (!g_index_block_reader.Read(*this, pindex, block)) {
                 FatalError("%s: Failed to read block %s from disk",
                            __func__, pindex->GetBlockHash().ToString());
                 return;
             }
-            if (!WriteBlock(block, pindex)) {
+            if (!WriteBlock(*block.block, pindex, block.undo.get())) {
                 FatalError("%s: Failed to write block %s to index database",
                            __func__, pindex->GetBlockHash().ToString());
                 return;
@@ -262,7 +271,7 @@ void BaseIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const
         }
     }
 
-    if (WriteBlock(*block, pindex)) {
+    if (WriteBlock(*block, pindex, nullptr)) {
         m_best_block_index = pindex;
     } else {
         FatalError("%s: Failed to write block %s to index",
@@ -12,6 +12,7 @@
 #include <validationinterface.h>
 
 class CBlockIndex;
+class CBlockUndo;
 class CChainState;
 
 struct IndexSummary {
@@ -39,7 +40,8 @@ protected:
     {
     public:
         DB(const fs::path& path, size_t n_cache_size,
-           bool f_memory = false, bool f_wipe = false, bool f_obfuscate = false);
+           bool f_memory = false, bool f_wipe = false, bool f_obfuscate = false,
+           const DBOptions& db_options = {});
 
         /// Read block locator of the chain that the txindex is in sync with.
         bool ReadBestBlock(CBlockLocator& locator) const;
@@ -88,8 +90,19 @@ protected:
     /// Initialize internal state from the database and block index.
     [[nodiscard]] virtual bool Init();
 
-    /// Write update index entries for a newly connected block.
-    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) { return true; }
+    /// Write update index entries for a newly connected block. block_undo is
+    /// the undo data of the block if it was read along with it, or null.
+    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo* block_undo) { return true; }
+
+    /// Whether WriteBlock uses the undo data of blocks, which should then be
+    /// read along with them while syncing.
+    virtual bool NeedsUndoData() const { return false; }
+
+    /// Called while syncing, on reader threads and possibly concurrently, for
+    /// blocks the index is about to write. Work that does not depend on the
+    /// previous blocks can be done here ahead of WriteBlock. block_undo is null
+    /// if the undo data was not read.
+    virtual void PrepareBlock(const CBlock& block, const CBlockUndo* block_undo, const CBlockIndex* pindex) {}
 
     /// Virtual method called internally by Commit that can be overridden to atomically
     /// commit more index state.
@@ -104,10 +117,14 @@ protected:
     /// Get the name of the index for display in logs.
     virtual const char* GetName() const = 0;
 
+    friend class IndexBlockReader;
+
 public:
     /// Destructor interrupts sync thread if running and blocks until it exits.
     virtual ~BaseIndex();
 
+    std::string SubscriberName() const override { return GetName(); }
+
     /// Blocks the current thread until the index is caught up to the current
     /// state of the block chain. This only blocks if the index has gotten in
     /// sync once and only needs to process blocks in the ValidationInterface
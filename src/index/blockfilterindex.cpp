@@ -2,10 +2,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
 #include <map>
+#include <optional>
 
 #include <dbwrapper.h>
 #include <index/blockfilterindex.h>
+#include <metrics/metrics.h>
 #include <node/blockstorage.h>
 #include <util/system.h>
 
@@ -37,6 +40,12 @@ constexpr unsigned int FLTR_FILE_CHUNK_SIZE = 0x100000; // 1 MiB
  *  is big enough for a 2,000,000 length block chain, which
  *  we should be enough until ~2047. */
 constexpr size_t CF_HEADERS_CACHE_MAX_SZ{2000};
+/** Filters of a range whose positions are further apart than this are read
+ *  separately rather than along with the data between them. */
+constexpr unsigned int MAX_FILTER_READ_GAP{1 << 20};
+/** Filters of a range are read in runs of at most this many bytes, up to the
+ *  start of the last filter of a run. */
+constexpr unsigned int MAX_FILTER_READ_SIZE{16 << 20};
 
 namespace {
 
@@ -102,7 +111,8 @@ BlockFilterIndex::BlockFilterIndex(BlockFilterType filter_type,
     fs::create_directories(path);
 
     m_name = filter_name + " block filter index";
-    m_db = std::make_unique<BaseIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe);
+    m_db = std::make_unique<BaseIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe,
+                                           /*f_obfuscate=*/false, GetDBOptions(gArgs, "blockfilterindex"));
     m_filter_fileseq = std::make_unique<FlatFileSeq>(std::move(path), "fltr", FLTR_FILE_CHUNK_SIZE);
 }
 
@@ -161,6 +171,49 @@ bool BlockFilterIndex::ReadFilterFromDisk(const FlatFilePos& pos, BlockFilter& f
     return true;
 }
 
+bool BlockFilterIndex::ReadFiltersFromDisk(const std::vector<std::pair<FlatFilePos, BlockFilter*>>& reads) const
+{
+    auto& filter_metrics = metrics::Instance()->Filters();
+    for (size_t begin = 0; begin < reads.size();) {
+        // Find the run of filters stored one after the other in the same file
+        size_t end = begin + 1;
+        while (end < reads.size() && reads[end].first.nFile == reads[begin].first.nFile &&
+               reads[end].first.nPos > reads[end - 1].first.nPos &&
+               reads[end].first.nPos - reads[end - 1].first.nPos <= MAX_FILTER_READ_GAP &&
+               reads[end].first.nPos - reads[begin].first.nPos <= MAX_FILTER_READ_SIZE) {
+            ++end;
+        }
+        const FlatFilePos& first_pos = reads[begin].first;
+        const FlatFilePos& last_pos = reads[end - 1].first;
+
+        CAutoFile filein(m_filter_fileseq->Open(first_pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            return false;
+        }
+
+        uint256 block_hash;
+        std::vector<uint8_t> encoded_filter;
+        try {
+            // Read the run up to its last filter at once, as the size of the
+            // last one is only known once it is deserialized
+            std::vector<uint8_t> data(last_pos.nPos - first_pos.nPos);
+            filein.read((char*)data.data(), data.size());
+            for (size_t i = begin; i < end - 1; ++i) {
+                VectorReader reader(SER_DISK, CLIENT_VERSION, data, reads[i].first.nPos - first_pos.nPos);
+                reader >> block_hash >> encoded_filter;
+                *reads[i].second = BlockFilter(GetFilterType(), block_hash, std::move(encoded_filter));
+            }
+            filein >> block_hash >> encoded_filter;
+            *reads[end - 1].second = BlockFilter(GetFilterType(), block_hash, std::move(encoded_filter));
+        } catch (const std::exception& e) {
+            return error("%s: Failed to deserialize block filter from disk: %s", __func__, e.what());
+        }
+        filter_metrics.DiskRead(end - begin);
+        begin = end;
+    }
+    return true;
+}
+
 size_t BlockFilterIndex::WriteFilterToDisk(FlatFilePos& pos, const BlockFilter& filter)
 {
     assert(filter.GetFilterType() == GetFilterType());
@@ -207,14 +260,38 @@ size_t BlockFilterIndex::WriteFilterToDisk(FlatFilePos& pos, const BlockFilter&
     return data_size;
 }
 
-bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+void BlockFilterIndex::PrepareBlock(const CBlock& block, const CBlockUndo* block_undo, const CBlockIndex* pindex)
 {
-    CBlockUndo block_undo;
+    // Building the filter only depends on the block, so it can be done ahead
+    if (!block_undo && pindex->nHeight > 0) return;
+    BlockFilter filter(m_filter_type, block, block_undo ? *block_undo : CBlockUndo{});
+    LOCK(m_cs_prepared_filters);
+    m_prepared_filters.emplace(pindex, std::move(filter));
+}
+
+bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo* block_undo)
+{
+    std::optional<BlockFilter> filter;
+    {
+        LOCK(m_cs_prepared_filters);
+        auto it = m_prepared_filters.find(pindex);
+        if (it != m_prepared_filters.end()) filter = std::move(it->second);
+        // Drop this filter and those of blocks the index went past, which were
+        // reorganized away
+        for (auto it = m_prepared_filters.begin(); it != m_prepared_filters.end();) {
+            it = it->first->nHeight <= pindex->nHeight ? m_prepared_filters.erase(it) : std::next(it);
+        }
+    }
+
+    CBlockUndo read_undo;
     uint256 prev_header;
 
     if (pindex->nHeight > 0) {
-        if (!UndoReadFromDisk(block_undo, pindex)) {
-            return false;
+        if (!filter && !block_undo) {
+            if (!UndoReadFromDisk(read_undo, pindex)) {
+                return false;
+            }
+            block_undo = &read_undo;
         }
 
         std::pair<uint256, DBVal> read_out;
@@ -231,15 +308,15 @@ bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex
         prev_header = read_out.second.header;
     }
 
-    BlockFilter filter(m_filter_type, block, block_undo);
+    if (!filter) filter.emplace(m_filter_type, block, block_undo ? *block_undo : read_undo);
 
-    size_t bytes_written = WriteFilterToDisk(m_next_filter_pos, filter);
+    size_t bytes_written = WriteFilterToDisk(m_next_filter_pos, *filter);
     if (bytes_written == 0) return false;
 
     std::pair<uint256, DBVal> value;
     value.first = pindex->GetBlockHash();
-    value.second.hash = filter.GetHash();
-    value.second.header = filter.ComputeHeader(prev_header);
+    value.second.hash = filter->GetHash();
+    value.second.header = filter->ComputeHeader(prev_header);
     value.second.pos = m_next_filter_pos;
 
     if (!m_db->Write(DBHeightKey(pindex->nHeight), value)) {
@@ -374,12 +451,28 @@ static bool LookupRange(CDBWrapper& db, const std::string& index_name, int start
 
 bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const
 {
+    {
+        LOCK(m_cs_recent_cache);
+        const BlockFilter* filter = m_filter_cache.Get(block_index->GetBlockHash());
+        metrics::Instance()->Filters().CacheLookup("filter", filter ? 1 : 0, filter ? 0 : 1);
+        if (filter) {
+            filter_out = *filter;
+            return true;
+        }
+    }
+
     DBVal entry;
     if (!LookupOne(*m_db, block_index, entry)) {
         return false;
     }
 
-    return ReadFilterFromDisk(entry.pos, filter_out);
+    if (!ReadFilterFromDisk(entry.pos, filter_out)) {
+        return false;
+    }
+    metrics::Instance()->Filters().DiskRead(1);
+    LOCK(m_cs_recent_cache);
+    m_filter_cache.Put(filter_out.GetBlockHash(), filter_out, filter_out.GetEncodedFilter().size() + sizeof(BlockFilter));
+    return true;
 }
 
 bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out)
@@ -397,6 +490,16 @@ bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint25
         }
     }
 
+    {
+        LOCK(m_cs_recent_cache);
+        const uint256* header = m_header_cache.Get(block_index->GetBlockHash());
+        metrics::Instance()->Filters().CacheLookup("header", header ? 1 : 0, header ? 0 : 1);
+        if (header) {
+            header_out = *header;
+            return true;
+        }
+    }
+
     DBVal entry;
     if (!LookupOne(*m_db, block_index, entry)) {
         return false;
@@ -407,6 +510,7 @@ bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint25
         // Add to the headers cache if this is a checkpoint height.
         m_headers_cache.emplace(block_index->GetBlockHash(), entry.header);
     }
+    WITH_LOCK(m_cs_recent_cache, m_header_cache.Put(block_index->GetBlockHash(), entry.header));
 
     header_out = entry.header;
     return true;
@@ -415,20 +519,52 @@ bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint25
 bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* stop_index,
                                          std::vector<BlockFilter>& filters_out) const
 {
+    if (start_height < 0 || start_height > stop_index->nHeight) {
+        return error("%s: start height (%d) is out of range for stop height (%d)",
+                     __func__, start_height, stop_index->nHeight);
+    }
+    const size_t count = static_cast<size_t>(stop_index->nHeight - start_height + 1);
+    filters_out.assign(count, BlockFilter{});
+
+    // Take the filters found in the cache, and note the range of those missing
+    std::vector<bool> cached(count);
+    std::optional<size_t> first_missing, last_missing;
+    {
+        LOCK(m_cs_recent_cache);
+        const CBlockIndex* block_index = stop_index;
+        for (size_t i = count; i-- > 0; block_index = block_index->pprev) {
+            if (const BlockFilter* filter = m_filter_cache.Get(block_index->GetBlockHash())) {
+                filters_out[i] = *filter;
+                cached[i] = true;
+            } else {
+                if (!last_missing) last_missing = i;
+                first_missing = i;
+            }
+        }
+    }
+    const size_t n_missing = std::count(cached.begin(), cached.end(), false);
+    metrics::Instance()->Filters().CacheLookup("filter", count - n_missing, n_missing);
+    if (n_missing == 0) return true;
+
     std::vector<DBVal> entries;
-    if (!LookupRange(*m_db, m_name, start_height, stop_index, entries)) {
+    if (!LookupRange(*m_db, m_name, start_height + *first_missing,
+                     stop_index->GetAncestor(start_height + *last_missing), entries)) {
         return false;
     }
 
-    filters_out.resize(entries.size());
-    auto filter_pos_it = filters_out.begin();
-    for (const auto& entry : entries) {
-        if (!ReadFilterFromDisk(entry.pos, *filter_pos_it)) {
-            return false;
-        }
-        ++filter_pos_it;
+    std::vector<std::pair<FlatFilePos, BlockFilter*>> reads;
+    reads.reserve(n_missing);
+    for (size_t i = *first_missing; i <= *last_missing; ++i) {
+        if (!cached[i]) reads.emplace_back(entries[i - *first_missing].pos, &filters_out[i]);
+    }
+    if (!ReadFiltersFromDisk(reads)) {
+        return false;
     }
 
+    LOCK(m_cs_recent_cache);
+    for (const auto& [pos, filter] : reads) {
+        m_filter_cache.Put(filter->GetBlockHash(), *filter, filter->GetEncodedFilter().size() + sizeof(BlockFilter));
+    }
     return true;
 }
 
@@ -10,10 +10,18 @@
 #include <flatfile.h>
 #include <index/base.h>
 #include <util/hasher.h>
+#include <util/lrucache.h>
+
+#include <map>
 
 /** Interval between compact filter checkpoints. See BIP 157. */
 static constexpr int CFCHECKPT_INTERVAL = 1000;
 
+/** Memory used at most by the cache of recently looked up filters. */
+static constexpr size_t FILTER_CACHE_MAX_MEMORY = 64 << 20;
+/** Number of recently looked up filter headers to cache. */
+static constexpr size_t FILTER_HEADER_CACHE_SIZE = 10000;
+
 /**
  * BlockFilterIndex is used to store and retrieve block filters, hashes, and headers for a range of
  * blocks by height. An index is constructed for each supported filter type with its own database
@@ -32,18 +40,33 @@ private:
     std::unique_ptr<FlatFileSeq> m_filter_fileseq;
 
     bool ReadFilterFromDisk(const FlatFilePos& pos, BlockFilter& filter) const;
+    /** Read filters, reading those stored one after the other in a single go. */
+    bool ReadFiltersFromDisk(const std::vector<std::pair<FlatFilePos, BlockFilter*>>& reads) const;
     size_t WriteFilterToDisk(FlatFilePos& pos, const BlockFilter& filter);
 
     Mutex m_cs_headers_cache;
     /** cache of block hash to filter header, to avoid disk access when responding to getcfcheckpt. */
     std::unordered_map<uint256, uint256, FilterHeaderHasher> m_headers_cache GUARDED_BY(m_cs_headers_cache);
 
+    mutable Mutex m_cs_recent_cache;
+    /** caches of recently looked up filters and filter headers, by block hash. */
+    mutable LRUCache<uint256, BlockFilter, BlockHasher> m_filter_cache GUARDED_BY(m_cs_recent_cache){FILTER_CACHE_MAX_MEMORY};
+    mutable LRUCache<uint256, uint256, BlockHasher> m_header_cache GUARDED_BY(m_cs_recent_cache){FILTER_HEADER_CACHE_SIZE};
+
+    Mutex m_cs_prepared_filters;
+    /** filters built by PrepareBlock() for blocks the index is about to sync. */
+    std::map<const CBlockIndex*, BlockFilter> m_prepared_filters GUARDED_BY(m_cs_prepared_filters);
+
 protected:
     bool Init() override;
 
     bool CommitInternal(CDBBatch& batch) override;
 
-    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo* block_undo) override;
+
+    bool NeedsUndoData() const override { return true; }
+
+    void PrepareBlock(const CBlock& block, const CBlockUndo* block_undo, const CBlockIndex* pindex) override;
 
     bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
 
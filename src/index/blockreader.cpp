@@ -0,0 +1,251 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/blockreader.h>
+
+#include <chainparams.h>
+#include <core_memusage.h>
+#include <index/base.h>
+#include <node/blockstorage.h>
+#include <primitives/block.h>
+#include <tinyformat.h>
+#include <undo.h>
+#include <util/thread.h>
+#include <validation.h>
+#include <version.h>
+
+#include <chrono>
+#include <limits>
+
+IndexBlockReader::~IndexBlockReader()
+{
+    std::vector<std::thread> threads;
+    {
+        LOCK(m_mutex);
+        ++m_generation;
+        threads = std::move(m_threads);
+    }
+    m_cond.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void IndexBlockReader::Register(BaseIndex& index, CChainState& chainstate, const CBlockIndex* best_block, bool needs_undo)
+{
+    LOCK(m_mutex);
+    m_chainstate = &chainstate;
+    m_indexes[&index] = Index{best_block ? best_block->nHeight : -1, needs_undo};
+    if (m_threads.empty()) {
+        m_next_height = 0;
+        for (int i = 0; i < READER_THREADS; ++i) {
+            m_threads.emplace_back([this, i, generation = m_generation] {
+                util::TraceThread(strprintf("idxread.%i", i).c_str(), [&] { ThreadRead(generation); });
+            });
+        }
+    }
+    m_cond.notify_all();
+}
+
+void IndexBlockReader::Unregister(BaseIndex& index)
+{
+    std::vector<std::thread> threads;
+    {
+        WAIT_LOCK(m_mutex, lock);
+        auto it = m_indexes.find(&index);
+        if (it == m_indexes.end()) return;
+        // Reader threads may still be preparing blocks for the index
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return it->second.preparing == 0; });
+        m_indexes.erase(it);
+        if (m_indexes.empty()) {
+            // Stop the reader threads until an index syncs again
+            ++m_generation;
+            threads = std::move(m_threads);
+            m_threads.clear();
+            m_blocks.clear();
+            m_memory = 0;
+        } else {
+            Evict();
+        }
+    }
+    m_cond.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+bool IndexBlockReader::Read(BaseIndex& index, const CBlockIndex* pindex, IndexBlock& block_out)
+{
+    WAIT_LOCK(m_mutex, lock);
+    Index& state = m_indexes.at(&index);
+    state.height = pindex->nHeight - 1;
+    Evict();
+    m_cond.notify_all();
+
+    while (true) {
+        auto it = m_blocks.find(pindex);
+        if (it != m_blocks.end()) {
+            if (!it->second.ready) {
+                m_cond.wait(lock);
+                continue;
+            }
+            block_out = it->second.data;
+            break;
+        }
+
+        // An index within READAHEAD_BLOCKS of the slowest one shares its reads
+        // with the others, and waits rather than getting further ahead. The
+        // slowest index never waits, so that the others can make progress.
+        const int min_height = MinHeight();
+        const bool sharing = state.height <= min_height + READAHEAD_BLOCKS;
+        const bool shared = pindex->nHeight <= min_height + READAHEAD_BLOCKS;
+        if (sharing && state.height != min_height && (!shared || m_memory >= READAHEAD_MEMORY)) {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        if (shared) m_blocks.emplace(pindex, Block{});
+        const bool needs_undo = shared ? NeedsUndo() : state.needs_undo;
+        bool read;
+        {
+            REVERSE_LOCK(lock);
+            read = ReadFromDisk(pindex, needs_undo, block_out);
+        }
+        if (shared) {
+            it = m_blocks.find(pindex);
+            if (read) {
+                it->second.data = block_out;
+                it->second.memory = RecursiveDynamicUsage(*block_out.block) + (block_out.undo ? ::GetSerializeSize(*block_out.undo, PROTOCOL_VERSION) : 0);
+                it->second.ready = true;
+                m_memory += it->second.memory;
+            } else {
+                m_blocks.erase(it);
+            }
+            m_cond.notify_all();
+        }
+        if (!read) return false;
+        break;
+    }
+
+    state.height = pindex->nHeight;
+    Evict();
+    m_cond.notify_all();
+    return true;
+}
+
+int IndexBlockReader::MinHeight() const
+{
+    int min_height{std::numeric_limits<int>::max()};
+    for (const auto& [index, state] : m_indexes) {
+        min_height = std::min(min_height, state.height);
+    }
+    return min_height;
+}
+
+bool IndexBlockReader::NeedsUndo() const
+{
+    for (const auto& [index, state] : m_indexes) {
+        if (state.needs_undo) return true;
+    }
+    return false;
+}
+
+void IndexBlockReader::Evict()
+{
+    const int min_height = MinHeight();
+    for (auto it = m_blocks.begin(); it != m_blocks.end();) {
+        if (it->second.ready && it->first->nHeight <= min_height) {
+            m_memory -= it->second.memory;
+            it = m_blocks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool IndexBlockReader::ReadFromDisk(const CBlockIndex* pindex, bool needs_undo, IndexBlock& block_out)
+{
+    auto block = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*block, pindex, Params().GetConsensus())) {
+        return false;
+    }
+    block_out.block = std::move(block);
+    block_out.undo.reset();
+    if (needs_undo && pindex->nHeight > 0) {
+        auto undo = std::make_shared<CBlockUndo>();
+        if (!UndoReadFromDisk(*undo, pindex)) {
+            return false;
+        }
+        block_out.undo = std::move(undo);
+    }
+    return true;
+}
+
+void IndexBlockReader::ThreadRead(uint64_t generation)
+{
+    WAIT_LOCK(m_mutex, lock);
+    while (generation == m_generation) {
+        const int min_height = MinHeight();
+        m_next_height = std::max(m_next_height, min_height + 1);
+        if (m_memory >= READAHEAD_MEMORY || m_next_height > min_height + READAHEAD_BLOCKS) {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        const int height{m_next_height++};
+        CChainState* chainstate{m_chainstate};
+        const CBlockIndex* pindex;
+        {
+            REVERSE_LOCK(lock);
+            pindex = WITH_LOCK(cs_main, return chainstate->m_chain[height]);
+        }
+        if (generation != m_generation) break;
+        if (!pindex) {
+            // Past the tip, which the indexes are about to reach
+            m_next_height = std::min(m_next_height, height);
+            m_cond.wait_for(lock, std::chrono::milliseconds{100});
+            continue;
+        }
+        if (!m_blocks.emplace(pindex, Block{}).second) continue;
+
+        const bool needs_undo = NeedsUndo();
+        std::vector<std::pair<BaseIndex*, Index*>> preparing;
+        for (auto& [index, state] : m_indexes) {
+            if (state.height < height) {
+                ++state.preparing;
+                preparing.emplace_back(index, &state);
+            }
+        }
+        IndexBlock block;
+        bool read;
+        {
+            REVERSE_LOCK(lock);
+            read = ReadFromDisk(pindex, needs_undo, block);
+            if (read) {
+                for (const auto& [index, state] : preparing) {
+                    index->PrepareBlock(*block.block, block.undo.get(), pindex);
+                }
+            }
+        }
+        for (const auto& [index, state] : preparing) {
+            --state->preparing;
+        }
+
+        // The block is gone if every index unregistered in the meantime
+        auto it = m_blocks.find(pindex);
+        if (it != m_blocks.end()) {
+            if (read) {
+                it->second.memory = RecursiveDynamicUsage(*block.block) + (block.undo ? ::GetSerializeSize(*block.undo, PROTOCOL_VERSION) : 0);
+                it->second.data = std::move(block);
+                it->second.ready = true;
+                m_memory += it->second.memory;
+                Evict();
+            } else {
+                // Let the index read it, and report the error
+                m_blocks.erase(it);
+            }
+        }
+        m_cond.notify_all();
+    }
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BLOCKREADER_H
+#define BITCOIN_INDEX_BLOCKREADER_H
+
+#include <sync.h>
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class BaseIndex;
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+class CChainState;
+
+/** A block read for the indexes, with its undo data when an index needed it */
+struct IndexBlock {
+    std::shared_ptr<const CBlock> block;
+    //! Null for the genesis block, or when no syncing index needed undo data
+    //! when the block was read.
+    std::shared_ptr<const CBlockUndo> undo;
+};
+
+/**
+ * Reads blocks for the indexes syncing with the block chain in the background,
+ * so that indexes syncing over the same part of the chain share each read.
+ *
+ * Indexes register while they sync. Reader threads read the blocks following
+ * the slowest syncing index, along with their undo data, and hand them to
+ * every index through Read(). A block is dropped once every index went past
+ * it. To bound memory, the faster indexes wait for the slowest one once the
+ * blocks read use READAHEAD_MEMORY, or once they are READAHEAD_BLOCKS ahead.
+ * An index further ahead than that when it registers reads its blocks on its
+ * own, until the others catch up with it.
+ *
+ * Reader threads also call BaseIndex::PrepareBlock() on the blocks they read,
+ * so that the per-block work of an index that does not depend on the previous
+ * blocks runs in parallel.
+ */
+class IndexBlockReader
+{
+public:
+    static constexpr size_t READAHEAD_MEMORY{128 << 20};
+    static constexpr int READAHEAD_BLOCKS{1000};
+    static constexpr int READER_THREADS{4};
+
+    ~IndexBlockReader();
+
+    /** Start sharing blocks with an index, which synced up to best_block */
+    void Register(BaseIndex& index, CChainState& chainstate, const CBlockIndex* best_block, bool needs_undo);
+    /** Stop sharing blocks with an index. Must be called from the thread calling Read(). */
+    void Unregister(BaseIndex& index);
+
+    /** Get the block that follows the last one the index read. Returns false
+     * if the block could not be read. */
+    bool Read(BaseIndex& index, const CBlockIndex* pindex, IndexBlock& block_out);
+
+private:
+    struct Index {
+        //! Height of the last block the index read
+        int height;
+        bool needs_undo;
+        //! Number of reader threads in PrepareBlock() for the index
+        int preparing{0};
+    };
+    struct Block {
+        IndexBlock data;
+        bool ready{false};
+        size_t memory{0};
+    };
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::map<BaseIndex*, Index> m_indexes GUARDED_BY(m_mutex);
+    std::map<const CBlockIndex*, Block> m_blocks GUARDED_BY(m_mutex);
+    size_t m_memory GUARDED_BY(m_mutex){0};
+    CChainState* m_chainstate GUARDED_BY(m_mutex){nullptr};
+    //! Height of the next block for the reader threads to read
+    int m_next_height GUARDED_BY(m_mutex){0};
+    //! Reader threads exit once this no longer matches the value they were started with
+    uint64_t m_generation GUARDED_BY(m_mutex){0};
+    std::vector<std::thread> m_threads GUARDED_BY(m_mutex);
+
+    int MinHeight() const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    bool NeedsUndo() const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void Evict() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    static bool ReadFromDisk(const CBlockIndex* pindex, bool needs_undo, IndexBlock& block_out);
+    void ThreadRead(uint64_t generation);
+};
+
+#endif // BITCOIN_INDEX_BLOCKREADER_H
@@ -39,7 +39,9 @@ private:
 protected:
     bool Init() override;
 
-    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo* block_undo) override;
+
+    bool NeedsUndoData() const override { return true; }
 
     bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
 
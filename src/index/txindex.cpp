@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chainparams.h>
 #include <index/disktxpos.h>
 #include <index/txindex.h>
 #include <node/blockstorage.h>
@@ -37,7 +38,8 @@ public:
 };
 
 TxIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
-    BaseIndex::DB(gArgs.GetDataDirNet() / "indexes" / "txindex", n_cache_size, f_memory, f_wipe)
+    BaseIndex::DB(gArgs.GetDataDirNet() / "indexes" / "txindex", n_cache_size, f_memory, f_wipe,
+                  /*f_obfuscate=*/false, GetDBOptions(gArgs, "txindex"))
 {}
 
 bool TxIndex::DB::ReadTxPos(const uint256 &txid, CDiskTxPos& pos) const
@@ -211,11 +213,13 @@ bool TxIndex::Init()
     return BaseIndex::Init();
 }
 
-bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo* block_undo)
 {
     // Exclude genesis block transaction because outputs are not spendable.
     if (pindex->nHeight == 0) return true;
 
+    // Offsets are into the serialization of the block, also when its record
+    // is compressed (see FindTx())
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos>> vPos;
     vPos.reserve(block.vtx.size());
@@ -235,17 +239,35 @@ bool TxIndex::FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRe
         return false;
     }
 
-    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    // Open the block file at the size field of the block record
+    FlatFilePos hpos = postx;
+    hpos.nPos -= 4;
+    CAutoFile file(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
     if (file.IsNull()) {
         return error("%s: OpenBlockFile failed", __func__);
     }
     CBlockHeader header;
     try {
-        file >> header;
-        if (fseek(file.Get(), postx.nTxOffset, SEEK_CUR)) {
-            return error("%s: fseek(...) failed", __func__);
+        uint32_t size_field;
+        file >> size_field;
+        if ((size_field >> BLOCK_RECORD_COMPRESSION_SHIFT) == uint8_t(BlockCompression::NONE)) {
+            file >> header;
+            if (fseek(file.Get(), postx.nTxOffset, SEEK_CUR)) {
+                return error("%s: fseek(...) failed", __func__);
+            }
+            file >> tx;
+        } else {
+            // A compressed block is decompressed as a whole. The offset is
+            // into its serialization, which is what decompression yields.
+            file.fclose();
+            std::vector<uint8_t> block;
+            if (!ReadRawBlockFromDisk(block, postx, Params().MessageStart())) {
+                return false;
+            }
+            VectorReader reader(SER_DISK, CLIENT_VERSION, block, 0);
+            reader >> header;
+            VectorReader(SER_DISK, CLIENT_VERSION, block, ::GetSerializeSize(header, CLIENT_VERSION) + postx.nTxOffset) >> tx;
         }
-        file >> tx;
     } catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -16,6 +16,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <compat/sanity.h>
+#include <dbwrapper.h>
 #include <deploymentstatus.h>
 #include <fs.h>
 #include <hash.h>
@@ -219,8 +220,13 @@ void Shutdown(NodeContext& node)
     node.banman.reset();
     node.addrman.reset();
 
-    if (node.mempool && node.mempool->IsLoaded() && node.args->GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
-        DumpMempool(*node.mempool);
+    if (node.mempool && node.mempool->IsLoaded() && node.chainman && node.args->GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        DumpMempool(*node.mempool, node.chainman->ActiveChainstate());
+    }
+
+    // The script check threads are stopped, nothing inserts into the caches anymore.
+    if (node.args->GetBoolArg("-persistscriptcache", DEFAULT_PERSIST_SCRIPT_CACHE)) {
+        DumpScriptCaches();
     }
 
     // Drop transactions we were still watching, and record fee estimations.
@@ -377,6 +383,7 @@ void SetupServerArgs(ArgsManager& argsman)
     argsman.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
     argsman.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s, signet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex(), signetChainParams->GetConsensus().defaultAssumeValid.GetHex()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-blockcompression=<method>", strprintf("Compress blocks and undo data written to the blocks directory with <method> (%s; default: none). Blocks already on disk stay as they are. Versions without support for <method> cannot read the data it compresses.", SupportedBlockCompressions()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blocksdir=<dir>", "Specify directory to hold blocks subdirectory for *.dat files (default: <datadir>)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-fastprune", "Use smaller block files and lower minimum prune height for testing purposes", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
 #if HAVE_SYSTEM
@@ -384,10 +391,13 @@ void SetupServerArgs(ArgsManager& argsman)
 #endif
     argsman.AddArg("-blockreconstructionextratxn=<n>", strprintf("Extra transactions to keep in memory for compact block reconstructions (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blocksonly", strprintf("Whether to reject transactions from network peers. Automatic broadcast and rebroadcast of any transactions from inbound peers is disabled, unless the peer has the 'forcerelay' permission. RPC transactions are not affected. (default: %u)", DEFAULT_BLOCKSONLY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-coinsbackend=<backend>", "Store the chainstate with <backend>: leveldb in chainstate/, or flatfile in chainstate_flat/, which serves every cache miss with at most one read but keeps an index of all unspent outputs in memory (default: leveldb). Switching requires -convertcoinsdb or -reindex-chainstate.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-coinstatsindex", strprintf("Maintain coinstats index used by the gettxoutsetinfo RPC (default: %u)", DEFAULT_COINSTATSINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-conf=<file>", strprintf("Specify path to read-only configuration file. Relative paths will be prefixed by datadir location. (default: %s)", BITCOIN_CONF_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-convertcoinsdb", "Convert the chainstate from the other backend to the one selected with -coinsbackend, then exit", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-dbopt=<db>:<option>=<value>", strprintf("Tune the LevelDB database <db> (%s). <option> is blocksize, bloombits (0 disables bloom filters), writebuffer (bytes, 0 for a quarter of the database cache), maxfilesize or compression (0 or 1, needs a LevelDB built with snappy). Can be specified multiple times.", Join(DB_OPTION_NAMES, ", ")), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     argsman.AddArg("-dbcache=<n>", strprintf("Maximum database cache size <n> MiB (%d to %d, default: %d). In addition, unused mempool memory is shared for this cache (see -maxmempool).", nMinDbCache, nMaxDbCache, nDefaultDbCache), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-loadblock=<file>", "Imports blocks from external file on startup", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -398,11 +408,14 @@ void SetupServerArgs(ArgsManager& argsman)
     argsman.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-trustmempoolfile", strprintf("Whether to skip script verification of the transactions loaded from mempool.dat if it was saved at the current chain tip (default: %u)", DEFAULT_TRUST_MEMPOOL_FILE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-persistscriptcache", strprintf("Whether to save the signature and script execution caches on shutdown and load them on restart. The cache file is trusted: entries loaded from it skip script verification (default: %u)", DEFAULT_PERSIST_SCRIPT_CACHE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", BITCOIN_PID_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex, -coinstatsindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-reindexthreads=<n>", strprintf("Number of threads reading and deserializing block files ahead of validation during -reindex (1 to %d, default: %d)", MAX_REINDEX_THREADS, DEFAULT_REINDEX_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks. When in pruning mode or if blocks on disk might be corrupted, use full -reindex instead.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-settings=<file>", strprintf("Specify path to dynamic settings data file. Can be disabled with -nosettings. File is written at runtime and not meant to be edited by users (use %s instead for custom settings). Relative paths will be prefixed by datadir location. (default: %s)", BITCOIN_CONF_FILENAME, BITCOIN_SETTINGS_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #if HAVE_SYSTEM
@@ -939,6 +952,25 @@ bool AppInitParameterInteraction(const ArgsManager& args)
         fPruneMode = true;
     }
 
+    const std::string block_compression = args.GetArg("-blockcompression", "none");
+    const std::optional<BlockCompression> compression = ParseBlockCompression(block_compression);
+    if (!compression || !BlockCompressionSupported(*compression)) {
+        return InitError(strprintf(_("Unsupported block compression method '%s' (supported: %s)."), block_compression, SupportedBlockCompressions()));
+    }
+    g_block_compression = *compression;
+
+    const std::string coins_backend = args.GetArg("-coinsbackend", CoinsBackendName(CoinsBackend::LEVELDB));
+    const std::optional<CoinsBackend> backend = ParseCoinsBackend(coins_backend);
+    if (!backend) {
+        return InitError(strprintf(_("Unknown chainstate backend '%s' (leveldb or flatfile)."), coins_backend));
+    }
+    g_coins_backend = *backend;
+
+    std::string db_options_error;
+    if (!CheckDBOptions(args, db_options_error)) {
+        return InitError(Untranslated(db_options_error));
+    }
+
     nConnectTimeout = args.GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0) {
         nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
@@ -1104,6 +1136,9 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
     //
     InitSignatureCache();
     InitScriptExecutionCache();
+    if (args.GetBoolArg("-persistscriptcache", DEFAULT_PERSIST_SCRIPT_CACHE)) {
+        LoadScriptCaches();
+    }
 
     int script_threads = args.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (script_threads <= 0) {
@@ -1135,6 +1170,11 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
         RandAddPeriodic();
     }, std::chrono::minutes{1});
 
+    // Export LevelDB stats, so that compaction work and stalls show up in the metrics.
+    node.scheduler->scheduleEvery([]{
+        CDBWrapper::ReportMetrics();
+    }, std::chrono::seconds{15});
+
     GetMainSignals().RegisterBackgroundSignalScheduler(*node.scheduler);
 
     /* Register RPC commands regardless of -server setting so they will be
@@ -1309,7 +1349,7 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
 
     RegisterValidationInterface(new metrics::MetricsNotificationsInterface(metrics::Instance()->Block(), metrics::Instance()->MemPool()));
 #if ENABLE_ZMQ
-    mg_zmq_notification_interface = CZMQNotificationInterface::Create();
+    g_zmq_notification_interface = CZMQNotificationInterface::Create();
 
     if (g_zmq_notification_interface) {
         RegisterValidationInterface(g_zmq_notification_interface);
@@ -1362,6 +1402,7 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
     configMetrics.SetFlag("blocknotify", OptionsCategory::OPTIONS, args.GetArg("-blocknotify", "") != "");
     configMetrics.SetFlag("checkpoints", OptionsCategory::DEBUG_TEST, fCheckpointsEnabled);
     configMetrics.SetFlag("checkblockindex", OptionsCategory::DEBUG_TEST, fCheckBlockIndex);
+    configMetrics.SetFlag("coinsbackend-flatfile", OptionsCategory::OPTIONS, g_coins_backend == CoinsBackend::FLATFILE);
     configMetrics.SetFlag("coinstatsindex", OptionsCategory::OPTIONS, args.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX));
     configMetrics.SetFlag("daemon", OptionsCategory::OPTIONS, args.GetBoolArg("-daemon", DEFAULT_DAEMON));
     configMetrics.SetFlag("daemonnowait", OptionsCategory::OPTIONS, args.GetBoolArg("-daemon", DEFAULT_DAEMONWAIT));
@@ -1378,6 +1419,8 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
     configMetrics.SetFlag("peerblockfilters", OptionsCategory::CONNECTION, args.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS));
     configMetrics.SetFlag("permitbaremultisig",  OptionsCategory::CONNECTION, fIsBareMultisigStd);
     configMetrics.SetFlag("persistmempool", OptionsCategory::OPTIONS,  args.GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL));
+    configMetrics.SetFlag("persistscriptcache", OptionsCategory::OPTIONS, args.GetBoolArg("-persistscriptcache", DEFAULT_PERSIST_SCRIPT_CACHE));
+    configMetrics.SetFlag("trustmempoolfile", OptionsCategory::OPTIONS, args.GetBoolArg("-trustmempoolfile", DEFAULT_TRUST_MEMPOOL_FILE));
     configMetrics.SetFlag("proxyrandomize", OptionsCategory::CONNECTION, proxyRandomize);
     configMetrics.SetFlag("reindex", OptionsCategory::OPTIONS, fReindex);
     configMetrics.SetFlag("reindex-chainstate", OptionsCategory::OPTIONS, fReindexChainState);
@@ -1396,6 +1439,7 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
     configMetrics.SetIBD(true); // reset by CChainState::IsInitialBlockDownload()
 
     configMetrics.Set("bantime", OptionsCategory::CONNECTION, "seconds", args.GetArg("-bantime", DEFAULT_MISBEHAVING_BANTIME));
+    configMetrics.Set("blockcompression", OptionsCategory::OPTIONS, "int", uint8_t(g_block_compression));
     configMetrics.Set("blockmaxweight", OptionsCategory::BLOCK_CREATION, "int", args.GetArg("-blockmaxweight", DEFAULT_BLOCK_MAX_WEIGHT));
     configMetrics.Set("blockmintxfee", OptionsCategory::BLOCK_CREATION, "int", args.GetArg("-blockmintxfee", DEFAULT_BLOCK_MIN_TX_FEE));
     configMetrics.Set("bytespersigop", OptionsCategory::NODE_RELAY,"bytes", nBytesPerSigOp);
@@ -1425,6 +1469,28 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
     //configMetrics.Set("chainstate-db", nCoinDBCache);
     //configMetrics.Set("txindex-cache", nTxIndexCache);
 
+    const CoinsBackend other_coins_backend = g_coins_backend == CoinsBackend::LEVELDB ? CoinsBackend::FLATFILE : CoinsBackend::LEVELDB;
+    if (args.GetBoolArg("-convertcoinsdb", false)) {
+        uiInterface.InitMessage(_("Converting chainstate…").translated);
+        std::string error;
+        if (!ConvertCoinsDB(args.GetDataDirNet(), "chainstate", other_coins_backend, g_coins_backend, nCoinDBCache, error)) {
+            if (ShutdownRequested()) {
+                LogPrintf("Shutdown requested. Exiting.\n");
+                return false;
+            }
+            return InitError(Untranslated(error));
+        }
+        LogPrintf("Chainstate conversion done. Exiting.\n");
+        StartShutdown();
+        return true;
+    }
+    if (!fReindex && !fReindexChainState &&
+        !fs::exists(GetCoinsDBPath(args.GetDataDirNet(), "chainstate", g_coins_backend)) &&
+        fs::exists(GetCoinsDBPath(args.GetDataDirNet(), "chainstate", other_coins_backend))) {
+        return InitError(strprintf(_("The chainstate is stored with -coinsbackend=%s. Convert it with -convertcoinsdb or rebuild it with -reindex-chainstate."),
+                                   CoinsBackendName(other_coins_backend)));
+    }
+
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
         const bool fReset = fReindex;
@@ -1749,7 +1815,7 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
     //// debug print
     {
         LOCK(cs_main);
-        LogPrintf("block tree size = %u\n", chainman.BlockIndex().size());
+        LogPrintf("block tree size = %u (%.1f MiB)\n", chainman.BlockIndex().size(), chainman.m_blockman.DynamicMemoryUsage() * (1.0 / (1 << 20)));
         chain_active_height = chainman.ActiveChain().Height();
         if (tip_info) {
             tip_info->block_height = chain_active_height;
@@ -1892,6 +1958,21 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
         banman->DumpBanlist();
     }, DUMP_BANS_INTERVAL);
 
+    if (node.fee_estimator) {
+        CBlockPolicyEstimator* fee_estimator = node.fee_estimator.get();
+        node.scheduler->scheduleEvery([fee_estimator] {
+            fee_estimator->FlushFeeEstimates();
+        }, FEE_FLUSH_INTERVAL);
+    }
+
+    // Dump the mempool in the background as well, so that little is lost on
+    // an unclean shutdown and the dump on shutdown is not the only one.
+    if (args.GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        node.scheduler->scheduleEvery([&node] {
+            if (node.mempool->IsLoaded()) DumpMempool(*node.mempool, node.chainman->ActiveChainstate());
+        }, DUMP_MEMPOOL_INTERVAL);
+    }
+
 #if HAVE_SYSTEM
     StartupNotify(args);
 #endif
@@ -0,0 +1,33 @@
+#include <metrics/metrics.h>
+
+namespace metrics {
+std::unique_ptr<DBMetrics> DBMetrics::make(const std::string& chain, prometheus::Registry& registry, bool noop)
+{
+    auto m = std::make_unique<DBMetrics>();
+    if (noop)
+        return m;
+
+    auto real = new DBMetricsImpl(chain, registry);
+    m.reset(reinterpret_cast<DBMetrics*>(real));
+    return m;
+}
+DBMetricsImpl::DBMetricsImpl(const std::string& chain, prometheus::Registry& registry) : Metrics(chain, registry)
+{
+    _memory_family = &FamilyGauge("leveldb_memory", {{"method", "CDBWrapper::DynamicMemoryUsage"}});
+    _level_family = &FamilyGauge("leveldb_level", {{"method", "CDBWrapper::GetLevelStats"}});
+}
+
+void DBMetricsImpl::MemoryUsage(const std::string& db, size_t bytes)
+{
+    _memory_family->Add({{"db", db}}).Set((double)bytes);
+}
+void DBMetricsImpl::Level(const std::string& db, int level, int files, double size_mb, double compaction_sec, double read_mb, double write_mb)
+{
+    const std::string lvl = std::to_string(level);
+    _level_family->Add({{"db", db}, {"level", lvl}, {"type", "files"}}).Set((double)files);
+    _level_family->Add({{"db", db}, {"level", lvl}, {"type", "size_mb"}}).Set(size_mb);
+    _level_family->Add({{"db", db}, {"level", lvl}, {"type", "compaction_sec"}}).Set(compaction_sec);
+    _level_family->Add({{"db", db}, {"level", lvl}, {"type", "compaction_read_mb"}}).Set(read_mb);
+    _level_family->Add({{"db", db}, {"level", lvl}, {"type", "compaction_write_mb"}}).Set(write_mb);
+}
+} // namespace metrics
@@ -0,0 +1,32 @@
+#include <metrics/metrics.h>
+
+namespace metrics {
+std::unique_ptr<FilterMetrics> FilterMetrics::make(const std::string& chain, prometheus::Registry& registry, bool noop)
+{
+    auto m = std::make_unique<FilterMetrics>();
+    if (noop)
+        return m;
+
+    auto real = new FilterMetricsImpl(chain, registry);
+    m.reset(reinterpret_cast<FilterMetrics*>(real));
+    return m;
+}
+FilterMetricsImpl::FilterMetricsImpl(const std::string& chain, prometheus::Registry& registry) : Metrics(chain, registry)
+{
+    _hits_family = &FamilyCounter("blockfilter_cache_hits", {{"method", "BlockFilterIndex::Lookup"}});
+    _misses_family = &FamilyCounter("blockfilter_cache_misses", {{"method", "BlockFilterIndex::Lookup"}});
+    _disk_reads = &FamilyCounter("blockfilter_disk_reads", {{"method", "BlockFilterIndex::ReadFiltersFromDisk"}}).Add({});
+    _disk_filters = &FamilyCounter("blockfilter_disk_filters", {{"method", "BlockFilterIndex::ReadFiltersFromDisk"}}).Add({});
+}
+
+void FilterMetricsImpl::CacheLookup(const std::string& cache, size_t hits, size_t misses)
+{
+    if (hits) _hits_family->Add({{"cache", cache}}).Increment((double)hits);
+    if (misses) _misses_family->Add({{"cache", cache}}).Increment((double)misses);
+}
+void FilterMetricsImpl::DiskRead(size_t filters)
+{
+    _disk_reads->Increment();
+    _disk_filters->Increment((double)filters);
+}
+} // namespace metrics
@@ -0,0 +1,31 @@
+#include <metrics/metrics.h>
+
+namespace metrics {
+std::unique_ptr<HTTPMetrics> HTTPMetrics::make(const std::string& chain, prometheus::Registry& registry, bool noop)
+{
+    auto m = std::make_unique<HTTPMetrics>();
+    if (noop)
+        return m;
+
+    auto real = new HTTPMetricsImpl(chain, registry);
+    m.reset(reinterpret_cast<HTTPMetrics*>(real));
+    return m;
+}
+HTTPMetricsImpl::HTTPMetricsImpl(const std::string& chain, prometheus::Registry& registry) : Metrics(chain, registry)
+{
+    auto& wait_family = FamilyHistory("http_queue_wait", {{"method", "WorkQueue::Run"}});
+    for (const std::string lane : {"cheap", "expensive"}) {
+        _queue_wait_timer[lane] = &wait_family.Add({{"lane", lane}}, prometheus::Histogram::BucketBoundaries{100, 1000, 10000, 100000, 1000000, 10000000});
+    }
+    _dropped_family = &FamilyCounter("http_queue_dropped", {{"method", "http_request_cb"}});
+}
+
+void HTTPMetricsImpl::QueueWait(const std::string& lane, int64_t us)
+{
+    _queue_wait_timer.at(lane)->Observe((double)us);
+}
+void HTTPMetricsImpl::Dropped(const std::string& lane, const std::string& reason)
+{
+    _dropped_family->Add({{"lane", lane}, {"reason", reason}}).Increment();
+}
+} // namespace metrics
@@ -107,6 +107,26 @@ ConfigMetrics& Container::Config()
     assert(this->_cfg_metrics);
     return *this->_cfg_metrics;
 }
+DBMetrics& Container::DB()
+{
+    assert(this->_db_metrics);
+    return *this->_db_metrics;
+}
+HTTPMetrics& Container::HTTP()
+{
+    assert(this->_http_metrics);
+    return *this->_http_metrics;
+}
+SignalsMetrics& Container::Signals()
+{
+    assert(this->_signals_metrics);
+    return *this->_signals_metrics;
+}
+FilterMetrics& Container::Filters()
+{
+    assert(this->_filter_metrics);
+    return *this->_filter_metrics;
+}
 
 void Container::Init(const std::string& chain, bool noop)
 {
@@ -121,6 +141,10 @@ void Container::Init(const std::string& chain, bool noop)
     //_utxo_metrics =  std::make_unique<UtxoMetrics>(chain, *prom_registry);
     _mempool_metrics = MemPoolMetrics::make(chain, *prom_registry, noop);
     _cfg_metrics = std::make_unique<ConfigMetrics>(chain, *prom_registry);
+    _db_metrics = DBMetrics::make(chain, *prom_registry, noop);
+    _http_metrics = HTTPMetrics::make(chain, *prom_registry, noop);
+    _signals_metrics = SignalsMetrics::make(chain, *prom_registry, noop);
+    _filter_metrics = FilterMetrics::make(chain, *prom_registry, noop);
 }
 
 void Init(const std::string& bind, const std::string& chain, bool noop)
@@ -375,6 +375,99 @@ public:
     void Orphans(size_t map, size_t outpoint) override;
 };
 
+class DBMetrics
+{
+protected:
+    prometheus::Family<prometheus::Gauge>* _memory_family;
+    prometheus::Family<prometheus::Gauge>* _level_family;
+
+public:
+    static std::unique_ptr<DBMetrics> make(const std::string& chain, prometheus::Registry& registry, bool noop);
+    virtual void MemoryUsage(const std::string& db, size_t bytes){};
+    virtual void Level(const std::string& db, int level, int files, double size_mb, double compaction_sec, double read_mb, double write_mb){};
+};
+class DBMetricsImpl : DBMetrics, Metrics
+{
+public:
+    explicit DBMetricsImpl(const std::string& chain, prometheus::Registry& registry);
+    ~DBMetricsImpl(){};
+    void MemoryUsage(const std::string& db, size_t bytes) override;
+    void Level(const std::string& db, int level, int files, double size_mb, double compaction_sec, double read_mb, double write_mb) override;
+};
+
+class HTTPMetrics
+{
+protected:
+    std::map<const std::string, prometheus::Histogram*> _queue_wait_timer;
+    prometheus::Family<prometheus::Counter>* _dropped_family;
+
+public:
+    static std::unique_ptr<HTTPMetrics> make(const std::string& chain, prometheus::Registry& registry, bool noop);
+    virtual ~HTTPMetrics(){};
+    virtual void QueueWait(const std::string& lane, int64_t us){};
+    virtual void Dropped(const std::string& lane, const std::string& reason){};
+};
+class HTTPMetricsImpl : HTTPMetrics, Metrics
+{
+public:
+    explicit HTTPMetricsImpl(const std::string& chain, prometheus::Registry& registry);
+    ~HTTPMetricsImpl(){};
+    void QueueWait(const std::string& lane, int64_t us) override;
+    void Dropped(const std::string& lane, const std::string& reason) override;
+};
+
+class SignalsMetrics
+{
+protected:
+    prometheus::Family<prometheus::Gauge>* _depth_family;
+    prometheus::Family<prometheus::Histogram>* _lag_family;
+
+public:
+    //! Metrics of one subscriber, looked up once when it registers
+    struct Subscriber {
+        prometheus::Gauge* depth{nullptr};
+        prometheus::Histogram* lag{nullptr};
+    };
+
+    static std::unique_ptr<SignalsMetrics> make(const std::string& chain, prometheus::Registry& registry, bool noop);
+    virtual ~SignalsMetrics(){};
+    virtual Subscriber Register(const std::string& subscriber) { return {}; }
+    virtual void QueueDepth(const Subscriber& subscriber, size_t depth){};
+    virtual void Lag(const Subscriber& subscriber, int64_t us){};
+};
+class SignalsMetricsImpl : SignalsMetrics, Metrics
+{
+public:
+    explicit SignalsMetricsImpl(const std::string& chain, prometheus::Registry& registry);
+    ~SignalsMetricsImpl(){};
+    Subscriber Register(const std::string& subscriber) override;
+    void QueueDepth(const Subscriber& subscriber, size_t depth) override;
+    void Lag(const Subscriber& subscriber, int64_t us) override;
+};
+
+class FilterMetrics
+{
+protected:
+    prometheus::Family<prometheus::Counter>* _hits_family;
+    prometheus::Family<prometheus::Counter>* _misses_family;
+    prometheus::Counter* _disk_reads;
+    prometheus::Counter* _disk_filters;
+
+public:
+    static std::unique_ptr<FilterMetrics> make(const std::string& chain, prometheus::Registry& registry, bool noop);
+    virtual ~FilterMetrics(){};
+    virtual void CacheLookup(const std::string& cache, size_t hits, size_t misses){};
+    virtual void DiskRead(size_t filters){};
+};
+class FilterMetricsImpl : FilterMetrics, Metrics
+{
+public:
+    explicit FilterMetricsImpl(const std::string& chain, prometheus::Registry& registry);
+    ~FilterMetricsImpl(){};
+    void CacheLookup(const std::string& cache, size_t hits, size_t misses) override;
+    void DiskRead(size_t filters) override;
+};
+
 class Container
 {
 protected:
@@ -385,6 +478,10 @@ protected:
     //std::unique_ptr<UtxoMetrics> _utxo_metrics;
     std::unique_ptr<MemPoolMetrics> _mempool_metrics;
     std::unique_ptr<ConfigMetrics> _cfg_metrics;
+    std::unique_ptr<DBMetrics> _db_metrics;
+    std::unique_ptr<HTTPMetrics> _http_metrics;
+    std::unique_ptr<SignalsMetrics> _signals_metrics;
+    std::unique_ptr<FilterMetrics> _filter_metrics;
     std::atomic<bool> _init{false};
 
 public:
@@ -401,6 +498,10 @@ public:
     //UtxoMetrics& Utxo();
     MemPoolMetrics& MemPool();
     ConfigMetrics& Config();
+    DBMetrics& DB();
+    HTTPMetrics& HTTP();
+    SignalsMetrics& Signals();
+    FilterMetrics& Filters();
 };
 
 
@@ -0,0 +1,35 @@
+#include <metrics/metrics.h>
+
+namespace metrics {
+std::unique_ptr<SignalsMetrics> SignalsMetrics::make(const std::string& chain, prometheus::Registry& registry, bool noop)
+{
+    auto m = std::make_unique<SignalsMetrics>();
+    if (noop)
+        return m;
+
+    auto real = new SignalsMetricsImpl(chain, registry);
+    m.reset(reinterpret_cast<SignalsMetrics*>(real));
+    return m;
+}
+SignalsMetricsImpl::SignalsMetricsImpl(const std::string& chain, prometheus::Registry& registry) : Metrics(chain, registry)
+{
+    _depth_family = &FamilyGauge("validation_signals_queue_depth", {{"method", "MainSignalsInstance::Enqueue"}});
+    _lag_family = &FamilyHistory("validation_signals_lag", {{"method", "MainSignalsInstance::Enqueue"}});
+}
+
+SignalsMetrics::Subscriber SignalsMetricsImpl::Register(const std::string& subscriber)
+{
+    return {
+        &_depth_family->Add({{"subscriber", subscriber}}),
+        &_lag_family->Add({{"subscriber", subscriber}}, prometheus::Histogram::BucketBoundaries{100, 1000, 10000, 100000, 1000000, 10000000}),
+    };
+}
+void SignalsMetricsImpl::QueueDepth(const Subscriber& subscriber, size_t depth)
+{
+    subscriber.depth->Set((double)depth);
+}
+void SignalsMetricsImpl::Lag(const Subscriber& subscriber, int64_t us)
+{
+    subscriber.lag->Observe((double)us);
+}
+} // namespace metrics
@@ -10,6 +10,8 @@ class MetricsNotificationsInterface final : public CValidationInterface
 public:
     explicit MetricsNotificationsInterface(metrics::BlockMetrics& blockMetrics, metrics::MemPoolMetrics& mempoolMetrics);
 
+    std::string SubscriberName() const override { return "metrics"; }
+
 protected:
     void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
     void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override;
@@ -14,6 +14,7 @@
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
 #include <deploymentstatus.h>
+#include <hash.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <pow.h>
@@ -63,6 +64,7 @@ BlockAssembler::BlockAssembler(CChainState& chainstate, const CTxMemPool& mempoo
       m_chainstate(chainstate)
 {
     blockMinFeeRate = options.blockMinFeeRate;
+    fPrintPriority = gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
     nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
 }
@@ -88,6 +90,7 @@ BlockAssembler::BlockAssembler(CChainState& chainstate, const CTxMemPool& mempoo
 void BlockAssembler::resetBlock()
 {
     inBlock.clear();
+    m_packages.clear();
 
     // Reserve space for coinbase tx
     nBlockWeight = 4000;
@@ -145,9 +148,26 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = DeploymentActiveAfter(pindexPrev, chainparams.GetConsensus(), Consensus::DEPLOYMENT_SEGWIT);
 
+    // The transactions selected for the last template are still the best
+    // choice for the same tip and options, as long as they are all still in
+    // the mempool and none were prioritised since. Only the transactions added
+    // to the mempool since then need to be considered again, unless they
+    // would take the place of some of the selected ones.
+    CHashWriter key_writer(SER_GETHASH, 0);
+    key_writer << pindexPrev->GetBlockHash() << nHeight << nLockTimeCutoff << fIncludeWitness << nBlockMaxWeight << blockMinFeeRate.GetFeePerK();
+    const uint256 selection_key = key_writer.GetHash();
+
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    bool incremental = RestoreSelection(selection_key);
+    if (incremental && !addNewPackageTxs(nPackagesSelected, nDescendantsUpdated)) {
+        RemoveAllFromBlock();
+        incremental = false;
+    }
+    if (!incremental) {
+        indexed_modified_transaction_set mapModifiedTx;
+        addPackageTxs(m_mempool.mapTx.get<ancestor_score>(), mapModifiedTx, nPackagesSelected, nDescendantsUpdated);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -179,9 +199,10 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (!TestBlockValidity(state, chainparams, m_chainstate, *pblock, pindexPrev, false, false)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, state.ToString()));
     }
+    SaveSelection(selection_key);
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants%s), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, incremental ? ", incremental" : "", 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -235,7 +256,6 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     nFees += iter->GetFee();
     inBlock.insert(iter);
 
-    bool fPrintPriority = gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
     if (fPrintPriority) {
         LogPrintf("fee %s txid %s\n",
                   CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(),
@@ -243,6 +263,141 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     }
 }
 
+void BlockAssembler::RemoveLastFromBlock(CTxMemPool::txiter iter)
+{
+    assert(pblocktemplate->block.vtx.back() == iter->GetSharedTx());
+    pblocktemplate->block.vtx.pop_back();
+    pblocktemplate->vTxFees.pop_back();
+    pblocktemplate->vTxSigOpsCost.pop_back();
+    nBlockWeight -= iter->GetTxWeight();
+    --nBlockTx;
+    nBlockSigOpsCost -= iter->GetSigOpCost();
+    nFees -= iter->GetFee();
+    inBlock.erase(iter);
+}
+
+void BlockAssembler::RemoveAllFromBlock()
+{
+    while (nBlockTx > 0) {
+        RemoveLastFromBlock(m_mempool.mapTx.find_by_wtxid(pblocktemplate->block.vtx.back()->GetWitnessHash()));
+    }
+    m_packages.clear();
+}
+
+bool BlockAssembler::RestoreSelection(const uint256& key)
+{
+    const CTxMemPool::TemplateSelection& selection = m_mempool.m_template_selection;
+    if (selection.key != key) return false;
+
+    size_t pos = 0;
+    for (const auto& package : selection.packages) {
+        for (; pos < package.end; ++pos) {
+            CTxMemPool::txiter it = m_mempool.mapTx.find_by_wtxid(selection.wtxids[pos]);
+            // A transaction that left the mempool may have made room for others
+            bool valid = it != m_mempool.mapTx.end();
+            if (valid) {
+                for (const CTxMemPool::txiter parent : it->GetMemPoolParentsConst()) {
+                    valid &= inBlock.count(parent) > 0;
+                }
+            }
+            if (!valid) {
+                RemoveAllFromBlock();
+                return false;
+            }
+            AddToBlock(it);
+        }
+        m_packages.push_back(package);
+    }
+    return true;
+}
+
+bool BlockAssembler::addNewPackageTxs(int& nPackagesSelected, int& nDescendantsUpdated)
+{
+    CTxMemPool::setEntries added;
+    for (const uint256& wtxid : m_mempool.m_template_selection.added) {
+        CTxMemPool::txiter it = m_mempool.mapTx.find_by_wtxid(wtxid);
+        if (it != m_mempool.mapTx.end() && !inBlock.count(it)) added.insert(it);
+    }
+    if (added.empty()) return true;
+    std::vector<CTxMemPool::txiter> candidates(added.begin(), added.end());
+
+    // Find the best feerate among the new packages, and whether they all fit
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    CTxMemPool::setEntries new_txs;
+    CAmount best_fees{0};
+    uint64_t best_size{0};
+    for (const CTxMemPool::txiter it : candidates) {
+        CTxMemPool::setEntries ancestors;
+        m_mempool.CalculateMemPoolAncestors(*it, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        onlyUnconfirmed(ancestors);
+        ancestors.insert(it);
+        CAmount fees{0};
+        uint64_t size{0};
+        for (const CTxMemPool::txiter anc : ancestors) {
+            fees += anc->GetModifiedFee();
+            size += anc->GetTxSize();
+        }
+        if (best_size == 0 || double(fees) * best_size > double(best_fees) * size) {
+            best_fees = fees;
+            best_size = size;
+        }
+        new_txs.insert(ancestors.begin(), ancestors.end());
+    }
+    uint64_t new_size{0};
+    int64_t new_sigops{0};
+    for (const CTxMemPool::txiter it : new_txs) {
+        new_size += it->GetTxSize();
+        new_sigops += it->GetSigOpCost();
+    }
+
+    // When the new packages do not all fit, a selected package with a lower
+    // feerate than the best of them may have to make room for it. A block
+    // built from scratch then also reconsiders the packages rejected before
+    // with a feerate in between, which may fit in the room left, so build it
+    // from scratch. Otherwise all of the selected packages stay in the block,
+    // and the packages rejected before still do not fit.
+    if (!TestPackage(new_size, new_sigops)) {
+        for (const CTxMemPool::TemplateSelection::Package& package : m_packages) {
+            if (double(package.fees) * best_size < double(best_fees) * package.size) return false;
+        }
+    }
+
+    // Account for the ancestors of the candidates already in the block
+    indexed_modified_transaction_set mapModifiedTx;
+    for (const CTxMemPool::txiter it : candidates) {
+        CTxMemPool::setEntries ancestors;
+        m_mempool.CalculateMemPoolAncestors(*it, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        CTxMemPoolModifiedEntry modEntry(it);
+        bool modified{false};
+        for (const CTxMemPool::txiter anc : ancestors) {
+            if (!inBlock.count(anc)) continue;
+            modEntry.nSizeWithAncestors -= anc->GetTxSize();
+            modEntry.nModFeesWithAncestors -= anc->GetModifiedFee();
+            modEntry.nSigOpCostWithAncestors -= anc->GetSigOpCost();
+            modified = true;
+        }
+        if (modified) mapModifiedTx.insert(modEntry);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](CTxMemPool::txiter a, CTxMemPool::txiter b) { return CompareTxMemPoolEntryByAncestorFee()(*a, *b); });
+    addPackageTxs(candidates, mapModifiedTx, nPackagesSelected, nDescendantsUpdated);
+    return true;
+}
+
+void BlockAssembler::SaveSelection(const uint256& key)
+{
+    CTxMemPool::TemplateSelection& selection = m_mempool.m_template_selection;
+    selection.key = key;
+    selection.wtxids.clear();
+    selection.wtxids.reserve(nBlockTx);
+    for (size_t i = 1; i < pblocktemplate->block.vtx.size(); ++i) {
+        selection.wtxids.push_back(pblocktemplate->block.vtx[i]->GetWitnessHash());
+    }
+    selection.packages = m_packages;
+    selection.added.clear();
+}
+
 int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
         indexed_modified_transaction_set &mapModifiedTx)
 {
@@ -306,19 +461,15 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::ve
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
+void BlockAssembler::addPackageTxs(const std::vector<CTxMemPool::txiter>& by_ancestor_score, indexed_modified_transaction_set& mapModifiedTx,
+                                   int& nPackagesSelected, int& nDescendantsUpdated)
 {
-    // mapModifiedTx will store sorted packages after they are modified
+    // mapModifiedTx stores sorted packages after they are modified
     // because some of their txs are already in the block
-    indexed_modified_transaction_set mapModifiedTx;
     // Keep track of entries that failed inclusion, to avoid duplicate work
     CTxMemPool::setEntries failedTx;
 
-    // Start by adding all descendants of previously added txs to mapModifiedTx
-    // and modifying them for their already included ancestors
-    UpdatePackagesForAdded(inBlock, mapModifiedTx);
-
-    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = m_mempool.mapTx.get<ancestor_score>().begin();
+    std::vector<CTxMemPool::txiter>::const_iterator mi = by_ancestor_score.begin();
     CTxMemPool::txiter iter;
 
     // Limit the number of attempts to add transactions to the block when it is
@@ -327,10 +478,10 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
     int64_t nConsecutiveFailed = 0;
 
-    while (mi != m_mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty()) {
+    while (mi != by_ancestor_score.end() || !mapModifiedTx.empty()) {
         // First try to find a new transaction in mapTx to evaluate.
-        if (mi != m_mempool.mapTx.get<ancestor_score>().end() &&
-            SkipMapTxEntry(m_mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
+        if (mi != by_ancestor_score.end() &&
+            SkipMapTxEntry(*mi, mapModifiedTx, failedTx)) {
             ++mi;
             continue;
         }
@@ -340,13 +491,13 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         bool fUsingModified = false;
 
         modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
-        if (mi == m_mempool.mapTx.get<ancestor_score>().end()) {
+        if (mi == by_ancestor_score.end()) {
             // We're out of entries in mapTx; use the entry from mapModifiedTx
             iter = modit->iter;
             fUsingModified = true;
         } else {
             // Try to compare the mapTx entry to the mapModifiedTx entry
-            iter = m_mempool.mapTx.project<0>(mi);
+            iter = *mi;
             if (modit != mapModifiedTx.get<ancestor_score>().end() &&
                     CompareTxMemPoolEntryByAncestorFee()(*modit, CTxMemPoolModifiedEntry(iter))) {
                 // The best entry in mapModifiedTx has higher score
@@ -427,6 +578,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             // Erase from the modified set, if present
             mapModifiedTx.erase(sortedEntries[i]);
         }
+        m_packages.push_back({nBlockTx, packageFees, packageSize});
 
         ++nPackagesSelected;
 
@@ -131,6 +131,7 @@ private:
 
     // Configuration parameters for the block size
     bool fIncludeWitness;
+    bool fPrintPriority;
     unsigned int nBlockMaxWeight;
     CFeeRate blockMinFeeRate;
 
@@ -140,6 +141,8 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    //! The packages added to the block, in order
+    std::vector<CTxMemPool::TemplateSelection::Package> m_packages;
 
     // Chain context for the block
     int nHeight;
@@ -170,12 +173,29 @@ private:
     void resetBlock();
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Remove the last tx added to the block */
+    void RemoveLastFromBlock(CTxMemPool::txiter iter);
+    /** Remove all txs from the block, leaving it empty */
+    void RemoveAllFromBlock() EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 
     // Methods for how to add transactions to a block.
-    /** Add transactions based on feerate including unconfirmed ancestors
+    /** Add transactions based on feerate including unconfirmed ancestors,
+      * from candidates sorted by ancestor score and from mapModifiedTx.
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int& nPackagesSelected, int& nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    void addPackageTxs(const std::vector<CTxMemPool::txiter>& candidates, indexed_modified_transaction_set& mapModifiedTx,
+                       int& nPackagesSelected, int& nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Add the transactions of the mempool's template selection to the block.
+      * Returns false, leaving the block empty, if they were selected for
+      * another tip or other options, or if any of them left the mempool. */
+    bool RestoreSelection(const uint256& key) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Select from the transactions added to the mempool since the restored
+      * selection was made. Returns false, leaving the block as restored, if
+      * they do not all fit and a selected package has a lower feerate than
+      * the best of them, in which case the block has to be built from scratch. */
+    bool addNewPackageTxs(int& nPackagesSelected, int& nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Store the transactions of the block as the mempool's template selection */
+    void SaveSelection(const uint256& key) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
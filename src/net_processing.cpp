@@ -164,6 +164,8 @@ static constexpr double MAX_ADDR_RATE_PER_SECOND{0.1};
  *  based increments won't go above this, but the MAX_ADDR_TO_SEND increment following GETADDR
  *  is exempt from this limit. */
 static constexpr size_t MAX_ADDR_PROCESSING_TOKEN_BUCKET{MAX_ADDR_TO_SEND};
+/** The maximum number of queued TX messages from a peer whose scripts are verified together */
+static constexpr size_t MAX_PREVERIFIED_TXS{100};
 
 static const auto& metricsContainer = metrics::Instance();
 
@@ -257,6 +259,12 @@ struct Peer {
     /** Set of txids to reconsider once their parent transactions have been accepted **/
     std::set<uint256> m_orphan_work_set GUARDED_BY(g_cs_orphans);
 
+    /** Number of the next TX messages from this peer whose scripts were already
+     *  verified by PreverifyTransactions(). Only used by the message handler thread. */
+    size_t m_txs_preverified{0};
+    /** Script failures of the transactions of these messages, by wtxid */
+    std::map<uint256, TxValidationState> m_preverified_rejects;
+
     /** Protects m_getdata_requests **/
     Mutex m_getdata_requests_mutex;
     /** Work queue of items requested by this peer **/
@@ -351,6 +359,11 @@ private:
     bool MaybeDiscourageAndDisconnect(CNode& pnode, Peer& peer);
 
     void ProcessOrphanTx(std::set<uint256>& orphan_work_set) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans);
+
+    /** Verify the scripts of the transaction in msg, a TX message from node, and
+     *  of those in the TX messages that follow it in its receive queue, in
+     *  parallel. Does nothing if this was done already, when msg was queued. */
+    void PreverifyTransactions(CNode& node, Peer& peer, const CNetMessage& msg);
     /** Process a single headers message from a peer. */
     void ProcessHeadersMessage(CNode& pfrom, const Peer& peer,
                                const std::vector<CBlockHeader>& headers,
@@ -1631,6 +1644,54 @@ bool PeerManagerImpl::AlreadyHaveTx(const GenTxid& gtxid)
     return recentRejects->contains(hash) || m_mempool.exists(gtxid);
 }
 
+void PeerManagerImpl::PreverifyTransactions(CNode& node, Peer& peer, const CNetMessage& msg)
+{
+    if (peer.m_txs_preverified > 0) {
+        --peer.m_txs_preverified;
+        return;
+    }
+    peer.m_preverified_rejects.clear();
+    // Without script check threads there is nothing to gain
+    if (!g_parallel_script_checks || node.m_tx_relay == nullptr) return;
+    if (m_ignore_incoming_txs && !node.HasPermission(NetPermissionFlags::Relay)) return;
+
+    // Only this thread removes messages from vProcessMsg, and the socket
+    // handler only appends to it, so the queued messages stay in place and
+    // can be read after the lock is released.
+    std::vector<const CNetMessage*> msgs{&msg};
+    {
+        LOCK(node.cs_vProcessMsg);
+        for (const CNetMessage& next : node.vProcessMsg) {
+            if (next.m_command != NetMsgType::TX || msgs.size() >= MAX_PREVERIFIED_TXS) break;
+            msgs.push_back(&next);
+        }
+    }
+    // A lone transaction is verified by AcceptToMemoryPool() as usual
+    if (msgs.size() < 2) return;
+    peer.m_txs_preverified = msgs.size() - 1;
+
+    std::vector<CTransactionRef> txs;
+    txs.reserve(msgs.size());
+    for (const CNetMessage* next : msgs) {
+        // Read without consuming the stream that ProcessMessage() reads later
+        CTransactionRef tx;
+        try {
+            VectorReader{SER_NETWORK, node.GetCommonVersion(), MakeUCharSpan(next->m_recv), 0} >> tx;
+        } catch (const std::exception&) {
+            // ProcessMessage() will deal with it
+            continue;
+        }
+        txs.push_back(std::move(tx));
+    }
+    {
+        LOCK2(cs_main, g_cs_orphans);
+        txs.erase(std::remove_if(txs.begin(), txs.end(), [&](const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+            return AlreadyHaveTx(GenTxid(/* is_wtxid=*/true, tx->GetWitnessHash()));
+        }), txs.end());
+    }
+    peer.m_preverified_rejects = PreverifyTransactionScripts(m_chainman.ActiveChainstate(), m_mempool, txs);
+}
+
 bool PeerManagerImpl::AlreadyHaveBlock(const uint256& block_hash)
 {
     return m_chainman.m_blockman.LookupBlockIndex(block_hash) != nullptr;
@@ -1929,9 +1990,9 @@ void PeerManagerImpl::ProcessGetData(CNode& pfrom, Peer& peer, const std::atomic
                 if (txiter) {
                     const CTxMemPoolEntry::Parents& parents = (*txiter)->GetMemPoolParentsConst();
                     parent_ids_to_add.reserve(parents.size());
-                    for (const CTxMemPoolEntry& parent : parents) {
-                        if (parent.GetTime() > now - UNCONDITIONAL_RELAY_DELAY) {
-                            parent_ids_to_add.push_back(parent.GetTx().GetHash());
+                    for (const CTxMemPool::txiter& parent : parents) {
+                        if (parent->GetTime() > now - UNCONDITIONAL_RELAY_DELAY) {
+                            parent_ids_to_add.push_back(parent->GetTx().GetHash());
                         }
                     }
                 }
@@ -3225,7 +3286,10 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
             return;
         }
 
-        const MempoolAcceptResult result = AcceptToMemoryPool(m_chainman.ActiveChainstate(), m_mempool, ptx, false /* bypass_limits */);
+        // The scripts of the transaction may have been found invalid already by PreverifyTransactions()
+        const auto preverified_reject = peer->m_preverified_rejects.find(wtxid);
+        const MempoolAcceptResult result = AcceptToMemoryPool(m_chainman.ActiveChainstate(), m_mempool, ptx, false /* bypass_limits */,
+            false /* test_accept */, preverified_reject != peer->m_preverified_rejects.end() ? &preverified_reject->second : nullptr);
         const TxValidationState& state = result.m_state;
 
         if (result.m_result_type == MempoolAcceptResult::ResultType::VALID) {
@@ -4074,6 +4138,7 @@ bool PeerManagerImpl::ProcessMessages(CNode* pfrom, std::atomic<bool>& interrupt
 
     try {
         auto start = std::chrono::high_resolution_clock::now();
+        if (msg_type == NetMsgType::TX) PreverifyTransactions(*pfrom, *peer, msg);
         ProcessMessage(*pfrom, msg_type, msg.m_recv, msg.m_time, interruptMsgProc);
         auto end = std::chrono::high_resolution_clock::now();
         auto diff = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
@@ -0,0 +1,128 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <node/blockcompression.h>
+
+#include <logging.h>
+
+#include <zlib.h>
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif // USE_ZSTD
+
+namespace {
+//! Favour speed over ratio: block data is mostly hashes, keys and signatures,
+//! and compression sits on the block download path.
+constexpr int ZLIB_LEVEL{Z_BEST_SPEED};
+#ifdef USE_ZSTD
+constexpr int ZSTD_LEVEL{3};
+#endif // USE_ZSTD
+} // namespace
+
+std::optional<BlockCompression> ParseBlockCompression(const std::string& name)
+{
+    if (name == "none") return BlockCompression::NONE;
+    if (name == "zlib") return BlockCompression::ZLIB;
+    if (name == "zstd") return BlockCompression::ZSTD;
+    return std::nullopt;
+}
+
+std::string BlockCompressionName(BlockCompression method)
+{
+    switch (method) {
+    case BlockCompression::NONE: return "none";
+    case BlockCompression::ZLIB: return "zlib";
+    case BlockCompression::ZSTD: return "zstd";
+    } // no default case, so the compiler can warn about missing cases
+    return "unknown";
+}
+
+bool BlockCompressionSupported(BlockCompression method)
+{
+    switch (method) {
+    case BlockCompression::NONE:
+    case BlockCompression::ZLIB:
+        return true;
+    case BlockCompression::ZSTD:
+#ifdef USE_ZSTD
+        return true;
+#else
+        return false;
+#endif // USE_ZSTD
+    } // no default case, so the compiler can warn about missing cases
+    return false;
+}
+
+std::string SupportedBlockCompressions()
+{
+    std::string names;
+    for (BlockCompression method : {BlockCompression::NONE, BlockCompression::ZLIB, BlockCompression::ZSTD}) {
+        if (!BlockCompressionSupported(method)) continue;
+        if (!names.empty()) names += ", ";
+        names += BlockCompressionName(method);
+    }
+    return names;
+}
+
+bool CompressBlockData(BlockCompression method, Span<const uint8_t> data, std::vector<uint8_t>& out)
+{
+    switch (method) {
+    case BlockCompression::NONE:
+        return false;
+    case BlockCompression::ZLIB: {
+        uLongf out_size = compressBound(data.size());
+        out.resize(out_size);
+        const int ret = compress2(out.data(), &out_size, data.data(), data.size(), ZLIB_LEVEL);
+        if (ret != Z_OK) {
+            LogPrintf("%s: zlib error %d\n", __func__, ret);
+            return false;
+        }
+        out.resize(out_size);
+        return true;
+    }
+    case BlockCompression::ZSTD: {
+#ifdef USE_ZSTD
+        out.resize(ZSTD_compressBound(data.size()));
+        const size_t ret = ZSTD_compress(out.data(), out.size(), data.data(), data.size(), ZSTD_LEVEL);
+        if (ZSTD_isError(ret)) {
+            LogPrintf("%s: zstd error: %s\n", __func__, ZSTD_getErrorName(ret));
+            return false;
+        }
+        out.resize(ret);
+        return true;
+#else
+        return false;
+#endif // USE_ZSTD
+    }
+    } // no default case, so the compiler can warn about missing cases
+    return false;
+}
+
+bool DecompressBlockData(BlockCompression method, Span<const uint8_t> data, size_t size, std::vector<uint8_t>& out)
+{
+    out.resize(size);
+    switch (method) {
+    case BlockCompression::NONE:
+        return false;
+    case BlockCompression::ZLIB: {
+        uLongf out_size = size;
+        const int ret = uncompress(out.data(), &out_size, data.data(), data.size());
+        return ret == Z_OK && out_size == size;
+    }
+    case BlockCompression::ZSTD: {
+#ifdef USE_ZSTD
+        const size_t ret = ZSTD_decompress(out.data(), out.size(), data.data(), data.size());
+        return !ZSTD_isError(ret) && ret == size;
+#else
+        return false;
+#endif // USE_ZSTD
+    }
+    } // no default case, so the compiler can warn about missing cases
+    return false;
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKCOMPRESSION_H
+#define BITCOIN_NODE_BLOCKCOMPRESSION_H
+
+#include <span.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * Compression methods for the records in blk?????.dat and rev?????.dat files.
+ * The value is stored with every record (see BLOCK_RECORD_COMPRESSION_SHIFT),
+ * so it must never be changed for an existing method.
+ */
+enum class BlockCompression : uint8_t {
+    NONE = 0,
+    ZLIB = 1,
+    ZSTD = 2,
+};
+
+/** Parse the name of a compression method, as used by -blockcompression */
+std::optional<BlockCompression> ParseBlockCompression(const std::string& name);
+std::string BlockCompressionName(BlockCompression method);
+/** Whether this build can compress and decompress records with method */
+bool BlockCompressionSupported(BlockCompression method);
+/** Comma separated names of the methods this build supports */
+std::string SupportedBlockCompressions();
+
+/** Compress data with method, which must not be NONE, replacing the contents of out */
+bool CompressBlockData(BlockCompression method, Span<const uint8_t> data, std::vector<uint8_t>& out);
+/** Decompress data that is known to decompress to exactly size bytes into out */
+bool DecompressBlockData(BlockCompression method, Span<const uint8_t> data, size_t size, std::vector<uint8_t>& out);
+
+#endif // BITCOIN_NODE_BLOCKCOMPRESSION_H
@@ -8,6 +8,7 @@
 #include <chainparams.h>
 #include <clientversion.h>
 #include <consensus/validation.h>
+#include <core_memusage.h>
 #include <flatfile.h>
 #include <fs.h>
 #include <hash.h>
@@ -17,13 +18,17 @@
 #include <streams.h>
 #include <undo.h>
 #include <util/system.h>
+#include <util/thread.h>
 #include <validation.h>
 
+#include <algorithm>
+
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
 bool fPruneMode = false;
 uint64_t nPruneTarget = 0;
+BlockCompression g_block_compression{BlockCompression::NONE};
 
 // TODO make namespace {
 RecursiveMutex cs_LastBlockFile;
@@ -105,7 +110,129 @@ CBlockFileInfo* GetBlockFileInfo(size_t n)
     return &vinfoBlockFile.at(n);
 }
 
-static bool UndoWriteToDisk(const CBlockUndo& blockundo, FlatFilePos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+static_assert(MAX_BLOCK_SERIALIZED_SIZE <= BLOCK_RECORD_SIZE_MASK, "block records must fit the size field");
+
+/**
+ * Compress the serialization of obj with g_block_compression. The record is
+ * left uncompressed if compression is off, does not make it smaller, or if
+ * the serialization does not fit the size field.
+ */
+template <typename T>
+static CompressedRecord CompressRecord(const T& obj)
+{
+    CompressedRecord record;
+    const BlockCompression compression = g_block_compression;
+    if (compression == BlockCompression::NONE) return record;
+
+    std::vector<uint8_t> serialized;
+    CVectorWriter{SER_DISK, CLIENT_VERSION, serialized, 0, obj};
+    if (serialized.size() > BLOCK_RECORD_SIZE_MASK) return record;
+    std::vector<uint8_t> compressed;
+    if (!CompressBlockData(compression, serialized, compressed) || compressed.size() + 4 >= serialized.size()) {
+        return record;
+    }
+    CVectorWriter{SER_DISK, CLIENT_VERSION, record.data, 0, uint32_t(serialized.size())};
+    record.data.insert(record.data.end(), compressed.begin(), compressed.end());
+    record.compression = compression;
+    return record;
+}
+
+CompressedRecord CompressBlockRecord(const CBlock& block)
+{
+    return CompressRecord(block);
+}
+
+/** The size of a record on disk, without its header */
+template <typename T>
+static size_t RecordSize(const T& obj, const CompressedRecord& record)
+{
+    return record.compression == BlockCompression::NONE ? ::GetSerializeSize(obj, CLIENT_VERSION) : record.data.size();
+}
+
+static uint32_t RecordSizeField(BlockCompression compression, size_t size)
+{
+    return std::min<size_t>(size, BLOCK_RECORD_SIZE_MASK) | uint32_t(compression) << BLOCK_RECORD_COMPRESSION_SHIFT;
+}
+
+/**
+ * Read the data of a compressed record of size bytes from s and decompress
+ * it into data. Throws std::ios_base::failure if it cannot be decompressed
+ * or would be larger than max_size.
+ */
+template <typename Stream>
+static void ReadCompressedRecord(Stream& s, BlockCompression compression, uint32_t size, size_t max_size, std::vector<uint8_t>& data)
+{
+    if (!BlockCompressionSupported(compression)) {
+        throw std::ios_base::failure(strprintf("unsupported compression method %u", uint8_t(compression)));
+    }
+    uint32_t uncompressed_size;
+    if (size < sizeof(uncompressed_size)) {
+        throw std::ios_base::failure("compressed record too short");
+    }
+    s >> uncompressed_size;
+    if (uncompressed_size > max_size) {
+        throw std::ios_base::failure("compressed record too large");
+    }
+    std::vector<uint8_t> compressed(size - sizeof(uncompressed_size));
+    s.read((char*)compressed.data(), compressed.size());
+    if (!DecompressBlockData(compression, compressed, uncompressed_size, data)) {
+        throw std::ios_base::failure(strprintf("%s decompression failed", BlockCompressionName(compression)));
+    }
+}
+
+/**
+ * Read the serialized undo data of the record at pos, decompressed, into data
+ * and its checksum into checksum. Throws std::ios_base::failure on errors.
+ */
+static void ReadUndoRecord(const FlatFilePos& pos, std::vector<uint8_t>& data, uint256& checksum)
+{
+    // Open history file to read, at the size field of the record header
+    FlatFilePos hpos = pos;
+    hpos.nPos -= 4;
+    CAutoFile filein(OpenUndoFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        throw std::ios_base::failure("OpenUndoFile failed");
+    }
+
+    uint32_t size_field;
+    filein >> size_field;
+    const auto compression = BlockCompression(size_field >> BLOCK_RECORD_COMPRESSION_SHIFT);
+    uint64_t size = size_field & BLOCK_RECORD_SIZE_MASK;
+    bool plain = compression == BlockCompression::NONE;
+    if (!plain) {
+        try {
+            ReadCompressedRecord(filein, compression, size, MAX_SIZE, data);
+        } catch (const std::ios_base::failure&) {
+            // Earlier versions wrote plain records of 16 MiB or more with the
+            // size over the whole field. The checksum tells whether it is one.
+            if (fseek(filein.Get(), pos.nPos, SEEK_SET)) {
+                throw std::ios_base::failure("fseek failed");
+            }
+            size = size_field;
+            plain = true;
+        }
+    } else if (size == BLOCK_RECORD_SIZE_MASK) {
+        // The size did not fit the size field; find it by deserializing
+        CBlockUndo blockundo;
+        filein >> blockundo;
+        const long end = ftell(filein.Get());
+        if (end < 0 || fseek(filein.Get(), pos.nPos, SEEK_SET)) {
+            throw std::ios_base::failure("ftell or fseek failed");
+        }
+        size = end - pos.nPos;
+    }
+    if (plain) {
+        // Check the size against the file before allocating for it
+        if (fseek(filein.Get(), 0, SEEK_END) || ftell(filein.Get()) < int64_t(pos.nPos + size) || fseek(filein.Get(), pos.nPos, SEEK_SET)) {
+            throw std::ios_base::failure("undo record past the end of the file");
+        }
+        data.resize(size);
+        filein.read((char*)data.data(), data.size());
+    }
+    filein >> checksum;
+}
+
+static bool UndoWriteToDisk(const CBlockUndo& blockundo, const CompressedRecord& record, FlatFilePos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
@@ -114,8 +241,7 @@ static bool UndoWriteToDisk(const CBlockUndo& blockundo, FlatFilePos& pos, const
     }
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(blockundo, fileout.GetVersion());
-    fileout << messageStart << nSize;
+    fileout << messageStart << RecordSizeField(record.compression, RecordSize(blockundo, record));
 
     // Write undo data
     long fileOutPos = ftell(fileout.Get());
@@ -123,7 +249,11 @@ static bool UndoWriteToDisk(const CBlockUndo& blockundo, FlatFilePos& pos, const
         return error("%s: ftell failed", __func__);
     }
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    if (record.compression == BlockCompression::NONE) {
+        fileout << blockundo;
+    } else {
+        fileout.write((const char*)record.data.data(), record.data.size());
+    }
 
     // calculate & write checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
@@ -136,30 +266,53 @@ static bool UndoWriteToDisk(const CBlockUndo& blockundo, FlatFilePos& pos, const
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
 {
-    FlatFilePos pos = pindex->GetUndoPos();
+    const FlatFilePos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
         return error("%s: no undo data available", __func__);
     }
 
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        return error("%s: OpenUndoFile failed", __func__);
-    }
-
     // Read block
     uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
+    uint256 hash;
     try {
+        std::vector<uint8_t> data;
+        ReadUndoRecord(pos, data, hashChecksum);
+        VectorReader reader(SER_DISK, CLIENT_VERSION, data, 0);
+        CHashVerifier<VectorReader> verifier(&reader); // We need a CHashVerifier as reserializing may lose data
         verifier << pindex->pprev->GetBlockHash();
         verifier >> blockundo;
-        filein >> hashChecksum;
+        hash = verifier.GetHash();
     } catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
     }
 
     // Verify checksum
-    if (hashChecksum != verifier.GetHash()) {
+    if (hashChecksum != hash) {
+        return error("%s: Checksum mismatch", __func__);
+    }
+
+    return true;
+}
+
+bool ReadRawUndoFromDisk(std::vector<uint8_t>& undo, const CBlockIndex* pindex)
+{
+    const FlatFilePos pos = pindex->GetUndoPos();
+    if (pos.IsNull()) {
+        return error("%s: no undo data available", __func__);
+    }
+
+    uint256 hashChecksum;
+    try {
+        ReadUndoRecord(pos, undo, hashChecksum);
+    } catch (const std::exception& e) {
+        return error("%s: I/O error - %s", __func__, e.what());
+    }
+
+    // The checksum covers the serialized undo data, which is what was read
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << pindex->pprev->GetBlockHash();
+    hasher.write((const char*)undo.data(), undo.size());
+    if (hasher.GetHash() != hashChecksum) {
         return error("%s: Checksum mismatch", __func__);
     }
 
@@ -310,7 +463,7 @@ static bool FindUndoPos(BlockValidationState& state, int nFile, FlatFilePos& pos
     return true;
 }
 
-static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessageHeader::MessageStartChars& messageStart)
+static bool WriteBlockToDisk(const CBlock& block, const CompressedRecord& record, FlatFilePos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -319,8 +472,7 @@ static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessa
     }
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(block, fileout.GetVersion());
-    fileout << messageStart << nSize;
+    fileout << messageStart << RecordSizeField(record.compression, RecordSize(block, record));
 
     // Write block
     long fileOutPos = ftell(fileout.Get());
@@ -328,7 +480,11 @@ static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessa
         return error("WriteBlockToDisk: ftell failed");
     }
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    if (record.compression == BlockCompression::NONE) {
+        fileout << block;
+    } else {
+        fileout.write((const char*)record.data.data(), record.data.size());
+    }
 
     return true;
 }
@@ -337,11 +493,15 @@ bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationState& st
 {
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
+        // The undo data only exists once the block is connected, so unlike
+        // blocks it is compressed while cs_main is held.
+        const CompressedRecord record = CompressRecord(blockundo);
+        const unsigned int nUndoSize = RecordSize(blockundo, record);
         FlatFilePos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, CLIENT_VERSION) + 40)) {
+        if (!FindUndoPos(state, pindex->nFile, _pos, nUndoSize + 40)) {
             return error("ConnectBlock(): FindUndoPos failed");
         }
-        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart())) {
+        if (!UndoWriteToDisk(blockundo, record, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart())) {
             return AbortNode(state, "Failed to write undo data");
         }
         // rev files are written in block height order, whereas blk files are written as blocks come in (often out of order)
@@ -366,15 +526,26 @@ bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::P
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    // Open history file to read, at the size field of the record header
+    FlatFilePos hpos = pos;
+    hpos.nPos -= 4;
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull()) {
         return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
     }
 
     // Read block
     try {
-        filein >> block;
+        uint32_t size_field;
+        filein >> size_field;
+        const auto compression = BlockCompression(size_field >> BLOCK_RECORD_COMPRESSION_SHIFT);
+        if (compression == BlockCompression::NONE) {
+            filein >> block;
+        } else {
+            std::vector<uint8_t> data;
+            ReadCompressedRecord(filein, compression, size_field & BLOCK_RECORD_SIZE_MASK, MAX_BLOCK_SERIALIZED_SIZE, data);
+            VectorReader(SER_DISK, CLIENT_VERSION, data, 0) >> block;
+        }
     } catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
     }
@@ -431,6 +602,12 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, c
                          HexStr(message_start));
         }
 
+        const auto compression = BlockCompression(blk_size >> BLOCK_RECORD_COMPRESSION_SHIFT);
+        if (compression != BlockCompression::NONE) {
+            ReadCompressedRecord(filein, compression, blk_size & BLOCK_RECORD_SIZE_MASK, MAX_BLOCK_SERIALIZED_SIZE, block);
+            return true;
+        }
+
         if (blk_size > MAX_SIZE) {
             return error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__, pos.ToString(),
                          blk_size, MAX_SIZE);
@@ -456,20 +633,51 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
     return ReadRawBlockFromDisk(block, block_pos, message_start);
 }
 
+/** Read the size of the record at pos in a block file from its header */
+static bool ReadBlockRecordSize(const FlatFilePos& pos, unsigned int& size)
+{
+    FlatFilePos hpos = pos;
+    hpos.nPos -= 4;
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    }
+    try {
+        uint32_t size_field;
+        filein >> size_field;
+        size = size_field & BLOCK_RECORD_SIZE_MASK;
+    } catch (const std::exception& e) {
+        return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
 /** Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk */
-FlatFilePos SaveBlockToDisk(const CBlock& block, int nHeight, CChain& active_chain, const CChainParams& chainparams, const FlatFilePos* dbp)
+FlatFilePos SaveBlockToDisk(const CBlock& block, int nHeight, CChain& active_chain, const CChainParams& chainparams, const FlatFilePos* dbp, const CompressedRecord* compressed)
 {
-    unsigned int nBlockSize = ::GetSerializeSize(block, CLIENT_VERSION);
+    unsigned int nBlockSize;
+    CompressedRecord record;
     FlatFilePos blockPos;
     if (dbp != nullptr) {
+        // Blocks that are already on disk are not compressed again, and the
+        // record may or may not have been compressed when it was written
+        if (!ReadBlockRecordSize(*dbp, nBlockSize)) {
+            return FlatFilePos();
+        }
         blockPos = *dbp;
+    } else {
+        if (compressed == nullptr) {
+            record = CompressRecord(block);
+            compressed = &record;
+        }
+        nBlockSize = RecordSize(block, *compressed);
     }
     if (!FindBlockPos(blockPos, nBlockSize + 8, nHeight, active_chain, block.GetBlockTime(), dbp != nullptr)) {
         error("%s: FindBlockPos failed", __func__);
         return FlatFilePos();
     }
     if (dbp == nullptr) {
-        if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart())) {
+        if (!WriteBlockToDisk(block, *compressed, blockPos, chainparams.MessageStart())) {
             AbortNode("Failed to write block");
             return FlatFilePos();
         }
@@ -477,6 +685,175 @@ FlatFilePos SaveBlockToDisk(const CBlock& block, int nHeight, CChain& active_cha
     return blockPos;
 }
 
+void ReadBlocksFromFile(FILE* file, int file_number, const CChainParams& chainparams, const std::function<bool(ExternalBlock&&)>& sink)
+{
+    // This takes over file and calls fclose() on it in the CBufferedFile destructor
+    CBufferedFile blkdat(file, 2 * MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE + 8, SER_DISK, CLIENT_VERSION);
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof()) {
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        BlockCompression compression{BlockCompression::NONE};
+        try {
+            // locate a header
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(chainparams.MessageStart()[0]);
+            nRewind = blkdat.GetPos() + 1;
+            blkdat >> buf;
+            if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE)) {
+                continue;
+            }
+            // read size
+            blkdat >> nSize;
+            compression = BlockCompression(nSize >> BLOCK_RECORD_COMPRESSION_SHIFT);
+            nSize &= BLOCK_RECORD_SIZE_MASK;
+            if (nSize < (compression == BlockCompression::NONE ? 80 : 4) || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                continue;
+            if (!BlockCompressionSupported(compression)) {
+                LogPrintf("%s: Skipping block with unsupported compression method %u\n", __func__, uint8_t(compression));
+                continue;
+            }
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            break;
+        }
+        ExternalBlock block;
+        try {
+            // read block
+            block.pos = FlatFilePos(file_number, blkdat.GetPos());
+            blkdat.SetLimit(block.pos.nPos + nSize);
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            if (compression == BlockCompression::NONE) {
+                blkdat >> *pblock;
+            } else {
+                std::vector<uint8_t> data;
+                ReadCompressedRecord(blkdat, compression, nSize, MAX_BLOCK_SERIALIZED_SIZE, data);
+                VectorReader(SER_DISK, CLIENT_VERSION, data, 0) >> *pblock;
+            }
+            nRewind = blkdat.GetPos();
+            block.hash = pblock->GetHash();
+            block.block = std::move(pblock);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+            continue;
+        }
+        if (!sink(std::move(block))) return;
+    }
+}
+
+BlockFileReader::BlockFileReader(const CChainParams& chainparams, int n_threads)
+    : m_chainparams(chainparams)
+{
+    size_t n_files = 0;
+    while (fs::exists(GetBlockPosFilename(FlatFilePos(n_files, 0)))) {
+        ++n_files;
+    }
+    WITH_LOCK(m_mutex, m_files.resize(n_files));
+
+    n_threads = std::clamp(n_threads, 1, MAX_REINDEX_THREADS);
+    for (int i = 0; i < n_threads && size_t(i) < n_files; ++i) {
+        m_threads.emplace_back([this, i, n_threads] {
+            util::TraceThread(strprintf("blkread.%i", i).c_str(), [&] { ThreadRead(i, n_threads); });
+        });
+    }
+    LogPrintf("Reading %u block files on %u threads\n", n_files, m_threads.size());
+}
+
+BlockFileReader::~BlockFileReader()
+{
+    Interrupt();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void BlockFileReader::Interrupt()
+{
+    WITH_LOCK(m_mutex, m_interrupt = true);
+    m_cond.notify_all();
+}
+
+std::string BlockFileReader::GetError() const
+{
+    return WITH_LOCK(m_mutex, return m_error);
+}
+
+bool BlockFileReader::Next(ExternalBlock& block)
+{
+    WAIT_LOCK(m_mutex, lock);
+    while (!m_interrupt && m_current_file < m_files.size()) {
+        File& file = m_files[m_current_file];
+        if (!file.blocks.empty()) {
+            block = std::move(file.blocks.front());
+            file.blocks.pop_front();
+            const size_t memory = RecursiveDynamicUsage(*block.block);
+            file.memory -= memory;
+            m_queued_memory -= memory;
+            m_cond.notify_all();
+            return true;
+        }
+        if (file.done) {
+            if (file.failed) return false;
+            ++m_current_file;
+            // The reader of the new current file may continue
+            m_cond.notify_all();
+            continue;
+        }
+        m_cond.wait(lock);
+    }
+    return false;
+}
+
+void BlockFileReader::ThreadRead(size_t first_file, size_t step)
+{
+    const Consensus::Params& consensus_params = m_chainparams.GetConsensus();
+    for (size_t file_number = first_file; file_number < WITH_LOCK(m_mutex, return m_files.size()); file_number += step) {
+        bool failed = false;
+        FILE* file = OpenBlockFile(FlatFilePos(file_number, 0), true);
+        if (!file) {
+            failed = true; // This error is logged in OpenBlockFile
+        } else {
+            try {
+                ReadBlocksFromFile(file, file_number, m_chainparams, [&](ExternalBlock&& block) {
+                    // Validation will run the same checks, but it then finds the block already checked.
+                    BlockValidationState state;
+                    CheckBlock(*block.block, state, consensus_params);
+
+                    const size_t memory = RecursiveDynamicUsage(*block.block);
+                    WAIT_LOCK(m_mutex, lock);
+                    File& queue = m_files[file_number];
+                    m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+                        if (m_interrupt) return true;
+                        if (file_number == m_current_file) return queue.memory < CURRENT_FILE_READAHEAD_MEMORY;
+                        return m_queued_memory < READAHEAD_MEMORY;
+                    });
+                    if (m_interrupt) return false;
+                    queue.blocks.push_back(std::move(block));
+                    queue.memory += memory;
+                    m_queued_memory += memory;
+                    m_cond.notify_all();
+                    return true;
+                });
+            } catch (const std::runtime_error& e) {
+                failed = true;
+                WITH_LOCK(m_mutex, m_error = e.what());
+            }
+        }
+        {
+            LOCK(m_mutex);
+            m_files[file_number].done = true;
+            m_files[file_number].failed = failed;
+            if (failed || m_interrupt) {
+                m_cond.notify_all();
+                return;
+            }
+        }
+        m_cond.notify_all();
+    }
+}
+
 struct CImportingNow {
     CImportingNow()
     {
@@ -500,23 +877,11 @@ void ThreadImport(ChainstateManager& chainman, std::vector<fs::path> vImportFile
 
         // -reindex
         if (fReindex) {
-            int nFile = 0;
-            while (true) {
-                FlatFilePos pos(nFile, 0);
-                if (!fs::exists(GetBlockPosFilename(pos))) {
-                    break; // No block files left to reindex
-                }
-                FILE* file = OpenBlockFile(pos, true);
-                if (!file) {
-                    break; // This error is logged in OpenBlockFile
-                }
-                LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-                chainman.ActiveChainstate().LoadExternalBlockFile(file, &pos);
-                if (ShutdownRequested()) {
-                    LogPrintf("Shutdown requested. Exit %s\n", __func__);
-                    return;
-                }
-                nFile++;
+            BlockFileReader reader(Params(), args.GetArg("-reindexthreads", DEFAULT_REINDEX_THREADS));
+            chainman.ActiveChainstate().LoadExternalBlockFiles(reader);
+            if (ShutdownRequested()) {
+                LogPrintf("Shutdown requested. Exit %s\n", __func__);
+                return;
             }
             pblocktree->WriteReindexing(false);
             fReindex = false;
@@ -5,11 +5,21 @@
 #ifndef BITCOIN_NODE_BLOCKSTORAGE_H
 #define BITCOIN_NODE_BLOCKSTORAGE_H
 
+#include <flatfile.h>
 #include <fs.h>
+#include <node/blockcompression.h>
 #include <protocol.h> // For CMessageHeader::MessageStartChars
+#include <sync.h>
+#include <uint256.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 class ArgsManager;
@@ -21,12 +31,14 @@ class CBlockUndo;
 class CChain;
 class CChainParams;
 class ChainstateManager;
-struct FlatFilePos;
 namespace Consensus {
 struct Params;
 }
 
 static constexpr bool DEFAULT_STOPAFTERBLOCKIMPORT{false};
+/** Default for -reindexthreads, the number of threads reading block files ahead of validation during -reindex */
+static constexpr int DEFAULT_REINDEX_THREADS{2};
+static constexpr int MAX_REINDEX_THREADS{16};
 
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
@@ -35,6 +47,22 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 
+/**
+ * Every record in blk?????.dat and rev?????.dat files starts with the network
+ * magic and a 32 bit size field. The top byte of the size field holds the
+ * BlockCompression of the record, which is zero for the plain serialization
+ * written by versions that did not compress. The data of a compressed record
+ * is its uncompressed size followed by the compressed serialization, so each
+ * record can be read on its own from the position in the block index.
+ *
+ * Undo records can be larger than the 24 bits left for the size. Those are
+ * never compressed, and their size field holds BLOCK_RECORD_SIZE_MASK with
+ * no compression. Earlier versions wrote the full size of such records
+ * instead, which is told apart when reading them (see UndoReadFromDisk()).
+ */
+static constexpr int BLOCK_RECORD_COMPRESSION_SHIFT{24};
+static constexpr uint32_t BLOCK_RECORD_SIZE_MASK{(1U << BLOCK_RECORD_COMPRESSION_SHIFT) - 1};
+
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 /** Pruning-related variables and constants */
@@ -44,6 +72,8 @@ extern bool fHavePruned;
 extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
+/** Compression for blocks and undo data written from now on, set by -blockcompression. */
+extern BlockCompression g_block_compression;
 
 //! Check whether the block associated with this index entry is pruned or not.
 bool IsBlockPruned(const CBlockIndex* pblockindex);
@@ -73,9 +103,91 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, c
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
+/** Read the serialized undo data of a block, without deserializing it */
+bool ReadRawUndoFromDisk(std::vector<uint8_t>& undo, const CBlockIndex* pindex);
 bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationState& state, CBlockIndex* pindex, const CChainParams& chainparams);
 
-FlatFilePos SaveBlockToDisk(const CBlock& block, int nHeight, CChain& active_chain, const CChainParams& chainparams, const FlatFilePos* dbp);
+/** A block or undo record as written to disk, compressed with g_block_compression */
+struct CompressedRecord {
+    //! NONE if the record is to be written uncompressed
+    BlockCompression compression{BlockCompression::NONE};
+    //! The uncompressed size followed by the compressed serialization
+    std::vector<uint8_t> data;
+};
+
+/** Compress a block ahead of SaveBlockToDisk(), so that it does not need to
+ * be compressed while cs_main is held */
+CompressedRecord CompressBlockRecord(const CBlock& block);
+
+/** Store a block on disk, which is already there at dbp if it is not null.
+ * Blocks not on disk yet are compressed unless compressed is passed. */
+FlatFilePos SaveBlockToDisk(const CBlock& block, int nHeight, CChain& active_chain, const CChainParams& chainparams, const FlatFilePos* dbp, const CompressedRecord* compressed = nullptr);
+
+/** A block found while scanning a block file */
+struct ExternalBlock {
+    std::shared_ptr<const CBlock> block;
+    uint256 hash;
+    //! Position of the block data. nFile is only meaningful for our own blk?????.dat files.
+    FlatFilePos pos;
+};
+
+/**
+ * Scan a file in blk?????.dat format for blocks, each preceded by the network
+ * magic and its size, and pass the ones that deserialize to sink in file order.
+ * Data that does not deserialize is skipped. Stops early if sink returns false.
+ *
+ * This takes over file and closes it. Throws std::runtime_error on I/O errors.
+ */
+void ReadBlocksFromFile(FILE* file, int file_number, const CChainParams& chainparams, const std::function<bool(ExternalBlock&&)>& sink);
+
+/**
+ * Reads our own blk?????.dat files for -reindex ahead of validation.
+ *
+ * Every reader thread takes every n-th file, deserializes its blocks and runs
+ * the context-free CheckBlock() on them. The results are handed out by Next()
+ * in file order, so validation sees the blocks in the same order as a single
+ * threaded scan. To bound memory, readers stop once the queued blocks use
+ * READAHEAD_MEMORY, except for the reader of the file being consumed, which
+ * may always queue up to CURRENT_FILE_READAHEAD_MEMORY.
+ */
+class BlockFileReader
+{
+public:
+    static constexpr size_t READAHEAD_MEMORY{128 << 20};
+    static constexpr size_t CURRENT_FILE_READAHEAD_MEMORY{32 << 20};
+
+    BlockFileReader(const CChainParams& chainparams, int n_threads);
+    ~BlockFileReader();
+
+    /** Wait for the next block. Returns false once all files have been read,
+     * at the first file that could not be opened or read, or when interrupted. */
+    bool Next(ExternalBlock& block);
+    /** Stop the reader threads. Next() returns false afterwards. */
+    void Interrupt();
+    /** The I/O error that stopped Next(), if any */
+    std::string GetError() const;
+
+private:
+    struct File {
+        std::deque<ExternalBlock> blocks;
+        size_t memory{0};
+        bool done{false};
+        bool failed{false};
+    };
+
+    const CChainParams& m_chainparams;
+    mutable Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<File> m_files GUARDED_BY(m_mutex);
+    size_t m_queued_memory GUARDED_BY(m_mutex){0};
+    //! The file Next() is taking blocks from
+    size_t m_current_file GUARDED_BY(m_mutex){0};
+    bool m_interrupt GUARDED_BY(m_mutex){false};
+    std::string m_error GUARDED_BY(m_mutex);
+    std::vector<std::thread> m_threads;
+
+    void ThreadRead(size_t first_file, size_t step);
+};
 
 void ThreadImport(ChainstateManager& chainman, std::vector<fs::path> vImportFiles, const ArgsManager& args);
 
@@ -11,10 +11,15 @@
 #include <index/coinstatsindex.h>
 #include <serialize.h>
 #include <uint256.h>
+#include <txdb.h>
 #include <util/system.h>
 #include <validation.h>
 
+#include <atomic>
 #include <map>
+#include <optional>
+#include <utility>
+#include <vector>
 
 #include <metrics/metrics.h>
 static const auto metricsContainer = metrics::Instance();
@@ -38,34 +43,14 @@ CDataStream TxOutSer(const COutPoint& outpoint, const Coin& coin) {
     return ss;
 }
 
-//! Warning: be very careful when changing this! assumeutxo and UTXO snapshot
-//! validation commitments are reliant on the hash constructed by this
-//! function.
-//!
-//! If the construction of this hash is changed, it will invalidate
-//! existing UTXO snapshots. This will not result in any kind of consensus
-//! failure, but it will force clients that were expecting to make use of
-//! assumeutxo to do traditional IBD instead.
-//!
-//! It is also possible, though very unlikely, that a change in this
-//! construction could cause a previously invalid (and potentially malicious)
-//! UTXO snapshot to be considered valid.
 static void ApplyHash(CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
-    for (auto it = outputs.begin(); it != outputs.end(); ++it) {
-        if (it == outputs.begin()) {
-            ss << hash;
-            ss << VARINT(it->second.nHeight * 2 + it->second.fCoinBase ? 1u : 0u);
-        }
-
-        ss << VARINT(it->first + 1);
-        ss << it->second.out.scriptPubKey;
-        ss << VARINT_MODE(it->second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+    SerializeHashedOutputs(ss, hash, outputs);
+}
 
-        if (it == std::prev(outputs.end())) {
-            ss << VARINT(0u);
-        }
-    }
+static void ApplyHash(CDataStream& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    SerializeHashedOutputs(ss, hash, outputs);
 }
 
 static void ApplyHash(std::nullptr_t, const uint256& hash, const std::map<uint32_t, Coin>& outputs) {}
@@ -90,37 +75,17 @@ static void ApplyStats(CCoinsStats& stats, const uint256& hash, const std::map<u
     }
 }
 
-//! Calculate statistics about the unspent transaction output set
+//! Apply the coins of cursor to stats and hash_obj
 template <typename T>
-static bool GetUTXOStats(CCoinsView* view, BlockManager& blockman, CCoinsStats& stats, T hash_obj, const std::function<void()>& interruption_point, const CBlockIndex* pindex)
+static bool ScanUTXOStats(CCoinsViewCursor& cursor, CCoinsStats& stats, T& hash_obj, const std::function<void()>& interruption_point)
 {
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    if (!pindex) {
-        {
-            LOCK(cs_main);
-            pindex = blockman.LookupBlockIndex(view->GetBestBlock());
-        }
-    }
-    stats.nHeight = Assert(pindex)->nHeight;
-    stats.hashBlock = pindex->GetBlockHash();
-
-    // Use CoinStatsIndex if it is requested and available and a hash_type of Muhash or None was requested
-    if ((stats.m_hash_type == CoinStatsHashType::MUHASH || stats.m_hash_type == CoinStatsHashType::NONE) && g_coin_stats_index && stats.index_requested) {
-        stats.index_used = true;
-        return g_coin_stats_index->LookUpStats(pindex, stats);
-    }
-
-    PrepareHash(hash_obj, stats);
-
     uint256 prevkey;
     std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
+    while (cursor.Valid()) {
         interruption_point();
         COutPoint key;
         Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+        if (cursor.GetKey(key) && cursor.GetValue(coin)) {
             if (!outputs.empty() && key.hash != prevkey) {
                 ApplyStats(stats, prevkey, outputs);
                 ApplyHash(hash_obj, prevkey, outputs);
@@ -132,12 +97,83 @@ static bool GetUTXOStats(CCoinsView* view, BlockManager& blockman, CCoinsStats&
         } else {
             return error("%s: unable to read value", __func__);
         }
-        pcursor->Next();
+        cursor.Next();
     }
     if (!outputs.empty()) {
         ApplyStats(stats, prevkey, outputs);
         ApplyHash(hash_obj, prevkey, outputs);
     }
+    return true;
+}
+
+// The coins of a key range are hashed on their own and then combined in key
+// order: the legacy hash is sequential, so its input is kept until then.
+static CDataStream RangeHash(const CHashWriter& ss) { return CDataStream(SER_GETHASH, PROTOCOL_VERSION); }
+static MuHash3072 RangeHash(const MuHash3072& muhash) { return {}; }
+static std::nullptr_t RangeHash(std::nullptr_t) { return nullptr; }
+
+static void MergeHash(CHashWriter& ss, const CDataStream& range) { ss.write((const char*)range.data(), range.size()); }
+static void MergeHash(MuHash3072& muhash, const MuHash3072& range) { muhash *= range; }
+static void MergeHash(std::nullptr_t, std::nullptr_t) {}
+
+static void MergeStats(CCoinsStats& stats, const CCoinsStats& range)
+{
+    stats.nTransactions += range.nTransactions;
+    stats.nTransactionOutputs += range.nTransactionOutputs;
+    stats.nBogoSize += range.nBogoSize;
+    stats.nTotalAmount += range.nTotalAmount;
+    stats.coins_count += range.coins_count;
+}
+
+//! Calculate statistics about the unspent transaction output set
+template <typename T>
+static bool GetUTXOStats(CCoinsView* view, BlockManager& blockman, CCoinsStats& stats, T hash_obj, const std::function<void()>& interruption_point, const CBlockIndex* pindex)
+{
+    // The coins on disk are scanned in parallel key ranges, other views with a single cursor.
+    const CCoinsViewDisk* disk_view = dynamic_cast<const CCoinsViewDisk*>(view);
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    if (disk_view) {
+        cursors = disk_view->RangeCursors(COINS_SCAN_RANGES);
+    } else {
+        cursors.push_back(view->Cursor());
+    }
+    assert(cursors.front());
+
+    if (!pindex) {
+        {
+            LOCK(cs_main);
+            pindex = blockman.LookupBlockIndex(view->GetBestBlock());
+        }
+    }
+    stats.nHeight = Assert(pindex)->nHeight;
+    stats.hashBlock = pindex->GetBlockHash();
+
+    // Use CoinStatsIndex if it is requested and available and a hash_type of Muhash or None was requested
+    if ((stats.m_hash_type == CoinStatsHashType::MUHASH || stats.m_hash_type == CoinStatsHashType::NONE) && g_coin_stats_index && stats.index_requested) {
+        stats.index_used = true;
+        return g_coin_stats_index->LookUpStats(pindex, stats);
+    }
+
+    PrepareHash(hash_obj, stats);
+
+    if (disk_view) {
+        std::vector<std::optional<std::pair<CCoinsStats, decltype(RangeHash(hash_obj))>>> ranges(cursors.size());
+        std::atomic<bool> failed{false};
+        ScanCoins(
+            std::move(cursors),
+            [&](size_t index, CCoinsViewCursor& cursor) {
+                auto& [range_stats, range_hash] = ranges[index].emplace(stats.m_hash_type, RangeHash(hash_obj));
+                if (!ScanUTXOStats(cursor, range_stats, range_hash, interruption_point)) failed = true;
+            },
+            [&](size_t index) {
+                MergeStats(stats, ranges[index]->first);
+                MergeHash(hash_obj, ranges[index]->second);
+                ranges[index].reset();
+            });
+        if (failed) return false;
+    } else if (!ScanUTXOStats(*cursors.front(), stats, hash_obj, interruption_point)) {
+        return false;
+    }
 
     FinalizeHash(hash_obj, stats);
 
@@ -14,6 +14,7 @@
 
 #include <cstdint>
 #include <functional>
+#include <map>
 
 class BlockManager;
 class CCoinsView;
@@ -65,4 +66,38 @@ uint64_t GetBogoSize(const CScript& script_pub_key);
 
 CDataStream TxOutSer(const COutPoint& outpoint, const Coin& coin);
 
+//! Serialize the unspent outputs of a transaction the way the HASH_SERIALIZED
+//! hash of the UTXO set covers them.
+//!
+//! Warning: be very careful when changing this! assumeutxo and UTXO snapshot
+//! validation commitments are reliant on the hash constructed by this
+//! function.
+//!
+//! If the construction of this hash is changed, it will invalidate
+//! existing UTXO snapshots. This will not result in any kind of consensus
+//! failure, but it will force clients that were expecting to make use of
+//! assumeutxo to do traditional IBD instead.
+//!
+//! It is also possible, though very unlikely, that a change in this
+//! construction could cause a previously invalid (and potentially malicious)
+//! UTXO snapshot to be considered valid.
+template <typename Stream>
+void SerializeHashedOutputs(Stream& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    for (auto it = outputs.begin(); it != outputs.end(); ++it) {
+        if (it == outputs.begin()) {
+            ss << hash;
+            ss << VARINT(it->second.nHeight * 2 + it->second.fCoinBase ? 1u : 0u);
+        }
+
+        ss << VARINT(it->first + 1);
+        ss << it->second.out.scriptPubKey;
+        ss << VARINT_MODE(it->second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+
+        if (it == std::prev(outputs.end())) {
+            ss << VARINT(0u);
+        }
+    }
+}
+
 #endif // BITCOIN_NODE_COINSTATS_H
@@ -343,6 +343,7 @@ public:
     explicit NotificationsProxy(std::shared_ptr<Chain::Notifications> notifications)
         : m_notifications(std::move(notifications)) {}
     virtual ~NotificationsProxy() = default;
+    std::string SubscriberName() const override { return "chain_notifications"; }
     void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override
     {
         m_notifications->transactionAddedToMempool(tx, mempool_sequence);
@@ -0,0 +1,418 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/utxo_snapshot.h>
+
+#include <clientversion.h>
+#include <hash.h>
+#include <logging.h>
+#include <node/coinstats.h>
+#include <sync.h>
+#include <tinyformat.h>
+#include <txdb.h>
+#include <util/system.h>
+#include <util/thread.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <ios>
+#include <limits>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+//! Key ranges that are read in parallel when writing a snapshot
+static constexpr size_t SNAPSHOT_RANGES{16};
+static constexpr int MAX_SNAPSHOT_THREADS{16};
+//! Chunks that may wait between the threads, per thread
+static constexpr size_t CHUNKS_QUEUED_PER_THREAD{2};
+//! Chunks are read in pieces of this size, so that a bogus size fails before it is allocated
+static constexpr size_t CHUNK_READ_SIZE{16 << 20};
+//! Smallest serialized coin: an outpoint, and a coin with one byte each for
+//! its code, compressed amount and compressed empty script
+static constexpr uint64_t MIN_SERIALIZED_COIN_SIZE{36 + 3};
+
+static int SnapshotThreads()
+{
+    return std::clamp(GetNumCores(), 1, MAX_SNAPSHOT_THREADS);
+}
+
+std::vector<std::unique_ptr<CCoinsViewCursor>> MakeSnapshotCursors(const CCoinsViewDisk& view)
+{
+    return view.RangeCursors(SNAPSHOT_RANGES);
+}
+
+namespace {
+struct WrittenChunk {
+    size_t index{0};
+    CDataStream data{SER_DISK, CLIENT_VERSION};
+    uint64_t coins_count{0};
+    uint256 hash{};
+};
+
+/**
+ * Serializes the chunks of a snapshot on worker threads, for WriteUTXOSnapshot().
+ *
+ * Chunks are handed out round-robin over the key ranges: the first chunk of
+ * every range, then the second one, and so on. That is also the order they
+ * are written in, which keeps the threads busy without holding many chunks in
+ * memory, and makes the file only depend on the coins.
+ */
+class SnapshotChunkWriter
+{
+public:
+    explicit SnapshotChunkWriter(std::vector<std::unique_ptr<CCoinsViewCursor>> cursors)
+        : m_cursors(std::move(cursors)), m_range_next(m_cursors.size(), 0), m_done(SNAPSHOT_CHUNKS)
+    {
+        const int n_threads = SnapshotThreads();
+        m_capacity = n_threads * CHUNKS_QUEUED_PER_THREAD;
+        m_running = n_threads;
+        for (int i = 0; i < n_threads; ++i) {
+            m_threads.emplace_back([this, i] {
+                util::TraceThread(strprintf("snapwrite.%i", i).c_str(), [&] { ThreadWrite(); });
+            });
+        }
+    }
+
+    ~SnapshotChunkWriter()
+    {
+        WITH_LOCK(m_mutex, m_interrupt = true);
+        m_cond.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    /** Wait for the next chunk to write. Returns nullopt once all are written, and rethrows errors of the threads. */
+    std::optional<WrittenChunk> Next()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        if (m_next_write == SNAPSHOT_CHUNKS) return std::nullopt;
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_done[m_next_write].has_value() || m_error; });
+        if (m_error) std::rethrow_exception(m_error);
+        std::optional<WrittenChunk> chunk = std::move(m_done[m_next_write]);
+        m_done[m_next_write++].reset();
+        m_cond.notify_all();
+        return chunk;
+    }
+
+    //! MuHash of all coins, once Next() returned nullopt
+    MuHash3072 GetMuHash()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_running == 0; });
+        return m_muhash;
+    }
+
+private:
+    const std::vector<std::unique_ptr<CCoinsViewCursor>> m_cursors;
+    std::vector<std::thread> m_threads;
+    size_t m_capacity;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    //! Chunks in the order they are written in
+    size_t m_next_claim GUARDED_BY(m_mutex){0};
+    size_t m_next_write GUARDED_BY(m_mutex){0};
+    //! The chunk of each range that its cursor is at
+    std::vector<size_t> m_range_next GUARDED_BY(m_mutex);
+    std::vector<std::optional<WrittenChunk>> m_done GUARDED_BY(m_mutex);
+    int m_running GUARDED_BY(m_mutex);
+    bool m_interrupt GUARDED_BY(m_mutex){false};
+    std::exception_ptr m_error GUARDED_BY(m_mutex);
+    MuHash3072 m_muhash GUARDED_BY(m_mutex);
+
+    WrittenChunk ReadChunk(size_t index, CCoinsViewCursor& cursor, MuHash3072& muhash)
+    {
+        WrittenChunk chunk{};
+        chunk.index = index;
+        COutPoint key;
+        Coin coin;
+        // Cursors are sorted by txid, so the chunk ends at the first coin with another leading byte.
+        for (; cursor.Valid(); cursor.Next()) {
+            if (!cursor.GetKey(key)) throw std::runtime_error("Unable to read UTXO set");
+            if (*key.hash.begin() != index) break;
+            if (!cursor.GetValue(coin)) throw std::runtime_error("Unable to read UTXO set");
+            chunk.data << key << coin;
+            muhash.Insert(MakeUCharSpan(TxOutSer(key, coin)));
+            ++chunk.coins_count;
+        }
+        chunk.hash = Hash(MakeUCharSpan(chunk.data));
+        return chunk;
+    }
+
+    void ThreadWrite()
+    {
+        const size_t n_ranges = m_cursors.size();
+        const size_t range_chunks = SNAPSHOT_CHUNKS / n_ranges;
+        MuHash3072 muhash;
+        try {
+            WAIT_LOCK(m_mutex, lock);
+            while (true) {
+                m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_interrupt || m_next_claim - m_next_write < m_capacity; });
+                if (m_interrupt || m_next_claim == SNAPSHOT_CHUNKS) break;
+                const size_t order = m_next_claim++;
+                const size_t range = order % n_ranges;
+                const size_t chunk = order / n_ranges;
+                // The previous chunk of the range may still be read by another thread.
+                m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_interrupt || m_range_next[range] == chunk; });
+                if (m_interrupt) break;
+                WrittenChunk written;
+                {
+                    REVERSE_LOCK(lock);
+                    written = ReadChunk(range * range_chunks + chunk, *m_cursors[range], muhash);
+                }
+                m_done[order].emplace(std::move(written));
+                ++m_range_next[range];
+                m_cond.notify_all();
+            }
+        } catch (...) {
+            LOCK(m_mutex);
+            if (!m_error) m_error = std::current_exception();
+        }
+        LOCK(m_mutex);
+        m_muhash *= muhash;
+        --m_running;
+        m_cond.notify_all();
+    }
+};
+} // namespace
+
+SnapshotMetadata WriteUTXOSnapshot(CAutoFile& file, const uint256& base_blockhash, std::vector<std::unique_ptr<CCoinsViewCursor>> cursors,
+                                   uint256& muhash, const std::function<void()>& interruption_point)
+{
+    SnapshotMetadata metadata{base_blockhash, 0, 0};
+    metadata.m_chunks.resize(SNAPSHOT_CHUNKS);
+    // The metadata has the same size once the chunk table is filled in.
+    file << metadata;
+
+    uint64_t offset = GetSerializeSize(metadata, CLIENT_VERSION);
+
+    SnapshotChunkWriter writer{std::move(cursors)};
+    while (std::optional<WrittenChunk> chunk = writer.Next()) {
+        interruption_point();
+        SnapshotChunk& entry = metadata.m_chunks[chunk->index];
+        entry.m_offset = offset;
+        entry.m_size = chunk->data.size();
+        entry.m_coins_count = chunk->coins_count;
+        entry.m_hash = chunk->hash;
+        file.write((const char*)chunk->data.data(), chunk->data.size());
+        metadata.m_coins_count += chunk->coins_count;
+        offset += chunk->data.size();
+    }
+    writer.GetMuHash().Finalize(muhash);
+
+    if (!FileSeek(file.Get(), 0)) {
+        throw std::ios_base::failure("WriteUTXOSnapshot: unable to seek to the start of the file");
+    }
+    file << metadata;
+    return metadata;
+}
+
+namespace {
+struct ParsedChunk {
+    SnapshotChunkCoins coins;
+    std::string error;
+};
+
+ParsedChunk ParseChunk(size_t index, const SnapshotChunk& chunk, CDataStream& data, int base_height)
+{
+    ParsedChunk parsed;
+    if (Hash(MakeUCharSpan(data)) != chunk.m_hash) {
+        parsed.error = strprintf("chunk %u does not match its hash", index);
+        return parsed;
+    }
+    SnapshotChunkCoins& result = parsed.coins;
+    // The count comes from the snapshot, so do not reserve more coins than the data can hold
+    result.coins.reserve(std::min<uint64_t>(chunk.m_coins_count, data.size() / MIN_SERIALIZED_COIN_SIZE));
+
+    // The outputs of the current transaction, which the HASH_SERIALIZED hash covers together
+    uint256 txid;
+    std::map<uint32_t, Coin> outputs;
+    try {
+        for (uint64_t i = 0; i < chunk.m_coins_count; ++i) {
+            COutPoint outpoint;
+            Coin coin;
+            data >> outpoint >> coin;
+            if (*outpoint.hash.begin() != index || coin.nHeight > base_height ||
+                outpoint.n >= std::numeric_limits<decltype(outpoint.n)>::max() // Avoid integer wrap-around in coinstats.cpp:ApplyHash
+            ) {
+                parsed.error = strprintf("bad coin %s in chunk %u", outpoint.ToString(), index);
+                return parsed;
+            }
+            if (outpoint.hash != txid) {
+                if (!outputs.empty()) {
+                    // Each transaction must be seen once, so that the hash matches that of the loaded UTXO set.
+                    if (outpoint.hash < txid) {
+                        parsed.error = strprintf("coins of chunk %u are not sorted", index);
+                        return parsed;
+                    }
+                    SerializeHashedOutputs(result.hash_data, txid, outputs);
+                    outputs.clear();
+                }
+                txid = outpoint.hash;
+            }
+            if (!outputs.emplace(outpoint.n, coin).second) {
+                parsed.error = strprintf("duplicate coin %s in chunk %u", outpoint.ToString(), index);
+                return parsed;
+            }
+            result.muhash.Insert(MakeUCharSpan(TxOutSer(outpoint, coin)));
+            CCoinsCacheEntry& entry = result.coins.try_emplace(outpoint, std::move(coin)).first->second;
+            entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+        }
+    } catch (const std::ios_base::failure&) {
+        parsed.error = strprintf("chunk %u is truncated", index);
+        return parsed;
+    }
+    if (!outputs.empty()) SerializeHashedOutputs(result.hash_data, txid, outputs);
+    if (!data.empty()) {
+        parsed.error = strprintf("coins left over in chunk %u", index);
+    }
+    return parsed;
+}
+
+/** Parses chunks on worker threads and hands them back in order, for ReadUTXOSnapshot(). */
+class SnapshotChunkParser
+{
+public:
+    SnapshotChunkParser(const SnapshotMetadata& metadata, int base_height) : m_metadata(metadata), m_base_height(base_height), m_parsed(metadata.m_chunks.size())
+    {
+        const int n_threads = SnapshotThreads();
+        m_capacity = n_threads * CHUNKS_QUEUED_PER_THREAD;
+        for (int i = 0; i < n_threads; ++i) {
+            m_threads.emplace_back([this, i] {
+                util::TraceThread(strprintf("snapload.%i", i).c_str(), [&] { ThreadParse(); });
+            });
+        }
+    }
+
+    ~SnapshotChunkParser()
+    {
+        WITH_LOCK(m_mutex, m_interrupt = true);
+        m_cond.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    //! Whether another chunk may be read, or too many are waiting for Next() already
+    bool HasRoom() const { return WITH_LOCK(m_mutex, return m_added - m_next < m_capacity); }
+
+    //! Queue the data of the next chunk
+    void Add(CDataStream&& data)
+    {
+        LOCK(m_mutex);
+        m_queue.emplace_back(m_added++, std::move(data));
+        m_cond.notify_all();
+    }
+
+    //! Wait for the oldest chunk that Next() did not return yet
+    ParsedChunk Next()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        assert(m_next < m_added);
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_parsed[m_next].has_value(); });
+        ParsedChunk chunk = std::move(*m_parsed[m_next]);
+        m_parsed[m_next++].reset();
+        return chunk;
+    }
+
+private:
+    const SnapshotMetadata& m_metadata;
+    const int m_base_height;
+    std::vector<std::thread> m_threads;
+    size_t m_capacity;
+
+    mutable Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::pair<size_t, CDataStream>> m_queue GUARDED_BY(m_mutex);
+    std::vector<std::optional<ParsedChunk>> m_parsed GUARDED_BY(m_mutex);
+    size_t m_added GUARDED_BY(m_mutex){0};
+    size_t m_next GUARDED_BY(m_mutex){0};
+    bool m_interrupt GUARDED_BY(m_mutex){false};
+
+    void ThreadParse()
+    {
+        while (true) {
+            std::optional<std::pair<size_t, CDataStream>> job;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_interrupt || !m_queue.empty(); });
+                if (m_interrupt) return;
+                job.emplace(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+            auto& [index, data] = *job;
+            ParsedChunk parsed = ParseChunk(index, m_metadata.m_chunks[index], data, m_base_height);
+            LOCK(m_mutex);
+            m_parsed[index].emplace(std::move(parsed));
+            m_cond.notify_all();
+        }
+    }
+};
+} // namespace
+
+bool ReadUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata, int base_height,
+                      const std::function<bool(SnapshotChunkCoins&&)>& fn, std::string& error)
+{
+    if (metadata.m_chunks.size() != SNAPSHOT_CHUNKS) {
+        error = strprintf("expected %u chunks, got %u", SNAPSHOT_CHUNKS, metadata.m_chunks.size());
+        return false;
+    }
+    uint64_t coins_count{0};
+    for (const SnapshotChunk& chunk : metadata.m_chunks) {
+        if (chunk.m_size > MAX_SNAPSHOT_CHUNK_SIZE) {
+            error = strprintf("chunk of %u bytes is too large", chunk.m_size);
+            return false;
+        }
+        if (chunk.m_coins_count > chunk.m_size / MIN_SERIALIZED_COIN_SIZE) {
+            error = strprintf("chunk of %u bytes cannot hold %u coins", chunk.m_size, chunk.m_coins_count);
+            return false;
+        }
+        if (chunk.m_coins_count > std::numeric_limits<uint64_t>::max() - coins_count) {
+            error = "the chunks have too many coins";
+            return false;
+        }
+        coins_count += chunk.m_coins_count;
+    }
+    if (coins_count != metadata.m_coins_count) {
+        error = strprintf("the chunks have %u coins instead of %u", coins_count, metadata.m_coins_count);
+        return false;
+    }
+
+    SnapshotChunkParser parser{metadata, base_height};
+    size_t n_read{0};
+    for (size_t n_done = 0; n_done < SNAPSHOT_CHUNKS; ++n_done) {
+        // Keep the parser threads busy while the chunks before are written.
+        while (n_read < SNAPSHOT_CHUNKS && parser.HasRoom()) {
+            const SnapshotChunk& chunk = metadata.m_chunks[n_read];
+            CDataStream data(SER_DISK, CLIENT_VERSION);
+            try {
+                if (!FileSeek(file.Get(), chunk.m_offset)) {
+                    throw std::ios_base::failure("seek failed");
+                }
+                while (data.size() < chunk.m_size) {
+                    const size_t pos = data.size();
+                    data.resize(std::min<uint64_t>(chunk.m_size, pos + CHUNK_READ_SIZE));
+                    file.read((char*)data.data() + pos, data.size() - pos);
+                }
+            } catch (const std::ios_base::failure&) {
+                error = strprintf("unable to read chunk %u", n_read);
+                return false;
+            }
+            parser.Add(std::move(data));
+            ++n_read;
+        }
+        ParsedChunk chunk = parser.Next();
+        if (!chunk.error.empty()) {
+            error = std::move(chunk.error);
+            return false;
+        }
+        if (!fn(std::move(chunk.coins))) return false;
+    }
+    return true;
+}
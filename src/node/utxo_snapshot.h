@@ -6,8 +6,50 @@
 #ifndef BITCOIN_NODE_UTXO_SNAPSHOT_H
 #define BITCOIN_NODE_UTXO_SNAPSHOT_H
 
+#include <coins.h>
+#include <crypto/muhash.h>
 #include <uint256.h>
 #include <serialize.h>
+#include <streams.h>
+#include <tinyformat.h>
+#include <version.h>
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ios>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CCoinsViewDisk;
+
+//! Number of chunks in a UTXO snapshot. Chunk i holds the coins of the
+//! transactions whose txid starts with the byte i.
+static constexpr size_t SNAPSHOT_CHUNKS{256};
+
+//! Chunks larger than this are refused when loading a snapshot
+static constexpr uint64_t MAX_SNAPSHOT_CHUNK_SIZE{1ULL << 30};
+
+//! Start of UTXO snapshot files. Snapshots written before the format was
+//! chunked start with the base block hash instead.
+static constexpr unsigned char SNAPSHOT_MAGIC_BYTES[5]{'u', 't', 'x', 'o', 0xff};
+
+//! Version of the UTXO snapshot format, following the magic bytes. Snapshots
+//! of any other version are refused.
+static constexpr uint16_t SNAPSHOT_VERSION{1};
+
+//! Where a chunk of coins is stored in a UTXO snapshot file.
+struct SnapshotChunk {
+    //! Position of the chunk in the file
+    uint64_t m_offset{0};
+    uint64_t m_size{0};
+    uint64_t m_coins_count{0};
+    //! Hash of the serialized coins of the chunk
+    uint256 m_hash;
+
+    SERIALIZE_METHODS(SnapshotChunk, obj) { READWRITE(obj.m_offset, obj.m_size, obj.m_coins_count, obj.m_hash); }
+};
 
 //! Metadata describing a serialized version of a UTXO set from which an
 //! assumeutxo CChainState can be constructed.
@@ -22,6 +64,10 @@ public:
     //! during snapshot load to estimate progress of UTXO set reconstruction.
     uint64_t m_coins_count = 0;
 
+    //! The SNAPSHOT_CHUNKS chunks of coins following the metadata in the
+    //! file, which may appear in any order.
+    std::vector<SnapshotChunk> m_chunks;
+
     SnapshotMetadata() { }
     SnapshotMetadata(
         const uint256& base_blockhash,
@@ -30,7 +76,66 @@ public:
             m_base_blockhash(base_blockhash),
             m_coins_count(coins_count) { }
 
-    SERIALIZE_METHODS(SnapshotMetadata, obj) { READWRITE(obj.m_base_blockhash, obj.m_coins_count); }
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << SNAPSHOT_MAGIC_BYTES << SNAPSHOT_VERSION << m_base_blockhash << m_coins_count << m_chunks;
+    }
+
+    //! Throws std::ios_base::failure for files that are not UTXO snapshots
+    //! or have another version.
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char magic[sizeof(SNAPSHOT_MAGIC_BYTES)];
+        s >> magic;
+        if (memcmp(magic, SNAPSHOT_MAGIC_BYTES, sizeof(magic)) != 0) {
+            throw std::ios_base::failure("Not a UTXO snapshot, or one written before snapshots were chunked");
+        }
+        uint16_t version;
+        s >> version;
+        if (version != SNAPSHOT_VERSION) {
+            throw std::ios_base::failure(strprintf("Unsupported UTXO snapshot version %u, expected version %u", version, SNAPSHOT_VERSION));
+        }
+        s >> m_base_blockhash >> m_coins_count >> m_chunks;
+    }
+};
+
+//! Cursors over the key ranges of view that WriteUTXOSnapshot() reads in parallel
+std::vector<std::unique_ptr<CCoinsViewCursor>> MakeSnapshotCursors(const CCoinsViewDisk& view);
+
+/**
+ * Write a UTXO snapshot of the coins cursors iterate over to file. The key
+ * ranges are read, serialized and hashed in parallel, and their chunks are
+ * written interleaved, in an order that only depends on the coins. The chunk
+ * table in the metadata at the start of file is filled in at the end.
+ *
+ * @param[out] muhash  MuHash of the coins, as reported by gettxoutsetinfo.
+ *                     It is computed per chunk, in parallel.
+ * @returns The metadata written to file.
+ */
+SnapshotMetadata WriteUTXOSnapshot(CAutoFile& file, const uint256& base_blockhash, std::vector<std::unique_ptr<CCoinsViewCursor>> cursors,
+                                   uint256& muhash, const std::function<void()>& interruption_point);
+
+//! The coins of a chunk of a UTXO snapshot, once they have been checked.
+struct SnapshotChunkCoins {
+    CCoinsMap coins;
+    //! What the chunk contributes to the HASH_SERIALIZED hash of the UTXO set,
+    //! which is the concatenation of these in chunk order.
+    CDataStream hash_data{SER_GETHASH, PROTOCOL_VERSION};
+    MuHash3072 muhash;
 };
 
+/**
+ * Read the coins of a UTXO snapshot. Chunks are read from file in key order
+ * and checked against their hash, deserialized and hashed on several threads.
+ * Coins must be sorted within a chunk, belong to it and not be newer than
+ * base_height. fn is called with each chunk in key order.
+ *
+ * @returns false if the snapshot is malformed, with error set, or as soon as
+ *          fn returns false.
+ */
+bool ReadUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata, int base_height,
+                      const std::function<bool(SnapshotChunkCoins&&)>& fn, std::string& error);
+
 #endif // BITCOIN_NODE_UTXO_SNAPSHOT_H
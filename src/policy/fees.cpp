@@ -12,6 +12,9 @@
 #include <txmempool.h>
 #include <util/serfloat.h>
 #include <util/system.h>
+#include <util/thread.h>
+
+#include <future>
 
 static const char* FEE_ESTIMATES_FILENAME = "fee_estimates.dat";
 
@@ -44,6 +47,56 @@ struct EncodedDoubleFormatter
     }
 };
 
+/**
+ * Rows of a table that copies of it share until they modify them. Published
+ * estimates are copies of the estimator's state, so each copy only allocates
+ * the rows modified since the last one was published.
+ */
+template <typename T>
+class SharedRows
+{
+private:
+    std::vector<std::shared_ptr<std::vector<T>>> m_rows;
+
+public:
+    SharedRows() = default;
+    explicit SharedRows(const std::vector<std::vector<T>>& rows)
+    {
+        for (const std::vector<T>& row : rows) m_rows.push_back(std::make_shared<std::vector<T>>(row));
+    }
+
+    size_t size() const { return m_rows.size(); }
+    const std::vector<T>& operator[](size_t i) const { return *m_rows[i]; }
+
+    /** Row i for writing, copied first if another table shares it */
+    std::vector<T>& Mutable(size_t i)
+    {
+        // Only the owner of the estimator's state copies it, so the count can
+        // drop concurrently but never rise.
+        if (m_rows[i].use_count() > 1) m_rows[i] = std::make_shared<std::vector<T>>(*m_rows[i]);
+        return *m_rows[i];
+    }
+
+    void resize(size_t rows, size_t columns)
+    {
+        m_rows.resize(rows);
+        for (size_t i = 0; i < m_rows.size(); ++i) {
+            if (!m_rows[i]) {
+                m_rows[i] = std::make_shared<std::vector<T>>(columns);
+            } else if (m_rows[i]->size() != columns) {
+                Mutable(i).resize(columns);
+            }
+        }
+    }
+
+    std::vector<std::vector<T>> ToVectors() const
+    {
+        std::vector<std::vector<T>> rows;
+        for (const auto& row : m_rows) rows.push_back(*row);
+        return rows;
+    }
+};
+
 } // namespace
 
 /**
@@ -68,11 +121,11 @@ private:
 
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of these totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    SharedRows<double> confAvg; // confAvg[Y][X]
 
     // Track moving avg of txs which have been evicted from the mempool
     // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    SharedRows<double> failAvg; // failAvg[Y][X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
@@ -89,7 +142,7 @@ private:
     // Mempool counts of outstanding transactions
     // For each bucket X, track the number of transactions in the mempool
     // that are unconfirmed for each possible confirmation value Y
-    std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
+    SharedRows<int> unconfTxs;  //unconfTxs[Y][X]
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
 
@@ -106,6 +159,9 @@ public:
     TxConfirmStats(const std::vector<double>& defaultBuckets, const std::map<double, unsigned int>& defaultBucketMap,
                    unsigned int maxPeriods, double decay, unsigned int scale);
 
+    /** Copy other, grouping transactions into the given copy of its buckets */
+    TxConfirmStats(const TxConfirmStats& other, const std::vector<double>& buckets, const std::map<double, unsigned int>& bucketMap);
+
     /** Roll the circular buffer for unconfirmed txs*/
     void ClearCurrent(unsigned int nBlockHeight);
 
@@ -161,12 +217,8 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     : buckets(defaultBuckets), bucketMap(defaultBucketMap), decay(_decay), scale(_scale)
 {
     assert(_scale != 0 && "_scale must be non-zero");
-    confAvg.resize(maxPeriods);
-    failAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        confAvg[i].resize(buckets.size());
-        failAvg[i].resize(buckets.size());
-    }
+    confAvg.resize(maxPeriods, buckets.size());
+    failAvg.resize(maxPeriods, buckets.size());
 
     txCtAvg.resize(buckets.size());
     m_feerate_avg.resize(buckets.size());
@@ -174,21 +226,26 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     resizeInMemoryCounters(buckets.size());
 }
 
+TxConfirmStats::TxConfirmStats(const TxConfirmStats& other, const std::vector<double>& _buckets, const std::map<double, unsigned int>& _bucketMap)
+    : buckets(_buckets), bucketMap(_bucketMap), txCtAvg(other.txCtAvg), confAvg(other.confAvg), failAvg(other.failAvg),
+      m_feerate_avg(other.m_feerate_avg), decay(other.decay), scale(other.scale), unconfTxs(other.unconfTxs), oldUnconfTxs(other.oldUnconfTxs)
+{
+    assert(buckets == other.buckets);
+}
+
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
     // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
-    unconfTxs.resize(GetMaxConfirms());
-    for (unsigned int i = 0; i < unconfTxs.size(); i++) {
-        unconfTxs[i].resize(newbuckets);
-    }
+    unconfTxs.resize(GetMaxConfirms(), newbuckets);
     oldUnconfTxs.resize(newbuckets);
 }
 
 // Roll the unconfirmed txs circular buffer
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
+    std::vector<int>& current = unconfTxs.Mutable(nBlockHeight % unconfTxs.size());
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight % unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
+        oldUnconfTxs[j] += current[j];
+        current[j] = 0;
     }
 }
 
@@ -201,7 +258,7 @@ void TxConfirmStats::Record(int blocksToConfirm, double feerate)
     int periodsToConfirm = (blocksToConfirm + scale - 1) / scale;
     unsigned int bucketindex = bucketMap.lower_bound(feerate)->second;
     for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+        confAvg.Mutable(i - 1)[bucketindex]++;
     }
     txCtAvg[bucketindex]++;
     m_feerate_avg[bucketindex] += feerate;
@@ -210,11 +267,15 @@ void TxConfirmStats::Record(int blocksToConfirm, double feerate)
 void TxConfirmStats::UpdateMovingAverages()
 {
     assert(confAvg.size() == failAvg.size());
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++) {
-            confAvg[i][j] *= decay;
-            failAvg[i][j] *= decay;
+    for (unsigned int i = 0; i < confAvg.size(); i++) {
+        std::vector<double>& conf = confAvg.Mutable(i);
+        std::vector<double>& fail = failAvg.Mutable(i);
+        for (unsigned int j = 0; j < buckets.size(); j++) {
+            conf[j] *= decay;
+            fail[j] *= decay;
         }
+    }
+    for (unsigned int j = 0; j < buckets.size(); j++) {
         m_feerate_avg[j] *= decay;
         txCtAvg[j] *= decay;
     }
@@ -380,8 +441,8 @@ void TxConfirmStats::Write(CAutoFile& fileout) const
     fileout << scale;
     fileout << Using<VectorFormatter<EncodedDoubleFormatter>>(m_feerate_avg);
     fileout << Using<VectorFormatter<EncodedDoubleFormatter>>(txCtAvg);
-    fileout << Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(confAvg);
-    fileout << Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(failAvg);
+    fileout << Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(confAvg.ToVectors());
+    fileout << Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(failAvg.ToVectors());
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -409,28 +470,32 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     if (txCtAvg.size() != numBuckets) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
     }
-    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(confAvg);
-    maxPeriods = confAvg.size();
+    std::vector<std::vector<double>> conf_avg;
+    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(conf_avg);
+    maxPeriods = conf_avg.size();
     maxConfirms = scale * maxPeriods;
 
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (confAvg[i].size() != numBuckets) {
+        if (conf_avg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
         }
     }
 
-    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(failAvg);
-    if (maxPeriods != failAvg.size()) {
+    std::vector<std::vector<double>> fail_avg;
+    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(fail_avg);
+    if (maxPeriods != fail_avg.size()) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in confirms tracked for failures");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (failAvg[i].size() != numBuckets) {
+        if (fail_avg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in one of failure average bucket counts");
         }
     }
+    confAvg = SharedRows<double>(conf_avg);
+    failAvg = SharedRows<double>(fail_avg);
 
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
@@ -444,7 +509,7 @@ unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
 {
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
     unsigned int blockIndex = nBlockHeight % unconfTxs.size();
-    unconfTxs[blockIndex][bucketindex]++;
+    unconfTxs.Mutable(blockIndex)[bucketindex]++;
     return bucketindex;
 }
 
@@ -470,7 +535,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     else {
         unsigned int blockIndex = entryHeight % unconfTxs.size();
         if (unconfTxs[blockIndex][bucketindex] > 0) {
-            unconfTxs[blockIndex][bucketindex]--;
+            unconfTxs.Mutable(blockIndex)[bucketindex]--;
         } else {
             LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
@@ -480,33 +545,48 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
         for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+            failAvg.Mutable(i)[bucketindex]++;
         }
     }
 }
 
-// This function is called from CTxMemPool::removeUnchecked to ensure
-// txs removed from the mempool for any reason are no longer
-// tracked. Txs that were part of a block have already been removed in
-// processBlockTx to ensure they are never double tracked, but it is
-// of no harm to try to remove them again.
-bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
+class CBlockPolicyEstimator::Estimates
 {
-    LOCK(m_cs_fee_estimator);
-    std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
-    if (pos != mapMemPoolTxs.end()) {
-        feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
-        shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
-        longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
-        mapMemPoolTxs.erase(hash);
-        return true;
-    } else {
-        return false;
-    }
-}
+public:
+    std::vector<double> buckets; // The upper-bound of the range for the bucket (inclusive)
+    std::map<double, unsigned int> bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
-CBlockPolicyEstimator::CBlockPolicyEstimator()
-    : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0)
+    /** Classes to track historical data on transaction confirmations */
+    std::unique_ptr<TxConfirmStats> feeStats;
+    std::unique_ptr<TxConfirmStats> shortStats;
+    std::unique_ptr<TxConfirmStats> longStats;
+
+    unsigned int nBestSeenHeight{0};
+    unsigned int firstRecordedHeight{0};
+    unsigned int historicalFirst{0};
+    unsigned int historicalBest{0};
+
+    Estimates();
+    Estimates(const Estimates& other);
+
+    CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
+    CFeeRate estimateRawFee(int confTarget, double successThreshold, FeeEstimateHorizon horizon, EstimationResult *result) const;
+    unsigned int HighestTargetTracked(FeeEstimateHorizon horizon) const;
+    void Write(CAutoFile& fileout) const;
+
+    /** Helper for estimateSmartFee */
+    double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
+    /** Helper for estimateSmartFee */
+    double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const;
+    /** Number of blocks of data recorded while fee estimates have been running */
+    unsigned int BlockSpan() const;
+    /** Number of blocks of recorded fee estimate data represented in saved data file */
+    unsigned int HistoricalBlockSpan() const;
+    /** Calculation of highest target that reasonable estimate can be provided for */
+    unsigned int MaxUsableEstimate() const;
+};
+
+CBlockPolicyEstimator::Estimates::Estimates()
 {
     static_assert(MIN_BUCKET_FEERATE > 0, "Min feerate must be nonzero");
     size_t bucketIndex = 0;
@@ -522,31 +602,131 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     feeStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
     shortStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
     longStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+}
+
+CBlockPolicyEstimator::Estimates::Estimates(const Estimates& other)
+    : buckets(other.buckets), bucketMap(other.bucketMap),
+      feeStats(std::make_unique<TxConfirmStats>(*other.feeStats, buckets, bucketMap)),
+      shortStats(std::make_unique<TxConfirmStats>(*other.shortStats, buckets, bucketMap)),
+      longStats(std::make_unique<TxConfirmStats>(*other.longStats, buckets, bucketMap)),
+      nBestSeenHeight(other.nBestSeenHeight), firstRecordedHeight(other.firstRecordedHeight),
+      historicalFirst(other.historicalFirst), historicalBest(other.historicalBest)
+{
+}
+
+// This function is called from CTxMemPool::removeUnchecked to ensure
+// txs removed from the mempool for any reason are no longer
+// tracked. Txs that were part of a block have already been removed in
+// processBlockTx to ensure they are never double tracked, but it is
+// of no harm to try to remove them again.
+void CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
+{
+    Enqueue([this, hash, inBlock]() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator) { removeTrackedTx(hash, inBlock); });
+}
+
+bool CBlockPolicyEstimator::removeTrackedTx(const uint256& hash, bool inBlock)
+{
+    AssertLockHeld(m_cs_fee_estimator);
+    std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
+    if (pos != mapMemPoolTxs.end()) {
+        m_state->feeStats->removeTx(pos->second.blockHeight, m_state->nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        m_state->shortStats->removeTx(pos->second.blockHeight, m_state->nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        m_state->longStats->removeTx(pos->second.blockHeight, m_state->nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        mapMemPoolTxs.erase(hash);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+CBlockPolicyEstimator::CBlockPolicyEstimator()
+    : trackedTxs(0), untrackedTxs(0)
+{
+    WITH_LOCK(m_cs_fee_estimator, m_state = std::make_unique<Estimates>());
 
     // If the fee estimation file is present, read recorded estimations
     fs::path est_filepath = gArgs.GetDataDirNet() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_file(fsbridge::fopen(est_filepath, "rb"), SER_DISK, CLIENT_VERSION);
     if (est_file.IsNull() || !Read(est_file)) {
         LogPrintf("Failed to read fee estimates from %s. Continue anyway.\n", est_filepath.string());
+        WITH_LOCK(m_cs_fee_estimator, PublishEstimates());
     }
+
+    m_thread = std::thread(&util::TraceThread, "feeest", [this] { ThreadProcessQueue(); });
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
 {
+    WITH_LOCK(m_queue_mutex, m_stop = true);
+    m_queue_cv.notify_one();
+    m_thread.join();
+}
+
+void CBlockPolicyEstimator::Enqueue(std::function<void()> fn)
+{
+    WITH_LOCK(m_queue_mutex, m_queue.push_back(std::move(fn)));
+    m_queue_cv.notify_one();
+}
+
+void CBlockPolicyEstimator::ThreadProcessQueue()
+{
+    std::vector<std::function<void()>> events;
+    while (true) {
+        {
+            WAIT_LOCK(m_queue_mutex, lock);
+            m_queue_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_queue_mutex) { return m_stop || !m_queue.empty(); });
+            // Events still queued on destruction are processed first
+            if (m_queue.empty()) return;
+            events.swap(m_queue);
+        }
+        // Estimates are published once for everything queued meanwhile
+        LOCK(m_cs_fee_estimator);
+        for (const auto& fn : events) fn();
+        PublishEstimates();
+        events.clear();
+    }
+}
+
+void CBlockPolicyEstimator::SyncWithQueue()
+{
+    std::promise<void> promise;
+    Enqueue([this, &promise]() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator) {
+        PublishEstimates();
+        promise.set_value();
+    });
+    promise.get_future().wait();
+}
+
+void CBlockPolicyEstimator::PublishEstimates()
+{
+    AssertLockHeld(m_cs_fee_estimator);
+    std::shared_ptr<const Estimates> estimates = std::make_shared<const Estimates>(*m_state);
+    // The previous estimates are released after the lock, by their last reader
+    WITH_LOCK(m_estimates_mutex, m_estimates.swap(estimates));
+}
+
+std::shared_ptr<const CBlockPolicyEstimator::Estimates> CBlockPolicyEstimator::GetEstimates() const
+{
+    return WITH_LOCK(m_estimates_mutex, return m_estimates);
 }
 
 void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate)
 {
-    LOCK(m_cs_fee_estimator);
-    unsigned int txHeight = entry.GetHeight();
-    uint256 hash = entry.GetTx().GetHash();
+    // Feerates are stored and reported as BTC-per-kb:
+    Enqueue([this, hash = entry.GetTx().GetHash(), txHeight = entry.GetHeight(), feeRate = CFeeRate(entry.GetFee(), entry.GetTxSize()), validFeeEstimate]()
+                EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator) { processTx(hash, txHeight, feeRate, validFeeEstimate); });
+}
+
+void CBlockPolicyEstimator::processTx(const uint256& hash, unsigned int txHeight, const CFeeRate& feeRate, bool validFeeEstimate)
+{
+    AssertLockHeld(m_cs_fee_estimator);
     if (mapMemPoolTxs.count(hash)) {
         LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error mempool tx %s already being tracked\n",
                  hash.ToString());
         return;
     }
 
-    if (txHeight != nBestSeenHeight) {
+    if (txHeight != m_state->nBestSeenHeight) {
         // Ignore side chains and re-orgs; assuming they are random they don't
         // affect the estimate.  We'll potentially double count transactions in 1-block reorgs.
         // Ignore txs if BlockPolicyEstimator is not in sync with ::ChainActive().Tip().
@@ -562,21 +742,18 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     }
     trackedTxs++;
 
-    // Feerates are stored and reported as BTC-per-kb:
-    CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
-
     mapMemPoolTxs[hash].blockHeight = txHeight;
-    unsigned int bucketIndex = feeStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+    unsigned int bucketIndex = m_state->feeStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
     mapMemPoolTxs[hash].bucketIndex = bucketIndex;
-    unsigned int bucketIndex2 = shortStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+    unsigned int bucketIndex2 = m_state->shortStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
     assert(bucketIndex == bucketIndex2);
-    unsigned int bucketIndex3 = longStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+    unsigned int bucketIndex3 = m_state->longStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
     assert(bucketIndex == bucketIndex3);
 }
 
-bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry)
+bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const uint256& hash, unsigned int txHeight, const CFeeRate& feeRate)
 {
-    if (!removeTx(entry->GetTx().GetHash(), true)) {
+    if (!removeTrackedTx(hash, true)) {
         // This transaction wasn't being tracked for fee estimation
         return false;
     }
@@ -584,7 +761,7 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     // How many blocks did it take for miners to include this transaction?
     // blocksToConfirm is 1-based, so a transaction included in the earliest
     // possible block has confirmation count of 1
-    int blocksToConfirm = nBlockHeight - entry->GetHeight();
+    int blocksToConfirm = nBlockHeight - txHeight;
     if (blocksToConfirm <= 0) {
         // This can't happen because we don't process transactions from a block with a height
         // lower than our greatest seen height
@@ -592,62 +769,76 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
         return false;
     }
 
-    // Feerates are stored and reported as BTC-per-kb:
-    CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
-
-    feeStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
-    shortStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
-    longStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    m_state->feeStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    m_state->shortStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    m_state->longStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
     return true;
 }
 
+namespace {
+//! What is processed of a transaction included in a block
+struct BlockTx {
+    uint256 hash;
+    unsigned int height;
+    CFeeRate feeRate;
+};
+} // namespace
+
 void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
                                          std::vector<const CTxMemPoolEntry*>& entries)
 {
-    LOCK(m_cs_fee_estimator);
-    if (nBlockHeight <= nBestSeenHeight) {
-        // Ignore side chains and re-orgs; assuming they are random
-        // they don't affect the estimate.
-        // And if an attacker can re-org the chain at will, then
-        // you've got much bigger problems than "attacker can influence
-        // transaction fees."
-        return;
+    // The entries are removed from the mempool once this returns
+    std::vector<BlockTx> txs;
+    txs.reserve(entries.size());
+    for (const auto& entry : entries) {
+        txs.push_back({entry->GetTx().GetHash(), entry->GetHeight(), CFeeRate(entry->GetFee(), entry->GetTxSize())});
     }
 
-    // Must update nBestSeenHeight in sync with ClearCurrent so that
-    // calls to removeTx (via processBlockTx) correctly calculate age
-    // of unconfirmed txs to remove from tracking.
-    nBestSeenHeight = nBlockHeight;
-
-    // Update unconfirmed circular buffer
-    feeStats->ClearCurrent(nBlockHeight);
-    shortStats->ClearCurrent(nBlockHeight);
-    longStats->ClearCurrent(nBlockHeight);
-
-    // Decay all exponential averages
-    feeStats->UpdateMovingAverages();
-    shortStats->UpdateMovingAverages();
-    longStats->UpdateMovingAverages();
+    Enqueue([this, nBlockHeight, txs = std::move(txs)]() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator) {
+        if (nBlockHeight <= m_state->nBestSeenHeight) {
+            // Ignore side chains and re-orgs; assuming they are random
+            // they don't affect the estimate.
+            // And if an attacker can re-org the chain at will, then
+            // you've got much bigger problems than "attacker can influence
+            // transaction fees."
+            return;
+        }
 
-    unsigned int countedTxs = 0;
-    // Update averages with data points from current block
-    for (const auto& entry : entries) {
-        if (processBlockTx(nBlockHeight, entry))
-            countedTxs++;
-    }
+        // Must update nBestSeenHeight in sync with ClearCurrent so that
+        // calls to removeTx (via processBlockTx) correctly calculate age
+        // of unconfirmed txs to remove from tracking.
+        m_state->nBestSeenHeight = nBlockHeight;
+
+        // Update unconfirmed circular buffer
+        m_state->feeStats->ClearCurrent(nBlockHeight);
+        m_state->shortStats->ClearCurrent(nBlockHeight);
+        m_state->longStats->ClearCurrent(nBlockHeight);
+
+        // Decay all exponential averages
+        m_state->feeStats->UpdateMovingAverages();
+        m_state->shortStats->UpdateMovingAverages();
+        m_state->longStats->UpdateMovingAverages();
+
+        unsigned int countedTxs = 0;
+        // Update averages with data points from current block
+        for (const BlockTx& tx : txs) {
+            if (processBlockTx(nBlockHeight, tx.hash, tx.height, tx.feeRate))
+                countedTxs++;
+        }
 
-    if (firstRecordedHeight == 0 && countedTxs > 0) {
-        firstRecordedHeight = nBestSeenHeight;
-        LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy first recorded height %u\n", firstRecordedHeight);
-    }
+        if (m_state->firstRecordedHeight == 0 && countedTxs > 0) {
+            m_state->firstRecordedHeight = m_state->nBestSeenHeight;
+            LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy first recorded height %u\n", m_state->firstRecordedHeight);
+        }
 
 
-    LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy estimates updated by %u of %u block txs, since last block %u of %u tracked, mempool map size %u, max target %u from %s\n",
-             countedTxs, entries.size(), trackedTxs, trackedTxs + untrackedTxs, mapMemPoolTxs.size(),
-             MaxUsableEstimate(), HistoricalBlockSpan() > BlockSpan() ? "historical" : "current");
+        LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy estimates updated by %u of %u block txs, since last block %u of %u tracked, mempool map size %u, max target %u from %s\n",
+                 countedTxs, txs.size(), trackedTxs, trackedTxs + untrackedTxs, mapMemPoolTxs.size(),
+                 m_state->MaxUsableEstimate(), m_state->HistoricalBlockSpan() > m_state->BlockSpan() ? "historical" : "current");
 
-    trackedTxs = 0;
-    untrackedTxs = 0;
+        trackedTxs = 0;
+        untrackedTxs = 0;
+    });
 }
 
 CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
@@ -660,6 +851,11 @@ CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
 }
 
 CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThreshold, FeeEstimateHorizon horizon, EstimationResult* result) const
+{
+    return GetEstimates()->estimateRawFee(confTarget, successThreshold, horizon, result);
+}
+
+CFeeRate CBlockPolicyEstimator::Estimates::estimateRawFee(int confTarget, double successThreshold, FeeEstimateHorizon horizon, EstimationResult* result) const
 {
     TxConfirmStats* stats = nullptr;
     double sufficientTxs = SUFFICIENT_FEETXS;
@@ -680,7 +876,6 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
     } // no default case, so the compiler can warn about missing cases
     assert(stats);
 
-    LOCK(m_cs_fee_estimator);
     // Return failure if trying to analyze a target we're not tracking
     if (confTarget <= 0 || (unsigned int)confTarget > stats->GetMaxConfirms())
         return CFeeRate(0);
@@ -697,7 +892,11 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
 
 unsigned int CBlockPolicyEstimator::HighestTargetTracked(FeeEstimateHorizon horizon) const
 {
-    LOCK(m_cs_fee_estimator);
+    return GetEstimates()->HighestTargetTracked(horizon);
+}
+
+unsigned int CBlockPolicyEstimator::Estimates::HighestTargetTracked(FeeEstimateHorizon horizon) const
+{
     switch (horizon) {
     case FeeEstimateHorizon::SHORT_HALFLIFE: {
         return shortStats->GetMaxConfirms();
@@ -712,7 +911,7 @@ unsigned int CBlockPolicyEstimator::HighestTargetTracked(FeeEstimateHorizon hori
     assert(false);
 }
 
-unsigned int CBlockPolicyEstimator::BlockSpan() const
+unsigned int CBlockPolicyEstimator::Estimates::BlockSpan() const
 {
     if (firstRecordedHeight == 0) return 0;
     assert(nBestSeenHeight >= firstRecordedHeight);
@@ -720,7 +919,7 @@ unsigned int CBlockPolicyEstimator::BlockSpan() const
     return nBestSeenHeight - firstRecordedHeight;
 }
 
-unsigned int CBlockPolicyEstimator::HistoricalBlockSpan() const
+unsigned int CBlockPolicyEstimator::Estimates::HistoricalBlockSpan() const
 {
     if (historicalFirst == 0) return 0;
     assert(historicalBest >= historicalFirst);
@@ -730,17 +929,16 @@ unsigned int CBlockPolicyEstimator::HistoricalBlockSpan() const
     return historicalBest - historicalFirst;
 }
 
-unsigned int CBlockPolicyEstimator::MaxUsableEstimate() const
+unsigned int CBlockPolicyEstimator::Estimates::MaxUsableEstimate() const
 {
     // Block spans are divided by 2 to make sure there are enough potential failing data points for the estimate
     return std::min(longStats->GetMaxConfirms(), std::max(BlockSpan(), HistoricalBlockSpan()) / 2);
 }
-
 /** Return a fee estimate at the required successThreshold from the shortest
  * time horizon which tracks confirmations up to the desired target.  If
  * checkShorterHorizon is requested, also allow short time horizon estimates
  * for a lower target to reduce the given answer */
-double CBlockPolicyEstimator::estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const
+double CBlockPolicyEstimator::Estimates::estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const
 {
     double estimate = -1;
     if (confTarget >= 1 && confTarget <= longStats->GetMaxConfirms()) {
@@ -779,7 +977,7 @@ double CBlockPolicyEstimator::estimateCombinedFee(unsigned int confTarget, doubl
 /** Ensure that for a conservative estimate, the DOUBLE_SUCCESS_PCT is also met
  * at 2 * target for any longer time horizons.
  */
-double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const
+double CBlockPolicyEstimator::Estimates::estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const
 {
     double estimate = -1;
     EstimationResult tempResult;
@@ -805,8 +1003,11 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  */
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
 {
-    LOCK(m_cs_fee_estimator);
+    return GetEstimates()->estimateSmartFee(confTarget, feeCalc, conservative);
+}
 
+CFeeRate CBlockPolicyEstimator::Estimates::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+{
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
         feeCalc->returnedTarget = confTarget;
@@ -883,7 +1084,11 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
 
 void CBlockPolicyEstimator::Flush() {
     FlushUnconfirmed();
+    FlushFeeEstimates();
+}
 
+void CBlockPolicyEstimator::FlushFeeEstimates()
+{
     fs::path est_filepath = gArgs.GetDataDirNet() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_file(fsbridge::fopen(est_filepath, "wb"), SER_DISK, CLIENT_VERSION);
     if (est_file.IsNull() || !Write(est_file)) {
@@ -894,20 +1099,8 @@ void CBlockPolicyEstimator::Flush() {
 bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 {
     try {
-        LOCK(m_cs_fee_estimator);
-        fileout << 149900; // version required to read: 0.14.99 or later
-        fileout << CLIENT_VERSION; // version that wrote the file
-        fileout << nBestSeenHeight;
-        if (BlockSpan() > HistoricalBlockSpan()/2) {
-            fileout << firstRecordedHeight << nBestSeenHeight;
-        }
-        else {
-            fileout << historicalFirst << historicalBest;
-        }
-        fileout << Using<VectorFormatter<EncodedDoubleFormatter>>(buckets);
-        feeStats->Write(fileout);
-        shortStats->Write(fileout);
-        longStats->Write(fileout);
+        // Only the published estimates are written, without waiting for the estimator
+        GetEstimates()->Write(fileout);
     }
     catch (const std::exception&) {
         LogPrintf("CBlockPolicyEstimator::Write(): unable to write policy estimator data (non-fatal)\n");
@@ -916,6 +1109,23 @@ bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
     return true;
 }
 
+void CBlockPolicyEstimator::Estimates::Write(CAutoFile& fileout) const
+{
+    fileout << 149900; // version required to read: 0.14.99 or later
+    fileout << CLIENT_VERSION; // version that wrote the file
+    fileout << nBestSeenHeight;
+    if (BlockSpan() > HistoricalBlockSpan()/2) {
+        fileout << firstRecordedHeight << nBestSeenHeight;
+    }
+    else {
+        fileout << historicalFirst << historicalBest;
+    }
+    fileout << Using<VectorFormatter<EncodedDoubleFormatter>>(buckets);
+    feeStats->Write(fileout);
+    shortStats->Write(fileout);
+    longStats->Write(fileout);
+}
+
 bool CBlockPolicyEstimator::Read(CAutoFile& filein)
 {
     try {
@@ -946,30 +1156,31 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
                 throw std::runtime_error("Corrupt estimates file. Must have between 2 and 1000 feerate buckets");
             }
 
-            std::unique_ptr<TxConfirmStats> fileFeeStats(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
-            std::unique_ptr<TxConfirmStats> fileShortStats(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
-            std::unique_ptr<TxConfirmStats> fileLongStats(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+            std::unique_ptr<TxConfirmStats> fileFeeStats(new TxConfirmStats(m_state->buckets, m_state->bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
+            std::unique_ptr<TxConfirmStats> fileShortStats(new TxConfirmStats(m_state->buckets, m_state->bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
+            std::unique_ptr<TxConfirmStats> fileLongStats(new TxConfirmStats(m_state->buckets, m_state->bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
             fileFeeStats->Read(filein, nVersionThatWrote, numBuckets);
             fileShortStats->Read(filein, nVersionThatWrote, numBuckets);
             fileLongStats->Read(filein, nVersionThatWrote, numBuckets);
 
             // Fee estimates file parsed correctly
             // Copy buckets from file and refresh our bucketmap
-            buckets = fileBuckets;
-            bucketMap.clear();
-            for (unsigned int i = 0; i < buckets.size(); i++) {
-                bucketMap[buckets[i]] = i;
+            m_state->buckets = fileBuckets;
+            m_state->bucketMap.clear();
+            for (unsigned int i = 0; i < m_state->buckets.size(); i++) {
+                m_state->bucketMap[m_state->buckets[i]] = i;
             }
 
             // Destroy old TxConfirmStats and point to new ones that already reference buckets and bucketMap
-            feeStats = std::move(fileFeeStats);
-            shortStats = std::move(fileShortStats);
-            longStats = std::move(fileLongStats);
+            m_state->feeStats = std::move(fileFeeStats);
+            m_state->shortStats = std::move(fileShortStats);
+            m_state->longStats = std::move(fileLongStats);
 
-            nBestSeenHeight = nFileBestSeenHeight;
-            historicalFirst = nFileHistoricalFirst;
-            historicalBest = nFileHistoricalBest;
+            m_state->nBestSeenHeight = nFileBestSeenHeight;
+            m_state->historicalFirst = nFileHistoricalFirst;
+            m_state->historicalBest = nFileHistoricalBest;
         }
+        PublishEstimates();
     }
     catch (const std::exception& e) {
         LogPrintf("CBlockPolicyEstimator::Read(): unable to read policy estimator data (non-fatal): %s\n",e.what());
@@ -979,16 +1190,18 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
 }
 
 void CBlockPolicyEstimator::FlushUnconfirmed() {
-    int64_t startclear = GetTimeMicros();
-    LOCK(m_cs_fee_estimator);
-    size_t num_entries = mapMemPoolTxs.size();
-    // Remove every entry in mapMemPoolTxs
-    while (!mapMemPoolTxs.empty()) {
-        auto mi = mapMemPoolTxs.begin();
-        removeTx(mi->first, false); // this calls erase() on mapMemPoolTxs
-    }
-    int64_t endclear = GetTimeMicros();
-    LogPrint(BCLog::ESTIMATEFEE, "Recorded %u unconfirmed txs from mempool in %gs\n", num_entries, (endclear - startclear)*0.000001);
+    Enqueue([this]() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator) {
+        int64_t startclear = GetTimeMicros();
+        size_t num_entries = mapMemPoolTxs.size();
+        // Remove every entry in mapMemPoolTxs
+        while (!mapMemPoolTxs.empty()) {
+            auto mi = mapMemPoolTxs.begin();
+            removeTrackedTx(mi->first, false); // this calls erase() on mapMemPoolTxs
+        }
+        int64_t endclear = GetTimeMicros();
+        LogPrint(BCLog::ESTIMATEFEE, "Recorded %u unconfirmed txs from mempool in %gs\n", num_entries, (endclear - startclear)*0.000001);
+    });
+    SyncWithQueue();
 }
 
 FeeFilterRounder::FeeFilterRounder(const CFeeRate& minIncrementalFee)
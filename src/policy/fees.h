@@ -12,9 +12,13 @@
 #include <sync.h>
 
 #include <array>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 class CAutoFile;
@@ -23,6 +27,9 @@ class CTxMemPoolEntry;
 class CTxMemPool;
 class TxConfirmStats;
 
+/** Interval between writes of the fee estimates to disk */
+static constexpr std::chrono::hours FEE_FLUSH_INTERVAL{1};
+
 /* Identifier for each of the 3 different TxConfirmStats which will track
  * history over different time horizons. */
 enum class FeeEstimateHorizon {
@@ -127,6 +134,11 @@ struct FeeCalculation
  *  We want to be able to estimate feerates that are needed on tx's to be included in
  * a certain number of blocks.  Every time a block is added to the best chain, this class records
  * stats on the transactions included in that block
+ *
+ * The mempool only queues the transactions and blocks it reports, they are
+ * processed on the estimator's own thread. After processing, a copy of the
+ * recorded data is published, from which estimates are calculated without
+ * waiting for the estimator.
  */
 class CBlockPolicyEstimator
 {
@@ -192,7 +204,10 @@ public:
     void processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate);
 
     /** Remove a transaction from the mempool tracking stats*/
-    bool removeTx(uint256 hash, bool inBlock);
+    void removeTx(uint256 hash, bool inBlock);
+
+    /** Wait until the transactions and blocks queued so far are processed and their estimates published */
+    void SyncWithQueue();
 
     /** DEPRECATED. Return a feerate estimate */
     CFeeRate estimateFee(int confTarget) const;
@@ -225,13 +240,22 @@ public:
     /** Drop still unconfirmed transactions and record current estimations, if the fee estimation file is present. */
     void Flush();
 
+    /** Record the current estimations to the fee estimation file */
+    void FlushFeeEstimates();
+
 private:
+    /** The recorded data estimates are calculated from */
+    class Estimates;
+
     mutable RecursiveMutex m_cs_fee_estimator;
 
-    unsigned int nBestSeenHeight GUARDED_BY(m_cs_fee_estimator);
-    unsigned int firstRecordedHeight GUARDED_BY(m_cs_fee_estimator);
-    unsigned int historicalFirst GUARDED_BY(m_cs_fee_estimator);
-    unsigned int historicalBest GUARDED_BY(m_cs_fee_estimator);
+    /** Data updated by the processed transactions and blocks */
+    std::unique_ptr<Estimates> m_state PT_GUARDED_BY(m_cs_fee_estimator);
+
+    /** Copy of m_state that estimates are answered from, never modified once published.
+     *  It shares the rows of its tables with m_state until m_state modifies them. */
+    mutable Mutex m_estimates_mutex;
+    std::shared_ptr<const Estimates> m_estimates GUARDED_BY(m_estimates_mutex);
 
     struct TxStatsInfo
     {
@@ -243,30 +267,31 @@ private:
     // map of txids to information about that transaction
     std::map<uint256, TxStatsInfo> mapMemPoolTxs GUARDED_BY(m_cs_fee_estimator);
 
-    /** Classes to track historical data on transaction confirmations */
-    std::unique_ptr<TxConfirmStats> feeStats PT_GUARDED_BY(m_cs_fee_estimator);
-    std::unique_ptr<TxConfirmStats> shortStats PT_GUARDED_BY(m_cs_fee_estimator);
-    std::unique_ptr<TxConfirmStats> longStats PT_GUARDED_BY(m_cs_fee_estimator);
-
     unsigned int trackedTxs GUARDED_BY(m_cs_fee_estimator);
     unsigned int untrackedTxs GUARDED_BY(m_cs_fee_estimator);
 
-    std::vector<double> buckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the bucket (inclusive)
-    std::map<double, unsigned int> bucketMap GUARDED_BY(m_cs_fee_estimator); // Map of bucket upper-bound to index into all vectors by bucket
-
+    /** Transactions and blocks reported by the mempool, waiting to be processed */
+    Mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::vector<std::function<void()>> m_queue GUARDED_BY(m_queue_mutex);
+    bool m_stop GUARDED_BY(m_queue_mutex){false};
+    std::thread m_thread;
+
+    /** Process the queue until the estimator is destroyed */
+    void ThreadProcessQueue();
+    /** Queue fn to be run with m_cs_fee_estimator held */
+    void Enqueue(std::function<void()> fn);
+    /** Publish a copy of m_state, which only copies the rows of its tables modified since the last one */
+    void PublishEstimates() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** The last published estimates */
+    std::shared_ptr<const Estimates> GetEstimates() const;
+
+    /** Process a transaction accepted to the mempool */
+    void processTx(const uint256& hash, unsigned int txHeight, const CFeeRate& feeRate, bool validFeeEstimate) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** Stop tracking a transaction, returning whether it was tracked */
+    bool removeTrackedTx(const uint256& hash, bool inBlock) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
     /** Process a transaction confirmed in a block*/
-    bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
-
-    /** Helper for estimateSmartFee */
-    double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
-    /** Helper for estimateSmartFee */
-    double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
-    /** Number of blocks of data recorded while fee estimates have been running */
-    unsigned int BlockSpan() const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
-    /** Number of blocks of recorded fee estimate data represented in saved data file */
-    unsigned int HistoricalBlockSpan() const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
-    /** Calculation of highest target that reasonable estimate can be provided for */
-    unsigned int MaxUsableEstimate() const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    bool processBlockTx(unsigned int nBlockHeight, const uint256& hash, unsigned int txHeight, const CFeeRate& feeRate) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 };
 
 class FeeFilterRounder
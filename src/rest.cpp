@@ -7,6 +7,7 @@
 #include <chainparams.h>
 #include <core_io.h>
 #include <httpserver.h>
+#include <index/blockfilterindex.h>
 #include <index/txindex.h>
 #include <node/blockstorage.h>
 #include <node/context.h>
@@ -14,6 +15,7 @@
 #include <primitives/transaction.h>
 #include <rpc/blockchain.h>
 #include <rpc/protocol.h>
+#include <rpc/request.h>
 #include <rpc/server.h>
 #include <streams.h>
 #include <sync.h>
@@ -30,6 +32,7 @@
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const int MAX_REST_BLOCKRANGE = 10000; //allow a max of 10000 blocks to be streamed at once
 
 enum class RetFormat {
     UNDEF,
@@ -226,7 +229,7 @@ static bool rest_headers(const std::any& context,
 
         std::string binaryHeader = ssHeader.str();
         req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, binaryHeader);
+        req->WriteReply(HTTP_OK, std::move(binaryHeader));
         return true;
     }
 
@@ -238,7 +241,7 @@ static bool rest_headers(const std::any& context,
 
         std::string strHex = HexStr(ssHeader) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
-        req->WriteReply(HTTP_OK, strHex);
+        req->WriteReply(HTTP_OK, std::move(strHex));
         return true;
     }
     case RetFormat::JSON: {
@@ -248,7 +251,7 @@ static bool rest_headers(const std::any& context,
         }
         std::string strJSON = jsonHeaders.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReply(HTTP_OK, std::move(strJSON));
         return true;
     }
     default: {
@@ -298,7 +301,7 @@ static bool rest_block(const std::any& context,
         ssBlock << block;
         std::string binaryBlock = ssBlock.str();
         req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, binaryBlock);
+        req->WriteReply(HTTP_OK, std::move(binaryBlock));
         return true;
     }
 
@@ -307,15 +310,27 @@ static bool rest_block(const std::any& context,
         ssBlock << block;
         std::string strHex = HexStr(ssBlock) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
-        req->WriteReply(HTTP_OK, strHex);
+        req->WriteReply(HTTP_OK, std::move(strHex));
         return true;
     }
 
     case RetFormat::JSON: {
-        UniValue objBlock = blockToJSON(block, tip, pblockindex, showTxDetails);
-        std::string strJSON = objBlock.write() + "\n";
+        // The block is sent in chunks while it is described
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->StartReply(HTTP_OK);
+        JSONStreamWriter out([&](std::string&& chunk) {
+            if (!req->WriteReplyChunk(std::move(chunk))) {
+                throw std::runtime_error("Client stopped receiving the reply");
+            }
+        });
+        try {
+            blockToJSON(out, block, tip, pblockindex, showTxDetails);
+            out.Flush();
+            req->WriteReplyChunk("\n");
+        } catch (const std::runtime_error& e) {
+            LogPrint(BCLog::HTTP, "REST block %s not sent: %s\n", hashStr, e.what());
+        }
+        req->EndReply();
         return true;
     }
 
@@ -353,7 +368,7 @@ static bool rest_chaininfo(const std::any& context, HTTPRequest* req, const std:
         UniValue chainInfoObject = getblockchaininfo().HandleRequest(jsonRequest);
         std::string strJSON = chainInfoObject.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReply(HTTP_OK, std::move(strJSON));
         return true;
     }
     default: {
@@ -377,7 +392,7 @@ static bool rest_mempool_info(const std::any& context, HTTPRequest* req, const s
 
         std::string strJSON = mempoolInfoObject.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReply(HTTP_OK, std::move(strJSON));
         return true;
     }
     default: {
@@ -400,7 +415,7 @@ static bool rest_mempool_contents(const std::any& context, HTTPRequest* req, con
 
         std::string strJSON = mempoolObject.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReply(HTTP_OK, std::move(strJSON));
         return true;
     }
     default: {
@@ -439,7 +454,7 @@ static bool rest_tx(const std::any& context, HTTPRequest* req, const std::string
 
         std::string binaryTx = ssTx.str();
         req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, binaryTx);
+        req->WriteReply(HTTP_OK, std::move(binaryTx));
         return true;
     }
 
@@ -449,7 +464,7 @@ static bool rest_tx(const std::any& context, HTTPRequest* req, const std::string
 
         std::string strHex = HexStr(ssTx) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
-        req->WriteReply(HTTP_OK, strHex);
+        req->WriteReply(HTTP_OK, std::move(strHex));
         return true;
     }
 
@@ -458,7 +473,7 @@ static bool rest_tx(const std::any& context, HTTPRequest* req, const std::string
         TxToUniv(*tx, hashBlock, objTx);
         std::string strJSON = objTx.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReply(HTTP_OK, std::move(strJSON));
         return true;
     }
 
@@ -609,7 +624,7 @@ static bool rest_getutxos(const std::any& context, HTTPRequest* req, const std::
         std::string ssGetUTXOResponseString = ssGetUTXOResponse.str();
 
         req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, ssGetUTXOResponseString);
+        req->WriteReply(HTTP_OK, std::move(ssGetUTXOResponseString));
         return true;
     }
 
@@ -619,7 +634,7 @@ static bool rest_getutxos(const std::any& context, HTTPRequest* req, const std::
         std::string strHex = HexStr(ssGetUTXOResponse) + "\n";
 
         req->WriteHeader("Content-Type", "text/plain");
-        req->WriteReply(HTTP_OK, strHex);
+        req->WriteReply(HTTP_OK, std::move(strHex));
         return true;
     }
 
@@ -649,7 +664,7 @@ static bool rest_getutxos(const std::any& context, HTTPRequest* req, const std::
         // return json string
         std::string strJSON = objGetUTXOResponse.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReply(HTTP_OK, std::move(strJSON));
         return true;
     }
     default: {
@@ -708,26 +723,128 @@ static bool rest_blockhash_by_height(const std::any& context, HTTPRequest* req,
     }
 }
 
+//! Append data to a block range record, prefixed by its CompactSize length
+static void AppendRecordField(std::string& record, const std::vector<uint8_t>& data)
+{
+    CDataStream size(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(size, data.size());
+    record.append(size.begin(), size.end());
+    record.append(data.begin(), data.end());
+}
+
+/**
+ * Stream a range of blocks of the active chain as they are stored, with their
+ * undo data and basic compact filters. Each block is sent in its own chunk as
+ * a record of its height (4 bytes, little endian), followed by the block, its
+ * undo data and its filter, each prefixed by its CompactSize length. The undo
+ * data is empty for the genesis block, and the filter is empty when the basic
+ * filter index is disabled or has not reached the block yet.
+ */
+static bool rest_blockrange(const std::any& context, HTTPRequest* req, const std::string& str_uri_part)
+{
+    if (!CheckWarmup(req)) return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, str_uri_part);
+    if (rf != RetFormat::BINARY) {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: bin)");
+    }
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() != 2) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/blockrange/<start>/<count>.bin");
+    }
+    int32_t start = -1;
+    if (!ParseInt32(path[0], &start) || start < 0) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + SanitizeString(path[0]));
+    }
+    int32_t count = 0;
+    if (!ParseInt32(path[1], &count) || count < 1 || count > MAX_REST_BLOCKRANGE) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + SanitizeString(path[1]));
+    }
+
+    std::vector<const CBlockIndex*> blocks;
+    {
+        ChainstateManager* maybe_chainman = GetChainman(context, req);
+        if (!maybe_chainman) return false;
+        LOCK(cs_main);
+        const CChain& active_chain = maybe_chainman->ActiveChain();
+        if (start > active_chain.Height()) {
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range");
+        }
+        const int end = std::min(active_chain.Height(), start + count - 1);
+        blocks.reserve(end - start + 1);
+        for (int height = start; height <= end; ++height) {
+            const CBlockIndex* pindex = active_chain[height];
+            if (IsBlockPruned(pindex)) {
+                return RESTERR(req, HTTP_NOT_FOUND, strprintf("Block at height %d not available (pruned data)", height));
+            }
+            blocks.push_back(pindex);
+        }
+    }
+
+    BlockFilterIndex* filter_index = GetBlockFilterIndex(BlockFilterType::BASIC);
+    const CMessageHeader::MessageStartChars& message_start = Params().MessageStart();
+    req->WriteHeader("Content-Type", "application/octet-stream");
+    req->StartReply(HTTP_OK);
+    std::vector<uint8_t> block_data;
+    std::vector<uint8_t> undo_data;
+    for (const CBlockIndex* pindex : blocks) {
+        // The files may be pruned while the range is sent, which ends it early
+        if (!ReadRawBlockFromDisk(block_data, pindex, message_start)) {
+            LogPrint(BCLog::HTTP, "REST block range stopped at height %d: block not readable\n", pindex->nHeight);
+            break;
+        }
+        undo_data.clear();
+        if (pindex->pprev && !ReadRawUndoFromDisk(undo_data, pindex)) {
+            LogPrint(BCLog::HTTP, "REST block range stopped at height %d: undo data not readable\n", pindex->nHeight);
+            break;
+        }
+        BlockFilter filter;
+        const bool have_filter = filter_index && filter_index->LookupFilter(pindex, filter);
+        const std::vector<unsigned char> no_filter;
+        const std::vector<unsigned char>& filter_data = have_filter ? filter.GetEncodedFilter() : no_filter;
+
+        // The chunk is built in place, as the HTTP server sends it without a copy
+        std::string record;
+        record.reserve(4 + 9 + block_data.size() + 9 + undo_data.size() + 9 + filter_data.size());
+        CDataStream height(SER_NETWORK, PROTOCOL_VERSION);
+        height << uint32_t(pindex->nHeight);
+        record.append(height.begin(), height.end());
+        AppendRecordField(record, block_data);
+        AppendRecordField(record, undo_data);
+        AppendRecordField(record, filter_data);
+        if (!req->WriteReplyChunk(std::move(record))) {
+            LogPrint(BCLog::HTTP, "REST block range stopped at height %d: client stopped receiving the reply\n", pindex->nHeight);
+            break;
+        }
+    }
+    req->EndReply();
+    return true;
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(const std::any& context, HTTPRequest* req, const std::string& strReq);
+    HTTPWorkLane lane;
 } uri_prefixes[] = {
-      {"/rest/tx/", rest_tx},
-      {"/rest/block/notxdetails/", rest_block_notxdetails},
-      {"/rest/block/", rest_block_extended},
-      {"/rest/chaininfo", rest_chaininfo},
-      {"/rest/mempool/info", rest_mempool_info},
-      {"/rest/mempool/contents", rest_mempool_contents},
-      {"/rest/headers/", rest_headers},
-      {"/rest/getutxos", rest_getutxos},
-      {"/rest/blockhashbyheight/", rest_blockhash_by_height},
+      {"/rest/tx/", rest_tx, HTTPWorkLane::CHEAP},
+      {"/rest/block/notxdetails/", rest_block_notxdetails, HTTPWorkLane::CHEAP},
+      {"/rest/blockrange/", rest_blockrange, HTTPWorkLane::EXPENSIVE},
+      {"/rest/block/", rest_block_extended, HTTPWorkLane::CHEAP},
+      {"/rest/chaininfo", rest_chaininfo, HTTPWorkLane::CHEAP},
+      {"/rest/mempool/info", rest_mempool_info, HTTPWorkLane::CHEAP},
+      {"/rest/mempool/contents", rest_mempool_contents, HTTPWorkLane::CHEAP},
+      {"/rest/headers/", rest_headers, HTTPWorkLane::CHEAP},
+      {"/rest/getutxos", rest_getutxos, HTTPWorkLane::CHEAP},
+      {"/rest/blockhashbyheight/", rest_blockhash_by_height, HTTPWorkLane::CHEAP},
 };
 
 void StartREST(const std::any& context)
 {
     for (const auto& up : uri_prefixes) {
         auto handler = [context, up](HTTPRequest* req, const std::string& prefix) { return up.handler(context, req, prefix); };
-        RegisterHTTPHandler(up.prefix, false, handler);
+        auto classifier = [lane = up.lane](HTTPRequest*) { return lane; };
+        RegisterHTTPHandler(up.prefix, false, handler, classifier);
     }
 }
 
@@ -35,6 +35,7 @@
 #include <txdb.h>
 #include <txmempool.h>
 #include <undo.h>
+#include <util/hasher.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 #include <util/translation.h>
@@ -50,6 +51,7 @@
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <unordered_set>
 
 #include <metrics/metrics.h>
 
@@ -203,14 +205,20 @@ UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails)
+/** Block description to JSON, but for its transactions */
+static UniValue blockSummaryToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex)
 {
     UniValue result = blockheaderToJSON(tip, blockindex);
 
     result.pushKV("strippedsize", (int)::GetSerializeSize(block, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
     result.pushKV("size", (int)::GetSerializeSize(block, PROTOCOL_VERSION));
     result.pushKV("weight", (int)::GetBlockWeight(block));
-    UniValue txs(UniValue::VARR);
+    return result;
+}
+
+/** Call fn with the description of every transaction of block, in order */
+static void blockTxsToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, const std::function<void(const UniValue&)>& fn)
+{
     if (txDetails) {
         CBlockUndo blockUndo;
         const bool have_undo = !IsBlockPruned(blockindex) && UndoReadFromDisk(blockUndo, blockindex);
@@ -220,18 +228,36 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIn
             const CTxUndo* txundo = (have_undo && i) ? &blockUndo.vtxundo.at(i - 1) : nullptr;
             UniValue objTx(UniValue::VOBJ);
             TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags(), txundo);
-            txs.push_back(objTx);
+            fn(objTx);
         }
     } else {
         for (const CTransactionRef& tx : block.vtx) {
-            txs.push_back(tx->GetHash().GetHex());
+            fn(tx->GetHash().GetHex());
         }
     }
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails)
+{
+    UniValue result = blockSummaryToJSON(block, tip, blockindex);
+    UniValue txs(UniValue::VARR);
+    blockTxsToJSON(block, blockindex, txDetails, [&](const UniValue& tx) { txs.push_back(tx); });
     result.pushKV("tx", txs);
 
     return result;
 }
 
+void blockToJSON(JSONStreamWriter& out, const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails)
+{
+    out.BeginObject();
+    out.Pairs(blockSummaryToJSON(block, tip, blockindex));
+    out.Key("tx");
+    out.BeginArray();
+    blockTxsToJSON(block, blockindex, txDetails, [&](const UniValue& tx) { out.Value(tx); });
+    out.EndArray();
+    out.EndObject();
+}
+
 static RPCHelpMan getblockcount()
 {
     return RPCHelpMan{"getblockcount",
@@ -527,8 +553,8 @@ static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPool
     UniValue spent(UniValue::VARR);
     const CTxMemPool::txiter& it = pool.mapTx.find(tx.GetHash());
     const CTxMemPoolEntry::Children& children = it->GetMemPoolChildrenConst();
-    for (const CTxMemPoolEntry& child : children) {
-        spent.push_back(child.GetTx().GetHash().ToString());
+    for (const CTxMemPool::txiter& child : children) {
+        spent.push_back(child->GetTx().GetHash().ToString());
     }
 
     info.pushKV("spentby", spent);
@@ -587,6 +613,43 @@ UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose, bool include_mempoo
     }
 }
 
+void MempoolToJSON(JSONStreamWriter& out, const CTxMemPool& pool)
+{
+    std::vector<uint256> txids;
+    {
+        LOCK(pool.cs);
+        txids.reserve(pool.mapTx.size());
+        for (const CTxMemPoolEntry& e : pool.mapTx) {
+            txids.push_back(e.GetTx().GetHash());
+        }
+    }
+
+    // Entries are described in batches, and only written once the mempool
+    // is unlocked again
+    static constexpr size_t BATCH_SIZE{1000};
+    std::vector<std::pair<std::string, UniValue>> batch;
+    out.BeginObject();
+    for (size_t start = 0; start < txids.size(); start += BATCH_SIZE) {
+        {
+            LOCK(pool.cs);
+            for (size_t i = start; i < std::min(start + BATCH_SIZE, txids.size()); ++i) {
+                const auto it = pool.mapTx.find(txids[i]);
+                // Transactions removed meanwhile are left out
+                if (it == pool.mapTx.end()) continue;
+                UniValue info(UniValue::VOBJ);
+                entryToJSON(pool, info, *it);
+                batch.emplace_back(txids[i].ToString(), std::move(info));
+            }
+        }
+        for (const auto& [txid, info] : batch) {
+            out.Key(txid);
+            out.Value(info);
+        }
+        batch.clear();
+    }
+    out.EndObject();
+}
+
 static RPCHelpMan getrawmempool()
 {
     return RPCHelpMan{"getrawmempool",
@@ -632,7 +695,12 @@ static RPCHelpMan getrawmempool()
         include_mempool_sequence = request.params[1].get_bool();
     }
 
-    return MempoolToJSON(EnsureAnyMemPool(request.context), fVerbose, include_mempool_sequence);
+    const CTxMemPool& mempool = EnsureAnyMemPool(request.context);
+    if (request.result_stream && fVerbose && !include_mempool_sequence) {
+        MempoolToJSON(*request.result_stream, mempool);
+        return NullUniValue;
+    }
+    return MempoolToJSON(mempool, fVerbose, include_mempool_sequence);
 },
     };
 }
@@ -1021,6 +1089,10 @@ static RPCHelpMan getblock()
         return strHex;
     }
 
+    if (request.result_stream && verbosity >= 2) {
+        blockToJSON(*request.result_stream, block, tip, pblockindex, true);
+        return NullUniValue;
+    }
     return blockToJSON(block, tip, pblockindex, verbosity >= 2);
 },
     };
@@ -2206,12 +2278,13 @@ static RPCHelpMan savemempool()
         [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
 {
     const CTxMemPool& mempool = EnsureAnyMemPool(request.context);
+    ChainstateManager& chainman = EnsureAnyChainman(request.context);
 
     if (!mempool.IsLoaded()) {
         throw JSONRPCError(RPC_MISC_ERROR, "The mempool was not loaded yet");
     }
 
-    if (!DumpMempool(mempool)) {
+    if (!DumpMempool(mempool, chainman.ActiveChainstate())) {
         throw JSONRPCError(RPC_MISC_ERROR, "Unable to dump mempool to disk");
     }
 
@@ -2221,15 +2294,15 @@ static RPCHelpMan savemempool()
 }
 
 namespace {
-//! Search for a given set of pubkey scripts
-bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results, std::function<void()>& interruption_point)
+using ScriptSet = std::unordered_set<CScript, SaltedSipHasher>;
+
+//! Search for a given set of pubkey scripts in the coins of a key range
+bool FindScriptPubKey(const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor& cursor, const ScriptSet& needles, std::map<COutPoint, Coin>& out_results, const std::function<void()>& interruption_point)
 {
-    scan_progress = 0;
-    count = 0;
-    while (cursor->Valid()) {
+    while (cursor.Valid()) {
         COutPoint key;
         Coin coin;
-        if (!cursor->GetKey(key) || !cursor->GetValue(coin)) return false;
+        if (!cursor.GetKey(key) || !cursor.GetValue(coin)) return false;
         if (++count % 8192 == 0) {
             interruption_point();
             if (should_abort) {
@@ -2237,19 +2310,20 @@ bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>&
                 return false;
             }
         }
-        if (count % 256 == 0) {
-            // update progress reference every 256 item
-            uint32_t high = 0x100 * *key.hash.begin() + *(key.hash.begin() + 1);
-            scan_progress = (int)(high * 100.0 / 65536.0 + 0.5);
-        }
         if (needles.count(coin.out.scriptPubKey)) {
             out_results.emplace(key, coin);
         }
-        cursor->Next();
+        cursor.Next();
     }
-    scan_progress = 100;
     return true;
 }
+
+//! What FindScriptPubKey() found in a key range
+struct ScanRangeResult {
+    bool success{false};
+    int64_t count{0};
+    std::map<COutPoint, Coin> coins;
+};
 } // namespace
 
 /** RAII object to prevent concurrency issue when scanning the txout set */
@@ -2373,7 +2447,7 @@ static RPCHelpMan scantxoutset()
             throw JSONRPCError(RPC_MISC_ERROR, "scanobjects argument is required for the start action");
         }
 
-        std::set<CScript> needles;
+        ScriptSet needles;
         std::map<CScript, std::string> descriptors;
         CAmount total_in = 0;
 
@@ -2394,7 +2468,7 @@ static RPCHelpMan scantxoutset()
         std::map<COutPoint, Coin> coins;
         g_should_abort_scan = false;
         int64_t count = 0;
-        std::unique_ptr<CCoinsViewCursor> pcursor;
+        std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
         CBlockIndex* tip;
         NodeContext& node = EnsureAnyNodeContext(request.context);
         {
@@ -2402,12 +2476,26 @@ static RPCHelpMan scantxoutset()
             LOCK(cs_main);
             CChainState& active_chainstate = chainman.ActiveChainstate();
             active_chainstate.ForceFlushStateToDisk();
-            pcursor = active_chainstate.CoinsDB().Cursor();
-            CHECK_NONFATAL(pcursor);
+            cursors = active_chainstate.CoinsDB().RangeCursors(COINS_SCAN_RANGES);
             tip = active_chainstate.m_chain.Tip();
             CHECK_NONFATAL(tip);
         }
-        bool res = FindScriptPubKey(g_scan_progress, g_should_abort_scan, count, pcursor.get(), needles, coins, node.rpc_interruption_point);
+        // All scan objects are looked for in a single pass over the UTXO set,
+        // whose key ranges are scanned in parallel.
+        bool res = true;
+        std::vector<ScanRangeResult> ranges(cursors.size());
+        ScanCoins(
+            std::move(cursors),
+            [&](size_t index, CCoinsViewCursor& cursor) {
+                ScanRangeResult& range = ranges[index];
+                range.success = FindScriptPubKey(g_should_abort_scan, range.count, cursor, needles, range.coins, node.rpc_interruption_point);
+            },
+            [&](size_t index) {
+                res &= ranges[index].success;
+                count += ranges[index].count;
+                coins.merge(ranges[index].coins);
+                g_scan_progress = (index + 1) * 100 / ranges.size();
+            });
         result.pushKV("success", res);
         result.pushKV("txouts", count);
         result.pushKV("height", tip->nHeight);
@@ -2528,7 +2616,8 @@ static RPCHelpMan dumptxoutset()
 {
     return RPCHelpMan{
         "dumptxoutset",
-        "\nWrite the serialized UTXO set to disk.\n",
+        "\nWrite the serialized UTXO set to disk.\n"
+        "The coins are split into chunks by txid, which are read and written in parallel.\n",
         {
             {"path",
                 RPCArg::Type::STR,
@@ -2542,6 +2631,7 @@ static RPCHelpMan dumptxoutset()
                     {RPCResult::Type::NUM, "coins_written", "the number of coins written in the snapshot"},
                     {RPCResult::Type::STR_HEX, "base_hash", "the hash of the base of the snapshot"},
                     {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
+                    {RPCResult::Type::STR_HEX, "muhash", "the MuHash of the coins, as computed by gettxoutsetinfo"},
                     {RPCResult::Type::STR, "path", "the absolute path that the snapshot was written to"},
                 }
         },
@@ -2576,18 +2666,16 @@ static RPCHelpMan dumptxoutset()
 
 UniValue CreateUTXOSnapshot(NodeContext& node, CChainState& chainstate, CAutoFile& afile)
 {
-    std::unique_ptr<CCoinsViewCursor> pcursor;
-    CCoinsStats stats{CoinStatsHashType::NONE};
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
     CBlockIndex* tip;
 
     {
         // We need to lock cs_main to ensure that the coinsdb isn't written to
-        // between (i) flushing coins cache to disk (coinsdb), (ii) getting stats
-        // based upon the coinsdb, and (iii) constructing a cursor to the
-        // coinsdb for use below this block.
+        // between (i) flushing coins cache to disk (coinsdb) and (ii)
+        // constructing the cursors to the coinsdb for use below this block.
         //
         // Cursors returned by leveldb iterate over snapshots, so the contents
-        // of the pcursor will not be affected by simultaneous writes during
+        // of the cursors will not be affected by simultaneous writes during
         // use below this block.
         //
         // See discussion here:
@@ -2597,40 +2685,21 @@ UniValue CreateUTXOSnapshot(NodeContext& node, CChainState& chainstate, CAutoFil
 
         chainstate.ForceFlushStateToDisk();
 
-        if (!GetUTXOStats(&chainstate.CoinsDB(), chainstate.m_blockman, stats, node.rpc_interruption_point)) {
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
-        }
-
-        pcursor = chainstate.CoinsDB().Cursor();
-        tip = chainstate.m_blockman.LookupBlockIndex(stats.hashBlock);
+        cursors = MakeSnapshotCursors(chainstate.CoinsDB());
+        tip = chainstate.m_blockman.LookupBlockIndex(chainstate.CoinsDB().GetBestBlock());
         CHECK_NONFATAL(tip);
     }
 
-    SnapshotMetadata metadata{tip->GetBlockHash(), stats.coins_count, tip->nChainTx};
-
-    afile << metadata;
-
-    COutPoint key;
-    Coin coin;
-    unsigned int iter{0};
-
-    while (pcursor->Valid()) {
-        if (iter % 5000 == 0) node.rpc_interruption_point();
-        ++iter;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            afile << key;
-            afile << coin;
-        }
-
-        pcursor->Next();
-    }
+    uint256 muhash;
+    const SnapshotMetadata metadata = WriteUTXOSnapshot(afile, tip->GetBlockHash(), std::move(cursors), muhash, node.rpc_interruption_point);
 
     afile.fclose();
 
     UniValue result(UniValue::VOBJ);
-    result.pushKV("coins_written", stats.coins_count);
+    result.pushKV("coins_written", metadata.m_coins_count);
     result.pushKV("base_hash", tip->GetBlockHash().ToString());
     result.pushKV("base_height", tip->nHeight);
+    result.pushKV("muhash", muhash.GetHex());
 
     return result;
 }
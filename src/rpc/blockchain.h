@@ -22,6 +22,7 @@ class CBlockPolicyEstimator;
 class CChainState;
 class CTxMemPool;
 class ChainstateManager;
+class JSONStreamWriter;
 class UniValue;
 struct NodeContext;
 
@@ -41,12 +42,19 @@ void RPCNotifyBlockChange(const CBlockIndex*);
 /** Block description to JSON */
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails = false) LOCKS_EXCLUDED(cs_main);
 
+/** Block description to JSON, written to out while it is described */
+void blockToJSON(JSONStreamWriter& out, const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails) LOCKS_EXCLUDED(cs_main);
+
 /** Mempool information to JSON */
 UniValue MempoolInfoToJSON(const CTxMemPool& pool);
 
 /** Mempool to JSON */
 UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose = false, bool include_mempool_sequence = false);
 
+/** Verbose mempool to JSON, written to out while it is described. Entries of
+ * transactions removed meanwhile are left out. */
+void MempoolToJSON(JSONStreamWriter& out, const CTxMemPool& pool);
+
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex) LOCKS_EXCLUDED(cs_main);
 
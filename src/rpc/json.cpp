@@ -0,0 +1,394 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/json.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+//! Arrays and objects may be nested this deep, as in UniValue::read
+constexpr size_t MAX_JSON_DEPTH{512};
+
+constexpr uint64_t ONES{0x0101010101010101};
+constexpr uint64_t HIGH_BITS{0x8080808080808080};
+
+//! Whether any byte of word is less than n, which must be at most 0x80
+constexpr uint64_t HasByteBelow(uint64_t word, uint8_t n) { return (word - ONES * n) & ~word & HIGH_BITS; }
+//! Whether any byte of word equals c
+constexpr uint64_t HasByte(uint64_t word, uint8_t c) { return HasByteBelow(word ^ (ONES * c), 1); }
+
+//! Whether a string character is copied as is by the parser
+bool IsPlainChar(unsigned char ch) { return ch >= 0x20 && ch < 0x80 && ch != '"' && ch != '\\'; }
+
+//! Whether all 8 characters from p on are plain
+bool IsPlainWord(const char* p)
+{
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return !(HasByte(word, '"') | HasByte(word, '\\') | HasByteBelow(word, 0x20) | (word & HIGH_BITS));
+}
+
+//! Whether a string character is written as is. UniValue escapes control characters, quotes, backslashes and DEL.
+bool IsVerbatimChar(unsigned char ch) { return ch >= 0x20 && ch != '"' && ch != '\\' && ch != 0x7f; }
+
+/**
+ * Decodes the non-ASCII characters and escapes of a string like univalue's
+ * JSONUTF8StringFilter, so that the same strings are accepted and give the
+ * same values: UTF-8 sequences are decoded and encoded again, and UTF-16
+ * surrogate pairs are collated, whether they are escaped or not.
+ */
+class StringDecoder
+{
+public:
+    explicit StringDecoder(std::string& str) : m_str(str) {}
+
+    //! Append a run of plain characters
+    bool Append(const char* begin, const char* end)
+    {
+        if (m_state) return false;
+        m_str.append(begin, end);
+        return true;
+    }
+
+    //! Append one byte, which may be part of a UTF-8 sequence
+    bool PushByte(unsigned char ch)
+    {
+        if (m_state == 0) {
+            if (ch < 0x80) {
+                m_str.push_back(ch);
+            } else if (ch < 0xc0) {
+                return false;
+            } else if (ch < 0xe0) {
+                m_codepoint = (ch & 0x1f) << 6;
+                m_state = 6;
+            } else if (ch < 0xf0) {
+                m_codepoint = (ch & 0x0f) << 12;
+                m_state = 12;
+            } else if (ch < 0xf8) {
+                m_codepoint = (ch & 0x07) << 18;
+                m_state = 18;
+            } else {
+                return false;
+            }
+            return true;
+        }
+        if ((ch & 0xc0) != 0x80) return false;
+        m_state -= 6;
+        m_codepoint |= (ch & 0x3f) << m_state;
+        return m_state != 0 || PushCodepoint(m_codepoint);
+    }
+
+    //! Append a code point, which may be half of a surrogate pair
+    bool PushCodepoint(unsigned int codepoint)
+    {
+        if (m_state) return false;
+        if (codepoint >= 0xd800 && codepoint < 0xdc00) {
+            if (m_surrogate) return false;
+            m_surrogate = codepoint;
+        } else if (codepoint >= 0xdc00 && codepoint < 0xe000) {
+            if (!m_surrogate) return false;
+            AppendCodepoint(0x10000 | ((m_surrogate - 0xd800) << 10) | (codepoint - 0xdc00));
+            m_surrogate = 0;
+        } else {
+            if (m_surrogate) return false;
+            AppendCodepoint(codepoint);
+        }
+        return true;
+    }
+
+    //! Whether the string may end here, with no sequence or surrogate pair left open
+    bool Finalize() const { return !m_state && !m_surrogate; }
+
+private:
+    void AppendCodepoint(unsigned int codepoint)
+    {
+        if (codepoint <= 0x7f) {
+            m_str.push_back(codepoint);
+        } else if (codepoint <= 0x7ff) {
+            m_str.push_back(0xc0 | (codepoint >> 6));
+            m_str.push_back(0x80 | (codepoint & 0x3f));
+        } else if (codepoint <= 0xffff) {
+            m_str.push_back(0xe0 | (codepoint >> 12));
+            m_str.push_back(0x80 | ((codepoint >> 6) & 0x3f));
+            m_str.push_back(0x80 | (codepoint & 0x3f));
+        } else if (codepoint <= 0x1fffff) {
+            m_str.push_back(0xf0 | (codepoint >> 18));
+            m_str.push_back(0x80 | ((codepoint >> 12) & 0x3f));
+            m_str.push_back(0x80 | ((codepoint >> 6) & 0x3f));
+            m_str.push_back(0x80 | (codepoint & 0x3f));
+        }
+    }
+
+    std::string& m_str;
+    unsigned int m_codepoint{0};
+    //! Bit the next byte of an open UTF-8 sequence goes to, or 0
+    int m_state{0};
+    //! First half of an open surrogate pair, or 0
+    unsigned int m_surrogate{0};
+};
+
+class JSONParser
+{
+public:
+    explicit JSONParser(std::string_view in) : m_pos(in.data()), m_end(in.data() + in.size()) {}
+
+    bool ParseDocument(UniValue& out)
+    {
+        if (!ParseValue(out, 0)) return false;
+        SkipSpace();
+        return m_pos == m_end;
+    }
+
+private:
+    void SkipSpace()
+    {
+        while (m_pos != m_end && json_isspace(*m_pos)) ++m_pos;
+    }
+
+    //! Skip whitespace and then c, if it comes next
+    bool Consume(char c)
+    {
+        SkipSpace();
+        if (m_pos == m_end || *m_pos != c) return false;
+        ++m_pos;
+        return true;
+    }
+
+    bool ConsumeLiteral(std::string_view literal)
+    {
+        if (size_t(m_end - m_pos) < literal.size() || std::memcmp(m_pos, literal.data(), literal.size()) != 0) return false;
+        m_pos += literal.size();
+        return true;
+    }
+
+    bool ConsumeDigits()
+    {
+        if (m_pos == m_end || *m_pos < '0' || *m_pos > '9') return false;
+        while (m_pos != m_end && *m_pos >= '0' && *m_pos <= '9') ++m_pos;
+        return true;
+    }
+
+    //! Parse a value nested in depth arrays and objects
+    bool ParseValue(UniValue& out, size_t depth)
+    {
+        SkipSpace();
+        if (m_pos == m_end) return false;
+        switch (*m_pos) {
+        case '{':
+            return ParseObject(out, depth + 1);
+        case '[':
+            return ParseArray(out, depth + 1);
+        case '"': {
+            std::string str;
+            if (!ParseString(str)) return false;
+            out = UniValue(UniValue::VSTR, str);
+            return true;
+        }
+        case 't':
+            return ConsumeLiteral("true") && out.setBool(true);
+        case 'f':
+            return ConsumeLiteral("false") && out.setBool(false);
+        case 'n':
+            return ConsumeLiteral("null") && out.setNull();
+        default:
+            return ParseNumber(out);
+        }
+    }
+
+    bool ParseArray(UniValue& out, size_t depth)
+    {
+        if (depth > MAX_JSON_DEPTH) return false;
+        ++m_pos;
+        out.setArray();
+        if (Consume(']')) return true;
+        do {
+            UniValue value;
+            if (!ParseValue(value, depth)) return false;
+            out.push_back(value);
+        } while (Consume(','));
+        return Consume(']');
+    }
+
+    bool ParseObject(UniValue& out, size_t depth)
+    {
+        if (depth > MAX_JSON_DEPTH) return false;
+        ++m_pos;
+        out.setObject();
+        if (Consume('}')) return true;
+        do {
+            SkipSpace();
+            std::string key;
+            UniValue value;
+            if (m_pos == m_end || *m_pos != '"' || !ParseString(key)) return false;
+            if (!Consume(':') || !ParseValue(value, depth)) return false;
+            // Keys are not looked up, so that duplicates are kept as by UniValue::read
+            out.__pushKV(key, value);
+        } while (Consume(','));
+        return Consume('}');
+    }
+
+    bool ParseString(std::string& out)
+    {
+        ++m_pos;
+        StringDecoder decoder(out);
+        while (true) {
+            const char* run{m_pos};
+            while (m_end - m_pos >= 8 && IsPlainWord(m_pos)) m_pos += 8;
+            while (m_pos != m_end && IsPlainChar(*m_pos)) ++m_pos;
+            if (m_pos != run && !decoder.Append(run, m_pos)) return false;
+            if (m_pos == m_end) return false;
+
+            const unsigned char ch = *m_pos++;
+            if (ch == '"') return decoder.Finalize();
+            if (ch < 0x20) return false;
+            if (ch >= 0x80) {
+                if (!decoder.PushByte(ch)) return false;
+                continue;
+            }
+
+            if (m_pos == m_end) return false;
+            bool ok;
+            switch (*m_pos++) {
+            case '"': ok = decoder.PushByte('"'); break;
+            case '\\': ok = decoder.PushByte('\\'); break;
+            case '/': ok = decoder.PushByte('/'); break;
+            case 'b': ok = decoder.PushByte('\b'); break;
+            case 'f': ok = decoder.PushByte('\f'); break;
+            case 'n': ok = decoder.PushByte('\n'); break;
+            case 'r': ok = decoder.PushByte('\r'); break;
+            case 't': ok = decoder.PushByte('\t'); break;
+            case 'u': {
+                if (m_end - m_pos < 4) return false;
+                unsigned int codepoint{0};
+                for (const char* end = m_pos + 4; m_pos != end; ++m_pos) {
+                    const char c = *m_pos;
+                    unsigned int digit;
+                    if (c >= '0' && c <= '9') {
+                        digit = c - '0';
+                    } else if (c >= 'a' && c <= 'f') {
+                        digit = c - 'a' + 10;
+                    } else if (c >= 'A' && c <= 'F') {
+                        digit = c - 'A' + 10;
+                    } else {
+                        return false;
+                    }
+                    codepoint = codepoint * 16 + digit;
+                }
+                ok = decoder.PushCodepoint(codepoint);
+                break;
+            }
+            default:
+                return false;
+            }
+            if (!ok) return false;
+        }
+    }
+
+    bool ParseNumber(UniValue& out)
+    {
+        const char* begin{m_pos};
+        if (*m_pos == '-') ++m_pos;
+        if (m_pos != m_end && *m_pos == '0') {
+            ++m_pos;
+        } else if (!ConsumeDigits()) {
+            return false;
+        }
+        if (m_pos != m_end && *m_pos == '.') {
+            ++m_pos;
+            if (!ConsumeDigits()) return false;
+        }
+        if (m_pos != m_end && (*m_pos == 'e' || *m_pos == 'E')) {
+            ++m_pos;
+            if (m_pos != m_end && (*m_pos == '-' || *m_pos == '+')) ++m_pos;
+            if (!ConsumeDigits()) return false;
+        }
+        out = UniValue(UniValue::VNUM, std::string(begin, m_pos));
+        return true;
+    }
+
+    const char* m_pos;
+    const char* const m_end;
+};
+
+void WriteString(const std::string& str, std::string& out)
+{
+    static constexpr char HEX_DIGITS[]{"0123456789abcdef"};
+    out += '"';
+    const char* run{str.data()};
+    const char* const end{str.data() + str.size()};
+    for (const char* pos = run; pos != end; ++pos) {
+        const unsigned char ch = *pos;
+        if (IsVerbatimChar(ch)) continue;
+        out.append(run, pos);
+        run = pos + 1;
+        switch (ch) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            out += "\\u00";
+            out += HEX_DIGITS[ch >> 4];
+            out += HEX_DIGITS[ch & 0xf];
+        }
+    }
+    out.append(run, end);
+    out += '"';
+}
+
+} // namespace
+
+bool ParseJSON(std::string_view in, UniValue& out)
+{
+    UniValue value;
+    if (!JSONParser{in}.ParseDocument(value)) return false;
+    out = std::move(value);
+    return true;
+}
+
+void WriteJSON(const UniValue& value, std::string& out)
+{
+    switch (value.getType()) {
+    case UniValue::VNULL:
+        out += "null";
+        break;
+    case UniValue::VBOOL:
+        out += value.isTrue() ? "true" : "false";
+        break;
+    case UniValue::VNUM:
+        out += value.getValStr();
+        break;
+    case UniValue::VSTR:
+        WriteString(value.getValStr(), out);
+        break;
+    case UniValue::VARR: {
+        out += '[';
+        const std::vector<UniValue>& values = value.getValues();
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (i) out += ',';
+            WriteJSON(values[i], out);
+        }
+        out += ']';
+        break;
+    }
+    case UniValue::VOBJ: {
+        out += '{';
+        const std::vector<std::string>& keys = value.getKeys();
+        const std::vector<UniValue>& values = value.getValues();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (i) out += ',';
+            WriteString(keys[i], out);
+            out += ':';
+            WriteJSON(values[i], out);
+        }
+        out += '}';
+        break;
+    }
+    }
+}
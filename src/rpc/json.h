@@ -0,0 +1,31 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSON_H
+#define BITCOIN_RPC_JSON_H
+
+#include <string>
+#include <string_view>
+
+#include <univalue.h>
+
+/**
+ * Parse a JSON document into a UniValue. This accepts the documents
+ * UniValue::read accepts and gives the same values, but skips over runs of
+ * plain string characters a word at a time, and does not copy tokens through
+ * intermediate strings. Large JSON-RPC batches spend most of their parsing
+ * time in the hex strings of transactions and blocks.
+ *
+ * @returns false if in is not a valid JSON document, out is then unchanged
+ */
+bool ParseJSON(std::string_view in, UniValue& out);
+
+/**
+ * Append the compact JSON text of a value to out, as UniValue::write()
+ * returns it. Nested values are appended to out directly, rather than being
+ * written to temporary strings first.
+ */
+void WriteJSON(const UniValue& value, std::string& out);
+
+#endif // BITCOIN_RPC_JSON_H
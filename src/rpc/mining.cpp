@@ -940,6 +940,8 @@ public:
 
     explicit submitblock_StateCatcher(const uint256 &hashIn) : hash(hashIn), found(false), state() {}
 
+    std::string SubscriberName() const override { return "submitblock"; }
+
 protected:
     void BlockChecked(const CBlock& block, const BlockValidationState& stateIn) override {
         if (block.GetHash() != hash)
@@ -8,10 +8,13 @@
 #include <fs.h>
 
 #include <random.h>
+#include <rpc/json.h>
 #include <rpc/protocol.h>
 #include <util/system.h>
 #include <util/strencodings.h>
 
+#include <cassert>
+
 /**
  * JSON-RPC protocol.  Bitcoin speaks version 1.0 for maximum compatibility,
  * but uses JSON-RPC 1.1/2.0 standards for parts of the 1.0 standard that were
@@ -44,8 +47,89 @@ UniValue JSONRPCReplyObj(const UniValue& result, const UniValue& error, const Un
 
 std::string JSONRPCReply(const UniValue& result, const UniValue& error, const UniValue& id)
 {
-    UniValue reply = JSONRPCReplyObj(result, error, id);
-    return reply.write() + "\n";
+    // Written like JSONRPCReplyObj, without copying the result into a reply object
+    std::string reply{"{\"result\":"};
+    WriteJSON(error.isNull() ? result : NullUniValue, reply);
+    reply += ",\"error\":";
+    WriteJSON(error, reply);
+    reply += ",\"id\":";
+    WriteJSON(id, reply);
+    reply += "}\n";
+    return reply;
+}
+
+void JSONStreamWriter::BeginValue()
+{
+    m_written = true;
+    if (m_after_key) {
+        m_after_key = false;
+    } else if (!m_has_elements.empty()) {
+        if (m_has_elements.back()) m_buffer += ',';
+        m_has_elements.back() = true;
+    }
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    BeginValue();
+    m_buffer += '{';
+    m_has_elements.push_back(false);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!m_has_elements.empty() && !m_after_key);
+    m_buffer += '}';
+    m_has_elements.pop_back();
+    if (m_buffer.size() >= CHUNK_SIZE) Flush();
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    BeginValue();
+    m_buffer += '[';
+    m_has_elements.push_back(false);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!m_has_elements.empty() && !m_after_key);
+    m_buffer += ']';
+    m_has_elements.pop_back();
+    if (m_buffer.size() >= CHUNK_SIZE) Flush();
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    assert(!m_has_elements.empty() && !m_after_key);
+    BeginValue();
+    WriteJSON(UniValue(key), m_buffer);
+    m_buffer += ':';
+    m_after_key = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    BeginValue();
+    WriteJSON(value, m_buffer);
+    if (m_buffer.size() >= CHUNK_SIZE) Flush();
+}
+
+void JSONStreamWriter::Pairs(const UniValue& obj)
+{
+    for (size_t i = 0; i < obj.size(); ++i) {
+        Key(obj.getKeys()[i]);
+        Value(obj.getValues()[i]);
+    }
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (m_buffer.empty()) return;
+    std::string chunk;
+    chunk.reserve(CHUNK_SIZE + CHUNK_SIZE / 8);
+    chunk.swap(m_buffer);
+    m_sink(std::move(chunk));
 }
 
 UniValue JSONRPCError(int code, const std::string& message)
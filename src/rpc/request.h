@@ -7,7 +7,9 @@
 #define BITCOIN_RPC_REQUEST_H
 
 #include <any>
+#include <functional>
 #include <string>
+#include <vector>
 
 #include <univalue.h>
 
@@ -25,6 +27,47 @@ void DeleteAuthCookie();
 /** Parse JSON-RPC batch reply into a vector */
 std::vector<UniValue> JSONRPCProcessBatchReply(const UniValue& in);
 
+/**
+ * Writes a JSON value piecewise, so that a large value is never held in memory
+ * as a whole. Arrays and objects are opened and closed explicitly, their
+ * elements are written from UniValues. The output is compact, as from
+ * UniValue::write, and passed on in chunks of about CHUNK_SIZE bytes to a sink,
+ * which throws if it cannot take them anymore.
+ */
+class JSONStreamWriter
+{
+public:
+    static constexpr size_t CHUNK_SIZE{64 * 1024};
+    using Sink = std::function<void(std::string&& chunk)>;
+
+    explicit JSONStreamWriter(Sink sink) : m_sink(std::move(sink)) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    /** Write the key of the next value of the current object */
+    void Key(const std::string& key);
+    /** Write the next value, of the current array or object */
+    void Value(const UniValue& value);
+    /** Write the key/value pairs of obj as the next ones of the current object */
+    void Pairs(const UniValue& obj);
+    /** Pass what was written to the sink */
+    void Flush();
+    /** Whether nothing was written */
+    bool empty() const { return !m_written; }
+
+private:
+    void BeginValue();
+
+    Sink m_sink;
+    std::string m_buffer;
+    //! For every open array or object, whether it has elements
+    std::vector<bool> m_has_elements;
+    bool m_after_key{false};
+    bool m_written{false};
+};
+
 class JSONRPCRequest
 {
 public:
@@ -36,6 +79,9 @@ public:
     std::string authUser;
     std::string peerAddr;
     std::any context;
+    /** If set, a method may write a large result there while it is computed,
+     * rather than return it. The method then returns NullUniValue. */
+    JSONStreamWriter* result_stream{nullptr};
 
     void parse(const UniValue& valRequest);
 };
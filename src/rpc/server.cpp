@@ -5,6 +5,7 @@
 
 #include <rpc/server.h>
 
+#include <rpc/json.h>
 #include <rpc/util.h>
 #include <shutdown.h>
 #include <sync.h>
@@ -15,9 +16,13 @@
 #include <boost/algorithm/string/split.hpp>
 #include <boost/signals2/signal.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <memory> // for unique_ptr
 #include <mutex>
+#include <set>
 #include <unordered_map>
 
 static Mutex g_rpc_warmup_mutex;
@@ -379,13 +384,98 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
+//! Methods that only read chain, mempool or network state, so that calls to
+//! them in a batch can run concurrently without changing its outcome
+static const std::set<std::string> CONCURRENT_BATCH_METHODS{
+    "getbestblockhash",
+    "getblock",
+    "getblockcount",
+    "getblockfilter",
+    "getblockhash",
+    "getblockheader",
+    "getblockstats",
+    "getchaintips",
+    "getdifficulty",
+    "getmempoolancestors",
+    "getmempooldescendants",
+    "getmempoolentry",
+    "getrawtransaction",
+    "gettxout",
+    "gettxoutproof",
+    "decoderawtransaction",
+    "decodescript",
+    "estimatesmartfee",
+    "validateaddress",
+};
+
+static bool IsConcurrentBatchCall(const UniValue& req)
+{
+    if (!req.isObject()) return false;
+    const UniValue& method = find_value(req, "method");
+    return method.isStr() && CONCURRENT_BATCH_METHODS.count(method.get_str());
+}
+
+namespace {
+//! Calls of a batch run by several threads, each claiming the next call
+struct ConcurrentBatchCalls {
+    const JSONRPCRequest jreq;
+    const std::vector<UniValue> requests;
+    std::vector<UniValue> replies;
+    std::atomic<size_t> next{0};
+    Mutex mutex;
+    std::condition_variable cond;
+    size_t done GUARDED_BY(mutex){0};
+
+    ConcurrentBatchCalls(const JSONRPCRequest& jreq_in, std::vector<UniValue> requests_in)
+        : jreq(jreq_in), requests(std::move(requests_in)), replies(requests.size()) {}
+
+    void Run()
+    {
+        for (size_t i = next++; i < requests.size(); i = next++) {
+            replies[i] = JSONRPCExecOne(jreq, requests[i]);
+            LOCK(mutex);
+            if (++done == requests.size()) cond.notify_all();
+        }
+    }
+};
+} // namespace
+
+std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq, const RPCTaskRunner& run_task, size_t max_tasks)
 {
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+    size_t begin = 0;
+    while (begin < vReq.size()) {
+        size_t end = begin;
+        while (end < vReq.size() && IsConcurrentBatchCall(vReq[end])) ++end;
+        if (end - begin < 2 || !run_task || max_tasks == 0) {
+            end = std::max(end, begin + 1);
+            for (; begin < end; ++begin) {
+                ret.push_back(JSONRPCExecOne(jreq, vReq[begin]));
+            }
+            continue;
+        }
+
+        // Tasks may only start once this thread has run all the calls, so
+        // they share ownership of them
+        auto calls = std::make_shared<ConcurrentBatchCalls>(jreq, std::vector<UniValue>(vReq.getValues().begin() + begin, vReq.getValues().begin() + end));
+        for (size_t i = 0; i < std::min(max_tasks, end - begin - 1); ++i) {
+            if (!run_task([calls] { calls->Run(); })) break;
+        }
+        calls->Run();
+        {
+            WAIT_LOCK(calls->mutex, lock);
+            calls->cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(calls->mutex) { return calls->done == calls->requests.size(); });
+        }
+        for (UniValue& reply : calls->replies) {
+            ret.push_back(std::move(reply));
+        }
+        begin = end;
+    }
 
-    return ret.write() + "\n";
+    std::string reply;
+    WriteJSON(ret, reply);
+    reply += '\n';
+    return reply;
 }
 
 /**
@@ -173,7 +173,17 @@ extern CRPCTable tableRPC;
 void StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq);
+
+//! Runs a task on another thread, returning false if it could not be queued
+using RPCTaskRunner = std::function<bool(std::function<void()> task)>;
+
+/**
+ * Execute a batch of JSON-RPC requests and return the serialized replies, in
+ * the order of the requests. Consecutive calls to read-only methods are
+ * spread over up to max_tasks tasks queued with run_task, in addition to
+ * the calling thread. Other calls run on their own, in order.
+ */
+std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq, const RPCTaskRunner& run_task = {}, size_t max_tasks = 0);
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
@@ -573,6 +573,8 @@ UniValue RPCHelpMan::HandleRequest(const JSONRPCRequest& request) const
         throw std::runtime_error(ToString());
     }
     const UniValue ret = m_fun(*this, request);
+    // The result was written to the stream rather than returned
+    if (request.result_stream && !request.result_stream->empty()) return ret;
     CHECK_NONFATAL(std::any_of(m_results.m_results.begin(), m_results.m_results.end(), [ret](const RPCResult& res) { return res.MatchesType(ret); }));
     return ret;
 }
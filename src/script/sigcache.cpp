@@ -13,8 +13,6 @@
 #include <cuckoocache.h>
 
 #include <algorithm>
-#include <mutex>
-#include <shared_mutex>
 #include <vector>
 
 namespace {
@@ -29,26 +27,37 @@ private:
      //! Entries are SHA256(nonce || 'E' or 'S' || 31 zero bytes || signature hash || public key || signature):
     CSHA256 m_salted_hasher_ecdsa;
     CSHA256 m_salted_hasher_schnorr;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    uint256 m_nonce;
+    //! Sharded so that concurrent script-check threads do not serialise on a single lock.
+    typedef CuckooCache::sharded_cache<uint256, SignatureCacheHasher> map_type;
     map_type setValid;
-    std::shared_mutex cs_sigcache;
 
 public:
     CSignatureCache()
     {
-        uint256 nonce = GetRandHash();
+        Salt(GetRandHash());
+    }
+
+    //! Reset the salted hashers to use nonce. Entries computed with a different nonce will no longer be found.
+    void Salt(const uint256& nonce)
+    {
         // We want the nonce to be 64 bytes long to force the hasher to process
         // this chunk, which makes later hash computations more efficient. We
         // just write our 32-byte entropy, and then pad with 'E' for ECDSA and
         // 'S' for Schnorr (followed by 0 bytes).
         static constexpr unsigned char PADDING_ECDSA[32] = {'E'};
         static constexpr unsigned char PADDING_SCHNORR[32] = {'S'};
+        m_nonce = nonce;
+        m_salted_hasher_ecdsa.Reset();
         m_salted_hasher_ecdsa.Write(nonce.begin(), 32);
         m_salted_hasher_ecdsa.Write(PADDING_ECDSA, 32);
+        m_salted_hasher_schnorr.Reset();
         m_salted_hasher_schnorr.Write(nonce.begin(), 32);
         m_salted_hasher_schnorr.Write(PADDING_SCHNORR, 32);
     }
 
+    const uint256& Nonce() const { return m_nonce; }
+
     void
     ComputeEntryECDSA(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
     {
@@ -66,19 +75,23 @@ public:
     bool
     Get(const uint256& entry, const bool erase)
     {
-        std::shared_lock<std::shared_mutex> lock(cs_sigcache);
         return setValid.contains(entry, erase);
     }
 
     void Set(const uint256& entry)
     {
-        std::unique_lock<std::shared_mutex> lock(cs_sigcache);
         setValid.insert(entry);
     }
     uint32_t setup_bytes(size_t n)
     {
         return setValid.setup_bytes(n);
     }
+
+    template <typename Fn>
+    void ForEach(Fn&& fn) const
+    {
+        setValid.for_each(fn);
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -102,6 +115,22 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+SaltedCacheSnapshot GetSignatureCacheSnapshot()
+{
+    SaltedCacheSnapshot snapshot;
+    snapshot.nonce = signatureCache.Nonce();
+    signatureCache.ForEach([&](const uint256& entry) { snapshot.entries.push_back(entry); });
+    return snapshot;
+}
+
+void LoadSignatureCacheSnapshot(const SaltedCacheSnapshot& snapshot)
+{
+    signatureCache.Salt(snapshot.nonce);
+    for (const uint256& entry : snapshot.entries) {
+        signatureCache.Set(entry);
+    }
+}
+
 bool CachingTransactionSignatureChecker::VerifyECDSASignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
@@ -7,7 +7,9 @@
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
 #include <script/interpreter.h>
+#include <serialize.h>
 #include <span.h>
+#include <uint256.h>
 #include <util/hasher.h>
 
 #include <vector>
@@ -35,4 +37,27 @@ public:
 
 void InitSignatureCache();
 
+/**
+ * The salt and the live entries of a salted cache. Entries are salted hashes,
+ * so they are only meaningful together with the nonce they were computed
+ * with. Used to persist the signature and script execution caches across
+ * restarts.
+ */
+struct SaltedCacheSnapshot {
+    uint256 nonce;
+    std::vector<uint256> entries;
+
+    SERIALIZE_METHODS(SaltedCacheSnapshot, obj) { READWRITE(obj.nonce, obj.entries); }
+};
+
+/** Copy out the signature cache's salt and live entries. */
+SaltedCacheSnapshot GetSignatureCacheSnapshot();
+
+/**
+ * Re-salt the signature cache with the snapshot's nonce and insert its
+ * entries. Must be called after InitSignatureCache() and before any signature
+ * is looked up.
+ */
+void LoadSignatureCacheSnapshot(const SaltedCacheSnapshot& snapshot);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -128,14 +128,14 @@ private:
     size_t nPos;
 };
 
-/** Minimal stream for reading from an existing vector by reference
+/** Minimal stream for reading from an existing vector or span by reference
  */
 class VectorReader
 {
 private:
     const int m_type;
     const int m_version;
-    const std::vector<unsigned char>& m_data;
+    const Span<const unsigned char> m_data;
     size_t m_pos = 0;
 
 public:
@@ -143,10 +143,10 @@ public:
     /**
      * @param[in]  type Serialization Type
      * @param[in]  version Serialization Version (including any flags)
-     * @param[in]  data Referenced byte vector to overwrite/append
+     * @param[in]  data Referenced bytes to read from
      * @param[in]  pos Starting position. Vector index where reads should start.
      */
-    VectorReader(int type, int version, const std::vector<unsigned char>& data, size_t pos)
+    VectorReader(int type, int version, Span<const unsigned char> data, size_t pos)
         : m_type(type), m_version(version), m_data(data), m_pos(pos)
     {
         if (m_pos > m_data.size()) {
@@ -159,7 +159,7 @@ public:
      * @param[in]  args  A list of items to deserialize starting at pos.
      */
     template <typename... Args>
-    VectorReader(int type, int version, const std::vector<unsigned char>& data, size_t pos,
+    VectorReader(int type, int version, Span<const unsigned char> data, size_t pos,
                   Args&&... args)
         : VectorReader(type, version, data, pos)
     {
@@ -6,7 +6,10 @@
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
+#include <index/txindex.h>
 #include <miner.h>
+#include <node/coinstats.h>
 #include <pow.h>
 #include <script/standard.h>
 #include <test/util/blockfilter.h>
@@ -266,6 +269,65 @@ BOOST_FIXTURE_TEST_CASE(blockfilter_index_initial_sync, BuildChainTestingSetup)
     filter_index.Stop();
 }
 
+// Indexes syncing at the same time share the blocks they read, and the filter
+// index builds filters ahead on the reader threads.
+BOOST_FIXTURE_TEST_CASE(blockfilter_index_sync_with_other_indexes, BuildChainTestingSetup)
+{
+    BlockFilterIndex filter_index(BlockFilterType::BASIC, 1 << 20, true);
+    TxIndex txindex(1 << 20, true);
+    CoinStatsIndex coin_stats_index(1 << 20, true);
+    CChainState& chainstate = m_node.chainman->ActiveChainstate();
+
+    BOOST_REQUIRE(filter_index.Start(chainstate));
+    BOOST_REQUIRE(txindex.Start(chainstate));
+    BOOST_REQUIRE(coin_stats_index.Start(chainstate));
+
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!filter_index.BlockUntilSyncedToCurrentChain() || !txindex.BlockUntilSyncedToCurrentChain() ||
+           !coin_stats_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    uint256 last_header;
+    const CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = m_node.chainman->ActiveChain().Tip();
+        // With nothing cached yet, the range is read from disk in one go
+        std::vector<BlockFilter> filters;
+        BOOST_CHECK(filter_index.LookupFilterRange(0, tip, filters));
+        BOOST_REQUIRE_EQUAL(filters.size(), tip->nHeight + 1U);
+        for (const CBlockIndex* block_index = m_node.chainman->ActiveChain().Genesis();
+             block_index != nullptr;
+             block_index = m_node.chainman->ActiveChain().Next(block_index)) {
+            BlockFilter expected_filter;
+            BOOST_REQUIRE(ComputeFilter(filter_index.GetFilterType(), block_index, expected_filter));
+            BOOST_CHECK_EQUAL(filters[block_index->nHeight].GetHash(), expected_filter.GetHash());
+            CheckFilterLookups(filter_index, block_index, last_header);
+        }
+        chainstate.ForceFlushStateToDisk();
+    }
+
+    uint256 block_hash;
+    CTransactionRef tx_disk;
+    for (const auto& txn : m_coinbase_txns) {
+        BOOST_CHECK(txindex.FindTx(txn->GetHash(), block_hash, tx_disk));
+    }
+
+    CCoinsStats index_stats{CoinStatsHashType::MUHASH};
+    BOOST_CHECK(coin_stats_index.LookUpStats(tip, index_stats));
+    CCoinsStats expected_stats{CoinStatsHashType::MUHASH};
+    expected_stats.index_requested = false;
+    BOOST_REQUIRE(GetUTXOStats(&chainstate.CoinsDB(), chainstate.m_blockman, expected_stats, [] {}));
+    BOOST_CHECK_EQUAL(index_stats.hashSerialized, expected_stats.hashSerialized);
+
+    filter_index.Stop();
+    txindex.Stop();
+    coin_stats_index.Stop();
+}
+
 BOOST_FIXTURE_TEST_CASE(blockfilter_index_init_destroy, BasicTestingSetup)
 {
     BlockFilterIndex* filter_index;
@@ -0,0 +1,93 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockmap.h>
+#include <chain.h>
+#include <test/util/setup_common.h>
+
+#include <map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockmap_insert_find)
+{
+    // Compare against std::map through several table growths.
+    const int n_entries = 10000;
+    std::vector<CBlockIndex> indexes(n_entries);
+    std::map<uint256, CBlockIndex*> expected;
+    BlockMap map;
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(InsecureRand256()) == map.end());
+
+    std::vector<const uint256*> keys;
+    for (int i = 0; i < n_entries; ++i) {
+        const uint256 hash = InsecureRand256();
+        auto [it, inserted] = map.emplace(hash, &indexes[i]);
+        BOOST_CHECK(inserted);
+        BOOST_CHECK(it->first == hash);
+        BOOST_CHECK_EQUAL(it->second, &indexes[i]);
+        expected.emplace(hash, &indexes[i]);
+        keys.push_back(&it->first);
+
+        // Inserting an existing key returns the existing entry.
+        auto [existing, reinserted] = map.emplace(hash, nullptr);
+        BOOST_CHECK(!reinserted);
+        BOOST_CHECK_EQUAL(existing->second, &indexes[i]);
+    }
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+
+    // Keys never move, so pointers taken at insertion (as phashBlock) stay valid.
+    for (int i = 0; i < n_entries; ++i) {
+        BOOST_CHECK_EQUAL(map.find(*keys[i])->second, &indexes[i]);
+        BOOST_CHECK_EQUAL(&map.find(*keys[i])->first, keys[i]);
+    }
+    for (const auto& [hash, index] : expected) {
+        BOOST_CHECK_EQUAL(map.count(hash), 1U);
+        BOOST_CHECK_EQUAL(map.find(hash)->second, index);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_CHECK_EQUAL(map.count(InsecureRand256()), 0U);
+    }
+
+    // Iteration visits every entry once, in insertion order.
+    int visited = 0;
+    for (const std::pair<const uint256, CBlockIndex*>& item : map) {
+        BOOST_CHECK_EQUAL(item.second, &indexes[visited]);
+        ++visited;
+    }
+    BOOST_CHECK_EQUAL(visited, n_entries);
+
+    // operator[] inserts a null entry for unknown keys.
+    const uint256 unknown = InsecureRand256();
+    BOOST_CHECK(map[unknown] == nullptr);
+    BOOST_CHECK_EQUAL(map.size(), expected.size() + 1);
+    BOOST_CHECK_EQUAL(map[*keys[0]], &indexes[0]);
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(unknown) == map.end());
+}
+
+BOOST_AUTO_TEST_CASE(blockmap_colliding_hashes)
+{
+    // Keys that share the low 64 bits land on the same slot and are told
+    // apart by the full key.
+    BlockMap map;
+    std::vector<CBlockIndex> indexes(64);
+    std::vector<uint256> hashes;
+    for (size_t i = 0; i < indexes.size(); ++i) {
+        uint256 hash = InsecureRand256();
+        std::fill(hash.begin(), hash.begin() + 8, 0);
+        hashes.push_back(hash);
+        BOOST_CHECK(map.emplace(hash, &indexes[i]).second);
+    }
+    for (size_t i = 0; i < indexes.size(); ++i) {
+        BOOST_CHECK_EQUAL(map.find(hashes[i])->second, &indexes[i]);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
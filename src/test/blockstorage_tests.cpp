@@ -0,0 +1,289 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <fs.h>
+#include <node/blockcompression.h>
+#include <node/blockstorage.h>
+#include <primitives/block.h>
+#include <script/interpreter.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(blockstorage_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(read_blocks_from_file)
+{
+    const CChainParams& params = Params();
+    const CBlock& genesis = params.GenesisBlock();
+    const unsigned int size = GetSerializeSize(genesis, CLIENT_VERSION);
+
+    // Two copies of the genesis block, surrounded by data that must be skipped:
+    // junk, a valid magic with an impossible size, and a truncated block.
+    const fs::path path = m_args.GetDataDirBase() / "blocks.dat";
+    std::vector<unsigned int> positions;
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        file << std::vector<unsigned char>(100, 0xfa);
+        file << params.MessageStart() << (unsigned int)(MAX_BLOCK_SERIALIZED_SIZE + 1);
+        file << params.MessageStart() << size;
+        positions.push_back(ftell(file.Get()));
+        file << genesis;
+        file << params.MessageStart() << size;
+        positions.push_back(ftell(file.Get()));
+        file << genesis;
+        file << params.MessageStart() << size << genesis.nVersion;
+    }
+
+    std::vector<ExternalBlock> blocks;
+    ReadBlocksFromFile(fsbridge::fopen(path, "rb"), 7, params, [&](ExternalBlock&& block) {
+        blocks.push_back(std::move(block));
+        return true;
+    });
+    BOOST_REQUIRE_EQUAL(blocks.size(), 2U);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        BOOST_CHECK_EQUAL(blocks[i].hash, genesis.GetHash());
+        BOOST_CHECK_EQUAL(blocks[i].block->GetHash(), genesis.GetHash());
+        BOOST_CHECK_EQUAL(blocks[i].pos.nFile, 7);
+        BOOST_CHECK_EQUAL(blocks[i].pos.nPos, positions[i]);
+    }
+
+    // The sink stops the scan
+    int calls = 0;
+    ReadBlocksFromFile(fsbridge::fopen(path, "rb"), 0, params, [&](ExternalBlock&&) {
+        ++calls;
+        return false;
+    });
+    BOOST_CHECK_EQUAL(calls, 1);
+}
+
+BOOST_AUTO_TEST_CASE(block_file_reader)
+{
+    std::vector<CBlockIndex*> chain;
+    {
+        LOCK(cs_main);
+        for (int height = 0; height <= m_node.chainman->ActiveHeight(); ++height) {
+            chain.push_back(m_node.chainman->ActiveChain()[height]);
+        }
+    }
+
+    // Make three block files out of the one the test chain was written to.
+    const fs::path blk0 = GetBlockPosFilename(FlatFilePos(0, 0));
+    BOOST_REQUIRE(fs::exists(blk0));
+    BOOST_REQUIRE(!fs::exists(GetBlockPosFilename(FlatFilePos(1, 0))));
+    for (int file = 1; file <= 2; ++file) {
+        fs::copy_file(blk0, GetBlockPosFilename(FlatFilePos(file, 0)));
+    }
+
+    for (int n_threads : {1, 2, 5}) {
+        BlockFileReader reader(Params(), n_threads);
+        ExternalBlock block;
+        for (int file = 0; file <= 2; ++file) {
+            for (const CBlockIndex* index : chain) {
+                BOOST_REQUIRE(reader.Next(block));
+                BOOST_CHECK_EQUAL(block.hash, index->GetBlockHash());
+                BOOST_CHECK_EQUAL(block.pos.nFile, file);
+                BOOST_CHECK_EQUAL(block.pos.nPos, index->nDataPos);
+                // The context-free checks were done on the reader thread
+                BOOST_CHECK(block.block->fChecked);
+            }
+        }
+        BOOST_CHECK(!reader.Next(block));
+        BOOST_CHECK(reader.GetError().empty());
+    }
+
+    // Stopping early does not wait for the rest of the files to be read.
+    {
+        BlockFileReader reader(Params(), 2);
+        ExternalBlock block;
+        BOOST_CHECK(reader.Next(block));
+        reader.Interrupt();
+        BOOST_CHECK(!reader.Next(block));
+    }
+
+    for (int file = 1; file <= 2; ++file) {
+        fs::remove(GetBlockPosFilename(FlatFilePos(file, 0)));
+    }
+}
+
+//! The compression method in the header of the record at pos in file
+static BlockCompression RecordCompression(const fs::path& file, const FlatFilePos& pos)
+{
+    FILE* f = fsbridge::fopen(file, "rb");
+    BOOST_REQUIRE(f);
+    CAutoFile record(f, SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE_EQUAL(fseek(record.Get(), pos.nPos - 4, SEEK_SET), 0);
+    uint32_t size_field;
+    record >> size_field;
+    return BlockCompression(size_field >> BLOCK_RECORD_COMPRESSION_SHIFT);
+}
+
+BOOST_AUTO_TEST_CASE(block_compression)
+{
+    const std::vector<uint8_t> data(10000, 'b');
+    std::vector<uint8_t> compressed, decompressed;
+    BOOST_CHECK(!CompressBlockData(BlockCompression::NONE, data, compressed));
+    for (BlockCompression method : {BlockCompression::ZLIB, BlockCompression::ZSTD}) {
+        BOOST_CHECK(ParseBlockCompression(BlockCompressionName(method)) == method);
+        if (!BlockCompressionSupported(method)) continue;
+        BOOST_REQUIRE(CompressBlockData(method, data, compressed));
+        BOOST_CHECK(compressed.size() < data.size() / 10);
+        BOOST_REQUIRE(DecompressBlockData(method, compressed, data.size(), decompressed));
+        BOOST_CHECK(decompressed == data);
+        // The size must be exact
+        BOOST_CHECK(!DecompressBlockData(method, compressed, data.size() - 1, decompressed));
+        compressed.back() ^= 1;
+        BOOST_CHECK(!DecompressBlockData(method, compressed, data.size(), decompressed));
+    }
+    BOOST_CHECK(!ParseBlockCompression("lzma"));
+}
+
+BOOST_AUTO_TEST_CASE(compressed_block_records)
+{
+    // Blocks with many identical outputs and spends, so that the block and its
+    // undo data compress well.
+    const CScript p2pk = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const CScript op_true = CScript() << OP_TRUE;
+    const int n_outputs = 100;
+
+    std::vector<BlockCompression> methods{BlockCompression::NONE};
+    for (BlockCompression method : {BlockCompression::ZLIB, BlockCompression::ZSTD}) {
+        if (BlockCompressionSupported(method)) methods.push_back(method);
+    }
+    for (size_t i = 0; i < methods.size(); ++i) {
+        g_block_compression = methods[i];
+
+        CMutableTransaction fan_out;
+        fan_out.vin.emplace_back(COutPoint(m_coinbase_txns[i]->GetHash(), 0));
+        for (int n = 0; n < n_outputs; ++n) {
+            fan_out.vout.emplace_back(m_coinbase_txns[i]->vout[0].nValue / (2 * n_outputs), op_true);
+        }
+        std::vector<unsigned char> sig;
+        BOOST_REQUIRE(coinbaseKey.Sign(SignatureHash(p2pk, fan_out, 0, SIGHASH_ALL, 0, SigVersion::BASE), sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        fan_out.vin[0].scriptSig << sig;
+
+        CMutableTransaction fan_in;
+        for (int n = 0; n < n_outputs; ++n) {
+            fan_in.vin.emplace_back(COutPoint(fan_out.GetHash(), n));
+        }
+        fan_in.vout.emplace_back(fan_out.vout[0].nValue, op_true);
+
+        CreateAndProcessBlock({fan_out}, p2pk);
+        const CBlock block = CreateAndProcessBlock({fan_in}, p2pk);
+
+        const CBlockIndex* index = WITH_LOCK(cs_main, return m_node.chainman->ActiveTip());
+        BOOST_REQUIRE_EQUAL(index->GetBlockHash(), block.GetHash());
+        const FlatFilePos undo_pos = index->GetUndoPos();
+        const fs::path undo_file = gArgs.GetBlocksDirPath() / strprintf("rev%05u.dat", undo_pos.nFile);
+        BOOST_CHECK(RecordCompression(GetBlockPosFilename(index->GetBlockPos()), index->GetBlockPos()) == methods[i]);
+        BOOST_CHECK(RecordCompression(undo_file, undo_pos) == methods[i]);
+
+        CBlock read;
+        BOOST_REQUIRE(ReadBlockFromDisk(read, index, Params().GetConsensus()));
+        BOOST_CHECK_EQUAL(read.vtx.size(), 2U);
+
+        std::vector<uint8_t> raw;
+        BOOST_REQUIRE(ReadRawBlockFromDisk(raw, index, Params().MessageStart()));
+        CDataStream expected(SER_NETWORK, PROTOCOL_VERSION);
+        expected << block;
+        BOOST_CHECK(MakeUCharSpan(expected) == MakeUCharSpan(raw));
+
+        CBlockUndo undo;
+        BOOST_REQUIRE(UndoReadFromDisk(undo, index));
+        BOOST_REQUIRE_EQUAL(undo.vtxundo.size(), 1U);
+        BOOST_CHECK_EQUAL(undo.vtxundo[0].vprevout.size(), size_t(n_outputs));
+
+        // Reindexing finds the compressed block
+        bool found = false;
+        ReadBlocksFromFile(OpenBlockFile(FlatFilePos(index->nFile, 0), true), index->nFile, Params(), [&](ExternalBlock&& external) {
+            if (external.hash != block.GetHash()) return true;
+            found = true;
+            BOOST_CHECK(external.pos == index->GetBlockPos());
+            return false;
+        });
+        BOOST_CHECK(found);
+    }
+    g_block_compression = BlockCompression::NONE;
+}
+
+BOOST_AUTO_TEST_CASE(large_undo_record)
+{
+    // Outputs with scripts of almost 10000 bytes that anyone can spend. The
+    // undo data of a block spending enough of them is larger than 16 MiB.
+    CScript big_script;
+    for (int i = 0; i < 19; ++i) {
+        big_script << std::vector<unsigned char>(MAX_SCRIPT_ELEMENT_SIZE, i) << OP_DROP;
+    }
+    big_script << OP_TRUE;
+    const CScript p2pk = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const int n_outputs = 95;
+    const int n_txs = 19;
+
+    g_block_compression = BlockCompression::ZLIB;
+    CMutableTransaction spend;
+    for (int i = 0; i < n_txs; ++i) {
+        CMutableTransaction fan_out;
+        fan_out.vin.emplace_back(COutPoint(m_coinbase_txns[i]->GetHash(), 0));
+        for (int n = 0; n < n_outputs; ++n) {
+            fan_out.vout.emplace_back(m_coinbase_txns[i]->vout[0].nValue / (2 * n_outputs), big_script);
+        }
+        std::vector<unsigned char> sig;
+        BOOST_REQUIRE(coinbaseKey.Sign(SignatureHash(p2pk, fan_out, 0, SIGHASH_ALL, 0, SigVersion::BASE), sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        fan_out.vin[0].scriptSig << sig;
+        CreateAndProcessBlock({fan_out}, p2pk);
+        for (int n = 0; n < n_outputs; ++n) {
+            spend.vin.emplace_back(COutPoint(fan_out.GetHash(), n));
+        }
+    }
+    spend.vout.emplace_back(COIN, CScript() << OP_TRUE);
+    const CBlock block = CreateAndProcessBlock({spend}, p2pk);
+    g_block_compression = BlockCompression::NONE;
+
+    const CBlockIndex* index = WITH_LOCK(cs_main, return m_node.chainman->ActiveTip());
+    BOOST_REQUIRE_EQUAL(index->GetBlockHash(), block.GetHash());
+
+    // The record is not compressed, and its size does not fit the size field
+    CBlockUndo undo;
+    BOOST_REQUIRE(UndoReadFromDisk(undo, index));
+    BOOST_REQUIRE_EQUAL(undo.vtxundo.size(), 1U);
+    BOOST_CHECK_EQUAL(undo.vtxundo[0].vprevout.size(), size_t(n_txs * n_outputs));
+    const size_t size = GetSerializeSize(undo, CLIENT_VERSION);
+    BOOST_CHECK(size > BLOCK_RECORD_SIZE_MASK);
+    const FlatFilePos undo_pos = index->GetUndoPos();
+    CAutoFile file(fsbridge::fopen(gArgs.GetBlocksDirPath() / strprintf("rev%05u.dat", undo_pos.nFile), "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE_EQUAL(fseek(file.Get(), undo_pos.nPos - 4, SEEK_SET), 0);
+    uint32_t size_field;
+    file >> size_field;
+    BOOST_CHECK_EQUAL(size_field, BLOCK_RECORD_SIZE_MASK);
+
+    std::vector<uint8_t> raw;
+    BOOST_REQUIRE(ReadRawUndoFromDisk(raw, index));
+    BOOST_CHECK_EQUAL(raw.size(), size);
+    file.fclose();
+
+    // Earlier versions wrote the full size, whose top byte looks like a
+    // compression method
+    BOOST_REQUIRE(size >> BLOCK_RECORD_COMPRESSION_SHIFT != 0);
+    {
+        CAutoFile legacy(fsbridge::fopen(gArgs.GetBlocksDirPath() / strprintf("rev%05u.dat", undo_pos.nFile), "rb+"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE_EQUAL(fseek(legacy.Get(), undo_pos.nPos - 4, SEEK_SET), 0);
+        legacy << uint32_t(size);
+    }
+    BOOST_CHECK(UndoReadFromDisk(undo, index));
+    BOOST_CHECK(ReadRawUndoFromDisk(raw, index));
+    BOOST_CHECK_EQUAL(raw.size(), size);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
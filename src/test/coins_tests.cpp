@@ -5,6 +5,7 @@
 #include <attributes.h>
 #include <clientversion.h>
 #include <coins.h>
+#include <flatcoins.h>
 #include <script/standard.h>
 #include <streams.h>
 #include <test/util/setup_common.h>
@@ -271,6 +272,9 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
 
     CCoinsViewDB db_base{"test", /*nCacheSize*/ 1 << 23, /*fMemory*/ true, /*fWipe*/ false};
     SimulationTest(&db_base, true);
+
+    CCoinsViewFlatFile flat_base{m_args.GetDataDirBase() / "chainstate_flat", /*wipe*/ true};
+    SimulationTest(&flat_base, true);
 }
 
 // Store of all necessary tx and undo data for next test
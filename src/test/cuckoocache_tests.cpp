@@ -114,6 +114,8 @@ BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate_ok)
     for (double load = 0.1; load < 2; load *= 2) {
         double hits = test_cache<CuckooCache::cache<uint256, SignatureCacheHasher>>(megabytes, load);
         BOOST_CHECK(normalize_hit_rate(hits, load) > HitRateThresh);
+        double sharded_hits = test_cache<CuckooCache::sharded_cache<uint256, SignatureCacheHasher>>(megabytes, load);
+        BOOST_CHECK(normalize_hit_rate(sharded_hits, load) > HitRateThresh);
     }
 }
 
@@ -181,6 +183,7 @@ BOOST_AUTO_TEST_CASE(cuckoocache_erase_ok)
 {
     size_t megabytes = 4;
     test_cache_erase<CuckooCache::cache<uint256, SignatureCacheHasher>>(megabytes);
+    test_cache_erase<CuckooCache::sharded_cache<uint256, SignatureCacheHasher>>(megabytes);
 }
 
 template <typename Cache>
@@ -366,6 +369,55 @@ static void test_cache_generations()
 BOOST_AUTO_TEST_CASE(cuckoocache_generations)
 {
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
+    test_cache_generations<CuckooCache::sharded_cache<uint256, SignatureCacheHasher>>();
+}
+
+/** Check that a sharded_cache needs no external locking: readers erase and
+ * writers insert concurrently, and every element that was inserted before the
+ * readers started and not erased by them is still found afterwards.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_sharded_parallel_ok)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    CuckooCache::sharded_cache<uint256, SignatureCacheHasher> set{};
+    const size_t bytes = 4 << 20;
+    set.setup_bytes(bytes);
+    // Stay well below a full epoch so that nothing is evicted by the inserts.
+    const uint32_t n_insert = (bytes / sizeof(uint256)) / 8;
+    std::vector<uint256> hashes(n_insert);
+    for (uint256& h : hashes) {
+        h = InsecureRand256();
+    }
+    for (uint32_t i = 0; i < n_insert / 2; ++i) {
+        set.insert(hashes[i]);
+    }
+
+    const uint32_t n_threads = 4;
+    std::vector<std::thread> threads;
+    for (uint32_t x = 0; x < n_threads; ++x) {
+        threads.emplace_back([&, x] {
+            if (x == 0) {
+                // One writer inserts the second half...
+                for (uint32_t i = n_insert / 2; i < n_insert; ++i) {
+                    set.insert(hashes[i]);
+                }
+                return;
+            }
+            // ...while the readers look up, and erase, the first quarter.
+            const size_t ntodo = (n_insert / 4) / (n_threads - 1);
+            for (uint32_t i = ntodo * (x - 1); i < ntodo * x; ++i) {
+                bool contains = set.contains(hashes[i], true);
+                assert(contains);
+            }
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    for (uint32_t i = n_insert / 4; i < n_insert; ++i) {
+        BOOST_CHECK(set.contains(hashes[i], false));
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END();
@@ -411,5 +411,81 @@ BOOST_AUTO_TEST_CASE(unicodepath)
     BOOST_CHECK(fs::exists(lockPath));
 }
 
+static bool ParseDBOpts(ArgsManager& args, const std::vector<const char*>& settings, std::string& error)
+{
+    args.AddArg("-dbopt=<db>:<option>=<value>", "", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    std::vector<const char*> argv{"bitcoind"};
+    argv.insert(argv.end(), settings.begin(), settings.end());
+    BOOST_REQUIRE(args.ParseParameters(argv.size(), argv.data(), error));
+    return CheckDBOptions(args, error);
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_options)
+{
+    std::string error;
+    {
+        ArgsManager args;
+        BOOST_CHECK(ParseDBOpts(args, {"-dbopt=chainstate:blocksize=16384", "-dbopt=chainstate:bloombits=0",
+                                       "-dbopt=txindex:writebuffer=1048576", "-dbopt=txindex:compression=1"}, error));
+        const DBOptions chainstate = GetDBOptions(args, "chainstate");
+        BOOST_CHECK_EQUAL(chainstate.name, "chainstate");
+        BOOST_CHECK_EQUAL(chainstate.block_size, 16384U);
+        BOOST_CHECK_EQUAL(chainstate.bloom_bits, 0);
+        BOOST_CHECK_EQUAL(chainstate.write_buffer_size, 0U);
+        BOOST_CHECK(!chainstate.compression);
+        const DBOptions txindex = GetDBOptions(args, "txindex");
+        BOOST_CHECK_EQUAL(txindex.block_size, DBOptions{}.block_size);
+        BOOST_CHECK_EQUAL(txindex.bloom_bits, DBOptions{}.bloom_bits);
+        BOOST_CHECK_EQUAL(txindex.write_buffer_size, 1048576U);
+        BOOST_CHECK(txindex.compression);
+
+        // The tuned databases work
+        CDBWrapper dbw(m_args.GetDataDirBase() / "dbwrapper_options", 1 << 20, true, false, false, chainstate);
+        BOOST_CHECK_EQUAL(dbw.GetName(), "chainstate");
+        for (uint32_t i = 0; i < 1000; ++i) BOOST_CHECK(dbw.Write(i, uint256{}));
+        uint256 res;
+        BOOST_CHECK(dbw.Read(uint32_t{999}, res));
+        BOOST_CHECK(!dbw.Read(uint32_t{1000}, res));
+    }
+    for (const char* invalid : {"-dbopt=chainstate", "-dbopt=chainstate:blocksize", "-dbopt=wallet:blocksize=4096",
+                                "-dbopt=chainstate:cachesize=4096", "-dbopt=chainstate:blocksize=-1",
+                                "-dbopt=chainstate:blocksize=16", "-dbopt=chainstate:bloombits=x", "-dbopt=chainstate:compression=2"}) {
+        ArgsManager args;
+        BOOST_CHECK(!ParseDBOpts(args, {invalid}, error));
+        BOOST_CHECK(error.find(std::string(invalid).substr(7)) != std::string::npos);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_level_stats)
+{
+    const std::string stats{
+        "                               Compactions\n"
+        "Level  Files Size(MB) Time(sec) Read(MB) Write(MB)\n"
+        "--------------------------------------------------\n"
+        "  0        3        1         0        0         0\n"
+        "  1        5       10         2       12        11\n"};
+    const std::vector<DBLevelStats> levels = ParseDBLevelStats(stats);
+    BOOST_REQUIRE_EQUAL(levels.size(), 2U);
+    BOOST_CHECK_EQUAL(levels[0].level, 0);
+    BOOST_CHECK_EQUAL(levels[0].files, 3);
+    BOOST_CHECK_EQUAL(levels[0].size_mb, 1);
+    BOOST_CHECK_EQUAL(levels[1].level, 1);
+    BOOST_CHECK_EQUAL(levels[1].files, 5);
+    BOOST_CHECK_EQUAL(levels[1].size_mb, 10);
+    BOOST_CHECK_EQUAL(levels[1].compaction_sec, 2);
+    BOOST_CHECK_EQUAL(levels[1].compaction_read_mb, 12);
+    BOOST_CHECK_EQUAL(levels[1].compaction_write_mb, 11);
+    BOOST_CHECK(ParseDBLevelStats("").empty());
+
+    // A database with a flushed memtable has a level 0 or compacted table
+    CDBWrapper dbw(m_args.GetDataDirBase() / "dbwrapper_level_stats", 1 << 20, true);
+    BOOST_CHECK(dbw.GetLevelStats().empty());
+    for (uint32_t i = 0; i < 10000; ++i) BOOST_CHECK(dbw.Write(i, uint256{}));
+    dbw.CompactRange(uint32_t{0}, uint32_t{10000});
+    int files = 0;
+    for (const DBLevelStats& level : dbw.GetLevelStats()) files += level.files;
+    BOOST_CHECK(files > 0);
+}
+
 
 BOOST_AUTO_TEST_SUITE_END()
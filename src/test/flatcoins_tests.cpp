@@ -0,0 +1,335 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <flatcoins.h>
+#include <fs.h>
+#include <script/script.h>
+#include <shutdown.h>
+#include <test/util/setup_common.h>
+#include <txdb.h>
+#include <uint256.h>
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+Coin MakeCoin(CAmount value, size_t script_size = 25)
+{
+    Coin coin;
+    coin.out.nValue = value;
+    coin.out.scriptPubKey = CScript() << OP_RETURN << std::vector<uint8_t>(script_size, 0x51);
+    coin.nHeight = 100;
+    return coin;
+}
+
+//! Write coins (spent ones erase) through view's BatchWrite
+void Write(CCoinsView& view, const std::map<COutPoint, Coin>& coins, const uint256& best_block)
+{
+    CCoinsMap map;
+    for (const auto& [outpoint, coin] : coins) {
+        CCoinsCacheEntry entry{Coin{coin}};
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        map.emplace(outpoint, std::move(entry));
+    }
+    BOOST_CHECK(view.BatchWrite(map, best_block));
+}
+
+//! All coins of view, in cursor order
+std::vector<std::pair<COutPoint, Coin>> ReadAll(const CCoinsView& view)
+{
+    std::vector<std::pair<COutPoint, Coin>> coins;
+    for (auto cursor = view.Cursor(); cursor->Valid(); cursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(outpoint));
+        BOOST_REQUIRE(cursor->GetValue(coin));
+        coins.emplace_back(outpoint, std::move(coin));
+    }
+    return coins;
+}
+
+void CheckCoins(const CCoinsView& view, const std::map<COutPoint, Coin>& expected)
+{
+    const auto coins = ReadAll(view);
+    BOOST_REQUIRE_EQUAL(coins.size(), expected.size());
+    auto it = expected.begin();
+    for (const auto& [outpoint, coin] : coins) {
+        BOOST_CHECK(outpoint == it->first);
+        BOOST_CHECK(coin.out == it->second.out);
+        Coin read;
+        BOOST_CHECK(view.GetCoin(outpoint, read));
+        BOOST_CHECK(read.out == it->second.out);
+        ++it;
+    }
+}
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(flatcoins_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(flatcoins_persistence)
+{
+    const fs::path dir = m_args.GetDataDirBase() / "chainstate_flat";
+    std::map<COutPoint, Coin> expected;
+    std::map<COutPoint, Coin> batch;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        batch.emplace(COutPoint(InsecureRand256(), i % 3), MakeCoin(i));
+    }
+    const uint256 block1 = InsecureRand256(), block2 = InsecureRand256();
+    {
+        CCoinsViewFlatFile view(dir, /* wipe */ true);
+        BOOST_CHECK(view.GetBestBlock().IsNull());
+        Write(view, batch, block1);
+        expected = batch;
+
+        // Spend every other coin and change the rest
+        batch.clear();
+        bool spend = false;
+        for (auto& [outpoint, coin] : expected) {
+            batch.emplace(outpoint, (spend = !spend) ? Coin{} : MakeCoin(coin.out.nValue + 1));
+        }
+        // Spending a coin that was never written is a no-op
+        batch.emplace(COutPoint(InsecureRand256(), 0), Coin{});
+        Write(view, batch, block2);
+        for (const auto& [outpoint, coin] : batch) {
+            if (coin.IsSpent()) {
+                expected.erase(outpoint);
+                BOOST_CHECK(!view.HaveCoin(outpoint));
+            } else {
+                expected[outpoint] = coin;
+                BOOST_CHECK(view.HaveCoin(outpoint));
+            }
+        }
+        BOOST_CHECK_EQUAL(view.GetBestBlock(), block2);
+        BOOST_CHECK(view.GetHeadBlocks().empty());
+        CheckCoins(view, expected);
+    }
+
+    // Everything is still there after reopening
+    {
+        CCoinsViewFlatFile view(dir, /* wipe */ false);
+        BOOST_CHECK_EQUAL(view.GetBestBlock(), block2);
+        CheckCoins(view, expected);
+        BOOST_CHECK(view.EstimateSize() < view.GetFileSize());
+    }
+
+    // Data appended after the last commit, as left by a crash, is ignored
+    {
+        FILE* file = fsbridge::fopen(dir / "coins00_0.dat", "ab");
+        BOOST_REQUIRE(file);
+        const std::vector<uint8_t> garbage(100, 0xff);
+        fwrite(garbage.data(), 1, garbage.size(), file);
+        fclose(file);
+        CCoinsViewFlatFile view(dir, /* wipe */ false);
+        CheckCoins(view, expected);
+    }
+
+    {
+        CCoinsViewFlatFile view(dir, /* wipe */ true);
+        BOOST_CHECK(view.GetBestBlock().IsNull());
+        BOOST_CHECK(ReadAll(view).empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(flatcoins_cursor_snapshot)
+{
+    CCoinsViewFlatFile view(m_args.GetDataDirBase() / "chainstate_flat", /* wipe */ true);
+    std::map<COutPoint, Coin> expected;
+    for (uint32_t i = 0; i < 100; ++i) {
+        expected.emplace(COutPoint(InsecureRand256(), i), MakeCoin(i));
+    }
+    const uint256 block1 = InsecureRand256();
+    Write(view, expected, block1);
+
+    // Changes after the cursor was created do not show up in it.
+    auto cursor = view.Cursor();
+    std::map<COutPoint, Coin> changes;
+    for (const auto& [outpoint, coin] : expected) {
+        changes.emplace(outpoint, Coin{});
+    }
+    changes.emplace(COutPoint(InsecureRand256(), 0), MakeCoin(1000));
+    Write(view, changes, InsecureRand256());
+
+    BOOST_CHECK_EQUAL(cursor->GetBestBlock(), block1);
+    auto it = expected.begin();
+    for (; cursor->Valid(); cursor->Next(), ++it) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_REQUIRE(it != expected.end());
+        BOOST_CHECK(cursor->GetKey(outpoint) && outpoint == it->first);
+        BOOST_CHECK(cursor->GetValue(coin) && coin.out == it->second.out);
+    }
+    BOOST_CHECK(it == expected.end());
+    BOOST_CHECK_EQUAL(ReadAll(view).size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(flatcoins_range_cursors)
+{
+    std::map<COutPoint, Coin> coins;
+    for (uint32_t i = 0; i < 2000; ++i) {
+        coins.emplace(COutPoint(InsecureRand256(), i % 5), MakeCoin(i));
+    }
+    for (CoinsBackend backend : {CoinsBackend::LEVELDB, CoinsBackend::FLATFILE}) {
+        const auto view = MakeCoinsView(backend, GetCoinsDBPath(m_args.GetDataDirBase(), "ranges", backend), 1 << 20, false, true);
+        const uint256 best_block = InsecureRand256();
+        Write(*view, coins, best_block);
+        for (size_t n : {1, 3, 16, 100, 256}) {
+            auto cursors = view->RangeCursors(n);
+            BOOST_REQUIRE_EQUAL(cursors.size(), n);
+            // Later writes do not show up in any of the cursors
+            const COutPoint added(InsecureRand256(), 0);
+            Write(*view, {{coins.begin()->first, Coin{}}, {added, MakeCoin(1)}}, InsecureRand256());
+
+            // Read the ranges in reverse, so that cursors of the same flat partition are used out of order
+            std::vector<std::vector<COutPoint>> ranges(n);
+            for (size_t i = n; i-- > 0;) {
+                BOOST_CHECK_EQUAL(cursors[i]->GetBestBlock(), best_block);
+                for (; cursors[i]->Valid(); cursors[i]->Next()) {
+                    COutPoint key;
+                    BOOST_REQUIRE(cursors[i]->GetKey(key));
+                    BOOST_CHECK(*key.hash.begin() >= i * 256 / n && *key.hash.begin() < (i + 1) * 256 / n);
+                    ranges[i].push_back(key);
+                }
+                cursors[i].reset();
+            }
+            auto expected = coins.begin();
+            for (const auto& range : ranges) {
+                for (const COutPoint& key : range) {
+                    BOOST_REQUIRE(expected != coins.end());
+                    BOOST_CHECK(key == expected->first);
+                    ++expected;
+                }
+            }
+            BOOST_CHECK(expected == coins.end());
+            auto restore = coins;
+            restore.emplace(added, Coin{});
+            Write(*view, restore, best_block);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scan_coins)
+{
+    std::map<COutPoint, Coin> coins;
+    for (uint32_t i = 0; i < 2000; ++i) {
+        coins.emplace(COutPoint(InsecureRand256(), i), MakeCoin(i));
+    }
+    CCoinsViewDB view(GetCoinsDBPath(m_args.GetDataDirBase(), "scan", CoinsBackend::LEVELDB), 1 << 20, true, false);
+    Write(view, coins, InsecureRand256());
+
+    // Ranges are merged in key order, whatever order they were scanned in.
+    std::vector<std::vector<COutPoint>> ranges(COINS_SCAN_RANGES);
+    std::vector<COutPoint> merged;
+    ScanCoins(
+        view.RangeCursors(COINS_SCAN_RANGES),
+        [&](size_t index, CCoinsViewCursor& cursor) {
+            // Not checked here, Boost.Test is not thread safe
+            for (COutPoint key; cursor.Valid() && cursor.GetKey(key); cursor.Next()) {
+                ranges[index].push_back(key);
+            }
+        },
+        [&](size_t index) {
+            merged.insert(merged.end(), ranges[index].begin(), ranges[index].end());
+        });
+    BOOST_REQUIRE_EQUAL(merged.size(), coins.size());
+    BOOST_CHECK(std::equal(merged.begin(), merged.end(), coins.begin(), [](const COutPoint& a, const auto& b) { return a == b.first; }));
+
+    // Errors of the scans end up in the caller
+    size_t merges{0};
+    BOOST_CHECK_THROW(ScanCoins(
+                          view.RangeCursors(COINS_SCAN_RANGES),
+                          [&](size_t index, CCoinsViewCursor& cursor) {
+                              if (index == 10) throw std::runtime_error("scan failed");
+                          },
+                          [&](size_t index) { ++merges; }),
+                      std::runtime_error);
+    BOOST_CHECK(merges <= 10);
+}
+
+BOOST_AUTO_TEST_CASE(flatcoins_compaction)
+{
+    const fs::path dir = m_args.GetDataDirBase() / "chainstate_flat";
+    std::optional<CCoinsViewFlatFile> view;
+    view.emplace(dir, /* wipe */ true);
+
+    // All coins go to the first partition, which is rewritten once most of it is dead.
+    std::map<COutPoint, Coin> coins;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        uint256 txid = InsecureRand256();
+        *txid.begin() = 0;
+        coins.emplace(COutPoint(txid, 0), Coin{});
+    }
+    std::unique_ptr<CCoinsViewCursor> cursor;
+    uint64_t max_size{0};
+    for (int round = 0; round < 12; ++round) {
+        for (auto& [outpoint, coin] : coins) coin = MakeCoin(round, 2000);
+        Write(*view, coins, InsecureRand256());
+        if (round == 0) cursor = view->Cursor();
+        max_size = std::max(max_size, view->GetFileSize());
+    }
+    BOOST_CHECK(fs::exists(dir / "coins00_1.dat"));
+    BOOST_CHECK(view->GetFileSize() < max_size);
+    CheckCoins(*view, coins);
+
+    // The cursor from before the compaction still sees the first round.
+    size_t count{0};
+    for (; cursor->Valid(); cursor->Next(), ++count) {
+        Coin coin;
+        BOOST_CHECK(cursor->GetValue(coin));
+        BOOST_CHECK_EQUAL(coin.out.nValue, 0);
+    }
+    BOOST_CHECK_EQUAL(count, coins.size());
+
+    // The replaced file is removed once the cursor is done with it.
+    BOOST_CHECK(fs::exists(dir / "coins00_0.dat"));
+    cursor.reset();
+    BOOST_CHECK(!fs::exists(dir / "coins00_0.dat"));
+    view.emplace(dir, /* wipe */ false);
+    CheckCoins(*view, coins);
+}
+
+BOOST_AUTO_TEST_CASE(flatcoins_convert)
+{
+    const fs::path datadir = m_args.GetDataDirBase();
+    std::map<COutPoint, Coin> expected;
+    for (uint32_t i = 0; i < 500; ++i) {
+        expected.emplace(COutPoint(InsecureRand256(), i), MakeCoin(i, i));
+    }
+    const uint256 best_block = InsecureRand256();
+    {
+        CCoinsViewDB db(GetCoinsDBPath(datadir, "convert", CoinsBackend::LEVELDB), 1 << 20, false, true);
+        Write(db, expected, best_block);
+    }
+
+    // An interrupted conversion leaves nothing behind
+    std::string error;
+    BOOST_REQUIRE(InitShutdownState());
+    StartShutdown();
+    BOOST_CHECK(!ConvertCoinsDB(datadir, "convert", CoinsBackend::LEVELDB, CoinsBackend::FLATFILE, 1 << 20, error));
+    AbortShutdown();
+    BOOST_CHECK(!fs::exists(GetCoinsDBPath(datadir, "convert", CoinsBackend::FLATFILE)));
+    BOOST_CHECK(!fs::exists(GetCoinsDBPath(datadir, "convert", CoinsBackend::FLATFILE).string() + ".tmp"));
+
+    BOOST_CHECK(ConvertCoinsDB(datadir, "convert", CoinsBackend::LEVELDB, CoinsBackend::FLATFILE, 1 << 20, error));
+    BOOST_CHECK(!ConvertCoinsDB(datadir, "convert", CoinsBackend::LEVELDB, CoinsBackend::FLATFILE, 1 << 20, error));
+    {
+        CCoinsViewFlatFile flat(GetCoinsDBPath(datadir, "convert", CoinsBackend::FLATFILE), false);
+        BOOST_CHECK_EQUAL(flat.GetBestBlock(), best_block);
+        CheckCoins(flat, expected);
+    }
+
+    // And back
+    fs::remove_all(GetCoinsDBPath(datadir, "convert", CoinsBackend::LEVELDB));
+    BOOST_CHECK(ConvertCoinsDB(datadir, "convert", CoinsBackend::FLATFILE, CoinsBackend::LEVELDB, 1 << 20, error));
+    CCoinsViewDB db(GetCoinsDBPath(datadir, "convert", CoinsBackend::LEVELDB), 1 << 20, false, false);
+    BOOST_CHECK_EQUAL(db.GetBestBlock(), best_block);
+    CheckCoins(db, expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
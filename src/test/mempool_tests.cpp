@@ -10,6 +10,7 @@
 #include <test/util/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <vector>
 
 BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
@@ -112,10 +113,9 @@ template<typename name>
 static void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
 {
     BOOST_CHECK_EQUAL(pool.size(), sortedOrder.size());
-    typename CTxMemPool::indexed_transaction_set::index<name>::type::iterator it = pool.mapTx.get<name>().begin();
     int count=0;
-    for (; it != pool.mapTx.get<name>().end(); ++it, ++count) {
-        BOOST_CHECK_EQUAL(it->GetTx().GetHash().ToString(), sortedOrder[count]);
+    for (CTxMemPool::txiter it : pool.mapTx.get<name>()) {
+        BOOST_CHECK_EQUAL(it->GetTx().GetHash().ToString(), sortedOrder[count++]);
     }
 }
 
@@ -421,6 +421,68 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolIndexOrderTest)
+{
+    // The heaps of TxMemPoolIndex must agree with its sorted views through
+    // random insertions, removals and modifications.
+    FastRandomContext rng{/* fDeterministic */ true};
+    TestMemPoolEntryHelper entry;
+    TxMemPoolIndex index;
+    std::vector<uint256> txids;
+
+    auto check_index = [&] {
+        BOOST_CHECK_EQUAL(index.size(), txids.size());
+        BOOST_CHECK_EQUAL(std::distance(index.begin(), index.end()), (std::ptrdiff_t)txids.size());
+        for (const uint256& txid : txids) {
+            BOOST_CHECK(index.find(txid) != index.end());
+        }
+        if (index.empty()) {
+            BOOST_CHECK(index.front<descendant_score>() == index.end());
+            BOOST_CHECK(index.front<entry_time>() == index.end());
+            return;
+        }
+        BOOST_CHECK(index.front<descendant_score>() == index.get<descendant_score>().front());
+        // Entry times tie, so only compare them
+        BOOST_CHECK(index.front<entry_time>()->GetTime() == index.get<entry_time>().front()->GetTime());
+    };
+
+    for (int i = 0; i < 2000; ++i) {
+        const uint64_t action = rng.randrange(4);
+        if (action < 2 || txids.empty()) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].scriptSig = CScript() << i;
+            tx.vout.resize(1);
+            tx.vout[0].nValue = 1 * COIN;
+            const auto [it, inserted] = index.insert(entry.Fee(rng.randrange(10000)).Time(rng.randrange(100)).FromTx(tx));
+            BOOST_CHECK(inserted);
+            BOOST_CHECK(index.find_by_wtxid(it->GetTx().GetWitnessHash()) == it);
+            txids.push_back(tx.GetHash());
+        } else if (action == 2) {
+            const size_t n = rng.randrange(txids.size());
+            index.erase(index.find(txids[n]));
+            txids[n] = txids.back();
+            txids.pop_back();
+        } else {
+            const TxMemPoolIndex::const_iterator it = index.find(txids[rng.randrange(txids.size())]);
+            index.modify(it, update_fee_delta(rng.randrange(20000) - 10000));
+        }
+        if (i % 50 == 0) check_index();
+    }
+    // Removing the front entry over and over goes through the sorted order
+    std::vector<uint256> sorted;
+    for (const TxMemPoolIndex::const_iterator it : index.get<descendant_score>()) {
+        sorted.push_back(it->GetTx().GetHash());
+    }
+    for (const uint256& txid : sorted) {
+        const TxMemPoolIndex::const_iterator it = index.front<descendant_score>();
+        BOOST_CHECK(it->GetTx().GetHash() == txid);
+        index.erase(it);
+        txids.erase(std::find(txids.begin(), txids.end(), txid));
+    }
+    check_index();
+}
+
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
     CTxMemPool pool;
@@ -537,7 +599,8 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
         pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
     pool.addUnchecked(entry.Fee(9000LL).FromTx(tx7));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // should maximize mempool size by only removing 5/7
+    // tx5 and tx7 take a bit less than half of the memory usage of the mempool
+    pool.TrimToSize(pool.DynamicMemoryUsage() * 11 / 20); // should maximize mempool size by only removing 5/7
     BOOST_CHECK(pool.exists(tx4.GetHash()));
     BOOST_CHECK(!pool.exists(tx5.GetHash()));
     BOOST_CHECK(pool.exists(tx6.GetHash()));
@@ -786,4 +849,46 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorLimitsTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+    std::string err;
+
+    // [tx1].0 <- [tx2].0 <- [tx3]
+    CTransactionRef tx1 = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef tx2 = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {tx1});
+    CTransactionRef tx3 = make_tx(/* output_values */ {8 * COIN}, /* inputs */ {tx2});
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tx1));
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tx2));
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tx3));
+
+    // A child of tx3 has 4 ancestors including itself
+    const CTxMemPoolEntry child = entry.FromTx(make_tx(/* output_values */ {7 * COIN}, /* inputs */ {tx3}));
+    CTxMemPool::setEntries ancestors;
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(child, ancestors, 4, 1000000, 4, 1000000, err));
+    BOOST_CHECK_EQUAL(ancestors.size(), 3U);
+    ancestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(child, ancestors, 3, 1000000, 4, 1000000, err));
+    BOOST_CHECK_EQUAL(err, "too many unconfirmed ancestors [limit: 3]");
+    // The cached state of tx3 is enough to reject the child
+    BOOST_CHECK(ancestors.empty());
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(child, ancestors, 4, 1000000, 3, 1000000, err));
+    BOOST_CHECK_EQUAL(err, strprintf("too many descendants for tx %s [limit: 3]", tx1->GetHash().ToString()));
+
+    // tx1 is mined, then disconnected again: tx3 exceeds an ancestor limit of
+    // 2 once tx1 is added back and is removed.
+    pool.removeForBlock({tx1}, 1);
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tx1));
+    pool.UpdateTransactionsFromBlock({tx1->GetHash()}, 1000000, 2);
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    BOOST_CHECK(pool.exists(tx2->GetHash()));
+    BOOST_CHECK(!pool.exists(tx3->GetHash()));
+    size_t ancestor_count, descendant_count;
+    pool.GetTransactionAncestry(tx1->GetHash(), ancestor_count, descendant_count);
+    BOOST_CHECK_EQUAL(descendant_count, 2U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
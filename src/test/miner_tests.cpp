@@ -26,6 +26,7 @@
 namespace miner_tests {
 struct MinerTestingSetup : public TestingSetup {
     void TestPackageSelection(const CChainParams& chainparams, const CScript& scriptPubKey, const std::vector<CTransactionRef>& txFirst) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_node.mempool->cs);
+    void TestIncrementalSelection(const CChainParams& chainparams, const CScript& scriptPubKey, const std::vector<CTransactionRef>& txFirst) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_node.mempool->cs);
     bool TestSequenceLocks(const CTransaction& tx, int flags) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_node.mempool->cs)
     {
         CCoinsViewMemPool view_mempool(&m_node.chainman->ActiveChainstate().CoinsTip(), *m_node.mempool);
@@ -198,6 +199,107 @@ void MinerTestingSetup::TestPackageSelection(const CChainParams& chainparams, co
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
 }
 
+// Test that templates built from the selection kept by the mempool, updated
+// for the transactions added since, have the same transactions as templates
+// built from scratch. New packages are added after the ones kept, unless they
+// take the place of some of them.
+void MinerTestingSetup::TestIncrementalSelection(const CChainParams& chainparams, const CScript& scriptPubKey, const std::vector<CTransactionRef>& txFirst)
+{
+    TestMemPoolEntryHelper entry;
+    m_node.mempool->clear();
+
+    std::vector<uint256> hashes;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    const auto add_tx = [&](const uint256& prev, CAmount fee, CAmount value = 5000000000LL) {
+        tx.vin[0].prevout = COutPoint(prev, 0);
+        tx.vout[0].nValue = value - 100000 - fee;
+        hashes.push_back(tx.GetHash());
+        m_node.mempool->addUnchecked(entry.Fee(100000 + fee).SpendsCoinbase(true).FromTx(tx));
+    };
+
+    // Leave room for two of these transactions only
+    BlockAssembler::Options options;
+    options.nBlockMaxWeight = 4000 + 2 * GetTransactionWeight(CTransaction(tx)) + 1;
+    options.blockMinFeeRate = blockMinFeeRate;
+    const auto create_block_txids = [&](bool from_scratch) {
+        if (from_scratch) m_node.mempool->m_template_selection = {};
+        std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(m_node.chainman->ActiveChainstate(), *m_node.mempool, chainparams, options).CreateNewBlock(scriptPubKey);
+        std::vector<uint256> txids;
+        for (size_t i = 1; i < pblocktemplate->block.vtx.size(); ++i) {
+            txids.push_back(pblocktemplate->block.vtx[i]->GetHash());
+        }
+        return txids;
+    };
+
+    add_tx(txFirst[0]->GetHash(), 1000);
+    add_tx(txFirst[1]->GetHash(), 2000);
+    BOOST_CHECK(create_block_txids(false) == std::vector<uint256>({hashes[1], hashes[0]}));
+    BOOST_CHECK(!m_node.mempool->m_template_selection.key.IsNull());
+
+    // A higher feerate transaction replaces the lowest feerate one
+    add_tx(txFirst[2]->GetHash(), 3000);
+    BOOST_CHECK(create_block_txids(false) == std::vector<uint256>({hashes[2], hashes[1]}));
+    BOOST_CHECK(create_block_txids(true) == std::vector<uint256>({hashes[2], hashes[1]}));
+
+    // A lower feerate transaction does not
+    add_tx(txFirst[3]->GetHash(), 500);
+    BOOST_CHECK(create_block_txids(false) == std::vector<uint256>({hashes[2], hashes[1]}));
+
+    // A child paying for its parent replaces both
+    add_tx(hashes[0], 10000, 5000000000LL - 101000);
+    BOOST_CHECK(create_block_txids(false) == std::vector<uint256>({hashes[0], hashes[4]}));
+    BOOST_CHECK(create_block_txids(true) == std::vector<uint256>({hashes[0], hashes[4]}));
+
+    // Removing a selected transaction makes room for others
+    m_node.mempool->removeRecursive(CTransaction(tx), MemPoolRemovalReason::REPLACED);
+    BOOST_CHECK(create_block_txids(false) == std::vector<uint256>({hashes[2], hashes[1]}));
+
+    // Prioritisation discards the selection
+    m_node.mempool->PrioritiseTransaction(hashes[3], 10000);
+    BOOST_CHECK(m_node.mempool->m_template_selection.key.IsNull());
+    BOOST_CHECK(create_block_txids(false) == std::vector<uint256>({hashes[3], hashes[2]}));
+
+    m_node.mempool->PrioritiseTransaction(hashes[3], -10000);
+    m_node.mempool->clear();
+    BOOST_CHECK(m_node.mempool->m_template_selection.key.IsNull());
+
+    // Transactions of the given virtual size and feerate in sat/vB, spending
+    // a coinbase output, padded through the script of their output
+    const auto add_sized_tx = [&](const CTransactionRef& prev, int64_t vsize, CAmount fee_rate) {
+        CMutableTransaction sized_tx;
+        sized_tx.vin.resize(1);
+        sized_tx.vin[0].prevout = COutPoint(prev->GetHash(), 0);
+        sized_tx.vin[0].scriptSig = CScript() << OP_1;
+        sized_tx.vout.resize(1);
+        sized_tx.vout[0].nValue = prev->vout[0].nValue - vsize * fee_rate;
+        for (size_t pad = 1; GetVirtualTransactionSize(CTransaction(sized_tx)) < vsize; ++pad) {
+            const std::vector<unsigned char> ops(pad, OP_1);
+            sized_tx.vout[0].scriptPubKey = CScript(ops.begin(), ops.end());
+        }
+        BOOST_REQUIRE_EQUAL(GetVirtualTransactionSize(CTransaction(sized_tx)), vsize);
+        m_node.mempool->addUnchecked(entry.Fee(vsize * fee_rate).SpendsCoinbase(true).FromTx(sized_tx));
+        return sized_tx.GetHash();
+    };
+
+    // Packages rejected before with a feerate between the ones displaced and
+    // the new one are reconsidered. In units of 200 vbytes, the block has room
+    // for 9.75. P1 (6 units at 10), P2 (3 at 6) and P3 (0.5 at 1) leave out X
+    // (1.5 at 5). N (2 at 9) takes the place of P2 and P3, and leaves room for X.
+    options.nBlockMaxWeight = 4000 + WITNESS_SCALE_FACTOR * 1950;
+    const uint256 p1 = add_sized_tx(txFirst[0], 1200, 1000);
+    const uint256 p2 = add_sized_tx(txFirst[1], 600, 600);
+    const uint256 x = add_sized_tx(txFirst[2], 300, 500);
+    const uint256 p3 = add_sized_tx(txFirst[3], 100, 100);
+    BOOST_CHECK(create_block_txids(false) == std::vector<uint256>({p1, p2, p3}));
+    const uint256 n = add_sized_tx(txFirst[4], 400, 900);
+    BOOST_CHECK(create_block_txids(false) == std::vector<uint256>({p1, n, x}));
+    BOOST_CHECK(create_block_txids(true) == std::vector<uint256>({p1, n, x}));
+    m_node.mempool->clear();
+}
+
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
 BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
 {
@@ -239,7 +341,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
             pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
             if (txFirst.size() == 0)
                 baseheight = m_node.chainman->ActiveChain().Height();
-            if (txFirst.size() < 4)
+            if (txFirst.size() < 5)
                 txFirst.push_back(pblock->vtx[0]);
             pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
             pblock->nNonce = bi.nonce;
@@ -523,6 +625,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     m_node.mempool->clear();
 
     TestPackageSelection(chainparams, scriptPubKey, txFirst);
+    TestIncrementalSelection(chainparams, scriptPubKey, txFirst);
 
     fCheckpointsEnabled = true;
 }
@@ -75,6 +75,7 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
             }
         }
         mpool.removeForBlock(block, ++blocknum);
+        feeEst.SyncWithQueue();
         block.clear();
         // Check after just a few txs that combining buckets works as expected
         if (blocknum == 3) {
@@ -114,6 +115,7 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     // We haven't decayed the moving average enough so we still have enough data points in every bucket
     while (blocknum < 250)
         mpool.removeForBlock(block, ++blocknum);
+    feeEst.SyncWithQueue();
 
     BOOST_CHECK(feeEst.estimateFee(1) == CFeeRate(0));
     for (int i = 2; i < 10;i++) {
@@ -134,6 +136,7 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
             }
         }
         mpool.removeForBlock(block, ++blocknum);
+        feeEst.SyncWithQueue();
     }
 
     for (int i = 1; i < 10;i++) {
@@ -151,6 +154,7 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
         }
     }
     mpool.removeForBlock(block, 266);
+    feeEst.SyncWithQueue();
     block.clear();
     BOOST_CHECK(feeEst.estimateFee(1) == CFeeRate(0));
     for (int i = 2; i < 10;i++) {
@@ -172,6 +176,7 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
             }
         }
         mpool.removeForBlock(block, ++blocknum);
+        feeEst.SyncWithQueue();
         block.clear();
     }
     BOOST_CHECK(feeEst.estimateFee(1) == CFeeRate(0));
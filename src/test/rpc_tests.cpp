@@ -2,17 +2,22 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chainparams.h>
 #include <rpc/client.h>
+#include <rpc/json.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 
 #include <core_io.h>
 #include <interfaces/chain.h>
+#include <node/blockstorage.h>
 #include <node/context.h>
 #include <test/util/setup_common.h>
 #include <util/time.h>
+#include <validation.h>
 
 #include <any>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
@@ -247,6 +252,146 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK_THROW(ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL"), std::runtime_error);
 }
 
+BOOST_AUTO_TEST_CASE(json_stream_writer)
+{
+    UniValue expected(UniValue::VOBJ);
+    expected.pushKV("a\"b", 1);
+    UniValue arr(UniValue::VARR);
+    for (int i = 0; i < 20000; ++i) arr.push_back(strprintf("element %d", i));
+    arr.push_back(UniValue(UniValue::VOBJ));
+    arr.push_back(UniValue(UniValue::VARR));
+    expected.pushKV("arr", arr);
+    expected.pushKV("null", NullUniValue);
+
+    std::vector<std::string> chunks;
+    JSONStreamWriter out([&](std::string&& chunk) { chunks.push_back(std::move(chunk)); });
+    BOOST_CHECK(out.empty());
+    out.BeginObject();
+    out.Key("a\"b");
+    out.Value(1);
+    out.Key("arr");
+    out.BeginArray();
+    for (size_t i = 0; i + 2 < arr.size(); ++i) out.Value(arr[i]);
+    out.BeginObject();
+    out.EndObject();
+    out.Value(UniValue(UniValue::VARR));
+    out.EndArray();
+    UniValue pairs(UniValue::VOBJ);
+    pairs.pushKV("null", NullUniValue);
+    out.Pairs(pairs);
+    out.EndObject();
+    out.Flush();
+    BOOST_CHECK(!out.empty());
+
+    // The output is passed on in chunks while it is written
+    BOOST_CHECK(chunks.size() > 1);
+    for (size_t i = 0; i + 1 < chunks.size(); ++i) {
+        BOOST_CHECK(chunks[i].size() >= JSONStreamWriter::CHUNK_SIZE);
+    }
+    std::string written;
+    for (const std::string& chunk : chunks) written += chunk;
+    BOOST_CHECK_EQUAL(written, expected.write());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_getblock_stream)
+{
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return m_node.chainman->ActiveChain().Tip());
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, tip, Params().GetConsensus()));
+
+    for (bool tx_details : {false, true}) {
+        std::string written;
+        JSONStreamWriter out([&](std::string&& chunk) { written += chunk; });
+        blockToJSON(out, block, tip, tip, tx_details);
+        out.Flush();
+        BOOST_CHECK_EQUAL(written, blockToJSON(block, tip, tip, tx_details).write());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpc_json_parse_write)
+{
+    const std::string long_str(100, 'x');
+    const std::vector<std::string> valid{
+        "null", "true", "false", "0", "-0", "1.5e-3", "-12E+4", " \t\r\n[ ] ", "{}",
+        "\"\"", "\"" + long_str + "\\\"" + long_str + "\\\\\\/\\b\\f\\n\\r\\t\"",
+        "\"\\u0000\\u001f\\u007F\\u00e9\\ud834\\udd1e\\ud834x\\udd1e\"", "\"\xc3\xa9\xf0\x9d\x84\x9e\x7f\"",
+        "[1,\"a\",[],{},[[null]],{\"x\":{\"y\":[true,false]}}]",
+        "{\"a\":1,\"a\":2,\"" + long_str + "\":\"" + long_str + "\"}",
+        std::string(512, '[') + std::string(512, ']'),
+    };
+    for (const std::string& json : valid) {
+        UniValue expected;
+        BOOST_REQUIRE(expected.read(json));
+        UniValue parsed;
+        BOOST_CHECK(ParseJSON(json, parsed));
+        std::string written;
+        WriteJSON(parsed, written);
+        BOOST_CHECK_EQUAL(written, expected.write());
+    }
+
+    const std::vector<std::string> invalid{
+        "", " ", "[1,]", "{\"a\":1,}", "[,1]", "{,}", "01", "1.", "1e", "+1", "[1 2]", "[1:2]",
+        "{\"a\" 1}", "{\"a\":1 \"b\":2}", "{1:2}", "\"abc", "\"\\x\"", "\"\\u12\"", "\"\x01\"",
+        "\"\xc3\"", "\"\x80\"", "\"\xf8\"", "\"\\ud834\"", "\"\\udd1e\"", "\"\\ud834\\u0041\"",
+        "nul", "truex", "[1]]", "]", ":", "\"a\":1", "[1] [2]",
+        std::string(513, '[') + std::string(513, ']'),
+    };
+    for (const std::string& json : invalid) {
+        UniValue expected;
+        BOOST_CHECK(!expected.read(json));
+        UniValue parsed{"unchanged"};
+        BOOST_CHECK(!ParseJSON(json, parsed));
+        BOOST_CHECK_EQUAL(parsed.get_str(), "unchanged");
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("tx", long_str);
+    UniValue error(UniValue::VOBJ);
+    error.pushKV("code", -1);
+    for (const UniValue& id : {UniValue{}, UniValue{7}, UniValue{"id"}}) {
+        BOOST_CHECK_EQUAL(JSONRPCReply(result, NullUniValue, id), JSONRPCReplyObj(result, NullUniValue, id).write() + "\n");
+        BOOST_CHECK_EQUAL(JSONRPCReply(result, error, id), JSONRPCReplyObj(result, error, id).write() + "\n");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_concurrent)
+{
+    if (RPCIsInWarmup(nullptr)) SetRPCWarmupFinished();
+    JSONRPCRequest jreq;
+    jreq.context = &m_node;
+
+    const std::string genesis_hash = Params().GenesisBlock().GetHash().GetHex();
+    UniValue batch(UniValue::VARR);
+    int id = 0;
+    for (int i = 0; i < 50; ++i) {
+        batch.push_back(JSONRPCRequestObj("getblockhash", RPCConvertValues("getblockhash", {"0"}), id++));
+        batch.push_back(JSONRPCRequestObj("getblockheader", RPCConvertValues("getblockheader", {genesis_hash}), id++));
+        // Calls to other methods, and failing calls, are kept in order
+        if (i % 10 == 0) batch.push_back(JSONRPCRequestObj("getblockhash", RPCConvertValues("getblockhash", {"1"}), id++));
+        if (i % 20 == 0) batch.push_back(JSONRPCRequestObj("setmocktime", RPCConvertValues("setmocktime", {"0"}), id++));
+    }
+
+    std::vector<std::thread> threads;
+    size_t tasks = 0;
+    const auto run_task = [&](std::function<void()> task) {
+        threads.emplace_back(std::move(task));
+        ++tasks;
+        return true;
+    };
+    const std::string concurrent = JSONRPCExecBatch(jreq, batch, run_task, 3);
+    for (std::thread& thread : threads) thread.join();
+    BOOST_CHECK(tasks > 0);
+    BOOST_CHECK_EQUAL(concurrent, JSONRPCExecBatch(jreq, batch));
+
+    UniValue replies;
+    BOOST_REQUIRE(replies.read(concurrent));
+    BOOST_REQUIRE_EQUAL(replies.size(), batch.size());
+    for (size_t i = 0; i < replies.size(); ++i) {
+        BOOST_CHECK_EQUAL(find_value(replies[i], "id").get_int(), (int)i);
+    }
+    BOOST_CHECK_EQUAL(find_value(replies[0], "result").get_str(), genesis_hash);
+}
+
 BOOST_AUTO_TEST_CASE(rpc_ban)
 {
     BOOST_CHECK_NO_THROW(CallRPC(std::string("clearbanned")));
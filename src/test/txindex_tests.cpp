@@ -3,8 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <clientversion.h>
 #include <index/txindex.h>
+#include <node/blockstorage.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
+#include <streams.h>
 #include <test/util/setup_common.h>
 #include <util/time.h>
 #include <validation.h>
@@ -75,4 +79,49 @@ BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup)
     SyncWithValidationInterfaceQueue();
 }
 
+BOOST_FIXTURE_TEST_CASE(txindex_compressed_blocks, TestChain100Setup)
+{
+    // A transaction with many identical outputs, so that its block compresses
+    const CScript p2pk = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction fan_out;
+    fan_out.vin.emplace_back(COutPoint(m_coinbase_txns[0]->GetHash(), 0));
+    for (int n = 0; n < 100; ++n) {
+        fan_out.vout.emplace_back(m_coinbase_txns[0]->vout[0].nValue / 200, CScript() << OP_TRUE);
+    }
+    std::vector<unsigned char> sig;
+    BOOST_REQUIRE(coinbaseKey.Sign(SignatureHash(p2pk, fan_out, 0, SIGHASH_ALL, 0, SigVersion::BASE), sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    fan_out.vin[0].scriptSig << sig;
+
+    g_block_compression = BlockCompression::ZLIB;
+    const CBlock block = CreateAndProcessBlock({fan_out}, p2pk);
+    g_block_compression = BlockCompression::NONE;
+
+    FlatFilePos pos = WITH_LOCK(cs_main, return m_node.chainman->ActiveTip()->GetBlockPos());
+    pos.nPos -= 4;
+    uint32_t size_field;
+    CAutoFile(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION) >> size_field;
+    BOOST_REQUIRE_EQUAL(size_field >> BLOCK_RECORD_COMPRESSION_SHIFT, uint8_t(BlockCompression::ZLIB));
+
+    TxIndex txindex(1 << 20, true);
+    BOOST_REQUIRE(txindex.Start(m_node.chainman->ActiveChainstate()));
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!txindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    for (const auto& txn : block.vtx) {
+        CTransactionRef tx_disk;
+        uint256 block_hash;
+        BOOST_REQUIRE(txindex.FindTx(txn->GetHash(), block_hash, tx_disk));
+        BOOST_CHECK_EQUAL(tx_disk->GetHash(), txn->GetHash());
+        BOOST_CHECK_EQUAL(block_hash, block.GetHash());
+    }
+
+    txindex.Stop();
+    SyncWithValidationInterfaceQueue();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
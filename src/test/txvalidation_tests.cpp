@@ -145,4 +145,56 @@ BOOST_FIXTURE_TEST_CASE(package_tests, TestChain100Setup)
     // Check that mempool size hasn't changed.
     BOOST_CHECK_EQUAL(m_node.mempool->size(), initialPoolSize);
 }
+
+BOOST_FIXTURE_TEST_CASE(preverify_scripts_tests, TestChain100Setup)
+{
+    const CScript output_script = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    // Make the first three coinbase outputs spendable
+    for (int i = 0; i < 2; ++i) {
+        CreateAndProcessBlock({}, output_script);
+    }
+    auto make_tx = [&](const CTransactionRef& input, CAmount output_amount) {
+        return CreateValidMempoolTransaction(/* input_transaction */ input, /* vout */ 0, /* input_height */ 0,
+                                             /* input_signing_key */ coinbaseKey, /* output_destination */ output_script,
+                                             /* output_amount */ output_amount, /* submit */ false);
+    };
+    CTransactionRef tx_a = MakeTransactionRef(make_tx(m_coinbase_txns[0], 49 * COIN));
+    CTransactionRef tx_b = MakeTransactionRef(make_tx(m_coinbase_txns[1], 49 * COIN));
+    // Spends an output of tx_a, so it is left to AcceptToMemoryPool()
+    CTransactionRef tx_child = MakeTransactionRef(make_tx(tx_a, 48 * COIN));
+    // Its signature no longer matches
+    CMutableTransaction mtx_bad = make_tx(m_coinbase_txns[2], 49 * COIN);
+    mtx_bad.vin[0].scriptSig[10] ^= 1;
+    CTransactionRef tx_bad = MakeTransactionRef(mtx_bad);
+    // Pays no fee, so its scripts are not worth checking
+    CMutableTransaction mtx_free = make_tx(m_coinbase_txns[2], 50 * COIN);
+    mtx_free.vin[0].scriptSig[10] ^= 1;
+    CTransactionRef tx_free = MakeTransactionRef(mtx_free);
+
+    const auto rejects = PreverifyTransactionScripts(m_node.chainman->ActiveChainstate(), *m_node.mempool, {tx_a, tx_b, tx_bad, tx_child, tx_free});
+    BOOST_CHECK_EQUAL(rejects.size(), 1U);
+    const auto it_bad = rejects.find(tx_bad->GetWitnessHash());
+    BOOST_REQUIRE(it_bad != rejects.end());
+    BOOST_CHECK(it_bad->second.GetResult() == TxValidationResult::TX_CONSENSUS);
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+
+    LOCK(cs_main);
+    for (const CTransactionRef& tx : {tx_a, tx_b, tx_child}) {
+        const MempoolAcceptResult result = AcceptToMemoryPool(m_node.chainman->ActiveChainstate(), *m_node.mempool, tx, /* bypass_limits */ false);
+        BOOST_CHECK_MESSAGE(result.m_result_type == MempoolAcceptResult::ResultType::VALID, result.m_state.GetRejectReason());
+    }
+    // The rejection is the one AcceptToMemoryPool() finds
+    const MempoolAcceptResult result_bad = AcceptToMemoryPool(m_node.chainman->ActiveChainstate(), *m_node.mempool, tx_bad, /* bypass_limits */ false);
+    BOOST_CHECK(result_bad.m_state.GetResult() == TxValidationResult::TX_CONSENSUS);
+    BOOST_CHECK_EQUAL(result_bad.m_state.GetRejectReason(), it_bad->second.GetRejectReason());
+    // Passed on to AcceptToMemoryPool(), it is reported once the other checks pass
+    const MempoolAcceptResult result_known = AcceptToMemoryPool(m_node.chainman->ActiveChainstate(), *m_node.mempool, tx_bad, /* bypass_limits */ false,
+                                                                /* test_accept */ false, /* script_failure */ &it_bad->second);
+    BOOST_CHECK_EQUAL(result_known.m_state.GetRejectReason(), it_bad->second.GetRejectReason());
+    // A transaction failing the other checks is rejected for those instead
+    const MempoolAcceptResult result_dup = AcceptToMemoryPool(m_node.chainman->ActiveChainstate(), *m_node.mempool, tx_a, /* bypass_limits */ false,
+                                                              /* test_accept */ false, /* script_failure */ &it_bad->second);
+    BOOST_CHECK_EQUAL(result_dup.m_state.GetRejectReason(), "txn-already-in-mempool");
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 3U);
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include <consensus/validation.h>
 #include <key.h>
+#include <script/sigcache.h>
 #include <script/sign.h>
 #include <script/signingprovider.h>
 #include <script/standard.h>
@@ -16,7 +17,7 @@
 bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
                        const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore,
                        bool cacheFullScriptStore, PrecomputedTransactionData& txdata,
-                       std::vector<CScriptCheck>* pvChecks) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+                       std::vector<CScriptCheck>* pvChecks);
 
 BOOST_AUTO_TEST_SUITE(txvalidationcache_tests)
 
@@ -374,4 +375,58 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(script_cache_persist, TestChain100Setup)
+{
+    // Test that script cache entries survive a dump and reload, even though
+    // the caches were re-salted in between.
+    CScript p2pk_scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend_tx;
+    spend_tx.nVersion = 1;
+    spend_tx.vin.resize(1);
+    spend_tx.vin[0].prevout.hash = m_coinbase_txns[0]->GetHash();
+    spend_tx.vin[0].prevout.n = 0;
+    spend_tx.vout.resize(1);
+    spend_tx.vout[0].nValue = 17*CENT; // not signed by any other test case
+    spend_tx.vout[0].scriptPubKey = p2pk_scriptPubKey;
+    {
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(p2pk_scriptPubKey, spend_tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spend_tx.vin[0].scriptSig << vchSig;
+    }
+    const CTransaction tx(spend_tx);
+    const unsigned int flags = SCRIPT_VERIFY_P2SH;
+
+    LOCK(cs_main);
+    const CCoinsViewCache& coins = m_node.chainman->ActiveChainstate().CoinsTip();
+    // Asking for script checks returns none on a script execution cache hit.
+    const auto cache_hit = [&]() EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+        TxValidationState state;
+        PrecomputedTransactionData txdata;
+        std::vector<CScriptCheck> scriptchecks;
+        BOOST_CHECK(CheckInputScripts(tx, state, coins, flags, true, true, txdata, &scriptchecks));
+        return scriptchecks.empty();
+    };
+
+    {
+        TxValidationState state;
+        PrecomputedTransactionData txdata;
+        BOOST_CHECK(CheckInputScripts(tx, state, coins, flags, true, true, txdata, nullptr));
+    }
+    BOOST_CHECK(cache_hit());
+    const size_t sig_entries = GetSignatureCacheSnapshot().entries.size();
+    BOOST_CHECK(sig_entries > 0);
+    BOOST_CHECK(DumpScriptCaches(fsbridge::fopen, /* skip_file_commit = */ true));
+
+    // A new salt makes every previous entry unreachable.
+    InitScriptExecutionCache();
+    BOOST_CHECK(!cache_hit());
+
+    BOOST_CHECK(LoadScriptCaches());
+    BOOST_CHECK(cache_hit());
+    BOOST_CHECK_EQUAL(GetSignatureCacheSnapshot().entries.size(), sig_entries);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -13,6 +13,7 @@
 #include <test/util/str.h>
 #include <uint256.h>
 #include <util/getuniquepath.h>
+#include <util/lrucache.h>
 #include <util/message.h> // For MessageSign(), MessageVerify(), MESSAGE_MAGIC
 #include <util/moneystr.h>
 #include <util/spanparsing.h>
@@ -2306,6 +2307,37 @@ BOOST_AUTO_TEST_CASE(message_hash)
     BOOST_CHECK_NE(message_hash1, signature_hash);
 }
 
+BOOST_AUTO_TEST_CASE(lru_cache)
+{
+    LRUCache<int, std::string> cache(/* max_cost */ 3);
+    cache.Put(1, "one");
+    cache.Put(2, "two");
+    cache.Put(3, "three");
+    BOOST_CHECK_EQUAL(cache.Size(), 3U);
+
+    // Using 1 makes 2 the least recently used entry, which is dropped first
+    BOOST_CHECK_EQUAL(*cache.Get(1), "one");
+    cache.Put(4, "four");
+    BOOST_CHECK(cache.Get(2) == nullptr);
+    BOOST_CHECK_EQUAL(*cache.Get(1), "one");
+    BOOST_CHECK_EQUAL(*cache.Get(3), "three");
+    BOOST_CHECK_EQUAL(*cache.Get(4), "four");
+
+    // Replacing an entry updates its cost, and entries are dropped until
+    // the total cost fits again
+    cache.Put(4, "FOUR", 2);
+    BOOST_CHECK_EQUAL(cache.Cost(), 3U);
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    BOOST_CHECK(cache.Get(1) == nullptr);
+    BOOST_CHECK_EQUAL(*cache.Get(4), "FOUR");
+
+    // An entry costing more than the maximum is not kept
+    cache.Put(5, "five", 4);
+    BOOST_CHECK(cache.Get(5) == nullptr);
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+    BOOST_CHECK_EQUAL(cache.Cost(), 0U);
+}
+
 BOOST_AUTO_TEST_CASE(remove_prefix)
 {
     BOOST_CHECK_EQUAL(RemovePrefix("./util/system.h", "./"), "util/system.h");
@@ -4,9 +4,11 @@
 //
 #include <chainparams.h>
 #include <consensus/validation.h>
+#include <node/coinstats.h>
 #include <node/utxo_snapshot.h>
 #include <random.h>
 #include <rpc/blockchain.h>
+#include <streams.h>
 #include <sync.h>
 #include <test/util/setup_common.h>
 #include <uint256.h>
@@ -168,6 +170,30 @@ BOOST_AUTO_TEST_CASE(chainstatemanager_rebalance_caches)
     BOOST_CHECK_CLOSE(c2.m_coinsdb_cache_size_bytes, max_cache * 0.95, 1);
 }
 
+//! Test that files of another format or version are not read as snapshots.
+BOOST_AUTO_TEST_CASE(snapshot_metadata_version)
+{
+    SnapshotMetadata metadata{uint256::ONE, 5, 0};
+    metadata.m_chunks.resize(SNAPSHOT_CHUNKS);
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << metadata;
+
+    SnapshotMetadata read;
+    CDataStream(stream) >> read;
+    BOOST_CHECK_EQUAL(read.m_base_blockhash, uint256::ONE);
+    BOOST_CHECK_EQUAL(read.m_coins_count, 5U);
+    BOOST_CHECK_EQUAL(read.m_chunks.size(), SNAPSHOT_CHUNKS);
+
+    // Snapshots written before the format was chunked start with the base
+    // block hash and coins count.
+    CDataStream unchunked(SER_DISK, CLIENT_VERSION);
+    unchunked << uint256::ONE << uint64_t{5};
+    BOOST_CHECK_EXCEPTION(unchunked >> read, std::ios_base::failure, HasReason("Not a UTXO snapshot"));
+
+    stream[sizeof(SNAPSHOT_MAGIC_BYTES)] = 2;
+    BOOST_CHECK_EXCEPTION(stream >> read, std::ios_base::failure, HasReason("Unsupported UTXO snapshot version 2"));
+}
+
 auto NoMalleation = [](CAutoFile& file, SnapshotMetadata& meta){};
 
 template<typename F = decltype(NoMalleation)>
@@ -186,6 +212,13 @@ CreateAndActivateUTXOSnapshot(NodeContext& node, const fs::path root, F malleati
     BOOST_TEST_MESSAGE(
         "Wrote UTXO snapshot to " << snapshot_path.make_preferred().string() << ": " << result.write());
 
+    // The MuHash combined from the chunks is that of the whole UTXO set.
+    CCoinsStats stats{CoinStatsHashType::MUHASH};
+    CChainState& chainstate = node.chainman->ActiveChainstate();
+    BOOST_REQUIRE(GetUTXOStats(&chainstate.CoinsDB(), chainstate.m_blockman, stats, node.rpc_interruption_point));
+    BOOST_CHECK_EQUAL(result["muhash"].get_str(), stats.hashSerialized.GetHex());
+    BOOST_CHECK_EQUAL(result["coins_written"].get_int64(), int64_t(stats.coins_count));
+
     // Read the written snapshot in and then activate it.
     //
     FILE* infile{fsbridge::fopen(snapshot_path, "rb")};
@@ -238,14 +271,20 @@ BOOST_FIXTURE_TEST_CASE(chainstatemanager_activate_snapshot, TestChain100Setup)
     // Should not load malleated snapshots
     BOOST_REQUIRE(!CreateAndActivateUTXOSnapshot(
         m_node, m_path_root, [](CAutoFile& auto_infile, SnapshotMetadata& metadata) {
-            // A UTXO is missing but count is correct
+            // A UTXO is missing but counts are correct
             metadata.m_coins_count -= 1;
-
-            COutPoint outpoint;
-            Coin coin;
-
-            auto_infile >> outpoint;
-            auto_infile >> coin;
+            for (SnapshotChunk& chunk : metadata.m_chunks) {
+                if (chunk.m_coins_count > 0) {
+                    chunk.m_coins_count -= 1;
+                    break;
+                }
+            }
+    }));
+    BOOST_REQUIRE(!CreateAndActivateUTXOSnapshot(
+        m_node, m_path_root, [](CAutoFile& auto_infile, SnapshotMetadata& metadata) {
+            // Chunk counts too large for their data, whose sum wraps around to the right count
+            metadata.m_chunks.at(0).m_coins_count += std::numeric_limits<uint64_t>::max() / 2 + 1;
+            metadata.m_chunks.at(1).m_coins_count += std::numeric_limits<uint64_t>::max() / 2 + 1;
     }));
     BOOST_REQUIRE(!CreateAndActivateUTXOSnapshot(
         m_node, m_path_root, [](CAutoFile& auto_infile, SnapshotMetadata& metadata) {
@@ -257,6 +296,30 @@ BOOST_FIXTURE_TEST_CASE(chainstatemanager_activate_snapshot, TestChain100Setup)
             // Coins count is smaller than coins in file
             metadata.m_coins_count -= 1;
     }));
+    BOOST_REQUIRE(!CreateAndActivateUTXOSnapshot(
+        m_node, m_path_root, [](CAutoFile& auto_infile, SnapshotMetadata& metadata) {
+            // Chunks swapped
+            std::vector<SnapshotChunk*> chunks;
+            for (SnapshotChunk& chunk : metadata.m_chunks) {
+                if (chunk.m_coins_count > 0) chunks.push_back(&chunk);
+            }
+            std::swap(*chunks.at(0), *chunks.at(1));
+    }));
+    BOOST_REQUIRE(!CreateAndActivateUTXOSnapshot(
+        m_node, m_path_root, [](CAutoFile& auto_infile, SnapshotMetadata& metadata) {
+            // Chunk does not match its hash
+            for (SnapshotChunk& chunk : metadata.m_chunks) {
+                if (chunk.m_coins_count > 0) {
+                    chunk.m_hash = uint256::ONE;
+                    break;
+                }
+            }
+    }));
+    BOOST_REQUIRE(!CreateAndActivateUTXOSnapshot(
+        m_node, m_path_root, [](CAutoFile& auto_infile, SnapshotMetadata& metadata) {
+            // Chunk missing
+            metadata.m_chunks.pop_back();
+    }));
     BOOST_REQUIRE(!CreateAndActivateUTXOSnapshot(
         m_node, m_path_root, [](CAutoFile& auto_infile, SnapshotMetadata& metadata) {
             // Wrong hash
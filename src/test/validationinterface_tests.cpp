@@ -10,6 +10,10 @@
 #include <util/check.h>
 #include <validationinterface.h>
 
+#include <chrono>
+#include <future>
+#include <numeric>
+
 BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, TestingSetup)
 
 struct TestSubscriberNoop final : public CValidationInterface {
@@ -91,4 +95,56 @@ BOOST_AUTO_TEST_CASE(unregister_all_during_call)
     BOOST_CHECK(destroyed);
 }
 
+class RecordingInterface : public CValidationInterface
+{
+public:
+    explicit RecordingInterface(std::function<void()> on_call = nullptr) : m_on_call(std::move(on_call)) {}
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override
+    {
+        if (m_on_call) m_on_call();
+        LOCK(m_mutex);
+        m_sequences.push_back(mempool_sequence);
+    }
+    std::vector<uint64_t> Sequences()
+    {
+        LOCK(m_mutex);
+        return m_sequences;
+    }
+    std::function<void()> m_on_call;
+    Mutex m_mutex;
+    std::vector<uint64_t> m_sequences GUARDED_BY(m_mutex);
+};
+
+// A subscriber blocked in a callback must not hold back the others, and each
+// subscriber must still see the events in order.
+BOOST_AUTO_TEST_CASE(slow_subscriber_does_not_delay_others)
+{
+    std::promise<void> release;
+    std::shared_future<void> released{release.get_future()};
+    auto slow = std::make_shared<RecordingInterface>([released] { released.wait(); });
+    auto fast = std::make_shared<RecordingInterface>();
+    RegisterSharedValidationInterface(slow);
+    RegisterSharedValidationInterface(fast);
+
+    std::vector<uint64_t> expected(100);
+    std::iota(expected.begin(), expected.end(), 0);
+    const CTransactionRef tx{MakeTransactionRef(CMutableTransaction{})};
+    for (uint64_t sequence : expected) GetMainSignals().TransactionAddedToMempool(tx, sequence);
+
+    std::promise<void> fast_done;
+    CallFunctionInValidationInterfaceQueue(*fast, [&] { fast_done.set_value(); });
+    const bool fast_finished{fast_done.get_future().wait_for(std::chrono::seconds{30}) == std::future_status::ready};
+    BOOST_CHECK(fast_finished);
+    BOOST_CHECK(fast->Sequences() == expected);
+    BOOST_CHECK(slow->Sequences().empty());
+
+    release.set_value();
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(slow->Sequences() == expected);
+    BOOST_CHECK(GetMainSignals().CallbacksPending() == 0);
+
+    UnregisterSharedValidationInterface(slow);
+    UnregisterSharedValidationInterface(fast);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,16 +5,24 @@
 
 #include <txdb.h>
 
+#include <flatcoins.h>
 #include <node/ui_interface.h>
 #include <pow.h>
 #include <random.h>
 #include <shutdown.h>
 #include <uint256.h>
+#include <sync.h>
 #include <util/system.h>
+#include <util/thread.h>
+#include <util/time.h>
 #include <util/translation.h>
 #include <util/vector.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
 #include <stdint.h>
+#include <thread>
 
 static constexpr uint8_t DB_COIN{'C'};
 static constexpr uint8_t DB_COINS{'c'};
@@ -39,8 +47,197 @@ struct CoinEntry {
 
 }
 
+CoinsBackend g_coins_backend{CoinsBackend::LEVELDB};
+
+std::optional<CoinsBackend> ParseCoinsBackend(const std::string& name)
+{
+    if (name == "leveldb") return CoinsBackend::LEVELDB;
+    if (name == "flatfile") return CoinsBackend::FLATFILE;
+    return std::nullopt;
+}
+
+std::string CoinsBackendName(CoinsBackend backend)
+{
+    switch (backend) {
+    case CoinsBackend::LEVELDB: return "leveldb";
+    case CoinsBackend::FLATFILE: return "flatfile";
+    } // no default case, so the compiler can warn about missing cases
+    return "unknown";
+}
+
+fs::path GetCoinsDBPath(const fs::path& datadir, const std::string& name, CoinsBackend backend)
+{
+    switch (backend) {
+    case CoinsBackend::LEVELDB: return datadir / name;
+    case CoinsBackend::FLATFILE: return datadir / (name + "_flat");
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
+std::unique_ptr<CCoinsViewDisk> MakeCoinsView(CoinsBackend backend, const fs::path& path, size_t cache_size, bool in_memory, bool wipe)
+{
+    if (backend == CoinsBackend::FLATFILE && !in_memory) {
+        return std::make_unique<CCoinsViewFlatFile>(path, wipe);
+    }
+    return std::make_unique<CCoinsViewDB>(path, cache_size, in_memory, wipe);
+}
+
+bool ConvertCoinsDB(const fs::path& datadir, const std::string& name, CoinsBackend from, CoinsBackend to, size_t cache_size, std::string& error)
+{
+    // Coins per BatchWrite
+    static constexpr size_t CONVERT_BATCH_SIZE{1000000};
+
+    const fs::path from_path = GetCoinsDBPath(datadir, name, from);
+    const fs::path to_path = GetCoinsDBPath(datadir, name, to);
+    const fs::path tmp_path = to_path.string() + ".tmp";
+    if (from == to || !fs::exists(from_path)) {
+        error = strprintf("There is no %s chainstate in %s to convert", CoinsBackendName(from), from_path.string());
+        return false;
+    }
+    if (fs::exists(to_path)) {
+        error = strprintf("%s already exists", to_path.string());
+        return false;
+    }
+
+    LogPrintf("Converting chainstate from %s to %s\n", CoinsBackendName(from), CoinsBackendName(to));
+    const int64_t start = GetTimeMillis();
+    bool interrupted{false};
+    {
+        const auto source = MakeCoinsView(from, from_path, cache_size, /* in_memory */ false, /* wipe */ false);
+        const auto dest = MakeCoinsView(to, tmp_path, cache_size, /* in_memory */ false, /* wipe */ true);
+        const uint256 best_block = source->GetBestBlock();
+        if (best_block.IsNull() || !source->GetHeadBlocks().empty()) {
+            error = "The chainstate is empty or was not shut down cleanly; start and stop the node once before converting it";
+            return false;
+        }
+
+        CCoinsMap coins;
+        size_t count{0};
+        for (auto cursor = source->Cursor(); cursor->Valid(); cursor->Next()) {
+            if (ShutdownRequested()) {
+                interrupted = true;
+                break;
+            }
+            COutPoint outpoint;
+            CCoinsCacheEntry entry;
+            if (!cursor->GetKey(outpoint) || !cursor->GetValue(entry.coin)) {
+                error = "Unable to read the chainstate";
+                return false;
+            }
+            entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+            coins.emplace(outpoint, std::move(entry));
+            if (coins.size() == CONVERT_BATCH_SIZE) {
+                count += coins.size();
+                dest->BatchWrite(coins, best_block);
+                coins.clear();
+                LogPrintf("Converted %u coins\n", count);
+            }
+        }
+        if (!interrupted) {
+            count += coins.size();
+            dest->BatchWrite(coins, best_block);
+            LogPrintf("Converted %u coins in %ds\n", count, (GetTimeMillis() - start) / 1000);
+        }
+    }
+    if (interrupted) {
+        // The next conversion starts over
+        fs::remove_all(tmp_path);
+        error = "Chainstate conversion interrupted";
+        return false;
+    }
+    // Only give the result its real name once it is complete.
+    fs::rename(tmp_path, to_path);
+    LogPrintf("The %s chainstate in %s is no longer used and may be removed\n", CoinsBackendName(from), from_path.string());
+    return true;
+}
+
+namespace {
+/** Runs the scans of ScanCoins() on worker threads, a bounded number of ranges ahead of the merges. */
+class CoinsScanner
+{
+public:
+    CoinsScanner(std::vector<std::unique_ptr<CCoinsViewCursor>> cursors, const std::function<void(size_t, CCoinsViewCursor&)>& scan)
+        : m_cursors(std::move(cursors)), m_scan(scan), m_scanned(m_cursors.size(), false)
+    {
+        const int n_threads = std::clamp(GetNumCores(), 1, MAX_COINS_SCAN_THREADS);
+        m_window = 2 * n_threads;
+        for (int i = 0; i < n_threads; ++i) {
+            m_threads.emplace_back([this, i] {
+                util::TraceThread(strprintf("coinscan.%i", i).c_str(), [&] { ThreadScan(); });
+            });
+        }
+    }
+
+    ~CoinsScanner()
+    {
+        WITH_LOCK(m_mutex, m_interrupt = true);
+        m_cond.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    /** Wait until range index is scanned, and let the threads scan past it. Rethrows errors of the threads. */
+    void WaitScanned(size_t index)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_scanned[index] || m_error; });
+        if (m_error) std::rethrow_exception(m_error);
+        m_next_merge = index + 1;
+        m_cond.notify_all();
+    }
+
+private:
+    std::vector<std::unique_ptr<CCoinsViewCursor>> m_cursors;
+    const std::function<void(size_t, CCoinsViewCursor&)>& m_scan;
+    std::vector<std::thread> m_threads;
+    size_t m_window;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    size_t m_next_scan GUARDED_BY(m_mutex){0};
+    size_t m_next_merge GUARDED_BY(m_mutex){0};
+    std::vector<bool> m_scanned GUARDED_BY(m_mutex);
+    bool m_interrupt GUARDED_BY(m_mutex){false};
+    std::exception_ptr m_error GUARDED_BY(m_mutex);
+
+    void ThreadScan()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (true) {
+            m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+                return m_interrupt || m_error || m_next_scan == m_cursors.size() || m_next_scan < m_next_merge + m_window;
+            });
+            if (m_interrupt || m_error || m_next_scan == m_cursors.size()) return;
+            const size_t index = m_next_scan++;
+            try {
+                REVERSE_LOCK(lock);
+                m_scan(index, *m_cursors[index]);
+                // Let go of what the cursor holds on to as soon as possible
+                m_cursors[index].reset();
+            } catch (...) {
+                m_error = std::current_exception();
+            }
+            m_scanned[index] = true;
+            m_cond.notify_all();
+        }
+    }
+};
+} // namespace
+
+void ScanCoins(std::vector<std::unique_ptr<CCoinsViewCursor>> cursors,
+               const std::function<void(size_t, CCoinsViewCursor&)>& scan, const std::function<void(size_t)>& merge)
+{
+    const size_t n_ranges = cursors.size();
+    CoinsScanner scanner(std::move(cursors), scan);
+    for (size_t index = 0; index < n_ranges; ++index) {
+        scanner.WaitScanned(index);
+        merge(index);
+    }
+}
+
 CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe) :
-    m_db(std::make_unique<CDBWrapper>(ldb_path, nCacheSize, fMemory, fWipe, true)),
+    m_db(std::make_unique<CDBWrapper>(ldb_path, nCacheSize, fMemory, fWipe, true, GetDBOptions(gArgs, "chainstate"))),
     m_ldb_path(ldb_path),
     m_is_memory(fMemory) { }
 
@@ -53,7 +250,7 @@ void CCoinsViewDB::ResizeCache(size_t new_cache_size)
         // filesystem lock.
         m_db.reset();
         m_db = std::make_unique<CDBWrapper>(
-            m_ldb_path, new_cache_size, m_is_memory, /*fWipe*/ false, /*obfuscate*/ true);
+            m_ldb_path, new_cache_size, m_is_memory, /*fWipe*/ false, /*obfuscate*/ true, GetDBOptions(gArgs, "chainstate"));
     }
 }
 
@@ -146,7 +343,7 @@ size_t CCoinsViewDB::EstimateSize() const
     return m_db->EstimateSize(DB_COIN, uint8_t(DB_COIN + 1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.GetDataDirNet() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.GetDataDirNet() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, GetDBOptions(gArgs, "blockindex")) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -174,8 +371,8 @@ class CCoinsViewDBCursor: public CCoinsViewCursor
 public:
     // Prefer using CCoinsViewDB::Cursor() since we want to perform some
     // cache warmup on instantiation.
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256&hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(std::shared_ptr<const leveldb::Snapshot> snapshot, CDBIterator* pcursorIn, const uint256&hashBlockIn, unsigned int end):
+        CCoinsViewCursor(hashBlockIn), m_snapshot(std::move(snapshot)), pcursor(pcursorIn), m_end(end) {}
     ~CCoinsViewDBCursor() {}
 
     bool GetKey(COutPoint &key) const override;
@@ -186,29 +383,55 @@ public:
     void Next() override;
 
 private:
+    //! Must outlive pcursor, which reads from it
+    const std::shared_ptr<const leveldb::Snapshot> m_snapshot;
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
+    //! First byte of the txids past the end of the cursor's range
+    const unsigned int m_end;
+
+    //! Cache the key of the current record, or make sure Valid() and GetKey() return false past the end
+    void CacheKey();
 
     friend class CCoinsViewDB;
 };
 
 std::unique_ptr<CCoinsViewCursor> CCoinsViewDB::Cursor() const
 {
-    auto i = std::make_unique<CCoinsViewDBCursor>(
-        const_cast<CDBWrapper&>(*m_db).NewIterator(), GetBestBlock());
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    i->pcursor->Seek(DB_COIN);
-    // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
+    return std::move(RangeCursors(1).front());
+}
+
+std::vector<std::unique_ptr<CCoinsViewCursor>> CCoinsViewDB::RangeCursors(size_t n) const
+{
+    assert(n >= 1 && n <= 256);
+    const auto snapshot = m_db->GetSnapshot();
+    uint256 best_block;
+    m_db->Read(DB_BEST_BLOCK, best_block, snapshot.get());
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    for (size_t range = 0; range < n; ++range) {
+        /* It seems that there are no "const iterators" for LevelDB.  Since we
+           only need read operations on it, use a const-cast to get around
+           that restriction.  */
+        auto i = std::make_unique<CCoinsViewDBCursor>(
+            snapshot, const_cast<CDBWrapper&>(*m_db).NewIterator(snapshot.get()), best_block, (range + 1) * 256 / n);
+        COutPoint start(uint256(), 0);
+        *start.hash.begin() = range * 256 / n;
+        i->pcursor->Seek(CoinEntry(&start));
+        // Cache key of first record
+        i->CacheKey();
+        cursors.push_back(std::move(i));
+    }
+    return cursors;
+}
+
+void CCoinsViewDBCursor::CacheKey()
+{
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry) || *keyTmp.second.hash.begin() >= m_end) {
+        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
     } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+        keyTmp.first = entry.key;
     }
-    return i;
 }
 
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
@@ -239,12 +462,7 @@ bool CCoinsViewDBCursor::Valid() const
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
-    CoinEntry entry(&keyTmp.second);
-    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
-        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
-    } else {
-        keyTmp.first = entry.key;
-    }
+    CacheKey();
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -11,7 +11,9 @@
 #include <chain.h>
 #include <primitives/block.h>
 
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -42,8 +44,72 @@ static const int64_t nMaxCoinsDBCache = 8;
 // Actually declared in validation.cpp; can't include because of circular dependency.
 extern RecursiveMutex cs_main;
 
+/** Storage engines for the coins of a chainstate, see -coinsbackend */
+enum class CoinsBackend {
+    LEVELDB,  //!< CCoinsViewDB in chainstate/
+    FLATFILE, //!< CCoinsViewFlatFile in chainstate_flat/
+};
+
+std::optional<CoinsBackend> ParseCoinsBackend(const std::string& name);
+std::string CoinsBackendName(CoinsBackend backend);
+
+/** Backend used for the chainstates opened from now on */
+extern CoinsBackend g_coins_backend;
+
+/** The lowest, on-disk layer of a chainstate's coins views */
+class CCoinsViewDisk : public CCoinsView
+{
+public:
+    //! Attempt to update from an older database format. Returns whether an error occurred.
+    virtual bool Upgrade() { return true; }
+
+    //! Dynamically alter the memory the backend may use to cache data from disk.
+    virtual void ResizeCache(size_t new_cache_size) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {}
+
+    /**
+     * Cursors over n key ranges that together cover all coins, for scanning
+     * them in parallel: range i holds the coins of the transactions whose txid
+     * starts with a byte in [i * 256 / n, (i + 1) * 256 / n). They all see the
+     * same state of the view, and are independent of each other.
+     *
+     * @param[in] n  Number of ranges, between 1 and 256.
+     */
+    virtual std::vector<std::unique_ptr<CCoinsViewCursor>> RangeCursors(size_t n) const = 0;
+};
+
+//! Number of key ranges ScanCoins() splits the coins into
+static constexpr size_t COINS_SCAN_RANGES{256};
+//! Threads ScanCoins() uses at most
+static constexpr int MAX_COINS_SCAN_THREADS{16};
+
+/**
+ * Scan the coins of cursors, the COINS_SCAN_RANGES range cursors of a view
+ * (see CCoinsViewDisk::RangeCursors()), on several threads. scan is called
+ * on the worker threads with the index and the cursor of every range, and
+ * merge on the calling thread with the index of every scanned range, in key
+ * order. Only a few ranges are scanned ahead of the merged ones, so results
+ * can be kept per range until they are merged. Errors thrown by scan or merge
+ * are rethrown.
+ */
+void ScanCoins(std::vector<std::unique_ptr<CCoinsViewCursor>> cursors,
+               const std::function<void(size_t, CCoinsViewCursor&)>& scan, const std::function<void(size_t)>& merge);
+
+/** Location of the coins of the chainstate called name (e.g. "chainstate") when stored with backend */
+fs::path GetCoinsDBPath(const fs::path& datadir, const std::string& name, CoinsBackend backend);
+
+/** Open the coins of a chainstate stored at path with backend. In-memory views always use LevelDB. */
+std::unique_ptr<CCoinsViewDisk> MakeCoinsView(CoinsBackend backend, const fs::path& path, size_t cache_size, bool in_memory, bool wipe);
+
+/**
+ * Copy the coins of the chainstate called name in datadir from one backend to
+ * the other, for -convertcoinsdb. The source is left in place and the
+ * destination must not exist yet. Stops early, converting nothing, if a
+ * shutdown is requested.
+ */
+bool ConvertCoinsDB(const fs::path& datadir, const std::string& name, CoinsBackend from, CoinsBackend to, size_t cache_size, std::string& error);
+
 /** CCoinsView backed by the coin database (chainstate/) */
-class CCoinsViewDB final : public CCoinsView
+class CCoinsViewDB final : public CCoinsViewDisk
 {
 protected:
     std::unique_ptr<CDBWrapper> m_db;
@@ -61,13 +127,13 @@ public:
     std::vector<uint256> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     std::unique_ptr<CCoinsViewCursor> Cursor() const override;
+    std::vector<std::unique_ptr<CCoinsViewCursor>> RangeCursors(size_t n) const override;
 
-    //! Attempt to update from an older database format. Returns whether an error occurred.
-    bool Upgrade();
+    bool Upgrade() override;
     size_t EstimateSize() const override;
 
     //! Dynamically alter the underlying leveldb cache size.
-    void ResizeCache(size_t new_cache_size) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    void ResizeCache(size_t new_cache_size) override EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
 /** Access to the block database (blocks/index/) */
@@ -18,7 +18,9 @@
 #include <validation.h>
 #include <validationinterface.h>
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
 #include <optional>
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
@@ -56,46 +58,187 @@ size_t CTxMemPoolEntry::GetTxSize() const
     return GetVirtualTransactionSize(nTxWeight, sigOpCost);
 }
 
+bool CTxMemPoolEntryLinks::insert(TxMemPoolIter it)
+{
+    const auto pos = std::lower_bound(m_links.begin(), m_links.end(), it, CompareIteratorByHash());
+    if (pos != m_links.end() && *pos == it) return false;
+    m_links.insert(pos, it);
+    return true;
+}
+
+bool CTxMemPoolEntryLinks::erase(TxMemPoolIter it)
+{
+    const auto pos = std::lower_bound(m_links.begin(), m_links.end(), it, CompareIteratorByHash());
+    if (pos == m_links.end() || *pos != it) return false;
+    m_links.erase(pos);
+    return true;
+}
+
+bool CTxMemPoolEntryLinks::count(TxMemPoolIter it) const
+{
+    const auto pos = std::lower_bound(m_links.begin(), m_links.end(), it, CompareIteratorByHash());
+    return pos != m_links.end() && *pos == it;
+}
+
+TxMemPoolIter TxMemPoolIndex::begin() const
+{
+    for (uint32_t pos = 0; pos < m_used_slots; ++pos) {
+        if (GetSlot(pos).entry) return {this, pos};
+    }
+    return end();
+}
+
+TxMemPoolIter TxMemPoolIndex::find(const uint256& txid) const
+{
+    const auto it = m_txids.find(txid);
+    return it == m_txids.end() ? end() : const_iterator{this, it->second};
+}
+
+TxMemPoolIter TxMemPoolIndex::find_by_wtxid(const uint256& wtxid) const
+{
+    const auto it = m_wtxids.find(wtxid);
+    return it == m_wtxids.end() ? end() : const_iterator{this, it->second};
+}
+
+std::pair<TxMemPoolIter, bool> TxMemPoolIndex::insert(const CTxMemPoolEntry& entry)
+{
+    const auto [txid_it, inserted] = m_txids.try_emplace(entry.GetTx().GetHash(), 0);
+    if (!inserted) return {const_iterator{this, txid_it->second}, false};
+
+    uint32_t pos;
+    if (!m_free_slots.empty()) {
+        std::pop_heap(m_free_slots.begin(), m_free_slots.end(), std::greater<uint32_t>{});
+        pos = m_free_slots.back();
+        m_free_slots.pop_back();
+    } else {
+        pos = m_used_slots++;
+        if ((pos >> CHUNK_BITS) == m_chunks.size()) {
+            m_chunks.push_back(std::make_unique<Slot[]>(CHUNK_SIZE));
+            m_chunk_entries.push_back(0);
+        }
+    }
+    ++m_chunk_entries[pos >> CHUNK_BITS];
+    txid_it->second = pos;
+    m_wtxids.emplace(entry.GetTx().GetWitnessHash(), pos);
+    GetSlot(pos).entry.emplace(entry);
+    ++m_size;
+
+    HeapInsert<descendant_score>(pos);
+    HeapInsert<entry_time>(pos);
+    m_view_valid.fill(false);
+    return {const_iterator{this, pos}, true};
+}
+
+void TxMemPoolIndex::erase(const_iterator it)
+{
+    const uint32_t pos = it.GetPos();
+    HeapErase<descendant_score>(pos);
+    HeapErase<entry_time>(pos);
+    m_view_valid.fill(false);
+
+    Slot& slot = GetSlot(pos);
+    m_txids.erase(slot.entry->GetTx().GetHash());
+    m_wtxids.erase(slot.entry->GetTx().GetWitnessHash());
+    slot.entry.reset();
+    m_free_slots.push_back(pos);
+    std::push_heap(m_free_slots.begin(), m_free_slots.end(), std::greater<uint32_t>{});
+    --m_size;
+    if (--m_chunk_entries[pos >> CHUNK_BITS] == 0) ReleaseTrailingChunks();
+}
+
+void TxMemPoolIndex::ReleaseTrailingChunks()
+{
+    const size_t chunks{m_chunks.size()};
+    while (!m_chunk_entries.empty() && m_chunk_entries.back() == 0) {
+        m_chunks.pop_back();
+        m_chunk_entries.pop_back();
+    }
+    if (m_chunks.size() == chunks) return;
+    m_used_slots = std::min<uint32_t>(m_used_slots, m_chunks.size() << CHUNK_BITS);
+    m_free_slots.erase(std::remove_if(m_free_slots.begin(), m_free_slots.end(),
+                                      [&](uint32_t pos) { return pos >= m_used_slots; }),
+                       m_free_slots.end());
+    std::make_heap(m_free_slots.begin(), m_free_slots.end(), std::greater<uint32_t>{});
+}
+
+void TxMemPoolIndex::clear()
+{
+    m_chunks.clear();
+    m_chunk_entries.clear();
+    m_used_slots = 0;
+    m_free_slots.clear();
+    m_size = 0;
+    m_txids.clear();
+    m_wtxids.clear();
+    for (auto& heap : m_heaps) heap.clear();
+    m_heap_built.fill(false);
+    for (auto& view : m_views) view.clear();
+    m_view_valid.fill(false);
+}
+
+size_t TxMemPoolIndex::DynamicMemoryUsage() const
+{
+    // Slots are counted per entry rather than per chunk, so that removing
+    // entries always lowers the usage, as TrimToSize() relies on, and an
+    // empty index is counted as taking no memory. Chunks left without
+    // entries at the end are released by erase(), and free slots are reused
+    // lowest first, so the chunks held stay close to what the entries need.
+    if (empty()) return 0;
+    size_t usage = m_size * (sizeof(Slot) + HEAPS * sizeof(uint32_t));
+    usage += memusage::DynamicUsage(m_chunks) + memusage::DynamicUsage(m_chunk_entries) + memusage::DynamicUsage(m_free_slots);
+    usage += memusage::DynamicUsage(m_txids) + memusage::DynamicUsage(m_wtxids);
+    for (const auto& view : m_views) usage += memusage::DynamicUsage(view);
+    return usage;
+}
+
 // Update the given tx for any in-mempool descendants.
 // Assumes that CTxMemPool::m_children is correct for the given tx and all
 // descendants.
-void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
+void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude,
+                                      std::set<uint256>& descendants_to_remove, uint64_t ancestor_size_limit, uint64_t ancestor_count_limit)
 {
-    CTxMemPoolEntry::Children stageEntries, descendants;
-    stageEntries = updateIt->GetMemPoolChildrenConst();
-
-    while (!stageEntries.empty()) {
-        const CTxMemPoolEntry& descendant = *stageEntries.begin();
-        descendants.insert(descendant);
-        stageEntries.erase(descendant);
-        const CTxMemPoolEntry::Children& children = descendant.GetMemPoolChildrenConst();
-        for (const CTxMemPoolEntry& childEntry : children) {
-            cacheMap::iterator cacheIt = cachedDescendants.find(mapTx.iterator_to(childEntry));
-            if (cacheIt != cachedDescendants.end()) {
-                // We've already calculated this one, just add the entries for this set
-                // but don't traverse again.
-                for (txiter cacheEntry : cacheIt->second) {
-                    descendants.insert(*cacheEntry);
-                }
-            } else if (!descendants.count(childEntry)) {
-                // Schedule for later processing
-                stageEntries.insert(childEntry);
-            }
-        }
-    }
-    // descendants now contains all in-mempool descendants of updateIt.
-    // Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (const CTxMemPoolEntry& descendant : descendants) {
-        if (!setExclude.count(descendant.GetTx().GetHash())) {
-            modifySize += descendant.GetTxSize();
-            modifyFee += descendant.GetModifiedFee();
-            modifyCount++;
-            cachedDescendants[updateIt].insert(mapTx.iterator_to(descendant));
-            // Update ancestor state for each descendant
-            mapTx.modify(mapTx.iterator_to(descendant), update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
+    std::vector<txiter>& cached = cachedDescendants[updateIt];
+    // Update the ancestor state of a descendant of updateIt and add it to the
+    // cached descendant map, unless it is already accounted for
+    auto update_descendant = [&](txiter descendant) EXCLUSIVE_LOCKS_REQUIRED(cs) {
+        if (setExclude.count(descendant->GetTx().GetHash())) return;
+        modifySize += descendant->GetTxSize();
+        modifyFee += descendant->GetModifiedFee();
+        modifyCount++;
+        cached.push_back(descendant);
+        mapTx.modify(descendant, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
+        if (descendant->GetSizeWithAncestors() > ancestor_size_limit || descendant->GetCountWithAncestors() > ancestor_count_limit) {
+            descendants_to_remove.insert(descendant->GetTx().GetHash());
+        }
+    };
+    {
+        WITH_FRESH_EPOCH(m_epoch);
+        const CTxMemPoolEntry::Children& updateChildren = updateIt->GetMemPoolChildrenConst();
+        std::vector<txiter> stageEntries(updateChildren.begin(), updateChildren.end());
+        for (const txiter child : stageEntries) {
+            visited(child);
+        }
+        while (!stageEntries.empty()) {
+            const txiter descendant = stageEntries.back();
+            stageEntries.pop_back();
+            update_descendant(descendant);
+            const CTxMemPoolEntry::Children& children = descendant->GetMemPoolChildrenConst();
+            for (const txiter childEntry : children) {
+                cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
+                if (cacheIt != cachedDescendants.end()) {
+                    // We've already calculated this one, just add the entries for this set
+                    // but don't traverse again.
+                    for (txiter cacheEntry : cacheIt->second) {
+                        if (!visited(cacheEntry)) update_descendant(cacheEntry);
+                    }
+                } else if (!visited(childEntry)) {
+                    // Schedule for later processing
+                    stageEntries.push_back(childEntry);
+                }
+            }
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
@@ -106,7 +249,7 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
 // for each entry, look for descendants that are outside vHashesToUpdate, and
 // add fee/size information for such descendants to the parent.
 // for each such descendant, also update the ancestor state to include the parent.
-void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate)
+void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate, uint64_t ancestor_size_limit, uint64_t ancestor_count_limit)
 {
     AssertLockHeld(cs);
     // For each entry in vHashesToUpdate, store the set of in-mempool, but not
@@ -118,6 +261,10 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
     // accounted for in the state of their ancestors)
     std::set<uint256> setAlreadyIncluded(vHashesToUpdate.begin(), vHashesToUpdate.end());
 
+    // Descendants exceeding the ancestor limits once they are linked to the
+    // transactions of the block
+    std::set<uint256> descendants_to_remove;
+
     // Iterate in reverse, so that whenever we are looking at a transaction
     // we are sure that all in-mempool descendants have already been processed.
     // This maximizes the benefit of the descendant cache and guarantees that
@@ -147,23 +294,34 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
                 }
             }
         } // release epoch guard for UpdateForDescendants
-        UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
+        UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded, descendants_to_remove, ancestor_size_limit, ancestor_count_limit);
+    }
+
+    for (const uint256& txid : descendants_to_remove) {
+        // This txid may have been removed already along with one of its ancestors
+        if (const std::optional<txiter> it = GetIter(txid)) {
+            removeRecursive((*it)->GetTx(), MemPoolRemovalReason::SIZELIMIT);
+        }
     }
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
-    CTxMemPoolEntry::Parents staged_ancestors;
+    WITH_FRESH_EPOCH(m_epoch);
+    std::vector<txiter> staged_ancestors;
     const CTransaction &tx = entry.GetTx();
 
+    for (const txiter ancestor : setAncestors) {
+        visited(ancestor);
+    }
     if (fSearchForParents) {
         // Get parents of this transaction that are in the mempool
         // GetMemPoolParents() is only valid for entries in the mempool, so we
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             std::optional<txiter> piter = GetIter(tx.vin[i].prevout.hash);
-            if (piter) {
-                staged_ancestors.insert(**piter);
+            if (piter && !visited(*piter)) {
+                staged_ancestors.push_back(*piter);
                 if (staged_ancestors.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -173,18 +331,38 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
     } else {
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
-        txiter it = mapTx.iterator_to(entry);
-        staged_ancestors = it->GetMemPoolParentsConst();
+        txiter it = mapTx.find(tx.GetHash());
+        for (const txiter parent : it->GetMemPoolParentsConst()) {
+            if (!visited(parent)) staged_ancestors.push_back(parent);
+        }
+    }
+
+    // The ancestors of each parent are ancestors of this transaction too, so
+    // the cached state of the parents is enough to reject most transactions
+    // exceeding the limits, however many ancestors they have.
+    for (const txiter parent : staged_ancestors) {
+        if (parent->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
+            errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", parent->GetTx().GetHash().ToString(), limitDescendantSize);
+            return false;
+        } else if (parent->GetCountWithDescendants() + 1 > limitDescendantCount) {
+            errString = strprintf("too many descendants for tx %s [limit: %u]", parent->GetTx().GetHash().ToString(), limitDescendantCount);
+            return false;
+        } else if (parent->GetSizeWithAncestors() + entry.GetTxSize() > limitAncestorSize) {
+            errString = strprintf("exceeds ancestor size limit [limit: %u]", limitAncestorSize);
+            return false;
+        } else if (parent->GetCountWithAncestors() + 1 > limitAncestorCount) {
+            errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+            return false;
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!staged_ancestors.empty()) {
-        const CTxMemPoolEntry& stage = staged_ancestors.begin()->get();
-        txiter stageit = mapTx.iterator_to(stage);
+        const txiter stageit = staged_ancestors.back();
+        staged_ancestors.pop_back();
 
         setAncestors.insert(stageit);
-        staged_ancestors.erase(stage);
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -199,12 +377,10 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         }
 
         const CTxMemPoolEntry::Parents& parents = stageit->GetMemPoolParentsConst();
-        for (const CTxMemPoolEntry& parent : parents) {
-            txiter parent_it = mapTx.iterator_to(parent);
-
+        for (const txiter parent_it : parents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(parent_it) == 0) {
-                staged_ancestors.insert(parent);
+            if (!visited(parent_it)) {
+                staged_ancestors.push_back(parent_it);
             }
             if (staged_ancestors.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -218,10 +394,10 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
-    CTxMemPoolEntry::Parents parents = it->GetMemPoolParents();
+    const CTxMemPoolEntry::Parents& parents = it->GetMemPoolParentsConst();
     // add or remove this tx as a child of each parent
-    for (const CTxMemPoolEntry& parent : parents) {
-        UpdateChild(mapTx.iterator_to(parent), it, add);
+    for (const txiter parent : parents) {
+        UpdateChild(parent, it, add);
     }
     const int64_t updateCount = (add ? 1 : -1);
     const int64_t updateSize = updateCount * it->GetTxSize();
@@ -248,8 +424,8 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
     const CTxMemPoolEntry::Children& children = it->GetMemPoolChildrenConst();
-    for (const CTxMemPoolEntry& updateIt : children) {
-        UpdateParent(mapTx.iterator_to(updateIt), it, false);
+    for (const txiter updateIt : children) {
+        UpdateParent(updateIt, it, false);
     }
 }
 
@@ -405,6 +581,12 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
 
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
+
+    if (!m_template_selection.key.IsNull()) {
+        m_template_selection.added.push_back(tx.GetWitnessHash());
+        // Past this point, selecting transactions from scratch is cheaper
+        if (m_template_selection.added.size() > mapTx.size()) m_template_selection = {};
+    }
 }
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
@@ -439,7 +621,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     totalTxSize -= it->GetTxSize();
     m_total_fee -= it->GetFee();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(it->GetMemPoolParentsConst()) + memusage::DynamicUsage(it->GetMemPoolChildrenConst());
+    cachedInnerUsage -= it->GetMemPoolParentsConst().DynamicMemoryUsage() + it->GetMemPoolChildrenConst().DynamicMemoryUsage();
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
@@ -453,23 +635,22 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
 {
-    setEntries stage;
-    if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
-    }
+    if (setDescendants.count(entryit)) return;
+    WITH_FRESH_EPOCH(m_epoch);
+    std::vector<txiter> stage{entryit};
+    visited(entryit);
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
+        stage.pop_back();
         setDescendants.insert(it);
-        stage.erase(it);
 
         const CTxMemPoolEntry::Children& children = it->GetMemPoolChildrenConst();
-        for (const CTxMemPoolEntry& child : children) {
-            txiter childiter = mapTx.iterator_to(child);
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+        for (const txiter childiter : children) {
+            if (!setDescendants.count(childiter) && !visited(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -592,6 +773,7 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     }
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = true;
+    m_template_selection = {};
 }
 
 void CTxMemPool::_clear()
@@ -604,6 +786,7 @@ void CTxMemPool::_clear()
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
+    m_template_selection = {};
     ++nTransactionsUpdated;
 }
 
@@ -647,7 +830,7 @@ void CTxMemPool::check(CChainState& active_chainstate) const
         check_total_fee += it->GetFee();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
-        innerUsage += memusage::DynamicUsage(it->GetMemPoolParentsConst()) + memusage::DynamicUsage(it->GetMemPoolChildrenConst());
+        innerUsage += it->GetMemPoolParentsConst().DynamicMemoryUsage() + it->GetMemPoolChildrenConst().DynamicMemoryUsage();
         bool fDependsWait = false;
         CTxMemPoolEntry::Parents setParentCheck;
         for (const CTxIn &txin : tx.vin) {
@@ -657,7 +840,7 @@ void CTxMemPool::check(CChainState& active_chainstate) const
                 const CTransaction& tx2 = it2->GetTx();
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
                 fDependsWait = true;
-                setParentCheck.insert(*it2);
+                setParentCheck.insert(it2);
             } else {
                 assert(active_coins_tip.HaveCoin(txin.prevout));
             }
@@ -668,11 +851,8 @@ void CTxMemPool::check(CChainState& active_chainstate) const
             assert(it3->second == &tx);
             i++;
         }
-        auto comp = [](const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) -> bool {
-            return a.GetTx().GetHash() == b.GetTx().GetHash();
-        };
         assert(setParentCheck.size() == it->GetMemPoolParentsConst().size());
-        assert(std::equal(setParentCheck.begin(), setParentCheck.end(), it->GetMemPoolParentsConst().begin(), comp));
+        assert(std::equal(setParentCheck.begin(), setParentCheck.end(), it->GetMemPoolParentsConst().begin()));
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -701,12 +881,12 @@ void CTxMemPool::check(CChainState& active_chainstate) const
         for (; iter != mapNextTx.end() && iter->first->hash == it->GetTx().GetHash(); ++iter) {
             txiter childit = mapTx.find(iter->second->GetHash());
             assert(childit != mapTx.end()); // mapNextTx points to in-mempool transactions
-            if (setChildrenCheck.insert(*childit).second) {
+            if (setChildrenCheck.insert(childit)) {
                 child_sizes += childit->GetTxSize();
             }
         }
         assert(setChildrenCheck.size() == it->GetMemPoolChildrenConst().size());
-        assert(std::equal(setChildrenCheck.begin(), setChildrenCheck.end(), it->GetMemPoolChildrenConst().begin(), comp));
+        assert(std::equal(setChildrenCheck.begin(), setChildrenCheck.end(), it->GetMemPoolChildrenConst().begin()));
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= child_sizes + it->GetTxSize());
@@ -781,7 +961,7 @@ std::vector<CTxMemPool::indexed_transaction_set::const_iterator> CTxMemPool::Get
 
     iters.reserve(mapTx.size());
 
-    for (indexed_transaction_set::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi) {
+    for (indexed_transaction_set::const_iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi) {
         iters.push_back(mi);
     }
     std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
@@ -863,6 +1043,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
             for (txiter descendantIt : setDescendants) {
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
+            m_template_selection = {};
             ++nTransactionsUpdated;
         }
     }
@@ -950,8 +1131,7 @@ void CCoinsViewMemPool::PackageAddTransaction(const CTransactionRef& tx)
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return mapTx.DynamicMemoryUsage() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + m_template_selection.DynamicMemoryUsage() + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveUnbroadcastTx(const uint256& txid, const bool unchecked) {
@@ -974,18 +1154,15 @@ void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPool
 int CTxMemPool::Expire(std::chrono::seconds time)
 {
     AssertLockHeld(cs);
-    indexed_transaction_set::index<entry_time>::type::iterator it = mapTx.get<entry_time>().begin();
-    setEntries toremove;
-    while (it != mapTx.get<entry_time>().end() && it->GetTime() < time) {
-        toremove.insert(mapTx.project<0>(it));
-        it++;
-    }
-    setEntries stage;
-    for (txiter removeit : toremove) {
-        CalculateDescendants(removeit, stage);
+    int removed = 0;
+    // Remove the oldest transaction along with its descendants until none is too old
+    while (!mapTx.empty() && mapTx.front<entry_time>()->GetTime() < time) {
+        setEntries stage;
+        CalculateDescendants(mapTx.front<entry_time>(), stage);
+        removed += stage.size();
+        RemoveStaged(stage, false, MemPoolRemovalReason::EXPIRY);
     }
-    RemoveStaged(stage, false, MemPoolRemovalReason::EXPIRY);
-    return stage.size();
+    return removed;
 }
 
 void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, bool validFeeEstimate)
@@ -1000,23 +1177,27 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, bool validFeeEstimat
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
     AssertLockHeld(cs);
-    CTxMemPoolEntry::Children s;
-    if (add && entry->GetMemPoolChildren().insert(*child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && entry->GetMemPoolChildren().erase(*child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    CTxMemPoolEntry::Children& children = entry->GetMemPoolChildren();
+    cachedInnerUsage -= children.DynamicMemoryUsage();
+    if (add) {
+        children.insert(child);
+    } else {
+        children.erase(child);
     }
+    cachedInnerUsage += children.DynamicMemoryUsage();
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
     AssertLockHeld(cs);
-    CTxMemPoolEntry::Parents s;
-    if (add && entry->GetMemPoolParents().insert(*parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && entry->GetMemPoolParents().erase(*parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    CTxMemPoolEntry::Parents& parents = entry->GetMemPoolParents();
+    cachedInnerUsage -= parents.DynamicMemoryUsage();
+    if (add) {
+        parents.insert(parent);
+    } else {
+        parents.erase(parent);
     }
+    cachedInnerUsage += parents.DynamicMemoryUsage();
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
@@ -1057,7 +1238,7 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+        const txiter it = mapTx.front<descendant_score>();
 
         // We set the new mempool min fee to the feerate of the removed set, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
@@ -1069,7 +1250,7 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
         setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
+        CalculateDescendants(it, stage);
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
@@ -1108,9 +1289,7 @@ uint64_t CTxMemPool::CalculateDescendantMaximum(txiter entry) const {
         if (parents.size() == 0) {
             maximum = std::max(maximum, candidate->GetCountWithDescendants());
         } else {
-            for (const CTxMemPoolEntry& i : parents) {
-                candidates.push_back(mapTx.iterator_to(i));
-            }
+            candidates.insert(candidates.end(), parents.begin(), parents.end());
         }
     }
     return maximum;
@@ -6,17 +6,24 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <amount.h>
 #include <coins.h>
 #include <indirectmap.h>
+#include <memusage.h>
 #include <policy/feerate.h>
 #include <primitives/transaction.h>
 #include <random.h>
@@ -26,7 +33,6 @@
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
 
 class CBlockIndex;
@@ -52,13 +58,7 @@ struct LockPoints
 };
 
 struct CompareIteratorByHash {
-    // SFINAE for T where T is either a pointer type (e.g., a txiter) or a reference_wrapper<T>
-    // (e.g. a wrapped CTxMemPoolEntry&)
-    template <typename T>
-    bool operator()(const std::reference_wrapper<T>& a, const std::reference_wrapper<T>& b) const
-    {
-        return a.get().GetTx().GetHash() < b.get().GetTx().GetHash();
-    }
+    // T is a pointer type (e.g., a txiter)
     template <typename T>
     bool operator()(const T& a, const T& b) const
     {
@@ -66,6 +66,64 @@ struct CompareIteratorByHash {
     }
 };
 
+class CTxMemPoolEntry;
+class TxMemPoolIndex;
+
+/** Iterator to an entry of a TxMemPoolIndex, valid until that entry is removed. */
+class TxMemPoolIter
+{
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = CTxMemPoolEntry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const CTxMemPoolEntry*;
+    using reference = const CTxMemPoolEntry&;
+
+    TxMemPoolIter() = default;
+    TxMemPoolIter(const TxMemPoolIndex* index, uint32_t pos) : m_index(index), m_pos(pos) {}
+
+    inline const CTxMemPoolEntry& operator*() const;
+    const CTxMemPoolEntry* operator->() const { return &**this; }
+    inline TxMemPoolIter& operator++();
+    TxMemPoolIter operator++(int)
+    {
+        TxMemPoolIter copy{*this};
+        ++*this;
+        return copy;
+    }
+    bool operator==(const TxMemPoolIter& other) const { return m_pos == other.m_pos; }
+    bool operator!=(const TxMemPoolIter& other) const { return m_pos != other.m_pos; }
+
+    //! Slot of the entry in the arena of the index
+    uint32_t GetPos() const { return m_pos; }
+
+private:
+    const TxMemPoolIndex* m_index{nullptr};
+    uint32_t m_pos{std::numeric_limits<uint32_t>::max()};
+};
+
+/** The in-mempool parents or children of an entry, as a vector sorted by txid. */
+class CTxMemPoolEntryLinks
+{
+    std::vector<TxMemPoolIter> m_links;
+
+public:
+    using const_iterator = std::vector<TxMemPoolIter>::const_iterator;
+
+    const_iterator begin() const { return m_links.begin(); }
+    const_iterator end() const { return m_links.end(); }
+    size_t size() const { return m_links.size(); }
+    bool empty() const { return m_links.empty(); }
+
+    //! Returns false if it is already linked
+    bool insert(TxMemPoolIter it);
+    //! Returns false if it was not linked
+    bool erase(TxMemPoolIter it);
+    bool count(TxMemPoolIter it) const;
+
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(m_links); }
+};
+
 /** \class CTxMemPoolEntry
  *
  * CTxMemPoolEntry stores data about the corresponding transaction, as well
@@ -81,10 +139,9 @@ struct CompareIteratorByHash {
 class CTxMemPoolEntry
 {
 public:
-    typedef std::reference_wrapper<const CTxMemPoolEntry> CTxMemPoolEntryRef;
     // two aliases, should the types ever diverge
-    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash> Parents;
-    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash> Children;
+    typedef CTxMemPoolEntryLinks Parents;
+    typedef CTxMemPoolEntryLinks Children;
 
 private:
     const CTransactionRef tx;
@@ -161,7 +218,7 @@ public:
     mutable Epoch::Marker m_epoch_marker; //!< epoch when last touched, useful for graph algorithms
 };
 
-// Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
+// Helpers for modifying CTxMemPool::mapTx through TxMemPoolIndex::modify().
 struct update_descendant_state
 {
     update_descendant_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount) :
@@ -228,21 +285,6 @@ struct mempoolentry_txid
     }
 };
 
-// extracts a transaction witness-hash from CTxMemPoolEntry or CTransactionRef
-struct mempoolentry_wtxid
-{
-    typedef uint256 result_type;
-    result_type operator() (const CTxMemPoolEntry &entry) const
-    {
-        return entry.GetTx().GetWitnessHash();
-    }
-
-    result_type operator() (const CTransactionRef& tx) const
-    {
-        return tx->GetWitnessHash();
-    }
-};
-
 
 /** \class CompareTxMemPoolEntryByDescendantScore
  *
@@ -263,7 +305,10 @@ public:
         double f2 = a_size * b_mod_fee;
 
         if (f1 == f2) {
-            return a.GetTime() >= b.GetTime();
+            // Newer transactions first, and the txid as a tie breaker for a
+            // strict weak ordering
+            if (a.GetTime() != b.GetTime()) return a.GetTime() > b.GetTime();
+            return a.GetTx().GetHash() < b.GetTx().GetHash();
         }
         return f1 < f2;
     }
@@ -360,11 +405,244 @@ public:
     }
 };
 
-// Multi_index tag names
+// Tag names of the orders of TxMemPoolIndex
 struct descendant_score {};
 struct entry_time {};
 struct ancestor_score {};
-struct index_by_wtxid {};
+
+template <typename Tag>
+struct TxMemPoolIndexOrder;
+
+template <>
+struct TxMemPoolIndexOrder<descendant_score> {
+    using Compare = CompareTxMemPoolEntryByDescendantScore;
+    static constexpr size_t VIEW{0};
+    static constexpr size_t HEAP{0};
+};
+
+template <>
+struct TxMemPoolIndexOrder<entry_time> {
+    using Compare = CompareTxMemPoolEntryByEntryTime;
+    static constexpr size_t VIEW{1};
+    static constexpr size_t HEAP{1};
+};
+
+template <>
+struct TxMemPoolIndexOrder<ancestor_score> {
+    using Compare = CompareTxMemPoolEntryByAncestorFee;
+    static constexpr size_t VIEW{2};
+};
+
+/**
+ * The entries of a CTxMemPool, stored in a flat arena of fixed-size chunks.
+ * Entries never move, and the slot of a removed entry is reused by the next
+ * one added, so iterators are plain slot positions. Entries are looked up by
+ * txid and wtxid through hash maps.
+ *
+ * The orders by descendant score and by entry time are kept as binary heaps of
+ * slots, which is all that eviction and expiry need. A heap is only built the
+ * first time front() is called for its order, and is kept up to date from then
+ * on. A fully sorted view of the entries is built when get() is called, and is
+ * cached until the index changes.
+ */
+class TxMemPoolIndex
+{
+public:
+    using const_iterator = TxMemPoolIter;
+    using iterator = TxMemPoolIter;
+
+    const_iterator begin() const;
+    const_iterator end() const { return {this, END}; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const_iterator find(const uint256& txid) const;
+    const_iterator find_by_wtxid(const uint256& wtxid) const;
+    size_t count(const uint256& txid) const { return m_txids.count(txid); }
+
+    //! Returns the entry with the same txid instead if there is one
+    std::pair<const_iterator, bool> insert(const CTxMemPoolEntry& entry);
+    void erase(const_iterator it);
+    void clear();
+
+    template <typename Modifier>
+    void modify(const_iterator it, Modifier modifier)
+    {
+        modifier(*GetSlot(it.GetPos()).entry);
+        // The entry time of an entry never changes
+        HeapUpdate<descendant_score>(it.GetPos());
+        m_view_valid.fill(false);
+    }
+
+    //! The first entry in the order of Tag, which must have a heap
+    template <typename Tag>
+    const_iterator front() const
+    {
+        constexpr size_t h{TxMemPoolIndexOrder<Tag>::HEAP};
+        std::vector<uint32_t>& heap = m_heaps[h];
+        if (!m_heap_built[h]) {
+            heap.clear();
+            for (const_iterator it = begin(); it != end(); ++it) {
+                GetSlot(it.GetPos()).heap_pos[h] = heap.size();
+                heap.push_back(it.GetPos());
+            }
+            for (size_t i = heap.size() / 2; i-- > 0;) {
+                SiftDown<Tag>(i);
+            }
+            m_heap_built[h] = true;
+        }
+        return heap.empty() ? end() : const_iterator{this, heap.front()};
+    }
+
+    //! All entries sorted in the order of Tag, valid until the index changes
+    template <typename Tag>
+    const std::vector<const_iterator>& get() const
+    {
+        constexpr size_t v{TxMemPoolIndexOrder<Tag>::VIEW};
+        std::vector<const_iterator>& view = m_views[v];
+        if (!m_view_valid[v]) {
+            view.clear();
+            view.reserve(m_size);
+            for (const_iterator it = begin(); it != end(); ++it) {
+                view.push_back(it);
+            }
+            const typename TxMemPoolIndexOrder<Tag>::Compare compare;
+            std::sort(view.begin(), view.end(), [&](const_iterator a, const_iterator b) { return compare(*a, *b); });
+            m_view_valid[v] = true;
+        }
+        return view;
+    }
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    friend class TxMemPoolIter;
+
+    static constexpr uint32_t END{std::numeric_limits<uint32_t>::max()};
+    static constexpr uint32_t CHUNK_BITS{8};
+    static constexpr uint32_t CHUNK_SIZE{1U << CHUNK_BITS};
+    static constexpr size_t HEAPS{2};
+    static constexpr size_t VIEWS{3};
+
+    struct Slot {
+        std::optional<CTxMemPoolEntry> entry;
+        //! Position of the entry in each heap that is built
+        std::array<uint32_t, HEAPS> heap_pos;
+    };
+
+    //! Slots are part of the mutable state of the heaps, even through a const index
+    Slot& GetSlot(uint32_t pos) const { return m_chunks[pos >> CHUNK_BITS][pos & (CHUNK_SIZE - 1)]; }
+
+    template <typename Tag>
+    bool Before(uint32_t a, uint32_t b) const
+    {
+        return typename TxMemPoolIndexOrder<Tag>::Compare{}(*GetSlot(a).entry, *GetSlot(b).entry);
+    }
+
+    template <typename Tag>
+    void SiftUp(size_t i) const
+    {
+        constexpr size_t h{TxMemPoolIndexOrder<Tag>::HEAP};
+        std::vector<uint32_t>& heap = m_heaps[h];
+        const uint32_t pos = heap[i];
+        while (i > 0) {
+            const size_t parent = (i - 1) / 2;
+            if (!Before<Tag>(pos, heap[parent])) break;
+            heap[i] = heap[parent];
+            GetSlot(heap[i]).heap_pos[h] = i;
+            i = parent;
+        }
+        heap[i] = pos;
+        GetSlot(pos).heap_pos[h] = i;
+    }
+
+    template <typename Tag>
+    void SiftDown(size_t i) const
+    {
+        constexpr size_t h{TxMemPoolIndexOrder<Tag>::HEAP};
+        std::vector<uint32_t>& heap = m_heaps[h];
+        const uint32_t pos = heap[i];
+        while (true) {
+            size_t child = 2 * i + 1;
+            if (child >= heap.size()) break;
+            if (child + 1 < heap.size() && Before<Tag>(heap[child + 1], heap[child])) ++child;
+            if (!Before<Tag>(heap[child], pos)) break;
+            heap[i] = heap[child];
+            GetSlot(heap[i]).heap_pos[h] = i;
+            i = child;
+        }
+        heap[i] = pos;
+        GetSlot(pos).heap_pos[h] = i;
+    }
+
+    template <typename Tag>
+    void HeapInsert(uint32_t pos)
+    {
+        constexpr size_t h{TxMemPoolIndexOrder<Tag>::HEAP};
+        if (!m_heap_built[h]) return;
+        m_heaps[h].push_back(pos);
+        SiftUp<Tag>(m_heaps[h].size() - 1);
+    }
+
+    template <typename Tag>
+    void HeapErase(uint32_t pos)
+    {
+        constexpr size_t h{TxMemPoolIndexOrder<Tag>::HEAP};
+        if (!m_heap_built[h]) return;
+        std::vector<uint32_t>& heap = m_heaps[h];
+        const size_t i = GetSlot(pos).heap_pos[h];
+        const uint32_t last = heap.back();
+        heap.pop_back();
+        if (i < heap.size()) {
+            heap[i] = last;
+            SiftUp<Tag>(i);
+            SiftDown<Tag>(GetSlot(last).heap_pos[h]);
+        }
+    }
+
+    template <typename Tag>
+    void HeapUpdate(uint32_t pos)
+    {
+        constexpr size_t h{TxMemPoolIndexOrder<Tag>::HEAP};
+        if (!m_heap_built[h]) return;
+        SiftUp<Tag>(GetSlot(pos).heap_pos[h]);
+        SiftDown<Tag>(GetSlot(pos).heap_pos[h]);
+    }
+
+    //! Frees the chunks at the end that hold no entries
+    void ReleaseTrailingChunks();
+
+    std::vector<std::unique_ptr<Slot[]>> m_chunks;
+    //! Number of entries in each chunk
+    std::vector<uint32_t> m_chunk_entries;
+    //! Number of slots ever used in the allocated chunks, free or not
+    uint32_t m_used_slots{0};
+    //! Min-heap of free slots below m_used_slots, so that the lowest slot is
+    //! reused first and the chunks at the end empty out
+    std::vector<uint32_t> m_free_slots;
+    size_t m_size{0};
+    std::unordered_map<uint256, uint32_t, SaltedTxidHasher> m_txids;
+    std::unordered_map<uint256, uint32_t, SaltedTxidHasher> m_wtxids;
+
+    mutable std::array<std::vector<uint32_t>, HEAPS> m_heaps;
+    mutable std::array<bool, HEAPS> m_heap_built{};
+    mutable std::array<std::vector<const_iterator>, VIEWS> m_views;
+    mutable std::array<bool, VIEWS> m_view_valid{};
+};
+
+const CTxMemPoolEntry& TxMemPoolIter::operator*() const
+{
+    return *m_index->GetSlot(m_pos).entry;
+}
+
+TxMemPoolIter& TxMemPoolIter::operator++()
+{
+    do {
+        ++m_pos;
+    } while (m_pos < m_index->m_used_slots && !m_index->GetSlot(m_pos).entry);
+    if (m_pos >= m_index->m_used_slots) m_pos = TxMemPoolIndex::END;
+    return *this;
+}
 
 class CBlockPolicyEstimator;
 
@@ -416,9 +694,8 @@ enum class MemPoolRemovalReason {
  *
  * CTxMemPool::mapTx, and CTxMemPoolEntry bookkeeping:
  *
- * mapTx is a boost::multi_index that sorts the mempool on 5 criteria:
- * - transaction hash (txid)
- * - witness-transaction hash (wtxid)
+ * mapTx is a TxMemPoolIndex that looks up the mempool by transaction hash
+ * (txid) and witness-transaction hash (wtxid), and orders it on 3 criteria:
  * - descendant feerate [we use max(feerate of tx, feerate of tx with all descendants)]
  * - time in mempool
  * - ancestor feerate [we use min(feerate of tx, feerate of tx with all unconfirmed ancestors)]
@@ -503,37 +780,7 @@ public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
 
-    typedef boost::multi_index_container<
-        CTxMemPoolEntry,
-        boost::multi_index::indexed_by<
-            // sorted by txid
-            boost::multi_index::hashed_unique<mempoolentry_txid, SaltedTxidHasher>,
-            // sorted by wtxid
-            boost::multi_index::hashed_unique<
-                boost::multi_index::tag<index_by_wtxid>,
-                mempoolentry_wtxid,
-                SaltedTxidHasher
-            >,
-            // sorted by fee rate
-            boost::multi_index::ordered_non_unique<
-                boost::multi_index::tag<descendant_score>,
-                boost::multi_index::identity<CTxMemPoolEntry>,
-                CompareTxMemPoolEntryByDescendantScore
-            >,
-            // sorted by entry time
-            boost::multi_index::ordered_non_unique<
-                boost::multi_index::tag<entry_time>,
-                boost::multi_index::identity<CTxMemPoolEntry>,
-                CompareTxMemPoolEntryByEntryTime
-            >,
-            // sorted by fee rate with ancestors
-            boost::multi_index::ordered_non_unique<
-                boost::multi_index::tag<ancestor_score>,
-                boost::multi_index::identity<CTxMemPoolEntry>,
-                CompareTxMemPoolEntryByAncestorFee
-            >
-        >
-    > indexed_transaction_set;
+    typedef TxMemPoolIndex indexed_transaction_set;
 
     /**
      * This mutex needs to be locked when accessing `mapTx` or other members
@@ -565,14 +812,14 @@ public:
     mutable RecursiveMutex cs;
     indexed_transaction_set mapTx GUARDED_BY(cs);
 
-    using txiter = indexed_transaction_set::nth_index<0>::type::const_iterator;
+    using txiter = indexed_transaction_set::const_iterator;
     std::vector<std::pair<uint256, txiter>> vTxHashes GUARDED_BY(cs); //!< All tx witness hashes/entries in mapTx, in random order
 
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
 
 
     void UpdateParent(txiter entry, txiter parent, bool add) EXCLUSIVE_LOCKS_REQUIRED(cs);
@@ -589,6 +836,35 @@ public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
     std::map<uint256, CAmount> mapDeltas GUARDED_BY(cs);
 
+    /**
+     * The transactions that BlockAssembler selected for the last block
+     * template, so that the next template only has to consider what changed
+     * in the mempool since. Transactions added to the mempool are queued as
+     * candidates, and anything that may change which transactions get
+     * selected first (prioritisation, a new block) discards the selection.
+     */
+    struct TemplateSelection {
+        //! A package of transactions selected as a whole, by ancestor feerate
+        struct Package {
+            //! Position one past its last transaction in wtxids
+            size_t end;
+            CAmount fees;
+            uint64_t size;
+        };
+
+        //! Identifies the chain tip and assembler options the transactions
+        //! were selected for. Null if there is no selection.
+        uint256 key;
+        //! Selected transactions, in block order
+        std::vector<uint256> wtxids;
+        std::vector<Package> packages;
+        //! Transactions added to the mempool since they were selected
+        std::vector<uint256> added;
+
+        size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(wtxids) + memusage::DynamicUsage(packages) + memusage::DynamicUsage(added); }
+    };
+    mutable TemplateSelection m_template_selection GUARDED_BY(cs);
+
     /** Create a new CTxMemPool.
      * Sanity checks will be off by default for performance, because otherwise
      * accepting transactions becomes O(N^2) where N is the number of transactions
@@ -666,8 +942,10 @@ public:
      *  child transactions present in vHashesToUpdate, which are already accounted
      *  for).  Note: vHashesToUpdate should be the set of transactions from the
      *  disconnected block that have been accepted back into the mempool.
+     *  Descendants that end up exceeding the ancestor limits are removed along
+     *  with their own descendants.
      */
-    void UpdateTransactionsFromBlock(const std::vector<uint256>& vHashesToUpdate) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main) LOCKS_EXCLUDED(m_epoch);
+    void UpdateTransactionsFromBlock(const std::vector<uint256>& vHashesToUpdate, uint64_t ancestor_size_limit, uint64_t ancestor_count_limit) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main) LOCKS_EXCLUDED(m_epoch);
 
     /** Try to calculate all in-mempool ancestors of entry.
      *  (these are all calculated including the tx itself)
@@ -678,13 +956,16 @@ public:
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
      *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *  The cached ancestor and descendant state of the parents is checked against
+     *  the limits first, so that a transaction exceeding them is rejected without
+     *  walking its ancestors, and the walk itself stops as soon as a limit is hit.
      */
-    bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString, bool fSearchForParents = true) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString, bool fSearchForParents = true) const EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
 
     /** Populate setDescendants with all in-mempool descendants of hash.
      *  Assumes that setDescendants includes all in-mempool descendants of anything
      *  already in it.  */
-    void CalculateDescendants(txiter it, setEntries& setDescendants) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void CalculateDescendants(txiter it, setEntries& setDescendants) const EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
 
     /** The minimum fee to get into the mempool, which may itself not be enough
       *  for larger-sized transactions.
@@ -737,7 +1018,7 @@ public:
     {
         LOCK(cs);
         if (gtxid.IsWtxid()) {
-            return (mapTx.get<index_by_wtxid>().count(gtxid.GetHash()) != 0);
+            return mapTx.find_by_wtxid(gtxid.GetHash()) != mapTx.end();
         }
         return (mapTx.count(gtxid.GetHash()) != 0);
     }
@@ -747,7 +1028,7 @@ public:
     txiter get_iter_from_wtxid(const uint256& wtxid) const EXCLUSIVE_LOCKS_REQUIRED(cs)
     {
         AssertLockHeld(cs);
-        return mapTx.project<0>(mapTx.get<index_by_wtxid>().find(wtxid));
+        return mapTx.find_by_wtxid(wtxid);
     }
     TxMempoolInfo info(const uint256& hash) const;
     TxMempoolInfo info(const GenTxid& gtxid) const;
@@ -803,10 +1084,16 @@ private:
      *  cachedDescendants will be updated with the descendants of the transaction
      *  being updated, so that future invocations don't need to walk the
      *  same transaction again, if encountered in another transaction chain.
+     *
+     *  Descendants whose ancestor state exceeds ancestor_size_limit or
+     *  ancestor_count_limit once updated are added to descendants_to_remove.
      */
     void UpdateForDescendants(txiter updateIt,
             cacheMap &cachedDescendants,
-            const std::set<uint256> &setExclude) EXCLUSIVE_LOCKS_REQUIRED(cs);
+            const std::set<uint256> &setExclude,
+            std::set<uint256>& descendants_to_remove,
+            uint64_t ancestor_size_limit,
+            uint64_t ancestor_count_limit) EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
     /** Update ancestors of hash to add/remove it as a descendant transaction. */
     void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** Set ancestor state for an entry */
@@ -0,0 +1,74 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTIL_LRUCACHE_H
+#define BITCOIN_UTIL_LRUCACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * A map keeping the most recently used entries, up to a total cost given by
+ * the caller for each entry (for example its memory usage). Once the total
+ * cost goes over the maximum, the least recently used entries are dropped.
+ *
+ * Not thread safe: callers are expected to guard it with their own mutex.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LRUCache
+{
+private:
+    struct Entry {
+        Key key;
+        Value value;
+        size_t cost;
+    };
+    //! Most recently used entry first
+    std::list<Entry> m_entries;
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> m_map;
+    const size_t m_max_cost;
+    size_t m_cost{0};
+
+public:
+    explicit LRUCache(size_t max_cost) : m_max_cost(max_cost) {}
+
+    /** Get an entry, marking it as the most recently used. Returns nullptr
+     * if the key is not in the cache. */
+    const Value* Get(const Key& key)
+    {
+        auto it = m_map.find(key);
+        if (it == m_map.end()) return nullptr;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return &it->second->value;
+    }
+
+    /** Add or replace an entry, then drop the least recently used ones until
+     * the total cost is within the maximum. */
+    void Put(const Key& key, Value value, size_t cost = 1)
+    {
+        auto it = m_map.find(key);
+        if (it != m_map.end()) {
+            m_cost -= it->second->cost;
+            m_entries.erase(it->second);
+            m_map.erase(it);
+        }
+        m_entries.push_front(Entry{key, std::move(value), cost});
+        m_map.emplace(key, m_entries.begin());
+        m_cost += cost;
+        while (m_cost > m_max_cost) {
+            const Entry& last = m_entries.back();
+            m_cost -= last.cost;
+            m_map.erase(last.key);
+            m_entries.pop_back();
+        }
+    }
+
+    size_t Size() const { return m_entries.size(); }
+    size_t Cost() const { return m_cost; }
+};
+
+#endif // BITCOIN_UTIL_LRUCACHE_H
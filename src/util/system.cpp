@@ -1136,6 +1136,15 @@ bool TruncateFile(FILE *file, unsigned int length) {
 #endif
 }
 
+bool FileSeek(FILE* file, uint64_t pos)
+{
+#ifdef WIN32
+    return _fseeki64(file, pos, SEEK_SET) == 0;
+#else
+    return fseeko(file, pos, SEEK_SET) == 0;
+#endif
+}
+
 /**
  * this function tries to raise the file descriptor limit to the requested number.
  * It returns the actual file descriptor limit (which may be more or less than nMinFD)
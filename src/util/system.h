@@ -67,6 +67,8 @@ bool FileCommit(FILE *file);
 void DirectoryCommit(const fs::path &dirname);
 
 bool TruncateFile(FILE *file, unsigned int length);
+//! Seek to an absolute position, which may be beyond what a long can hold
+bool FileSeek(FILE* file, uint64_t pos);
 int RaiseFileDescriptorLimit(int nMinFD);
 void AllocateFileRange(FILE *file, unsigned int offset, unsigned int length);
 [[nodiscard]] bool RenameOver(fs::path src, fs::path dest);
@@ -178,8 +178,7 @@ std::unique_ptr<CBlockTreeDB> pblocktree;
 bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
                        const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore,
                        bool cacheFullScriptStore, PrecomputedTransactionData& txdata,
-                       std::vector<CScriptCheck>* pvChecks = nullptr)
-                       EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+                       std::vector<CScriptCheck>* pvChecks = nullptr);
 
 bool CheckFinalTx(const CBlockIndex* active_chain_tip, const CTransaction &tx, int flags)
 {
@@ -368,7 +367,9 @@ void CChainState::MaybeUpdateMempoolForReorg(
     // previously-confirmed transactions back to the mempool.
     // UpdateTransactionsFromBlock finds descendants of any transactions in
     // the disconnectpool that were added back and cleans up the mempool state.
-    m_mempool->UpdateTransactionsFromBlock(vHashUpdate);
+    const uint64_t ancestor_count_limit = gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+    const uint64_t ancestor_size_limit = gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+    m_mempool->UpdateTransactionsFromBlock(vHashUpdate, ancestor_size_limit, ancestor_count_limit);
 
     // We also need to remove any now-immature transactions
     m_mempool->removeForReorg(*this, STANDARD_LOCKTIME_VERIFY_FLAGS);
@@ -453,6 +454,12 @@ public:
          * any transaction spending the same inputs as a transaction in the mempool is considered
          * a conflict. */
         const bool m_allow_bip125_replacement{true};
+        /** Whether the scripts of the transaction are known to be valid under the
+         * flags of the current tip, see LoadMempool(). */
+        const bool m_skip_script_checks{false};
+        /** The failure of the script checks of the transaction under the
+         * policy flags, if PreverifyTransactionScripts() found one. */
+        const TxValidationState* m_script_failure{nullptr};
     };
 
     // Single transaction acceptance
@@ -465,6 +472,26 @@ public:
     */
     PackageMempoolAcceptResult AcceptMultipleTransactions(const std::vector<CTransactionRef>& txns, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Script checks of a transaction ahead of its acceptance, see
+     * PreverifyTransactionScripts(). PrepareScriptChecks() runs PreChecks()
+     * against the current mempool, which copies the inputs of the transaction
+     * into m_view. Returns false if the transaction failed there;
+     * AcceptSingleTransaction() then reports the failure.
+     */
+    bool PrepareScriptChecks(const CTransactionRef& ptx, ATMPArgs& args, unsigned int consensus_flags) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
+
+    /**
+     * Verify the scripts of the prepared transaction under the policy and the
+     * consensus flags, and cache the results for AcceptSingleTransaction() to
+     * find. Only reads m_view, so it does not need any lock. Returns false if
+     * the policy checks failed.
+     */
+    bool RunScriptChecks(const ATMPArgs& args);
+
+    //! State of the prepared transaction
+    const TxValidationState& GetPreparedState() const { return m_prepared->m_state; }
+
 private:
     // All the intermediate state that gets passed between the various levels
     // of checking a given transaction.
@@ -495,7 +522,9 @@ private:
 
     // Run the script checks using our policy flags. As this can be slow, we should
     // only invoke this on transactions that have otherwise passed policy checks.
-    bool PolicyScriptChecks(const ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
+    // Only reads the inputs in m_view. If cache_result is set, a success is stored
+    // in the script execution cache, for a later call to find (and erase).
+    bool PolicyScriptChecks(const ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata, bool cache_result = false);
 
     // Re-run the script checks, using consensus flags, and try to cache the
     // result in the scriptcache. This should be done after
@@ -530,6 +559,11 @@ private:
 
     CChainState& m_active_chainstate;
 
+    // The transaction prepared by PrepareScriptChecks(), and the consensus
+    // script flags of the tip at the time.
+    std::optional<Workspace> m_prepared;
+    unsigned int m_prepared_consensus_flags{0};
+
     // The package limits in effect at the time of invocation.
     const size_t m_limit_ancestors;
     const size_t m_limit_ancestor_size;
@@ -918,7 +952,7 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     return true;
 }
 
-bool MemPoolAccept::PolicyScriptChecks(const ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata)
+bool MemPoolAccept::PolicyScriptChecks(const ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata, bool cache_result)
 {
     const CTransaction& tx = *ws.m_ptx;
     TxValidationState& state = ws.m_state;
@@ -927,7 +961,7 @@ bool MemPoolAccept::PolicyScriptChecks(const ATMPArgs& args, Workspace& ws, Prec
 
     // Check input scripts and signatures.
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-    if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
+    if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, cache_result, txdata)) {
         // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
         // need to turn both off, and compare against just turning off CLEANSTACK
         // to see if the failure is specifically due to witness validation.
@@ -1037,9 +1071,17 @@ MempoolAcceptResult MemPoolAccept::AcceptSingleTransaction(const CTransactionRef
     // checks pass, to mitigate CPU exhaustion denial-of-service attacks.
     PrecomputedTransactionData txdata;
 
-    if (!PolicyScriptChecks(args, ws, txdata)) return MempoolAcceptResult::Failure(ws.m_state);
+    if (args.m_script_failure) {
+        // The scripts were verified against the same inputs ahead of time
+        ws.m_state = *args.m_script_failure;
+        return MempoolAcceptResult::Failure(ws.m_state);
+    }
 
-    if (!ConsensusScriptChecks(args, ws, txdata)) return MempoolAcceptResult::Failure(ws.m_state);
+    if (!args.m_skip_script_checks) {
+        if (!PolicyScriptChecks(args, ws, txdata)) return MempoolAcceptResult::Failure(ws.m_state);
+
+        if (!ConsensusScriptChecks(args, ws, txdata)) return MempoolAcceptResult::Failure(ws.m_state);
+    }
 
     // Tx was accepted, but not added
     if (args.m_test_accept) {
@@ -1057,6 +1099,32 @@ MempoolAcceptResult MemPoolAccept::AcceptSingleTransaction(const CTransactionRef
     return MempoolAcceptResult::Success(std::move(ws.m_replaced_transactions), ws.m_base_fees);
 }
 
+bool MemPoolAccept::PrepareScriptChecks(const CTransactionRef& ptx, ATMPArgs& args, unsigned int consensus_flags)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(m_pool.cs);
+
+    m_prepared.emplace(ptx);
+    m_prepared_consensus_flags = consensus_flags;
+    // Only spend script checks on transactions that pass the cheap checks,
+    // fees and replacement rules included, as AcceptSingleTransaction() does.
+    // This also leaves the inputs in m_view for RunScriptChecks().
+    return PreChecks(args, *m_prepared);
+}
+
+bool MemPoolAccept::RunScriptChecks(const ATMPArgs& args)
+{
+    Workspace& ws = *m_prepared;
+    PrecomputedTransactionData txdata;
+    if (!PolicyScriptChecks(args, ws, txdata, /* cache_result */ true)) return false;
+
+    // Failures under the consensus flags are left to ConsensusScriptChecks() to
+    // report, when the transaction is accepted.
+    TxValidationState state_dummy;
+    CheckInputScripts(*ws.m_ptx, state_dummy, m_view, m_prepared_consensus_flags, /* cacheSigStore */ true, /* cacheFullScriptStore */ true, txdata);
+    return true;
+}
+
 PackageMempoolAcceptResult MemPoolAccept::AcceptMultipleTransactions(const std::vector<CTransactionRef>& txns, ATMPArgs& args)
 {
     AssertLockHeld(cs_main);
@@ -1108,19 +1176,49 @@ PackageMempoolAcceptResult MemPoolAccept::AcceptMultipleTransactions(const std::
     return PackageMempoolAcceptResult(package_state, std::move(results));
 }
 
+/** Runs the script checks of a transaction prepared by MemPoolAccept::PrepareScriptChecks() */
+class MempoolScriptCheck
+{
+private:
+    MemPoolAccept* m_accept{nullptr};
+    const MemPoolAccept::ATMPArgs* m_args{nullptr};
+    bool* m_result{nullptr};
+
+public:
+    MempoolScriptCheck() {}
+    MempoolScriptCheck(MemPoolAccept& accept, const MemPoolAccept::ATMPArgs& args, bool& result) : m_accept(&accept), m_args(&args), m_result(&result) {}
+
+    bool operator()()
+    {
+        *m_result = m_accept->RunScriptChecks(*m_args);
+        // Failures are reported through m_result, so that the other transactions are still checked.
+        return true;
+    }
+
+    void swap(MempoolScriptCheck& check) noexcept
+    {
+        std::swap(m_accept, check.m_accept);
+        std::swap(m_args, check.m_args);
+        std::swap(m_result, check.m_result);
+    }
+};
+
 } // anon namespace
 
+static CCheckQueue<MempoolScriptCheck> mempoolcheckqueue(16);
+
 /** (try to) add transaction to memory pool with a specified acceptance time **/
 static MempoolAcceptResult AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool,
                                                       CChainState& active_chainstate,
                                                       const CTransactionRef &tx, int64_t nAcceptTime,
-                                                      bool bypass_limits, bool test_accept)
+                                                      bool bypass_limits, bool test_accept, bool skip_script_checks = false,
+                                                      const TxValidationState* script_failure = nullptr)
                                                       EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     auto start = std::chrono::high_resolution_clock::now();
     std::vector<COutPoint> coins_to_uncache;
     MemPoolAccept::ATMPArgs args { chainparams, nAcceptTime, bypass_limits, coins_to_uncache,
-                                   test_accept, /* m_allow_bip125_replacement */ true };
+                                   test_accept, /* m_allow_bip125_replacement */ true, skip_script_checks, script_failure };
 
     const MempoolAcceptResult result = MemPoolAccept(pool, active_chainstate).AcceptSingleTransaction(tx, args);
     if (result.m_result_type != MempoolAcceptResult::ResultType::VALID) {
@@ -1144,9 +1242,74 @@ static MempoolAcceptResult AcceptToMemoryPoolWithTime(const CChainParams& chainp
 }
 
 MempoolAcceptResult AcceptToMemoryPool(CChainState& active_chainstate, CTxMemPool& pool, const CTransactionRef& tx,
-                                       bool bypass_limits, bool test_accept)
+                                       bool bypass_limits, bool test_accept, const TxValidationState* script_failure)
 {
-    return AcceptToMemoryPoolWithTime(Params(), pool, active_chainstate, tx, GetTime(), bypass_limits, test_accept);
+    return AcceptToMemoryPoolWithTime(Params(), pool, active_chainstate, tx, GetTime(), bypass_limits, test_accept,
+                                      /* skip_script_checks */ false, script_failure);
+}
+
+std::map<uint256, TxValidationState> PreverifyTransactionScripts(CChainState& active_chainstate, CTxMemPool& pool,
+                                                                 const std::vector<CTransactionRef>& txns)
+{
+    AssertLockNotHeld(cs_main);
+
+    struct PreparedTx {
+        PreparedTx(const CTransactionRef& tx, CTxMemPool& pool, CChainState& active_chainstate, const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+            : m_tx(tx),
+              m_args{chainparams, GetTime(), /* bypass_limits */ false, m_coins_to_uncache, /* test_accept */ false},
+              m_accept(pool, active_chainstate) {}
+        const CTransactionRef m_tx;
+        std::vector<COutPoint> m_coins_to_uncache;
+        MemPoolAccept::ATMPArgs m_args;
+        MemPoolAccept m_accept;
+        bool m_scripts_ok{false};
+    };
+    std::vector<std::unique_ptr<PreparedTx>> prepared;
+    prepared.reserve(txns.size());
+
+    const CChainParams& chainparams = Params();
+    {
+        LOCK2(cs_main, pool.cs);
+        const unsigned int consensus_flags = GetBlockScriptFlags(active_chainstate.m_chain.Tip(), chainparams.GetConsensus());
+        for (const CTransactionRef& tx : txns) {
+            auto prepared_tx = std::make_unique<PreparedTx>(tx, pool, active_chainstate, chainparams);
+            if (prepared_tx->m_accept.PrepareScriptChecks(prepared_tx->m_tx, prepared_tx->m_args, consensus_flags)) {
+                prepared.push_back(std::move(prepared_tx));
+            } else {
+                // AcceptToMemoryPool() will look the inputs up again if it
+                // needs them, so do not leave them in the coins cache.
+                for (const COutPoint& outpoint : prepared_tx->m_coins_to_uncache) {
+                    active_chainstate.CoinsTip().Uncache(outpoint);
+                }
+            }
+        }
+    }
+
+    std::vector<MempoolScriptCheck> checks;
+    checks.reserve(prepared.size());
+    for (const auto& prepared_tx : prepared) {
+        checks.emplace_back(prepared_tx->m_accept, prepared_tx->m_args, prepared_tx->m_scripts_ok);
+    }
+    if (g_parallel_script_checks) {
+        CCheckQueueControl<MempoolScriptCheck> control(&mempoolcheckqueue);
+        control.Add(checks);
+        control.Wait();
+    } else {
+        for (MempoolScriptCheck& check : checks) {
+            check();
+        }
+    }
+
+    std::map<uint256, TxValidationState> rejected;
+    LOCK(cs_main);
+    for (const auto& prepared_tx : prepared) {
+        if (prepared_tx->m_scripts_ok) continue;
+        rejected.emplace(prepared_tx->m_tx->GetWitnessHash(), prepared_tx->m_accept.GetPreparedState());
+        for (const COutPoint& outpoint : prepared_tx->m_coins_to_uncache) {
+            active_chainstate.CoinsTip().Uncache(outpoint);
+        }
+    }
+    return rejected;
 }
 
 PackageMempoolAcceptResult ProcessNewPackage(CChainState& active_chainstate, CTxMemPool& pool,
@@ -1214,9 +1377,10 @@ CoinsViews::CoinsViews(
     std::string ldb_name,
     size_t cache_size_bytes,
     bool in_memory,
-    bool should_wipe) : m_dbview(
-                            gArgs.GetDataDirNet() / ldb_name, cache_size_bytes, in_memory, should_wipe),
-                        m_catcherview(&m_dbview) {}
+    bool should_wipe) : m_dbview(MakeCoinsView(
+                            g_coins_backend, GetCoinsDBPath(gArgs.GetDataDirNet(), ldb_name, g_coins_backend),
+                            cache_size_bytes, in_memory, should_wipe)),
+                        m_catcherview(m_dbview.get()) {}
 
 void CoinsViews::InitCache()
 {
@@ -1384,17 +1548,24 @@ int BlockManager::GetSpendHeight(const CCoinsViewCache& inputs)
 }
 
 
-static CuckooCache::cache<uint256, SignatureCacheHasher> g_scriptExecutionCache;
+static CuckooCache::sharded_cache<uint256, SignatureCacheHasher> g_scriptExecutionCache;
 static CSHA256 g_scriptExecutionCacheHasher;
+static uint256 g_scriptExecutionCacheNonce;
 
-void InitScriptExecutionCache() {
-    // Setup the salted hasher
-    uint256 nonce = GetRandHash();
+static void SaltScriptExecutionCache(const uint256& nonce)
+{
     // We want the nonce to be 64 bytes long to force the hasher to process
     // this chunk, which makes later hash computations more efficient. We
     // just write our 32-byte entropy twice to fill the 64 bytes.
+    g_scriptExecutionCacheNonce = nonce;
+    g_scriptExecutionCacheHasher.Reset();
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
+}
+
+void InitScriptExecutionCache() {
+    // Setup the salted hasher
+    SaltScriptExecutionCache(GetRandHash());
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
     size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
@@ -1441,7 +1612,6 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
     uint256 hashCacheEntry;
     CSHA256 hasher = g_scriptExecutionCacheHasher;
     hasher.Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
-    AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
     if (g_scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
         return true;
     }
@@ -1614,11 +1784,13 @@ static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 void StartScriptCheckWorkerThreads(int threads_num)
 {
     scriptcheckqueue.StartWorkerThreads(threads_num);
+    mempoolcheckqueue.StartWorkerThreads(threads_num, "mempoolch");
 }
 
 void StopScriptCheckWorkerThreads()
 {
     scriptcheckqueue.StopWorkerThreads();
+    mempoolcheckqueue.StopWorkerThreads();
 }
 
 /**
@@ -2983,7 +3155,8 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = NewBlockIndex();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3447,7 +3620,7 @@ bool ChainstateManager::ProcessNewBlockHeaders(const std::vector<CBlockHeader>&
 }
 
 /** Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk */
-bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, BlockValidationState& state, CBlockIndex** ppindex, bool fRequested, const FlatFilePos* dbp, bool* fNewBlock)
+bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, BlockValidationState& state, CBlockIndex** ppindex, bool fRequested, const FlatFilePos* dbp, bool* fNewBlock, const CompressedRecord* compressed)
 {
     const CBlock& block = *pblock;
 
@@ -3512,7 +3685,7 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, Block
     // Write block to history file
     if (fNewBlock) *fNewBlock = true;
     try {
-        FlatFilePos blockPos = SaveBlockToDisk(block, pindex->nHeight, m_chain, m_params, dbp);
+        FlatFilePos blockPos = SaveBlockToDisk(block, pindex->nHeight, m_chain, m_params, dbp, compressed);
         if (blockPos.IsNull()) {
             state.Error(strprintf("%s: Failed to find position to write new block to disk", __func__));
             return false;
@@ -3538,6 +3711,11 @@ bool ChainstateManager::ProcessNewBlock(const CChainParams& chainparams, const s
         if (new_block) *new_block = false;
         BlockValidationState state;
 
+        // Compress requested blocks, which are expected to be stored, before
+        // taking cs_main. Others are compressed if they get stored after all.
+        std::optional<CompressedRecord> compressed;
+        if (force_processing) compressed = CompressBlockRecord(*block);
+
         // CheckBlock() does not support multi-threaded block validation because CBlock::fChecked can cause data race.
         // Therefore, the following critical section must include the CheckBlock() call as well.
         LOCK(cs_main);
@@ -3550,7 +3728,7 @@ bool ChainstateManager::ProcessNewBlock(const CChainParams& chainparams, const s
         bool ret = CheckBlock(*block, state, chainparams.GetConsensus());
         if (ret) {
             // Store to disk
-            ret = ActiveChainstate().AcceptBlock(block, state, &pindex, force_processing, nullptr, new_block);
+            ret = ActiveChainstate().AcceptBlock(block, state, &pindex, force_processing, nullptr, new_block, compressed ? &*compressed : nullptr);
         }
         if (!ret) {
             GetMainSignals().BlockChecked(*block, state);
@@ -3730,6 +3908,17 @@ void BlockManager::FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPr
            nLastBlockWeCanPrune, count);
 }
 
+CBlockIndex* BlockManager::NewBlockIndex()
+{
+    AssertLockHeld(cs_main);
+
+    if (m_block_index_chunk_used == BLOCK_INDEX_CHUNK_SIZE) {
+        m_block_index_chunks.push_back(std::make_unique<CBlockIndex[]>(BLOCK_INDEX_CHUNK_SIZE));
+        m_block_index_chunk_used = 0;
+    }
+    return &m_block_index_chunks.back()[m_block_index_chunk_used++];
+}
+
 CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
 {
     AssertLockHeld(cs_main);
@@ -3743,7 +3932,7 @@ CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = NewBlockIndex();
     mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -3809,11 +3998,17 @@ void BlockManager::Unload() {
     m_failed_blocks.clear();
     m_blocks_unlinked.clear();
 
-    for (const BlockMap::value_type& entry : m_block_index) {
-        delete entry.second;
-    }
-
     m_block_index.clear();
+    m_block_index_chunks.clear();
+    m_block_index_chunk_used = BLOCK_INDEX_CHUNK_SIZE;
+}
+
+size_t BlockManager::DynamicMemoryUsage() const
+{
+    AssertLockHeld(cs_main);
+    return m_block_index.DynamicMemoryUsage() +
+           memusage::DynamicUsage(m_block_index_chunks) +
+           m_block_index_chunks.size() * memusage::MallocUsage(BLOCK_INDEX_CHUNK_SIZE * sizeof(CBlockIndex));
 }
 
 bool CChainState::LoadBlockIndexDB()
@@ -4208,124 +4403,128 @@ bool CChainState::LoadGenesisBlock()
     return true;
 }
 
-void CChainState::LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
+bool CChainState::LoadExternalBlock(const ExternalBlock& block, bool reindex, int& nLoaded)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+    const FlatFilePos* dbp = reindex ? &block.pos : nullptr;
 
-    int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            if (ShutdownRequested()) return;
-
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(m_params.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, m_params.MessageStart(), CMessageHeader::MESSAGE_START_SIZE)) {
-                    continue;
-                }
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
+        const uint256& hash = block.hash;
+        // Blocks from outside our block files are written to them, compressed
+        // before taking cs_main
+        std::optional<CompressedRecord> compressed;
+        if (!dbp) compressed = CompressBlockRecord(*block.block);
+        {
+            LOCK(cs_main);
+            // detect out of order blocks, and store them for later
+            if (hash != m_params.GetConsensus().hashGenesisBlock && !m_blockman.LookupBlockIndex(block.block->hashPrevBlock)) {
+                LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                        block.block->hashPrevBlock.ToString());
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                uint256 hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != m_params.GetConsensus().hashGenesisBlock && !m_blockman.LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                                block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                        continue;
-                    }
+                    mapBlocksUnknownParent.insert(std::make_pair(block.block->hashPrevBlock, *dbp));
+                return true;
+            }
 
-                    // process in case the block isn't known yet
-                    CBlockIndex* pindex = m_blockman.LookupBlockIndex(hash);
-                    if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
-                      BlockValidationState state;
-                      if (AcceptBlock(pblock, state, nullptr, true, dbp, nullptr)) {
-                          nLoaded++;
-                      }
-                      if (state.IsError()) {
-                          break;
-                      }
-                    } else if (hash != m_params.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                        LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
-                    }
-                }
+            // process in case the block isn't known yet
+            CBlockIndex* pindex = m_blockman.LookupBlockIndex(hash);
+            if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+              BlockValidationState state;
+              if (AcceptBlock(block.block, state, nullptr, true, dbp, nullptr, compressed ? &*compressed : nullptr)) {
+                  nLoaded++;
+              }
+              if (state.IsError()) {
+                  return false;
+              }
+            } else if (hash != m_params.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+                LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+            }
+        }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == m_params.GetConsensus().hashGenesisBlock) {
-                    BlockValidationState state;
-                    if (!ActivateBestChain(state, nullptr)) {
-                        break;
-                    }
-                }
+        // Activate the genesis block so normal node progress can continue
+        if (hash == m_params.GetConsensus().hashGenesisBlock) {
+            BlockValidationState state;
+            if (!ActivateBestChain(state, nullptr)) {
+                return false;
+            }
+        }
 
-                NotifyHeaderTip(*this);
+        NotifyHeaderTip(*this);
 
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, m_params.GetConsensus())) {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            BlockValidationState dummy;
-                            if (AcceptBlock(pblockrecursive, dummy, nullptr, true, &it->second, nullptr)) {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip(*this);
+        // Recursively process earlier encountered successors of this block
+        std::deque<uint256> queue;
+        queue.push_back(hash);
+        while (!queue.empty()) {
+            uint256 head = queue.front();
+            queue.pop_front();
+            std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+            while (range.first != range.second) {
+                std::multimap<uint256, FlatFilePos>::iterator it = range.first;
+                std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+                if (ReadBlockFromDisk(*pblockrecursive, it->second, m_params.GetConsensus())) {
+                    LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                            head.ToString());
+                    LOCK(cs_main);
+                    BlockValidationState dummy;
+                    if (AcceptBlock(pblockrecursive, dummy, nullptr, true, &it->second, nullptr)) {
+                        nLoaded++;
+                        queue.push_back(pblockrecursive->GetHash());
                     }
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                range.first++;
+                mapBlocksUnknownParent.erase(it);
+                NotifyHeaderTip(*this);
             }
         }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+    }
+    return true;
+}
+
+void CChainState::LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    try {
+        ReadBlocksFromFile(fileIn, dbp ? dbp->nFile : 0, m_params, [&](ExternalBlock&& block) {
+            if (ShutdownRequested()) return false;
+            if (dbp) *dbp = block.pos;
+            return LoadExternalBlock(block, dbp != nullptr, nLoaded);
+        });
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
     LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
 }
 
+void CChainState::LoadExternalBlockFiles(BlockFileReader& reader)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    int nFile = -1;
+    // File whose remaining blocks are skipped after an error, as loading a
+    // single file stops at the first error
+    int skip_file = -1;
+    ExternalBlock block;
+    while (reader.Next(block)) {
+        if (ShutdownRequested()) return;
+        if (block.pos.nFile != nFile) {
+            nFile = block.pos.nFile;
+            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+        }
+        if (block.pos.nFile == skip_file) continue;
+        if (!LoadExternalBlock(block, /* reindex= */ true, nLoaded)) skip_file = block.pos.nFile;
+    }
+    const std::string error = reader.GetError();
+    if (!error.empty()) {
+        AbortNode(std::string("System error: ") + error);
+    }
+    LogPrintf("Loaded %i blocks from block files in %dms\n", nLoaded, GetTimeMillis() - nStart);
+}
+
 void CChainState::CheckBlockIndex()
 {
     if (!fCheckBlockIndex) {
@@ -4551,6 +4750,9 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
 
+//! Transactions read from mempool.dat before they are verified and accepted together
+static constexpr size_t MEMPOOL_LOAD_BATCH_SIZE{200};
+
 bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function)
 {
     const CChainParams& chainparams = Params();
@@ -4569,6 +4771,54 @@ bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mocka
     int64_t unbroadcast = 0;
     int64_t nNow = GetTime();
 
+    // The hash of the tip the file was written at trails it, where older
+    // versions do not look. If it is still the tip, the scripts of the
+    // transactions were verified under the same flags before.
+    bool skip_script_checks{false};
+    if (gArgs.GetBoolArg("-trustmempoolfile", DEFAULT_TRUST_MEMPOOL_FILE)) {
+        uint256 dump_tip;
+        if (fseek(file.Get(), -int{sizeof(dump_tip)}, SEEK_END) == 0 && fread(dump_tip.begin(), 1, dump_tip.size(), file.Get()) == dump_tip.size()) {
+            LOCK(cs_main);
+            skip_script_checks = active_chainstate.m_chain.Tip() && dump_tip == active_chainstate.m_chain.Tip()->GetBlockHash();
+        }
+        if (fseek(file.Get(), 0, SEEK_SET) != 0) {
+            LogPrintf("Failed to rewind mempool file. Continuing anyway.\n");
+            return false;
+        }
+        if (skip_script_checks) {
+            LogPrintf("Loading mempool.dat written at the current chain tip, skipping script verification\n");
+        }
+    }
+
+    // Transactions are read in batches, so that their scripts can be verified
+    // in parallel and cs_main is taken once per batch. The file lists
+    // transactions by increasing number of in-mempool ancestors, so their
+    // parents are usually accepted in earlier batches.
+    const auto accept_batch = [&](const std::vector<std::pair<CTransactionRef, int64_t>>& batch) {
+        std::vector<CTransactionRef> txns;
+        for (const auto& [tx, time] : batch) txns.push_back(tx);
+        const auto rejected = skip_script_checks ? std::map<uint256, TxValidationState>{} : PreverifyTransactionScripts(active_chainstate, pool, txns);
+
+        LOCK(cs_main);
+        for (const auto& [tx, time] : batch) {
+            if (!rejected.count(tx->GetWitnessHash()) &&
+                AcceptToMemoryPoolWithTime(chainparams, pool, active_chainstate, tx, time, false /* bypass_limits */,
+                                           false /* test_accept */, skip_script_checks).m_result_type == MempoolAcceptResult::ResultType::VALID) {
+                ++count;
+            } else {
+                // mempool may contain the transaction already, e.g. from
+                // wallet(s) having loaded it while we were processing
+                // mempool transactions; consider these as valid, instead of
+                // failed, but mark them as 'already there'
+                if (pool.exists(tx->GetHash())) {
+                    ++already_there;
+                } else {
+                    ++failed;
+                }
+            }
+        }
+    };
+
     try {
         uint64_t version;
         file >> version;
@@ -4577,6 +4827,8 @@ bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mocka
         }
         uint64_t num;
         file >> num;
+        std::vector<std::pair<CTransactionRef, int64_t>> batch;
+        batch.reserve(std::min<uint64_t>(num, MEMPOOL_LOAD_BATCH_SIZE));
         while (num--) {
             CTransactionRef tx;
             int64_t nTime;
@@ -4590,24 +4842,14 @@ bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mocka
                 pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
             }
             if (nTime > nNow - nExpiryTimeout) {
-                LOCK(cs_main);
-                if (AcceptToMemoryPoolWithTime(chainparams, pool, active_chainstate, tx, nTime, false /* bypass_limits */,
-                                               false /* test_accept */).m_result_type == MempoolAcceptResult::ResultType::VALID) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetHash())) {
-                        ++already_there;
-                    } else {
-                        ++failed;
-                    }
-                }
+                batch.emplace_back(tx, nTime);
             } else {
                 ++expired;
             }
+            if (batch.size() == MEMPOOL_LOAD_BATCH_SIZE || (num == 0 && !batch.empty())) {
+                accept_batch(batch);
+                batch.clear();
+            }
             if (ShutdownRequested())
                 return false;
         }
@@ -4635,26 +4877,39 @@ bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mocka
     return true;
 }
 
-bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function, bool skip_file_commit)
+bool DumpMempool(const CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function, bool skip_file_commit)
 {
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
+    std::vector<std::pair<uint64_t, TxMempoolInfo>> vinfo;
     std::set<uint256> unbroadcast_txids;
 
     static Mutex dump_mutex;
     LOCK(dump_mutex);
 
+    const uint256 tip = WITH_LOCK(cs_main, return active_chainstate.m_chain.Tip() ? active_chainstate.m_chain.Tip()->GetBlockHash() : uint256{});
     {
+        // Only copy the entries under the lock, they are sorted after
         LOCK(pool.cs);
         for (const auto &i : pool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
-        vinfo = pool.infoAll();
+        vinfo.reserve(pool.mapTx.size());
+        for (const CTxMemPoolEntry& entry : pool.mapTx) {
+            vinfo.emplace_back(entry.GetCountWithAncestors(), TxMempoolInfo{entry.GetSharedTx(), entry.GetTime(), entry.GetFee(), entry.GetTxSize(), entry.GetModifiedFee() - entry.GetFee()});
+        }
         unbroadcast_txids = pool.GetUnbroadcastTxs();
     }
 
+    // A transaction has more in-mempool ancestors than any of its parents, so
+    // they come first. Transactions with as many ancestors are written by
+    // decreasing feerate, to be accepted first if the mempool is smaller.
+    std::sort(vinfo.begin(), vinfo.end(), [](const auto& a, const auto& b) {
+        if (a.first != b.first) return a.first < b.first;
+        return CFeeRate(a.second.fee + a.second.nFeeDelta, a.second.vsize) > CFeeRate(b.second.fee + b.second.nFeeDelta, b.second.vsize);
+    });
+
     int64_t mid = GetTimeMicros();
 
     try {
@@ -4669,7 +4924,7 @@ bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function, bool s
         file << version;
 
         file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
+        for (const auto& [ancestors, i] : vinfo) {
             file << *(i.tx);
             file << int64_t{count_seconds(i.m_time)};
             file << int64_t{i.nFeeDelta};
@@ -4681,6 +4936,8 @@ bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function, bool s
         LogPrintf("Writing %d unbroadcast transactions to disk.\n", unbroadcast_txids.size());
         file << unbroadcast_txids;
 
+        file << tip;
+
         if (!skip_file_commit && !FileCommit(file.Get()))
             throw std::runtime_error("FileCommit failed");
         file.fclose();
@@ -4696,6 +4953,97 @@ bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function, bool s
     return true;
 }
 
+static const uint64_t SCRIPT_CACHE_DUMP_VERSION = 1;
+
+bool LoadScriptCaches(FopenFn mockable_fopen_function)
+{
+    FILE* filestr{mockable_fopen_function(gArgs.GetDataDirNet() / "scriptcache.dat", "rb")};
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open script cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    SaltedCacheSnapshot sig_snapshot;
+    SaltedCacheSnapshot script_snapshot;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SCRIPT_CACHE_DUMP_VERSION) {
+            return false;
+        }
+        // Entries record the outcome of script verification by this
+        // particular build. Never trust results from a different one.
+        int client_version;
+        file >> client_version;
+        if (client_version != CLIENT_VERSION) {
+            LogPrintf("Ignoring script cache file written by client version %d\n", client_version);
+            return false;
+        }
+        file >> sig_snapshot;
+        file >> script_snapshot;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize script cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LoadSignatureCacheSnapshot(sig_snapshot);
+    SaltScriptExecutionCache(script_snapshot.nonce);
+    for (const uint256& entry : script_snapshot.entries) {
+        g_scriptExecutionCache.insert(entry);
+    }
+
+    LogPrintf("Imported script caches from disk: %u signature cache entries, %u script execution cache entries\n",
+              sig_snapshot.entries.size(), script_snapshot.entries.size());
+    return true;
+}
+
+bool DumpScriptCaches(FopenFn mockable_fopen_function, bool skip_file_commit)
+{
+    int64_t start = GetTimeMicros();
+
+    SaltedCacheSnapshot sig_snapshot = GetSignatureCacheSnapshot();
+    SaltedCacheSnapshot script_snapshot;
+    script_snapshot.nonce = g_scriptExecutionCacheNonce;
+    g_scriptExecutionCache.for_each([&](const uint256& entry) { script_snapshot.entries.push_back(entry); });
+
+    // Nothing was ever cached (e.g. shutting down before init completed), do
+    // not replace a previous dump with an empty one.
+    if (sig_snapshot.entries.empty() && script_snapshot.entries.empty()) {
+        return false;
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr{mockable_fopen_function(gArgs.GetDataDirNet() / "scriptcache.dat.new", "wb")};
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = SCRIPT_CACHE_DUMP_VERSION;
+        file << version;
+        file << int{CLIENT_VERSION};
+        file << sig_snapshot;
+        file << script_snapshot;
+
+        if (!skip_file_commit && !FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        if (!RenameOver(gArgs.GetDataDirNet() / "scriptcache.dat.new", gArgs.GetDataDirNet() / "scriptcache.dat")) {
+            throw std::runtime_error("Rename failed");
+        }
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped script caches: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump script caches: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 //! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
@@ -4889,120 +5237,62 @@ bool ChainstateManager::PopulateAndValidateSnapshot(
 
     const AssumeutxoData& au_data = *maybe_au_data;
 
-    COutPoint outpoint;
-    Coin coin;
     const uint64_t coins_count = metadata.m_coins_count;
-    uint64_t coins_left = metadata.m_coins_count;
-
-    LogPrintf("[snapshot] loading coins from snapshot %s\n", base_blockhash.ToString());
-    int64_t flush_now{0};
-    int64_t coins_processed{0};
-
-    while (coins_left > 0) {
-        try {
-            coins_file >> outpoint;
-            coins_file >> coin;
-        } catch (const std::ios_base::failure&) {
-            LogPrintf("[snapshot] bad snapshot format or truncated snapshot after deserializing %d coins\n",
-                      coins_count - coins_left);
-            return false;
-        }
-        if (coin.nHeight > base_height ||
-            outpoint.n >= std::numeric_limits<decltype(outpoint.n)>::max() // Avoid integer wrap-around in coinstats.cpp:ApplyHash
-        ) {
-            LogPrintf("[snapshot] bad snapshot data after deserializing %d coins\n",
-                      coins_count - coins_left);
-            return false;
-        }
-
-        coins_cache.EmplaceCoinInternalDANGER(std::move(outpoint), std::move(coin));
-
-        --coins_left;
-        ++coins_processed;
-
-        if (coins_processed % 1000000 == 0) {
-            LogPrintf("[snapshot] %d coins loaded (%.2f%%, %.2f MB)\n",
-                coins_processed,
-                static_cast<float>(coins_processed) * 100 / static_cast<float>(coins_count),
-                coins_cache.DynamicMemoryUsage() / (1000 * 1000));
-        }
+    uint64_t coins_processed{0};
 
-        // Batch write and flush (if we need to) every so often.
-        //
-        // If our average Coin size is roughly 41 bytes, checking every 120,000 coins
-        // means <5MB of memory imprecision.
-        if (coins_processed % 120000 == 0) {
-            if (ShutdownRequested()) {
-                return false;
-            }
-
-            const auto snapshot_cache_state = WITH_LOCK(::cs_main,
-                return snapshot_chainstate.GetCoinsCacheSizeState());
-
-            if (snapshot_cache_state >=
-                    CoinsCacheSizeState::CRITICAL) {
-                LogPrintf("[snapshot] flushing coins cache (%.2f MB)... ", /* Continued */
-                    coins_cache.DynamicMemoryUsage() / (1000 * 1000));
-                flush_now = GetTimeMillis();
-
-                // This is a hack - we don't know what the actual best block is, but that
-                // doesn't matter for the purposes of flushing the cache here. We'll set this
-                // to its correct value (`base_blockhash`) below after the coins are loaded.
-                coins_cache.SetBestBlock(GetRandHash());
-
-                coins_cache.Flush();
-                LogPrintf("done (%.2fms)\n", GetTimeMillis() - flush_now);
-            }
-        }
-    }
+    // As above, okay to immediately release cs_main here since no other context knows
+    // about the snapshot_chainstate.
+    CCoinsViewDisk& snapshot_coinsdb = *WITH_LOCK(::cs_main, return &snapshot_chainstate.CoinsDB());
 
-    // Important that we set this. This and the coins_cache accesses above are
-    // sort of a layer violation, but either we reach into the innards of
-    // CCoinsViewCache here or we have to invert some of the CChainState to
-    // embed them in a snapshot-activation-specific CCoinsViewCache bulk load
-    // method.
-    coins_cache.SetBestBlock(base_blockhash);
+    // The chunks are checked and hashed on several threads. The HASH_SERIALIZED
+    // hash of the UTXO set is computed from their coins as they are loaded, so
+    // the loaded coins need not be read again to compare it with the assumeutxo
+    // value.
+    CHashWriter hash_serialized(SER_GETHASH, PROTOCOL_VERSION);
+    hash_serialized << base_blockhash;
+    MuHash3072 muhash;
 
-    bool out_of_coins{false};
-    try {
-        coins_file >> outpoint;
-    } catch (const std::ios_base::failure&) {
-        // We expect an exception since we should be out of coins.
-        out_of_coins = true;
-    }
-    if (!out_of_coins) {
-        LogPrintf("[snapshot] bad snapshot - coins left over after deserializing %d coins\n",
-            coins_count);
+    LogPrintf("[snapshot] loading coins from snapshot %s\n", base_blockhash.ToString());
+    std::string error;
+    const bool loaded = ReadUTXOSnapshot(coins_file, metadata, base_height, [&](SnapshotChunkCoins&& chunk) {
+        hash_serialized.write((const char*)chunk.hash_data.data(), chunk.hash_data.size());
+        muhash *= chunk.muhash;
+        coins_processed += chunk.coins.size();
+
+        // The chunks are written straight to the coins database, skipping the
+        // cache. This is a hack - we don't know what the actual best block is,
+        // but that doesn't matter for the purposes of writing the coins here.
+        // We'll set this to its correct value (`base_blockhash`) below after
+        // the coins are loaded.
+        if (!chunk.coins.empty()) snapshot_coinsdb.BatchWrite(chunk.coins, GetRandHash());
+
+        LogPrint(BCLog::VALIDATION, "[snapshot] %d coins loaded (%.2f%%)\n",
+            coins_processed, coins_count ? coins_processed * 100.0 / coins_count : 100.0);
+        return !ShutdownRequested();
+    }, error);
+    if (!loaded) {
+        if (!error.empty()) LogPrintf("[snapshot] bad snapshot: %s\n", error);
         return false;
     }
 
-    LogPrintf("[snapshot] loaded %d (%.2f MB) coins from snapshot %s\n",
-        coins_count,
-        coins_cache.DynamicMemoryUsage() / (1000 * 1000),
-        base_blockhash.ToString());
-
-    LogPrintf("[snapshot] flushing snapshot chainstate to disk\n");
-    // No need to acquire cs_main since this chainstate isn't being used yet.
-    coins_cache.Flush(); // TODO: if #17487 is merged, add erase=false here for better performance.
-
+    // Important that we set this. This and the coins database accesses above
+    // are sort of a layer violation, but either we reach into the innards of
+    // the chainstate here or we have to invert some of the CChainState to
+    // embed them in a snapshot-activation-specific bulk load method.
+    coins_cache.SetBestBlock(base_blockhash);
+    coins_cache.Flush();
     assert(coins_cache.GetBestBlock() == base_blockhash);
 
-    CCoinsStats stats{CoinStatsHashType::HASH_SERIALIZED};
-    auto breakpoint_fnc = [] { /* TODO insert breakpoint here? */ };
-
-    // As above, okay to immediately release cs_main here since no other context knows
-    // about the snapshot_chainstate.
-    CCoinsViewDB* snapshot_coinsdb = WITH_LOCK(::cs_main, return &snapshot_chainstate.CoinsDB());
-
-    if (!GetUTXOStats(snapshot_coinsdb, WITH_LOCK(::cs_main, return std::ref(m_blockman)), stats, breakpoint_fnc)) {
-        LogPrintf("[snapshot] failed to generate coins stats\n");
-        return false;
-    }
+    uint256 muhash_out;
+    muhash.Finalize(muhash_out);
+    LogPrintf("[snapshot] loaded %d coins from snapshot %s (muhash %s)\n",
+        coins_count, base_blockhash.ToString(), muhash_out.ToString());
 
     // Assert that the deserialized chainstate contents match the expected assumeutxo value.
-    if (AssumeutxoHash{stats.hashSerialized} != au_data.hash_serialized) {
+    const uint256 content_hash = hash_serialized.GetHash();
+    if (AssumeutxoHash{content_hash} != au_data.hash_serialized) {
         LogPrintf("[snapshot] bad snapshot content hash: expected %s, got %s\n",
-            au_data.hash_serialized.ToString(), stats.hashSerialized.ToString());
+            au_data.hash_serialized.ToString(), content_hash.ToString());
         return false;
     }
 
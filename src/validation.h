@@ -12,6 +12,7 @@
 
 #include <amount.h>
 #include <attributes.h>
+#include <blockmap.h>
 #include <coins.h>
 #include <consensus/validation.h>
 #include <crypto/common.h> // for ReadLE64
@@ -41,6 +42,7 @@
 #include <vector>
 
 class CChainState;
+class BlockFileReader;
 class BlockValidationState;
 class CBlockIndex;
 class CBlockTreeDB;
@@ -53,8 +55,10 @@ class CScriptCheck;
 class CTxMemPool;
 class ChainstateManager;
 struct ChainTxData;
+struct CompressedRecord;
 
 struct DisconnectedBlockTransactions;
+struct ExternalBlock;
 struct PrecomputedTransactionData;
 struct LockPoints;
 struct AssumeutxoData;
@@ -82,6 +86,12 @@ static constexpr bool DEFAULT_COINSTATSINDEX{false};
 static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -trustmempoolfile */
+static const bool DEFAULT_TRUST_MEMPOOL_FILE = false;
+/** Interval between background dumps of the mempool with -persistmempool */
+static constexpr std::chrono::minutes DUMP_MEMPOOL_INTERVAL{15};
+/** Default for -persistscriptcache */
+static const bool DEFAULT_PERSIST_SCRIPT_CACHE = false;
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of ::ChainActive().Tip() will not be pruned. */
@@ -106,7 +116,6 @@ enum class SynchronizationState {
 };
 
 extern RecursiveMutex cs_main;
-typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern Mutex g_best_block_mutex;
 extern std::condition_variable g_best_block_cv;
 extern uint256 g_best_block;
@@ -228,9 +237,31 @@ struct PackageMempoolAcceptResult
  * (Try to) add a transaction to the memory pool.
  * @param[in]  bypass_limits   When true, don't enforce mempool fee limits.
  * @param[in]  test_accept     When true, run validation checks but don't submit to mempool.
+ * @param[in]  script_failure  The failure of the scripts of the transaction found by
+ *                             PreverifyTransactionScripts(), reported in place of verifying them again.
  */
 MempoolAcceptResult AcceptToMemoryPool(CChainState& active_chainstate, CTxMemPool& pool, const CTransactionRef& tx,
-                                       bool bypass_limits, bool test_accept=false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+                                       bool bypass_limits, bool test_accept=false,
+                                       const TxValidationState* script_failure=nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/**
+ * Verify the scripts of transactions that are about to be submitted to
+ * AcceptToMemoryPool(), in parallel and without holding cs_main. Their inputs
+ * are looked up under cs_main, then their scripts are verified against these
+ * coins on the mempool script check threads. Successes are cached, so that
+ * AcceptToMemoryPool() only has to redo the cheap checks under cs_main.
+ *
+ * Only the context free checks run before the scripts are verified; the rest
+ * of the policy checks are left to AcceptToMemoryPool(). Transactions whose
+ * inputs are missing, for instance because they spend outputs of one another,
+ * are left to AcceptToMemoryPool() entirely.
+ *
+ * @returns The script failures of the transactions with invalid scripts, by
+ *          wtxid. These only depend on the inputs of the transactions, so they
+ *          can be passed to AcceptToMemoryPool() as script_failure.
+ */
+std::map<uint256, TxValidationState> PreverifyTransactionScripts(CChainState& active_chainstate, CTxMemPool& pool,
+                                                                 const std::vector<CTransactionRef>& txns) LOCKS_EXCLUDED(cs_main);
 
 /**
 * Atomically test acceptance of a package. If the package only contains one tx, package rules still
@@ -417,6 +448,18 @@ private:
      */
     void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight, int chain_tip_height, int prune_height, bool is_ibd);
 
+    /** Number of CBlockIndex entries allocated at once. */
+    static constexpr size_t BLOCK_INDEX_CHUNK_SIZE{4096};
+
+    /** Backing storage for every CBlockIndex in m_block_index. Entries are
+     * allocated in chunks, rather than one heap allocation per block, and
+     * are freed all at once by Unload(). */
+    std::vector<std::unique_ptr<CBlockIndex[]>> m_block_index_chunks GUARDED_BY(cs_main);
+    size_t m_block_index_chunk_used GUARDED_BY(cs_main){BLOCK_INDEX_CHUNK_SIZE};
+
+    /** Allocate a default constructed CBlockIndex, owned by this BlockManager. */
+    CBlockIndex* NewBlockIndex() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 public:
     BlockMap m_block_index GUARDED_BY(cs_main);
 
@@ -463,6 +506,9 @@ public:
     /** Clear all data members. */
     void Unload() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /** Approximate heap usage of the block index, including the CBlockIndex entries. */
+    size_t DynamicMemoryUsage() const EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     CBlockIndex* AddToBlockIndex(const CBlockHeader& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /** Create a new block index entry for a given block hash */
     CBlockIndex* InsertBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -507,14 +553,14 @@ public:
  * This class consists of an arrangement of layered CCoinsView objects,
  * preferring to store and retrieve coins in memory via `m_cacheview` but
  * ultimately falling back on cache misses to the canonical store of UTXOs on
- * disk, `m_dbview`.
+ * disk, `m_dbview`, which is kept in the format of g_coins_backend.
  */
 class CoinsViews {
 
 public:
-    //! The lowest level of the CoinsViews cache hierarchy sits in a leveldb database on disk.
-    //! All unspent coins reside in this store.
-    CCoinsViewDB m_dbview GUARDED_BY(cs_main);
+    //! The lowest level of the CoinsViews cache hierarchy sits in a leveldb database or flat
+    //! files on disk. All unspent coins reside in this store.
+    std::unique_ptr<CCoinsViewDisk> m_dbview GUARDED_BY(cs_main);
 
     //! This view wraps access to the leveldb instance and handles read errors gracefully.
     CCoinsViewErrorCatcher m_catcherview GUARDED_BY(cs_main);
@@ -523,12 +569,12 @@ public:
     //! can fit per the dbcache setting.
     std::unique_ptr<CCoinsViewCache> m_cacheview GUARDED_BY(cs_main);
 
-    //! This constructor initializes CCoinsViewDB and CCoinsViewErrorCatcher instances, but it
+    //! This constructor initializes the on-disk view and CCoinsViewErrorCatcher instances, but it
     //! *does not* create a CCoinsViewCache instance by default. This is done separately because the
     //! presence of the cache has implications on whether or not we're allowed to flush the cache's
     //! state to disk, which should not be done until the health of the database is verified.
     //!
-    //! All arguments forwarded onto CCoinsViewDB.
+    //! All arguments forwarded onto MakeCoinsView.
     CoinsViews(std::string ldb_name, size_t cache_size_bytes, bool in_memory, bool should_wipe);
 
     //! Initialize the CCoinsViewCache member.
@@ -654,9 +700,9 @@ public:
     }
 
     //! @returns A reference to the on-disk UTXO set database.
-    CCoinsViewDB& CoinsDB() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    CCoinsViewDisk& CoinsDB() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     {
-        return m_coins_views->m_dbview;
+        return *m_coins_views->m_dbview;
     }
 
     //! @returns A reference to a wrapped view of the in-memory UTXO set that
@@ -682,6 +728,8 @@ public:
 
     /** Import blocks from an external file */
     void LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp = nullptr);
+    /** Import the blocks read ahead from our own block files by reader, for -reindex */
+    void LoadExternalBlockFiles(BlockFileReader& reader);
 
     /**
      * Update the on-disk chain state.
@@ -725,7 +773,7 @@ public:
         BlockValidationState& state,
         std::shared_ptr<const CBlock> pblock = nullptr) LOCKS_EXCLUDED(cs_main);
 
-    bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, BlockValidationState& state, CBlockIndex** ppindex, bool fRequested, const FlatFilePos* dbp, bool* fNewBlock) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, BlockValidationState& state, CBlockIndex** ppindex, bool fRequested, const FlatFilePos* dbp, bool* fNewBlock, const CompressedRecord* compressed = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Block (dis)connection on a given view:
     DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
@@ -800,6 +848,13 @@ private:
 
     bool LoadBlockIndexDB() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Accept a block read by LoadExternalBlockFile(s), or remember where it is
+     * if its parent is not known yet and it is in one of our own block files
+     * (reindex). Returns false if importing the rest of the file should stop.
+     */
+    bool LoadExternalBlock(const ExternalBlock& block, bool reindex, int& nLoaded) LOCKS_EXCLUDED(cs_main);
+
     //! Indirection necessary to make lock annotations work with an optional mempool.
     RecursiveMutex* MempoolMutex() const LOCK_RETURNED(m_mempool->cs)
     {
@@ -1052,12 +1107,25 @@ extern std::unique_ptr<CBlockTreeDB> pblocktree;
 
 using FopenFn = std::function<FILE*(const fs::path&, const char*)>;
 
-/** Dump the mempool to disk. */
-bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function = fsbridge::fopen, bool skip_file_commit = false);
+/** Dump the mempool to disk, in topological order and followed by the hash of
+ * the chain tip. The pool is only locked while its entries are copied. */
+bool DumpMempool(const CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function = fsbridge::fopen, bool skip_file_commit = false);
 
-/** Load the mempool from disk. */
+/** Load the mempool from disk. Transactions are verified and accepted in
+ * batches; with -trustmempoolfile their scripts are not verified again if the
+ * file was dumped at the current chain tip. */
 bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function = fsbridge::fopen);
 
+/** Dump the signature and script execution caches, together with their salts, to disk. */
+bool DumpScriptCaches(FopenFn mockable_fopen_function = fsbridge::fopen, bool skip_file_commit = false);
+
+/**
+ * Load the signature and script execution caches from disk. Must be called
+ * after InitSignatureCache() and InitScriptExecutionCache(), before any
+ * script is verified, as it replaces the caches' salts.
+ */
+bool LoadScriptCaches(FopenFn mockable_fopen_function = fsbridge::fopen);
+
 /**
  * Return the expected assumeutxo value for a given height, if one exists.
  *
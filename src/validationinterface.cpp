@@ -8,83 +8,237 @@
 #include <chain.h>
 #include <consensus/validation.h>
 #include <logging.h>
+#include <metrics/metrics.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <scheduler.h>
+#include <tinyformat.h>
+#include <util/thread.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <future>
-#include <unordered_map>
+#include <list>
+#include <thread>
 #include <utility>
 
-//! The MainSignalsInstance manages a list of shared_ptr<CValidationInterface>
-//! callbacks.
+//! Number of threads running the callbacks of subscribers
+static constexpr int VALIDATION_SIGNAL_THREADS{4};
+
+//! A registered subscriber and the queue its background callbacks run on.
+//!
+//! Callbacks queued for a subscriber hold a shared_ptr to its Subscriber, so
+//! the callbacks object is released after the last of them ran. Callbacks
+//! still queued when it is unregistered are skipped.
+struct Subscriber {
+    std::shared_ptr<CValidationInterface> callbacks;
+    SingleThreadedSchedulerClient* queue;
+    //! Queue depth and lag metrics of the subscriber
+    metrics::SignalsMetrics::Subscriber metrics;
+    std::atomic<bool> registered{true};
+};
+
+//! The MainSignalsInstance manages the registered subscribers and the queues
+//! background callbacks run on.
 //!
-//! A std::unordered_map is used to track what callbacks are currently
-//! registered, and a std::list is to used to store the callbacks that are
-//! currently registered as well as any callbacks that are just unregistered
-//! and about to be deleted when they are done executing.
+//! Events are queued in order on a single dispatch queue running on the node
+//! scheduler, which copies each of them to the queue of every subscriber
+//! registered at that point. Subscriber queues are serviced by a pool of
+//! threads: one subscriber being slow no longer delays the others, and as each
+//! queue runs one callback at a time, each subscriber still sees the events in
+//! order.
 struct MainSignalsInstance {
 private:
     Mutex m_mutex;
-    //! List entries consist of a callback pointer and reference count. The
-    //! count is equal to the number of current executions of that entry, plus 1
-    //! if it's registered. It cannot be 0 because that would imply it is
-    //! unregistered and also not being executed (so shouldn't exist).
-    struct ListEntry { std::shared_ptr<CValidationInterface> callbacks; int count = 1; };
-    std::list<ListEntry> m_list GUARDED_BY(m_mutex);
-    std::unordered_map<CValidationInterface*, std::list<ListEntry>::iterator> m_map GUARDED_BY(m_mutex);
+    //! Registered subscribers, in registration order
+    std::vector<std::shared_ptr<Subscriber>> m_subscribers GUARDED_BY(m_mutex);
+    //! Subscriber queues are reused rather than destroyed on unregistration,
+    //! as the pool may still hold references to them.
+    std::list<SingleThreadedSchedulerClient> m_queues GUARDED_BY(m_mutex);
+    std::vector<SingleThreadedSchedulerClient*> m_free_queues GUARDED_BY(m_mutex);
+
+    CScheduler m_pool;
+    std::vector<std::thread> m_pool_threads;
+    std::atomic<bool> m_pool_stopped{false};
+
+    std::vector<std::shared_ptr<Subscriber>> Subscribers() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    {
+        LOCK(m_mutex);
+        return m_subscribers;
+    }
+
+    std::vector<SingleThreadedSchedulerClient*> Queues() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    {
+        LOCK(m_mutex);
+        std::vector<SingleThreadedSchedulerClient*> queues;
+        for (auto& queue : m_queues) queues.push_back(&queue);
+        return queues;
+    }
+
+    void Unregister(std::vector<std::shared_ptr<Subscriber>>::iterator it) EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        (*it)->registered = false;
+        m_free_queues.push_back((*it)->queue);
+        m_subscribers.erase(it);
+    }
+
+    //! Queue func on the subscriber's queue
+    void Enqueue(const std::shared_ptr<Subscriber>& subscriber, std::function<void()> func)
+    {
+        const auto enqueued = std::chrono::steady_clock::now();
+        subscriber->queue->AddToProcessQueue([subscriber, func = std::move(func), enqueued] {
+            if (!subscriber->registered) return;
+            auto& signals_metrics = metrics::Instance()->Signals();
+            signals_metrics.Lag(subscriber->metrics, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - enqueued).count());
+            signals_metrics.QueueDepth(subscriber->metrics, subscriber->queue->CallbacksPending());
+            func();
+        });
+        metrics::Instance()->Signals().QueueDepth(subscriber->metrics, subscriber->queue->CallbacksPending());
+    }
+
+    //! Wait for all subscriber queues to run the callbacks queued so far. Once
+    //! the pool is stopped, run them on the calling thread instead.
+    void WaitForSubscribers()
+    {
+        const auto queues = Queues();
+        if (m_pool_stopped) {
+            for (auto* queue : queues) queue->EmptyQueue();
+            return;
+        }
+        Mutex mutex;
+        std::condition_variable cond;
+        size_t remaining{queues.size()};
+        for (auto* queue : queues) {
+            queue->AddToProcessQueue([&] {
+                LOCK(mutex);
+                if (--remaining == 0) cond.notify_one();
+            });
+        }
+        WAIT_LOCK(mutex, lock);
+        cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(mutex) { return remaining == 0; });
+    }
 
-public:
     // We are not allowed to assume the scheduler only runs in one thread,
     // but must ensure all callbacks happen in-order, so we end up creating
     // our own queue here :(
     SingleThreadedSchedulerClient m_schedulerClient;
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+public:
+    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler)
+    {
+        for (int i = 0; i < VALIDATION_SIGNAL_THREADS; ++i) {
+            m_pool_threads.emplace_back([this, i] { util::TraceThread(strprintf("valsig.%i", i).c_str(), [this] { m_pool.serviceQueue(); }); });
+        }
+    }
+
+    ~MainSignalsInstance() { StopPool(); }
+
+    void StopPool()
+    {
+        if (m_pool_stopped.exchange(true)) return;
+        m_pool.stop();
+        for (auto& thread : m_pool_threads) thread.join();
+    }
 
     void Register(std::shared_ptr<CValidationInterface> callbacks)
     {
+        auto subscriber = std::make_shared<Subscriber>();
+        subscriber->metrics = metrics::Instance()->Signals().Register(callbacks->SubscriberName());
+        subscriber->callbacks = std::move(callbacks);
         LOCK(m_mutex);
-        auto inserted = m_map.emplace(callbacks.get(), m_list.end());
-        if (inserted.second) inserted.first->second = m_list.emplace(m_list.end());
-        inserted.first->second->callbacks = std::move(callbacks);
+        auto it = std::find_if(m_subscribers.begin(), m_subscribers.end(), [&](const auto& s) { return s->callbacks.get() == subscriber->callbacks.get(); });
+        if (it != m_subscribers.end()) {
+            // Registering again replaces the callbacks object, keeping the
+            // queue so that the order of events is unchanged
+            subscriber->queue = (*it)->queue;
+            (*it)->registered = false;
+            *it = std::move(subscriber);
+            return;
+        }
+        if (m_free_queues.empty()) {
+            subscriber->queue = &m_queues.emplace_back(&m_pool);
+        } else {
+            subscriber->queue = m_free_queues.back();
+            m_free_queues.pop_back();
+        }
+        m_subscribers.push_back(std::move(subscriber));
     }
 
     void Unregister(CValidationInterface* callbacks)
     {
         LOCK(m_mutex);
-        auto it = m_map.find(callbacks);
-        if (it != m_map.end()) {
-            if (!--it->second->count) m_list.erase(it->second);
-            m_map.erase(it);
-        }
+        auto it = std::find_if(m_subscribers.begin(), m_subscribers.end(), [&](const auto& s) { return s->callbacks.get() == callbacks; });
+        if (it != m_subscribers.end()) Unregister(it);
     }
 
-    //! Clear unregisters every previously registered callback, erasing every
-    //! map entry. After this call, the list may still contain callbacks that
-    //! are currently executing, but it will be cleared when they are done
-    //! executing.
+    //! Clear unregisters every previously registered callback. Callbacks that
+    //! are currently executing are released when they are done executing.
     void Clear()
     {
         LOCK(m_mutex);
-        for (const auto& entry : m_map) {
-            if (!--entry.second->count) m_list.erase(entry.second);
-        }
-        m_map.clear();
+        while (!m_subscribers.empty()) Unregister(std::prev(m_subscribers.end()));
     }
 
+    //! Call f on every registered subscriber, on the calling thread
     template<typename F> void Iterate(F&& f)
     {
-        WAIT_LOCK(m_mutex, lock);
-        for (auto it = m_list.begin(); it != m_list.end();) {
-            ++it->count;
-            {
-                REVERSE_LOCK(lock);
-                f(*it->callbacks);
-            }
-            it = --it->count ? std::next(it) : m_list.erase(it);
+        for (const auto& subscriber : Subscribers()) {
+            if (subscriber->registered) f(*subscriber->callbacks);
         }
     }
+
+    //! Queue a call of f on every registered subscriber, to run on their
+    //! queues. log is called once, when the event is dispatched.
+    template<typename L, typename F> void Dispatch(L log, F f)
+    {
+        m_schedulerClient.AddToProcessQueue([this, log, f] {
+            log();
+            for (const auto& subscriber : Subscribers()) {
+                Enqueue(subscriber, [f, &callbacks = *subscriber->callbacks] { f(callbacks); });
+            }
+        });
+    }
+
+    //! Queue func to run once every callback queued before it ran
+    void CallFunction(std::function<void()> func)
+    {
+        m_schedulerClient.AddToProcessQueue([this, func = std::move(func)] {
+            WaitForSubscribers();
+            func();
+        });
+    }
+
+    //! Queue func on the queue of a subscriber, to run once the callbacks
+    //! queued for it before ran. It is dropped if the subscriber is not
+    //! registered by then.
+    void CallFunction(CValidationInterface& callbacks, std::function<void()> func)
+    {
+        m_schedulerClient.AddToProcessQueue([this, &callbacks, func = std::move(func)] {
+            for (const auto& subscriber : Subscribers()) {
+                if (subscriber->callbacks.get() == &callbacks) Enqueue(subscriber, func);
+            }
+        });
+    }
+
+    //! Run every queued callback on the calling thread. The node scheduler
+    //! must have been stopped.
+    void Flush()
+    {
+        StopPool();
+        do {
+            m_schedulerClient.EmptyQueue();
+            for (auto* queue : Queues()) queue->EmptyQueue();
+        } while (m_schedulerClient.CallbacksPending() > 0);
+    }
+
+    //! The dispatch queue depth, plus that of the longest subscriber queue
+    size_t CallbacksPending()
+    {
+        size_t max_pending{0};
+        for (auto* queue : Queues()) max_pending = std::max(max_pending, queue->CallbacksPending());
+        return m_schedulerClient.CallbacksPending() + max_pending;
+    }
 };
 
 static CMainSignals g_signals;
@@ -103,14 +257,14 @@ void CMainSignals::UnregisterBackgroundSignalScheduler()
 void CMainSignals::FlushBackgroundCallbacks()
 {
     if (m_internals) {
-        m_internals->m_schedulerClient.EmptyQueue();
+        m_internals->Flush();
     }
 }
 
 size_t CMainSignals::CallbacksPending()
 {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    return m_internals->CallbacksPending();
 }
 
 CMainSignals& GetMainSignals()
@@ -154,7 +308,12 @@ void UnregisterAllValidationInterfaces()
 
 void CallFunctionInValidationInterfaceQueue(std::function<void()> func)
 {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    g_signals.m_internals->CallFunction(std::move(func));
+}
+
+void CallFunctionInValidationInterfaceQueue(CValidationInterface& callbacks, std::function<void()> func)
+{
+    g_signals.m_internals->CallFunction(callbacks, std::move(func));
 }
 
 void SyncWithValidationInterfaceQueue()
@@ -172,14 +331,13 @@ void SyncWithValidationInterfaceQueue()
 // evaluating arguments when logging is not enabled.
 //
 // NOTE: The lambda captures all local variables by value.
-#define ENQUEUE_AND_LOG_EVENT(event, fmt, name, ...)           \
-    do {                                                       \
-        auto local_name = (name);                              \
-        LOG_EVENT("Enqueuing " fmt, local_name, __VA_ARGS__);  \
-        m_internals->m_schedulerClient.AddToProcessQueue([=] { \
-            LOG_EVENT(fmt, local_name, __VA_ARGS__);           \
-            event();                                           \
-        });                                                    \
+#define ENQUEUE_AND_LOG_EVENT(event, fmt, name, ...)          \
+    do {                                                      \
+        auto local_name = (name);                             \
+        LOG_EVENT("Enqueuing " fmt, local_name, __VA_ARGS__); \
+        m_internals->Dispatch([=] {                           \
+            LOG_EVENT(fmt, local_name, __VA_ARGS__);          \
+        }, event);                                            \
     } while (0)
 
 #define LOG_EVENT(fmt, ...) \
@@ -190,8 +348,8 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
     // the chain actually updates. One way to ensure this is for the caller to invoke this signal
     // in the same critical section where the chain is updated
 
-    auto event = [pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload); });
+    auto event = [pindexNew, pindexFork, fInitialDownload](CValidationInterface& callbacks) {
+        callbacks.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: new block hash=%s fork block hash=%s (in IBD=%s)", __func__,
                           pindexNew->GetBlockHash().ToString(),
@@ -200,8 +358,8 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
 }
 
 void CMainSignals::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) {
-    auto event = [tx, mempool_sequence, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.TransactionAddedToMempool(tx, mempool_sequence); });
+    auto event = [tx, mempool_sequence](CValidationInterface& callbacks) {
+        callbacks.TransactionAddedToMempool(tx, mempool_sequence);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: txid=%s wtxid=%s", __func__,
                           tx->GetHash().ToString(),
@@ -209,8 +367,8 @@ void CMainSignals::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t
 }
 
 void CMainSignals::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) {
-    auto event = [tx, reason, mempool_sequence, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.TransactionRemovedFromMempool(tx, reason, mempool_sequence); });
+    auto event = [tx, reason, mempool_sequence](CValidationInterface& callbacks) {
+        callbacks.TransactionRemovedFromMempool(tx, reason, mempool_sequence);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: txid=%s wtxid=%s", __func__,
                           tx->GetHash().ToString(),
@@ -218,8 +376,8 @@ void CMainSignals::TransactionRemovedFromMempool(const CTransactionRef& tx, MemP
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex) {
-    auto event = [pblock, pindex, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.BlockConnected(pblock, pindex); });
+    auto event = [pblock, pindex](CValidationInterface& callbacks) {
+        callbacks.BlockConnected(pblock, pindex);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s block height=%d", __func__,
                           pblock->GetHash().ToString(),
@@ -228,8 +386,8 @@ void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, c
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex)
 {
-    auto event = [pblock, pindex, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.BlockDisconnected(pblock, pindex); });
+    auto event = [pblock, pindex](CValidationInterface& callbacks) {
+        callbacks.BlockDisconnected(pblock, pindex);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s block height=%d", __func__,
                           pblock->GetHash().ToString(),
@@ -237,8 +395,8 @@ void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock
 }
 
 void CMainSignals::ChainStateFlushed(const CBlockLocator &locator) {
-    auto event = [locator, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.ChainStateFlushed(locator); });
+    auto event = [locator](CValidationInterface& callbacks) {
+        callbacks.ChainStateFlushed(locator);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s", __func__,
                           locator.IsNull() ? "null" : locator.vHave.front().ToString());
@@ -11,6 +11,7 @@
 
 #include <functional>
 #include <memory>
+#include <string>
 
 extern RecursiveMutex cs_main;
 class BlockValidationState;
@@ -49,6 +50,14 @@ void UnregisterSharedValidationInterface(std::shared_ptr<CValidationInterface> c
  * will result in a deadlock (that DEBUG_LOCKORDER will miss).
  */
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
+/**
+ * Pushes a function to callback onto the notification queue of one
+ * subscriber, guaranteeing the callbacks generated prior to now for that
+ * subscriber are finished when the function is called. Unlike the above, this
+ * does not wait for the other subscribers. The function is dropped if the
+ * subscriber is unregistered before it gets to run.
+ */
+void CallFunctionInValidationInterfaceQueue(CValidationInterface& callbacks, std::function<void ()> func);
 /**
  * This is a synonym for the following, which asserts certain locks are not
  * held:
@@ -73,9 +82,14 @@ void SyncWithValidationInterfaceQueue() LOCKS_EXCLUDED(cs_main);
  * UpdatedBlockTip() callback may depend on an operation performed in
  * the BlockConnected() callback without worrying about explicit
  * synchronization. No ordering should be assumed across
- * ValidationInterface() subscribers.
+ * ValidationInterface() subscribers: each of them has its own queue, and
+ * callbacks of different subscribers may run concurrently.
  */
 class CValidationInterface {
+public:
+    /** Name of the subscriber, which labels its validation_signals_* metrics */
+    virtual std::string SubscriberName() const { return "unnamed"; }
+
 protected:
     /**
      * Protected destructor so that instances can only be deleted by derived classes.
@@ -185,15 +199,17 @@ private:
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
     friend void ::CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
+    friend void ::CallFunctionInValidationInterfaceQueue(CValidationInterface& callbacks, std::function<void ()> func);
 
 public:
     /** Register a CScheduler to give callbacks which should run in the background (may only be called once) */
     void RegisterBackgroundSignalScheduler(CScheduler& scheduler);
     /** Unregister a CScheduler to give callbacks which should run in the background - these callbacks will now be dropped! */
     void UnregisterBackgroundSignalScheduler();
-    /** Call any remaining callbacks on the calling thread */
+    /** Call any remaining callbacks on the calling thread, once the scheduler is stopped */
     void FlushBackgroundCallbacks();
 
+    /** Number of events queued and not yet processed by the slowest subscriber */
     size_t CallbacksPending();
 
 
@@ -2974,6 +2974,7 @@ static RPCHelpMan listunspent()
 
     UniValue results(UniValue::VARR);
     std::vector<COutput> vecOutputs;
+    std::vector<uint256> txids;
     {
         CCoinControl cctl;
         cctl.m_avoid_address_reuse = false;
@@ -2982,13 +2983,22 @@ static RPCHelpMan listunspent()
         cctl.m_include_unsafe_inputs = include_unsafe;
         LOCK(pwallet->cs_wallet);
         pwallet->AvailableCoins(vecOutputs, &cctl, nMinimumAmount, nMaximumAmount, nMinimumSumAmount, nMaximumCount);
+        for (const COutput& out : vecOutputs) txids.push_back(out.tx->GetHash());
     }
 
-    LOCK(pwallet->cs_wallet);
+    WAIT_LOCK(pwallet->cs_wallet, wallet_lock);
 
     const bool avoid_reuse = pwallet->IsWalletFlagSet(WALLET_FLAG_AVOID_REUSE);
 
-    for (const COutput& out : vecOutputs) {
+    // A streamed result is written in batches, while the wallet is unlocked
+    static constexpr size_t STREAM_BATCH_SIZE{1000};
+    if (request.result_stream) request.result_stream->BeginArray();
+
+    for (size_t i = 0; i < vecOutputs.size(); ++i) {
+        const COutput& out = vecOutputs[i];
+        // Leave out transactions removed from the wallet while it was unlocked
+        if (pwallet->GetWalletTx(txids[i]) != out.tx) continue;
+
         CTxDestination address;
         const CScript& scriptPubKey = out.tx->tx->vout[out.i].scriptPubKey;
         bool fValidAddress = ExtractDestination(scriptPubKey, address);
@@ -3058,8 +3068,24 @@ static RPCHelpMan listunspent()
         if (avoid_reuse) entry.pushKV("reused", reused);
         entry.pushKV("safe", out.fSafe);
         results.push_back(entry);
+
+        if (request.result_stream && results.size() == STREAM_BATCH_SIZE) {
+            REVERSE_LOCK(wallet_lock);
+            for (const UniValue& result : results.getValues()) {
+                request.result_stream->Value(result);
+            }
+            results.setArray();
+        }
     }
 
+    if (request.result_stream) {
+        REVERSE_LOCK(wallet_lock);
+        for (const UniValue& result : results.getValues()) {
+            request.result_stream->Value(result);
+        }
+        request.result_stream->EndArray();
+        return NullUniValue;
+    }
     return results;
 },
     };
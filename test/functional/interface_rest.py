@@ -22,7 +22,7 @@ from test_framework.util import (
     hex_str_to_bytes,
 )
 
-from test_framework.messages import BLOCK_HEADER_SIZE
+from test_framework.messages import BLOCK_HEADER_SIZE, deser_compact_size
 
 class ReqType(Enum):
     JSON = 1
@@ -43,7 +43,7 @@ class RESTTest (BitcoinTestFramework):
     def set_test_params(self):
         self.setup_clean_chain = True
         self.num_nodes = 2
-        self.extra_args = [["-rest"], []]
+        self.extra_args = [["-rest", "-blockfilterindex"], []]
         self.supports_cli = False
 
     def skip_test_if_missing_module(self):
@@ -325,5 +325,37 @@ class RESTTest (BitcoinTestFramework):
         json_obj = self.test_rest_request("/chaininfo")
         assert_equal(json_obj['bestblockhash'], bb_hash)
 
+        self.log.info("Test the /blockrange URI")
+
+        self.wait_until(lambda: self.nodes[0].getindexinfo()['basic block filter index']['synced'])
+        tip_height = self.nodes[0].getblockcount()
+        resp_bytes = self.test_rest_request("/blockrange/0/{}".format(tip_height + 10), req_type=ReqType.BIN, ret_type=RetType.BYTES)
+        records = BytesIO(resp_bytes)
+        for height in range(tip_height + 1):
+            assert_equal(unpack("<I", records.read(4))[0], height)
+            block_hash = self.nodes[0].getblockhash(height)
+            block = records.read(deser_compact_size(records))
+            assert_equal(block.hex(), self.nodes[0].getblock(block_hash, 0))
+            undo = records.read(deser_compact_size(records))
+            # The genesis block has no undo data, others at least the count of their transactions
+            assert_equal(len(undo) > 0, height > 0)
+            block_filter = records.read(deser_compact_size(records))
+            assert_equal(block_filter.hex(), self.nodes[0].getblockfilter(block_hash)['filter'])
+        assert_equal(records.read(), b'')
+
+        # A range starting within the chain
+        resp_bytes = self.test_rest_request("/blockrange/{}/2".format(tip_height - 1), req_type=ReqType.BIN, ret_type=RetType.BYTES)
+        assert_equal(unpack("<I", resp_bytes[:4])[0], tip_height - 1)
+
+        # Check invalid blockrange requests
+        resp = self.test_rest_request("/blockrange/{}/1".format(tip_height + 1), req_type=ReqType.BIN, ret_type=RetType.OBJ, status=404)
+        assert_equal(resp.read().decode('utf-8').rstrip(), "Block height out of range")
+        resp = self.test_rest_request("/blockrange/0/0", req_type=ReqType.BIN, ret_type=RetType.OBJ, status=400)
+        assert_equal(resp.read().decode('utf-8').rstrip(), "Block count out of range: 0")
+        resp = self.test_rest_request("/blockrange/-1/1", req_type=ReqType.BIN, ret_type=RetType.OBJ, status=400)
+        assert_equal(resp.read().decode('utf-8').rstrip(), "Invalid height: -1")
+        self.test_rest_request("/blockrange/0", req_type=ReqType.BIN, ret_type=RetType.OBJ, status=400)
+        self.test_rest_request("/blockrange/0/1", req_type=ReqType.JSON, ret_type=RetType.OBJ, status=404)
+
 if __name__ == '__main__':
     RESTTest().main()
@@ -4,12 +4,16 @@
 # file COPYING or http://www.opensource.org/licenses/mit-license.php.
 """Tests some generic aspects of the RPC interface."""
 
+import base64
+import http.client
 import os
 from test_framework.authproxy import JSONRPCException
 from test_framework.test_framework import BitcoinTestFramework
-from test_framework.util import assert_equal, assert_greater_than_or_equal
+from test_framework.util import assert_equal, assert_greater_than_or_equal, get_rpc_proxy
 from threading import Thread
 import subprocess
+import time
+import urllib.parse
 
 
 def expect_http_status(expected_http_status, expected_rpc_code,
@@ -74,6 +78,24 @@ class RPCInterfaceTest(BitcoinTestFramework):
         assert_equal(result_by_id[3]['error'], None)
         assert result_by_id[3]['result'] is not None
 
+        self.log.info("Testing large JSON-RPC batch of read-only calls...")
+        genesis_hash = self.nodes[0].getblockhash(0)
+        requests = []
+        for i in range(200):
+            requests.append({"method": "getblockhash", "id": len(requests), "params": [0]})
+            requests.append({"method": "getblockheader", "id": len(requests), "params": [genesis_hash]})
+            if i % 50 == 0:
+                requests.append({"method": "getblockhash", "id": len(requests), "params": [1]})
+        results = self.nodes[0].batch(requests)
+        assert_equal([res["id"] for res in results], list(range(len(requests))))
+        for request, res in zip(requests, results):
+            if request["params"] == [1]:
+                assert_equal(res['error']['code'], -8)
+            elif request["method"] == "getblockhash":
+                assert_equal(res['result'], genesis_hash)
+            else:
+                assert_equal(res['result']['hash'], genesis_hash)
+
     def test_http_status_codes(self):
         self.log.info("Testing HTTP status codes for JSON-RPC requests...")
 
@@ -92,11 +114,42 @@ class RPCInterfaceTest(BitcoinTestFramework):
         for t in threads:
             t.join()
 
+    def test_expensive_lane(self):
+        self.log.info("Testing that expensive calls leave a worker to the others...")
+        self.restart_node(0, ['-rpcthreads=2'])
+        node = self.nodes[0]
+
+        def wait_for_new_block():
+            get_rpc_proxy(node.url, 0, timeout=60, coveragedir=node.coverage_dir).waitfornewblock(3000)
+
+        # The first call takes one worker, the second waits for it in the expensive lane
+        threads = [Thread(target=wait_for_new_block) for _ in range(2)]
+        for t in threads:
+            t.start()
+            time.sleep(0.2)
+        start = time.time()
+        assert_equal(node.getblockcount(), 0)
+        assert time.time() - start < 2
+
+        self.log.info("Testing queued requests of disconnected clients...")
+        # The request is dropped if libevent notices the closed connection
+        # while it is queued. Versions of libevent that stop reading from a
+        # connection while its request is handled do not, and run it.
+        url = urllib.parse.urlparse(node.url)
+        auth = base64.b64encode(f"{url.username}:{url.password}".encode()).decode()
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request('POST', '/', '{"method": "waitfornewblock", "params": [3000]}', {"Authorization": "Basic " + auth})
+        conn.close()
+        for t in threads:
+            t.join()
+        assert_equal(node.getblockcount(), 0)
+
     def run_test(self):
         self.test_getrpcinfo()
         self.test_batch_request()
         self.test_http_status_codes()
         self.test_work_queue_exceeded()
+        self.test_expensive_lane()
 
 
 if __name__ == '__main__':
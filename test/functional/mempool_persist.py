@@ -28,6 +28,9 @@ Test is as follows:
   - Restart node0 with -persistmempool. Verify that it has 5
     transactions in its mempool. This tests that -persistmempool=0
     does not overwrite a previously valid mempool stored on disk.
+  - Restart node0 with -trustmempoolfile. Verify that it loads the
+    transactions without verifying their scripts, as the chain tip did
+    not change since mempool.dat was written.
   - Remove node0 mempool.dat and verify savemempool RPC recreates it
     and verify that node1 can load it and has 5 transactions in its
     mempool.
@@ -131,6 +134,14 @@ class MempoolPersistTest(BitcoinTestFramework):
         assert self.nodes[0].getmempoolinfo()["loaded"]
         assert_equal(len(self.nodes[0].getrawmempool()), 6)
 
+        self.log.debug("Stop-start node0 with -trustmempoolfile. Verify that it loads the transactions without verifying their scripts.")
+        self.stop_nodes()
+        with self.nodes[0].assert_debug_log(["skipping script verification", "Imported mempool transactions from disk: 6 succeeded"]):
+            self.start_node(0, extra_args=["-trustmempoolfile", "-disablewallet"])
+        assert_equal(len(self.nodes[0].getrawmempool()), 6)
+        self.stop_nodes()
+        self.start_node(0)
+
         mempooldat0 = os.path.join(self.nodes[0].datadir, self.chain, 'mempool.dat')
         mempooldat1 = os.path.join(self.nodes[1].datadir, self.chain, 'mempool.dat')
         self.log.debug("Remove the mempool.dat file. Verify that savemempool to disk via RPC re-creates it")
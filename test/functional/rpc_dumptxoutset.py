@@ -39,11 +39,14 @@ class DumptxoutsetTest(BitcoinTestFramework):
             out['base_hash'],
             '6fd417acba2a8738b06fee43330c50d58e6a725046c3d843c8dd7e51d46d1ed6')
 
+        # The MuHash combined from the chunks is that of the whole UTXO set.
+        assert_equal(out['muhash'], node.gettxoutsetinfo('muhash')['muhash'])
+
         with open(str(expected_path), 'rb') as f:
             digest = hashlib.sha256(f.read()).hexdigest()
             # UTXO snapshot hash should be deterministic based on mocked time.
             assert_equal(
-                digest, '7ae82c986fa5445678d2a21453bb1c86d39e47af13da137640c2b1cf8093691c')
+                digest, '48a3815646e3f26b0d0ae26921cc2e745c766fc92a55ac4ad3a80d3613b3a931')
 
         # Specifying a path to an existing file will fail.
         assert_raises_rpc_error(